@@ -0,0 +1,352 @@
+#!/usr/bin/env python3
+"""Generate scalable benchmark programs for the Igbo interpreter.
+
+Every workload is a function that takes a scale factor and returns a
+tuple of (source, units, unit_name).  ``units`` is the amount of work the
+program performs and is used by run_bench.py to report throughput.  A
+workload that reads input returns its data as a fourth item; it is written
+next to the program and DATA_FILE in the source is replaced by its path.
+
+Loops are written as nests of at most 1000 iterations because the
+interpreter stops any single `mgbe` loop after 10000 iterations.
+
+Usage:
+    python3 bench/gen_workloads.py [--scale N] [--out DIR] [case ...]
+"""
+
+import argparse
+import os
+import sys
+
+INNER = 1000
+
+
+def lex_large(scale):
+    # A large body that is lexed and parsed but never executed, so the
+    # measurement is dominated by the front end.
+    stmts = 20000 * scale
+    lines = ["// Lexer-heavy workload", "ma ụgha {"]
+    for i in range(stmts):
+        lines.append("    // statement %d with a comment that the lexer must skip" % i)
+        lines.append('    dee aha_%d = "ndewo %d" + (%d * %d - %d / 7)' % (i, i, i, i + 3, i))
+        lines.append("    dee onu_%d = %d * %d - %d / 7" % (i, i, i + 3, i))
+        lines.append("    ma onu_%d >= %d { gosi(aha_%d) } mana { gosi(eziokwu) }" % (i, i, i))
+    lines.append("}")
+    lines.append('gosi("done")')
+    src = "\n".join(lines) + "\n"
+    return src, len(src.encode("utf-8")), "bytes"
+
+
+def deep_arith(scale):
+    # A long left-leaning arithmetic chain with nested parentheses,
+    # evaluated repeatedly inside a loop.
+    depth = 60
+    expr = "x"
+    for i in range(depth):
+        op = "+-*/"[i % 4]
+        operand = str(i % 9 + 1)
+        expr = "(%s %s %s)" % (expr, op, operand)
+    chain = " + ".join("(x * %d - %d)" % (i + 1, i) for i in range(40))
+    outer = 10 * scale
+    src = (
+        "// Deep arithmetic workload\n"
+        "dee total = 0\n"
+        "dee o = 0\n"
+        "mgbe o < %d {\n"
+        "    dee x = 1\n"
+        "    mgbe x <= %d {\n"
+        "        dee total = total + %s\n"
+        "        dee total = total + %s\n"
+        "        dee x = x + 1\n"
+        "    }\n"
+        "    dee o = o + 1\n"
+        "}\n"
+        "gosi(total)\n"
+    ) % (outer, INNER, expr, chain)
+    return src, outer * INNER * (depth + 80), "ops"
+
+
+def numeric_loop(scale):
+    # Nested counting loops doing simple numeric work.
+    outer = 100 * scale
+    src = (
+        "// Numeric mgbe loop workload\n"
+        "dee sum = 0\n"
+        "dee o = 0\n"
+        "mgbe o < %d {\n"
+        "    dee i = 0\n"
+        "    mgbe i < %d {\n"
+        "        dee sum = sum + i * 2 - o\n"
+        "        dee i = i + 1\n"
+        "    }\n"
+        "    dee o = o + 1\n"
+        "}\n"
+        "gosi(sum)\n"
+    ) % (outer, INNER)
+    return src, outer * INNER, "iters"
+
+
+def parallel_loop(scale):
+    # numeric_loop with the outer loop spread over the thread pool and the
+    # sum combined by a reduction.
+    outer = 100 * scale
+    src = (
+        "// Parallel mgbe ngwa workload\n"
+        "mgbe ngwa o site 0 ruo %d jikota sum total {\n"
+        "    dee i = 0\n"
+        "    mgbe i < %d {\n"
+        "        dee total = total + i * 2 - o\n"
+        "        dee i = i + 1\n"
+        "    }\n"
+        "}\n"
+        "gosi(total)\n"
+    ) % (outer - 1, INNER)
+    return src, outer * INNER, "iters"
+
+
+def generator_pipeline(scale):
+    # Items streamed through two generator stages into a 'maka' loop.
+    outer = 100 * scale
+    src = (
+        "// Generator pipeline workload\n"
+        "oru onu(n) {\n"
+        "    dee o = 0\n"
+        "    mgbe o < n {\n"
+        "        dee i = 0\n"
+        "        mgbe i < %d {\n"
+        "            nye i\n"
+        "            dee i = i + 1\n"
+        "        }\n"
+        "        dee o = o + 1\n"
+        "    }\n"
+        "}\n"
+        "oru okpukpu(src) {\n"
+        "    maka x na src { nye x * 2 }\n"
+        "}\n"
+        "dee total = 0\n"
+        "maka v na okpukpu(onu(%d)) { dee total = total + v }\n"
+        "gosi(total)\n"
+    ) % (INNER, outer)
+    return src, outer * INNER, "items"
+
+
+def file_records(scale):
+    # A CSV file read with records() and lines(), summing a numeric column.
+    rows = 200000 * scale
+    data = "".join("%d,item%d,%d.%03d\n" % (i, i % 97, i % 100, i % 1000)
+                   for i in range(rows))
+    src = (
+        "// File input workload\n"
+        "dee total = 0\n"
+        'maka r na records("DATA_FILE") { dee total = total + r[2] }\n'
+        "dee chars = 0\n"
+        'maka l na lines("DATA_FILE") { dee chars = chars + len(l) }\n'
+        "gosi(total)\n"
+        "gosi(chars)\n"
+    )
+    return src, len(data) * 2, "bytes", data
+
+
+def string_concat(scale):
+    # Repeatedly grow strings one piece at a time.
+    rounds = 4 * scale
+    per_round = 2000
+    src = (
+        "// String concatenation workload\n"
+        "dee r = 0\n"
+        "dee total = 0\n"
+        "mgbe r < %d {\n"
+        '    dee s = ""\n'
+        "    dee i = 0\n"
+        "    mgbe i < %d {\n"
+        '        dee s = s + "ab" + i\n'
+        "        dee i = i + 1\n"
+        "    }\n"
+        "    dee total = total + 1\n"
+        "    dee r = r + 1\n"
+        "}\n"
+        "gosi(total)\n"
+    ) % (rounds, per_round)
+    return src, rounds * per_round, "concats"
+
+
+def string_search(scale):
+    # Searching, splitting and case-converting a 2 KB string of Igbo text.
+    rounds = 5 * scale
+    line = "ụgha na eziokwu, ọ bụ ịhe ọma; "
+    copies = 64
+    src = (
+        "// String search workload\n"
+        'dee text = ""\n'
+        "dee i = 0\n"
+        "mgbe i < %d {\n"
+        '    dee text = text + "%s"\n'
+        "    dee i = i + 1\n"
+        "}\n"
+        "dee total = 0\n"
+        "dee r = 0\n"
+        "mgbe r < %d {\n"
+        "    dee i = 0\n"
+        "    mgbe i < %d {\n"
+        '        dee total = total + len(split(text, ";")) + find(text, "ọma", i)\n'
+        '        dee total = total + ulen(upper(text)) + len(replace(text, "ọ", "o"))\n'
+        "        dee i = i + 1\n"
+        "    }\n"
+        "    dee r = r + 1\n"
+        "}\n"
+        "gosi(total)\n"
+    ) % (copies, line, rounds, INNER)
+    return src, rounds * INNER * 4 * copies * len(line.encode("utf-8")), "bytes"
+
+
+def cyclic_garbage(scale):
+    # Short-lived lists and maps that refer to each other, so each round
+    # leaves behind a cycle only the cycle collector can free. Peak memory
+    # should not grow with the scale.
+    outer = 20 * scale
+    src = (
+        "// Cyclic garbage workload\n"
+        "dee total = 0\n"
+        "dee o = 0\n"
+        "mgbe o < %d {\n"
+        "    dee i = 0\n"
+        "    mgbe i < %d {\n"
+        '        dee node = ["node", i]\n'
+        '        dee owner = {"node": node}\n'
+        "        append(node, owner)\n"
+        "        dee total = total + len(node)\n"
+        "        dee i = i + 1\n"
+        "    }\n"
+        "    dee o = o + 1\n"
+        "}\n"
+        "gosi(total)\n"
+    ) % (outer, INNER)
+    return src, outer * INNER, "cycles"
+
+
+def many_vars(scale):
+    # Declare many distinct globals, then read each of them back.
+    count = 2000 * scale
+    lines = ["// Many-variable workload"]
+    for i in range(count):
+        lines.append("dee v%d = %d" % (i, i))
+    lines.append("dee total = 0")
+    for i in range(count):
+        lines.append("dee total = total + v%d" % i)
+    lines.append("gosi(total)")
+    src = "\n".join(lines) + "\n"
+    return src, count * 2, "stmts"
+
+
+def print_heavy(scale):
+    # Print many short lines of mixed types.
+    outer = 20 * scale
+    src = (
+        "// Print-heavy workload\n"
+        "dee o = 0\n"
+        "mgbe o < %d {\n"
+        "    dee i = 0\n"
+        "    mgbe i < %d {\n"
+        '        gosi("line " + i)\n'
+        "        gosi(i * o)\n"
+        "        gosi(i < o)\n"
+        "        dee i = i + 1\n"
+        "    }\n"
+        "    dee o = o + 1\n"
+        "}\n"
+    ) % (outer, INNER)
+    return src, outer * INNER * 3, "lines"
+
+
+def map_ops(entries):
+    # Insert `entries` keys, then look each one up again. Running the same
+    # program at growing sizes shows whether the time per operation stays
+    # flat as the map grows. The keys are numbers, which a map stores as
+    # their exact digits; "k" + n would print large n as "k1e+06" and
+    # collapse many of them into one key.
+    def workload(scale):
+        n = entries * scale
+        outer = max(1, n // INNER)
+        src = (
+            "// Map workload with %d entries\n"
+            "dee m = {}\n"
+            "dee o = 0\n"
+            "mgbe o < %d {\n"
+            "    dee i = 0\n"
+            "    mgbe i < %d {\n"
+            "        dee m[o * %d + i] = i\n"
+            "        dee i = i + 1\n"
+            "    }\n"
+            "    dee o = o + 1\n"
+            "}\n"
+            "dee found = 0\n"
+            "dee o = 0\n"
+            "mgbe o < %d {\n"
+            "    dee i = 0\n"
+            "    mgbe i < %d {\n"
+            "        dee found = found + get(m, o * %d + i, 0)\n"
+            "        dee i = i + 1\n"
+            "    }\n"
+            "    dee o = o + 1\n"
+            "}\n"
+            "gosi(len(m))\n"
+            "gosi(found)\n"
+        ) % (n, outer, INNER, INNER, outer, INNER, INNER)
+        return src, outer * INNER * 2, "ops"
+    return workload
+
+
+WORKLOADS = {
+    "lex_large": lex_large,
+    "deep_arith": deep_arith,
+    "numeric_loop": numeric_loop,
+    "parallel_loop": parallel_loop,
+    "generator_pipeline": generator_pipeline,
+    "file_records": file_records,
+    "string_concat": string_concat,
+    "string_search": string_search,
+    "cyclic_garbage": cyclic_garbage,
+    "many_vars": many_vars,
+    "print_heavy": print_heavy,
+    "map_10k": map_ops(10000),
+    "map_100k": map_ops(100000),
+    "map_1m": map_ops(1000000),
+}
+
+
+def generate(name, scale, out_dir):
+    """Write workload `name` to out_dir and return (path, units, unit_name)."""
+    result = WORKLOADS[name](scale)
+    src, units, unit_name = result[:3]
+    os.makedirs(out_dir, exist_ok=True)
+    if len(result) > 3:
+        data_path = os.path.join(out_dir, "%s.data" % name)
+        with open(data_path, "w", encoding="utf-8") as f:
+            f.write(result[3])
+        src = src.replace("DATA_FILE", os.path.abspath(data_path))
+    path = os.path.join(out_dir, "%s.igbo" % name)
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(src)
+    return path, units, unit_name
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--scale", type=int, default=1, help="workload size multiplier")
+    ap.add_argument("--out", default="build/bench/workloads", help="output directory")
+    ap.add_argument("cases", nargs="*", help="workloads to generate (default: all)")
+    args = ap.parse_args()
+
+    cases = args.cases or list(WORKLOADS)
+    for name in cases:
+        if name not in WORKLOADS:
+            sys.exit("unknown workload '%s' (choose from %s)" % (name, ", ".join(WORKLOADS)))
+    width = max(len(name) for name in cases)
+    for name in cases:
+        path, units, unit_name = generate(name, args.scale, args.out)
+        print("%-*s %s (%d %s)" % (width, name, path, units, unit_name))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Measure how the parallel tokenizer scales with the number of threads.
+
+The lex_large workload is generated once and lexed with
+``igbo --lex-only -j N`` for each thread count.  The token count printed
+by every run is checked against the single-threaded run, and the table
+reports the median time and the speedup over one thread.
+
+Usage:
+    python3 bench/lex_scaling.py --igbo build/bench/igbo [--measure build/bench/measure]
+                                 [--runs N] [--scale N] [--threads 1,2,4]
+"""
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import gen_workloads  # noqa: E402
+from run_bench import human, run_once  # noqa: E402
+
+
+def default_threads():
+    cpus = os.cpu_count() or 1
+    counts = [1]
+    while counts[-1] * 2 <= cpus:
+        counts.append(counts[-1] * 2)
+    if counts[-1] != cpus:
+        counts.append(cpus)
+    return counts
+
+
+def token_count(igbo, path, threads):
+    out = subprocess.run([igbo, "--lex-only", "-j", str(threads), path],
+                         stdout=subprocess.PIPE, stderr=subprocess.PIPE, check=True)
+    return out.stdout.decode("utf-8").strip()
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--igbo", default="./igbo", help="interpreter binary to benchmark")
+    ap.add_argument("--measure", default="build/bench/measure",
+                    help="launcher built from bench/measure.c")
+    ap.add_argument("--runs", type=int, default=5, help="runs per thread count (median is reported)")
+    ap.add_argument("--scale", type=int, default=20, help="lex_large size multiplier")
+    ap.add_argument("--out", default="build/bench/workloads", help="directory for generated programs")
+    ap.add_argument("--threads", help="comma separated thread counts (default: powers of two up to the CPU count)")
+    args = ap.parse_args()
+
+    if not os.access(args.igbo, os.X_OK):
+        sys.exit("interpreter not found: %s" % args.igbo)
+    if not os.access(args.measure, os.X_OK):
+        sys.exit("measure launcher not found: %s (run `make bench-lex`)" % args.measure)
+    counts = [int(t) for t in args.threads.split(",")] if args.threads else default_threads()
+
+    path, size, _ = gen_workloads.generate("lex_large", args.scale, args.out)
+    result_file = os.path.join(args.out, "lex_scaling.measure")
+    expected = token_count(args.igbo, path, 1)
+    print("lex_large at scale %d: %s, %s" % (args.scale, human(size) + "B", expected))
+
+    header = "%-8s %10s %14s %8s %10s" % ("threads", "median", "throughput", "speedup", "peak RSS")
+    print(header)
+    print("-" * len(header))
+    serial = None
+    for threads in counts:
+        got = token_count(args.igbo, path, threads)
+        if got != expected:
+            sys.exit("-j %d produced %s, expected %s" % (threads, got, expected))
+        cmd = [args.igbo, "--lex-only", "-j", str(threads), path]
+        times = []
+        peak = 0
+        for _ in range(args.runs):
+            elapsed, rss_kb, code, stderr = run_once(args.measure, cmd, result_file)
+            if code != 0 or stderr:
+                sys.exit("-j %d: interpreter failed (exit %d)\n%s" % (threads, code, stderr))
+            times.append(elapsed)
+            peak = max(peak, rss_kb)
+        median = statistics.median(times)
+        if serial is None:
+            serial = median
+        print("%-8d %9.3fs %12s/s %7.2fx %8.1fM" % (
+            threads, median, human(size / median) + "B", serial / median, peak / 1024.0))
+
+
+if __name__ == "__main__":
+    main()
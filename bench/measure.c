@@ -0,0 +1,62 @@
+// Run a command and record its wall-clock time and peak resident memory.
+//
+// Usage: measure RESULT_FILE command [args...]
+//
+// RESULT_FILE receives one line: "<seconds> <peak_rss_kb> <exit_code>".
+// The command's own stdout and stderr are passed through untouched.
+//
+// Python's subprocess module may start children with vfork, in which case
+// the kernel charges the parent's memory to the child's ru_maxrss.  This
+// small launcher has a tiny footprint of its own, so the numbers it
+// reports belong to the measured program alone.
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s RESULT_FILE command [args...]\n", argv[0]);
+        return 2;
+    }
+
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 2;
+    }
+    if (pid == 0) {
+        execvp(argv[2], &argv[2]);
+        perror(argv[2]);
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        return 2;
+    }
+    double elapsed = now_seconds() - start;
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    FILE *out = fopen(argv[1], "w");
+    if (!out) {
+        perror(argv[1]);
+        return 2;
+    }
+    fprintf(out, "%.9f %ld %d\n", elapsed, (long)usage.ru_maxrss, code);
+    fclose(out);
+    return 0;
+}
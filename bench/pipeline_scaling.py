@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Measure how a pipeline of isolates scales with the number of stages.
+
+The same work is done twice: by a serial program that runs every stage
+of each item in one loop, and by a pipeline that runs each stage in its
+own isolate (``malite``) and passes the items between them through
+channels.  Every stage does the same amount of arithmetic per item, so
+with one CPU per stage the pipeline should approach a speedup equal to
+the number of stages.  The total printed by both programs is checked to
+be the same, and the table reports the median time, the item throughput
+and the speedup over the serial program.
+
+Usage:
+    python3 bench/pipeline_scaling.py --igbo build/bench/igbo [--measure build/bench/measure]
+                                      [--runs N] [--items N] [--work N] [--stages 4]
+"""
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from run_bench import human, run_once  # noqa: E402
+
+# Items are produced in batches, as 'mgbe' loops stop after 10000 rounds
+BATCH = 1000
+
+WORK = """oru work(x, n) {
+    dee k = 0
+    mgbe k < n {
+        dee x = x / 2 + k
+        dee k = k + 1
+    }
+    laghachi x
+}
+"""
+
+
+def serial_program(items, work, stages):
+    batches = items // BATCH
+    call = "b * %d + i" % BATCH
+    for _ in range(stages):
+        call = "work(%s, %d)" % (call, work)
+    return WORK + """
+dee total = 0
+dee b = 0
+mgbe b < %d {
+    dee i = 0
+    mgbe i < %d {
+        dee total = total + %s
+        dee i = i + 1
+    }
+    dee b = b + 1
+}
+gosi(total)
+""" % (batches, BATCH, call)
+
+
+def pipeline_program(items, work, stages):
+    batches = items // BATCH
+    lines = [WORK, """oru produce(out, n) {
+    dee b = 0
+    mgbe b < %d {
+        dee i = 0
+        mgbe i < %d {
+            send(out, work(b * %d + i, n))
+            dee i = i + 1
+        }
+        dee b = b + 1
+    }
+    close(out)
+}
+
+oru stage(inp, out, n) {
+    maka x na inp {
+        send(out, work(x, n))
+    }
+    close(out)
+}
+
+oru aggregate(inp, result, n) {
+    dee total = 0
+    maka x na inp {
+        dee total = total + work(x, n)
+    }
+    send(result, total)
+}
+""" % (batches, BATCH, BATCH)]
+    for s in range(stages):
+        lines.append('dee c%d = channel("number", 1024)' % s)
+    lines.append("malite produce(c0, %d)" % work)
+    for s in range(1, stages - 1):
+        lines.append("malite stage(c%d, c%d, %d)" % (s - 1, s, work))
+    lines.append("malite aggregate(c%d, c%d, %d)" % (stages - 2, stages - 1, work))
+    lines.append("gosi(receive(c%d))" % (stages - 1))
+    return "\n".join(lines) + "\n"
+
+
+def output(igbo, path):
+    out = subprocess.run([igbo, path], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    if out.returncode != 0 or out.stderr:
+        sys.exit("%s failed (exit %d)\n%s" % (path, out.returncode,
+                                               out.stderr.decode("utf-8", "replace")))
+    return out.stdout.decode("utf-8").strip()
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--igbo", default="./igbo", help="interpreter binary to benchmark")
+    ap.add_argument("--measure", default="build/bench/measure",
+                    help="launcher built from bench/measure.c")
+    ap.add_argument("--runs", type=int, default=5, help="runs per program (median is reported)")
+    ap.add_argument("--items", type=int, default=20000, help="items sent through the pipeline")
+    ap.add_argument("--work", type=int, default=100, help="loop rounds per item per stage")
+    ap.add_argument("--stages", type=int, default=4, help="pipeline stages (at least 2)")
+    ap.add_argument("--out", default="build/bench/workloads", help="directory for generated programs")
+    args = ap.parse_args()
+
+    if not os.access(args.igbo, os.X_OK):
+        sys.exit("interpreter not found: %s" % args.igbo)
+    if not os.access(args.measure, os.X_OK):
+        sys.exit("measure launcher not found: %s (run `make bench-pipeline`)" % args.measure)
+    if args.stages < 2:
+        sys.exit("--stages must be at least 2")
+    items = max(args.items // BATCH, 1) * BATCH
+
+    os.makedirs(args.out, exist_ok=True)
+    programs = []
+    for name, make in (("serial", serial_program), ("pipeline", pipeline_program)):
+        path = os.path.join(args.out, "pipeline_%s.igbo" % name)
+        with open(path, "w", encoding="utf-8") as f:
+            f.write(make(items, args.work, args.stages))
+        programs.append((name, path))
+    result_file = os.path.join(args.out, "pipeline_scaling.measure")
+    expected = output(args.igbo, programs[0][1])
+    print("%d items, %d stages of %d rounds each, %d CPUs" % (
+        items, args.stages, args.work, os.cpu_count() or 1))
+
+    header = "%-9s %10s %14s %8s %10s" % ("program", "median", "throughput", "speedup", "peak RSS")
+    print(header)
+    print("-" * len(header))
+    serial = None
+    for name, path in programs:
+        got = output(args.igbo, path)
+        if got != expected:
+            sys.exit("%s printed %s, expected %s" % (name, got, expected))
+        times = []
+        peak = 0
+        for _ in range(args.runs):
+            elapsed, rss_kb, code, stderr = run_once(args.measure, [args.igbo, path], result_file)
+            if code != 0 or stderr:
+                sys.exit("%s: interpreter failed (exit %d)\n%s" % (name, code, stderr))
+            times.append(elapsed)
+            peak = max(peak, rss_kb)
+        median = statistics.median(times)
+        if serial is None:
+            serial = median
+        print("%-9s %9.3fs %10s items/s %6.2fx %8.1fM" % (
+            name, median, human(items / median), serial / median, peak / 1024.0))
+
+
+if __name__ == "__main__":
+    main()
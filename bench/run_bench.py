@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Run the Igbo benchmark suite.
+
+Each workload from gen_workloads.py is generated, run several times and
+summarised by its median wall-clock time, throughput and peak resident
+memory.  Results can be saved as JSON and compared against a previously
+saved baseline.
+
+Usage:
+    python3 bench/run_bench.py --igbo build/bench/igbo [--measure build/bench/measure]
+                               [--runs N] [--scale N] [--save FILE]
+                               [--baseline FILE] [case ...]
+"""
+
+import argparse
+import json
+import os
+import platform
+import statistics
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import gen_workloads  # noqa: E402
+
+
+def run_once(measure, cmd, result_file):
+    """Run cmd once and return (seconds, peak_rss_kb, returncode, stderr)."""
+    proc = subprocess.run([measure, result_file] + cmd,
+                          stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    if proc.returncode != 0:
+        sys.exit("measure failed: %s" % proc.stderr.decode("utf-8", "replace"))
+    with open(result_file, encoding="utf-8") as f:
+        elapsed, rss, code = f.read().split()
+    # ru_maxrss is reported in kilobytes on Linux and bytes on macOS.
+    rss_kb = int(rss) // 1024 if sys.platform == "darwin" else int(rss)
+    return float(elapsed), rss_kb, int(code), proc.stderr.decode("utf-8", "replace")
+
+
+def bench_case(igbo, measure, name, scale, runs, out_dir):
+    path, units, unit_name = gen_workloads.generate(name, scale, out_dir)
+    result_file = os.path.join(out_dir, "%s.measure" % name)
+    times = []
+    peak = 0
+    for _ in range(runs):
+        elapsed, rss_kb, code, stderr = run_once(measure, [igbo, path], result_file)
+        if code != 0 or stderr:
+            sys.exit("%s: interpreter failed (exit %d)\n%s" % (name, code, stderr))
+        times.append(elapsed)
+        peak = max(peak, rss_kb)
+    median = statistics.median(times)
+    return {
+        "median_s": median,
+        "min_s": min(times),
+        "max_s": max(times),
+        "runs": runs,
+        "units": units,
+        "unit_name": unit_name,
+        "throughput": units / median if median > 0 else 0.0,
+        "peak_rss_kb": peak,
+    }
+
+
+def human(n):
+    for suffix in ("", "K", "M", "G"):
+        if abs(n) < 1000:
+            return "%.1f%s" % (n, suffix)
+        n /= 1000.0
+    return "%.1fT" % n
+
+
+def print_table(results, baseline):
+    # The throughput column holds the full unit, e.g. "805.7K bytes/s"
+    rates = dict((name, "%s %s/s" % (human(r["throughput"]), r["unit_name"]))
+                 for name, r in results.items())
+    width = max([len("case")] + [len(name) for name in results])
+    rate_width = max([len("throughput")] + [len(rate) for rate in rates.values()])
+    header = "%-*s %10s %*s %10s" % (width, "case", "median", rate_width, "throughput", "peak RSS")
+    if baseline:
+        header += " %10s %10s" % ("Δ time", "Δ RSS")
+    print(header)
+    print("-" * len(header))
+    for name, r in results.items():
+        line = "%-*s %9.3fs %*s %9.1fM" % (
+            width, name, r["median_s"], rate_width, rates[name], r["peak_rss_kb"] / 1024.0)
+        base = baseline.get(name) if baseline else None
+        if base:
+            dt = (r["median_s"] / base["median_s"] - 1.0) * 100.0 if base["median_s"] else 0.0
+            dm = (r["peak_rss_kb"] / base["peak_rss_kb"] - 1.0) * 100.0 if base["peak_rss_kb"] else 0.0
+            line += " %+9.1f%% %+9.1f%%" % (dt, dm)
+        elif baseline is not None:
+            line += " %10s %10s" % ("new", "new")
+        print(line)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--igbo", default="./igbo", help="interpreter binary to benchmark")
+    ap.add_argument("--measure", default="build/bench/measure",
+                    help="launcher built from bench/measure.c")
+    ap.add_argument("--runs", type=int, default=5, help="runs per case (median is reported)")
+    ap.add_argument("--scale", type=int, default=1, help="workload size multiplier")
+    ap.add_argument("--out", default="build/bench/workloads", help="directory for generated programs")
+    ap.add_argument("--save", help="write results as JSON to this file")
+    ap.add_argument("--baseline", help="compare against results saved with --save")
+    ap.add_argument("cases", nargs="*", help="cases to run (default: all)")
+    args = ap.parse_args()
+
+    if not os.access(args.igbo, os.X_OK):
+        sys.exit("interpreter not found: %s" % args.igbo)
+    if not os.access(args.measure, os.X_OK):
+        sys.exit("measure launcher not found: %s (run `make bench`)" % args.measure)
+    cases = args.cases or list(gen_workloads.WORKLOADS)
+    for name in cases:
+        if name not in gen_workloads.WORKLOADS:
+            sys.exit("unknown case '%s' (choose from %s)"
+                     % (name, ", ".join(gen_workloads.WORKLOADS)))
+
+    baseline = None
+    if args.baseline:
+        with open(args.baseline, encoding="utf-8") as f:
+            baseline = json.load(f).get("results", {})
+
+    results = {}
+    for name in cases:
+        results[name] = bench_case(args.igbo, args.measure, name, args.scale, args.runs, args.out)
+
+    print_table(results, baseline)
+
+    if args.save:
+        doc = {
+            "machine": platform.platform(),
+            "scale": args.scale,
+            "runs": args.runs,
+            "results": results,
+        }
+        with open(args.save, "w", encoding="utf-8") as f:
+            json.dump(doc, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("saved results to %s" % args.save)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""Measure operation latency percentiles with and without a fixed memory block.
+
+Each case is a program that repeats one small allocating operation, such
+as building a string or a map, and times every repetition inside the
+program with ``clock()``, so neither process startup nor setting up the
+block is counted.  Every program is run several times, once with the
+system allocator and once with ``igbo --memory SIZE``, where every
+allocation is carved out of one block set up at startup.  The table
+reports the median, 95th and 99th percentile and the slowest operation
+over all runs for both, and the ratio of the 99th percentile to the
+median, which shows how much the slow operations stray from the typical
+one.
+
+Usage:
+    python3 bench/tail_latency.py --igbo build/bench/igbo [--runs N] [--scale N]
+                                  [--memory SIZE] [case ...]
+"""
+
+import argparse
+import math
+import os
+import subprocess
+import sys
+
+# Operations per batch, as 'mgbe' loops stop after 10000 rounds
+BATCH = 1000
+
+# The body of one operation, run with 'i' set to its number
+OPERATIONS = {
+    "string_build": """    dee s = ""
+    dee j = 0
+    mgbe j < 50 {
+        dee s = s + "ab" + j
+        dee j = j + 1
+    }
+    dee total = total + len(s)
+""",
+    "list_build": """    dee l = []
+    dee j = 0
+    mgbe j < 100 {
+        append(l, i + j)
+        dee j = j + 1
+    }
+    dee total = total + len(l)
+""",
+    "map_build": """    dee m = {}
+    dee j = 0
+    mgbe j < 50 {
+        dee m["k" + j] = i
+        dee j = j + 1
+    }
+    dee total = total + len(m)
+""",
+    "cyclic_garbage": """    dee j = 0
+    mgbe j < 20 {
+        dee node = ["node", i]
+        dee owner = {"node": node}
+        append(node, owner)
+        dee total = total + len(node)
+        dee j = j + 1
+    }
+""",
+}
+
+
+def program(name, batches):
+    # Each latency is printed once the operation it belongs to has been
+    # timed, so the printing is not part of any measurement.
+    body = "".join("    " + line if line else line
+                   for line in OPERATIONS[name].splitlines(True))
+    return """// Per-operation latency: %s
+dee total = 0
+dee b = 0
+mgbe b < %d {
+    dee i = 0
+    mgbe i < %d {
+        dee start = clock()
+%s        gosi(clock() - start)
+        dee i = i + 1
+    }
+    dee b = b + 1
+}
+""" % (name, batches, BATCH, body)
+
+
+def latencies(igbo, extra, path):
+    out = subprocess.run([igbo] + extra + [path], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    if out.returncode != 0 or out.stderr:
+        sys.exit("%s: interpreter failed (exit %d)\n%s" % (
+            path, out.returncode, out.stderr.decode("utf-8", "replace")))
+    return [float(line) for line in out.stdout.decode("utf-8").split()]
+
+
+def percentile(sorted_times, p):
+    # Nearest rank
+    rank = int(math.ceil(p / 100.0 * len(sorted_times)))
+    return sorted_times[max(rank, 1) - 1]
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--igbo", default="./igbo", help="interpreter binary to benchmark")
+    ap.add_argument("--runs", type=int, default=5, help="runs per case and mode")
+    ap.add_argument("--scale", type=int, default=1,
+                    help="operations per run, in thousands")
+    ap.add_argument("--memory", default="64M", help="block size passed to --memory")
+    ap.add_argument("--out", default="build/bench/workloads", help="directory for generated programs")
+    ap.add_argument("cases", nargs="*", help="cases to run (default: %s)" % " ".join(OPERATIONS))
+    args = ap.parse_args()
+
+    if not os.access(args.igbo, os.X_OK):
+        sys.exit("interpreter not found: %s" % args.igbo)
+    cases = args.cases or list(OPERATIONS)
+    for name in cases:
+        if name not in OPERATIONS:
+            sys.exit("unknown case: %s" % name)
+
+    os.makedirs(args.out, exist_ok=True)
+    width = max(len("case"), max(len(name) for name in cases))
+    header = "%-*s %-8s %9s %9s %9s %9s %8s" % (width, "case", "memory", "p50", "p95", "p99",
+                                               "max", "p99/p50")
+    print("%d operations per run, %d runs" % (args.scale * BATCH, args.runs))
+    print(header)
+    print("-" * len(header))
+    for name in cases:
+        path = os.path.join(args.out, "latency_%s.igbo" % name)
+        with open(path, "w", encoding="utf-8") as f:
+            f.write(program(name, args.scale))
+        for mode, extra in (("system", []), (args.memory, ["--memory", args.memory])):
+            times = []
+            for _ in range(args.runs):
+                times.extend(latencies(args.igbo, extra, path))
+            times.sort()
+            p50 = percentile(times, 50)
+            # clock() counts milliseconds; the table shows microseconds
+            print("%-*s %-8s %7.1fus %7.1fus %7.1fus %7.1fus %7.2fx" % (
+                width, name, mode, p50 * 1e3, percentile(times, 95) * 1e3,
+                percentile(times, 99) * 1e3, times[-1] * 1e3,
+                percentile(times, 99) / p50 if p50 else 0.0))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,10 +1,11 @@
 #include "ast.h"
+#include "memory.h"
 #include "util.h"
 #include <string.h>
 #include <stdio.h>
 
 ASTNode *create_ast_node(NodeType type, const char *value, ASTNode *left, ASTNode *right, ASTNode *third) {
-    ASTNode *node = (ASTNode *)malloc(sizeof(ASTNode));
+    ASTNode *node = (ASTNode *)memory_alloc(sizeof(ASTNode));
     if (!node) {
         report_error("Memory allocation failed for AST node", -1);
         return NULL;
@@ -14,6 +15,10 @@ ASTNode *create_ast_node(NodeType type, const char *value, ASTNode *left, ASTNod
     node->left = left;
     node->right = right;
     node->third = third;
+    node->slot = -1;
+    node->yields = 0;
+    node->types = 0;
+    node->line = 0;
     return node;
 }
 
@@ -22,8 +27,8 @@ void free_ast_node(ASTNode *node) {
     free_ast_node(node->left);
     free_ast_node(node->right);
     free_ast_node(node->third);
-    free(node->value);
-    free(node);
+    memory_free(node->value);
+    memory_free(node);
 }
 
 // Helper to print indentation
@@ -77,6 +82,42 @@ void print_ast(ASTNode *node, int indent) {
             printf("Body:\n");
             print_ast(node->right, indent + 4);
             break;
+        case NODE_FOR_STMT:
+            indent_spaces(indent);
+            printf("ForStmt %s\n", node->value);
+            indent_spaces(indent + 2);
+            printf("Iterable:\n");
+            print_ast(node->left, indent + 4);
+            indent_spaces(indent + 2);
+            printf("Body:\n");
+            print_ast(node->right, indent + 4);
+            break;
+        case NODE_INDEX_ASSIGN:
+            indent_spaces(indent);
+            printf("IndexAssign %s\n", node->value);
+            indent_spaces(indent + 2);
+            printf("Index:\n");
+            print_ast(node->right, indent + 4);
+            indent_spaces(indent + 2);
+            printf("Value:\n");
+            print_ast(node->left, indent + 4);
+            break;
+        case NODE_FUNC_DEF:
+            indent_spaces(indent);
+            printf(node->yields ? "FuncDef %s (generator, %d slots)\n" : "FuncDef %s (%d slots)\n",
+                   node->value, node->slot);
+            indent_spaces(indent + 2);
+            printf("Params:\n");
+            print_ast(node->left, indent + 4);
+            indent_spaces(indent + 2);
+            printf("Body:\n");
+            print_ast(node->right, indent + 4);
+            break;
+        case NODE_RETURN:
+            indent_spaces(indent);
+            printf(node->slot == 1 ? "Return (tail call)\n" : "Return\n");
+            print_ast(node->left, indent + 2);
+            break;
         case NODE_BINARY_EXPR:
             indent_spaces(indent);
             printf("BinaryExpr '%s'\n", node->value);
@@ -85,7 +126,10 @@ void print_ast(ASTNode *node, int indent) {
             break;
         case NODE_IDENTIFIER:
             indent_spaces(indent);
-            printf("Identifier %s\n", node->value);
+            if (node->slot >= 0)
+                printf("Identifier %s (slot %d)\n", node->value, node->slot);
+            else
+                printf("Identifier %s\n", node->value);
             break;
         case NODE_NUMBER:
             indent_spaces(indent);
@@ -99,6 +143,82 @@ void print_ast(ASTNode *node, int indent) {
             indent_spaces(indent);
             printf("Bool %s\n", node->value);
             break;
+        case NODE_LIST:
+            indent_spaces(indent);
+            printf("List\n");
+            print_ast(node->left, indent + 2);
+            break;
+        case NODE_MAP:
+            indent_spaces(indent);
+            printf("Map\n");
+            for (ASTNode *n = node->left; n != NULL; n = n->right) {
+                indent_spaces(indent + 2);
+                printf("Entry:\n");
+                print_ast(n->left, indent + 4);
+                print_ast(n->third, indent + 4);
+            }
+            break;
+        case NODE_INDEX:
+            indent_spaces(indent);
+            printf("Index\n");
+            print_ast(node->left, indent + 2);
+            print_ast(node->right, indent + 2);
+            break;
+        case NODE_CALL:
+            indent_spaces(indent);
+            printf("Call %s\n", node->value);
+            print_ast(node->left, indent + 2);
+            break;
+        case NODE_EXPR_LIST:
+            print_ast(node->left, indent);
+            if (node->right)
+                print_ast(node->right, indent);
+            break;
+        case NODE_HOISTED:
+            indent_spaces(indent);
+            printf("Hoisted (cell %d)\n", node->slot);
+            print_ast(node->left, indent + 2);
+            break;
+        case NODE_YIELD:
+            indent_spaces(indent);
+            printf("Yield\n");
+            print_ast(node->left, indent + 2);
+            break;
+        case NODE_IMPORT:
+            indent_spaces(indent);
+            printf("Import %s\n", node->value);
+            break;
+        case NODE_SPAWN:
+            indent_spaces(indent);
+            printf("Spawn\n");
+            print_ast(node->left, indent + 2);
+            break;
+        case NODE_PARALLEL_FOR:
+            indent_spaces(indent);
+            printf("ParallelFor %s (%d slots)\n", node->value, node->slot);
+            indent_spaces(indent + 2);
+            printf("From:\n");
+            print_ast(node->left, indent + 4);
+            indent_spaces(indent + 2);
+            printf("To:\n");
+            print_ast(node->third, indent + 4);
+            for (ASTNode *n = node->right->right; n != NULL; n = n->right) {
+                indent_spaces(indent + 2);
+                printf("Reduce %s %s (slot %d)\n", n->value, n->left->value, n->left->slot);
+            }
+            indent_spaces(indent + 2);
+            printf("Body:\n");
+            print_ast(node->right->left, indent + 4);
+            break;
+        case NODE_LAZY_BLOCK:
+            indent_spaces(indent);
+            if (node->slot >= 0) {
+                printf("LazyBlock (unparsed, token %d)\n", node->slot);
+            } else {
+                printf("LazyBlock\n");
+                print_ast(node->left, indent + 2);
+            }
+            break;
         default:
             indent_spaces(indent);
             printf("<unknown node>\n");
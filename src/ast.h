@@ -9,11 +9,26 @@ typedef enum {
     NODE_PRINT_STMT,
     NODE_IF_STMT,
     NODE_WHILE_STMT,
+    NODE_FOR_STMT,
+    NODE_INDEX_ASSIGN,
+    NODE_FUNC_DEF,
+    NODE_RETURN,
     NODE_BINARY_EXPR,
     NODE_IDENTIFIER,
     NODE_NUMBER,
     NODE_STRING,
-    NODE_BOOL
+    NODE_BOOL,
+    NODE_LIST,
+    NODE_MAP,
+    NODE_INDEX,
+    NODE_CALL,
+    NODE_EXPR_LIST,
+    NODE_LAZY_BLOCK,
+    NODE_HOISTED,
+    NODE_PARALLEL_FOR,
+    NODE_YIELD,
+    NODE_IMPORT,
+    NODE_SPAWN
 } NodeType;
 
 typedef struct ASTNode {
@@ -22,6 +37,23 @@ typedef struct ASTNode {
     struct ASTNode *left;
     struct ASTNode *right;
     struct ASTNode *third;
+    // Frame slot of the variable named by an identifier, 'dee' or 'maka'
+    // node inside a function, or -1 for a global. A function definition
+    // stores its frame size here, and a 'laghachi' node 1 when it returns
+    // the result of a call directly (a tail call). A parallel loop stores
+    // the frame size of its body.
+    int slot;
+    // Set on a function definition whose body contains 'nye' (a generator),
+    // and inside it on 'nye' and on each 'ma', 'mgbe' and 'maka' that has
+    // a 'nye' somewhere in its blocks.
+    int yields;
+    // Types the expression can produce, as found by types_infer() (see
+    // types.h), or 0 when it has not been analysed.
+    unsigned types;
+    // Source line of the operator, name or '[' the node was built from,
+    // for diagnostics; 0 when unknown (other node types, nodes read back
+    // from the module cache or made by the optimizer).
+    int line;
 } ASTNode;
 
 ASTNode *create_ast_node(NodeType type, const char *value, ASTNode *left, ASTNode *right, ASTNode *third);
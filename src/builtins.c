@@ -0,0 +1,723 @@
+#define _POSIX_C_SOURCE 200809L
+#include "builtins.h"
+#include "generator.h"
+#include "interpreter.h"
+#include "isolate.h"
+#include "list.h"
+#include "map.h"
+#include "memory.h"
+#include "reader.h"
+#include "text.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static Value number_value(double n) {
+    return (Value){VAL_NUMBER, {.number = n}};
+}
+
+static Value list_value(List *list) {
+    Value v;
+    v.type = VAL_LIST;
+    v.as.list = list;
+    return v;
+}
+
+static void type_error(const char *builtin, const char *expected, Value got) {
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%s expects %s, got %s", builtin, expected,
+             value_type_name(got.type));
+    report_error(msg, -1);
+}
+
+// Check that arg is a list holding only numbers
+static int expect_numeric_list(const char *builtin, Value arg) {
+    if (arg.type != VAL_LIST) {
+        type_error(builtin, "a list", arg);
+        return 0;
+    }
+    if (!list_is_numeric(arg.as.list)) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%s expects a list of numbers", builtin);
+        report_error(msg, -1);
+        return 0;
+    }
+    return 1;
+}
+
+static int expect_same_length(const char *builtin, List *a, List *b) {
+    if (a->count == b->count) return 1;
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%s expects lists of the same length (%zu and %zu)",
+             builtin, a->count, b->count);
+    report_error(msg, -1);
+    return 0;
+}
+
+static Value bool_value(int b) {
+    return (Value){VAL_BOOL, {.boolean = b}};
+}
+
+// len(list | map | string)
+static Value builtin_len(Value *args, size_t argc) {
+    (void)argc;
+    if (args[0].type == VAL_LIST) return number_value((double)args[0].as.list->count);
+    if (args[0].type == VAL_MAP) return number_value((double)args[0].as.map->count);
+    if (args[0].type == VAL_STRING) return number_value((double)strlen(args[0].as.string));
+    type_error("len", "a list, map or string", args[0]);
+    return number_value(0);
+}
+
+// append(list, value) - appends in place and returns the list
+static Value builtin_append(Value *args, size_t argc) {
+    (void)argc;
+    if (args[0].type != VAL_LIST) {
+        type_error("append", "a list", args[0]);
+        return number_value(0);
+    }
+    list_append(args[0].as.list, args[1]);
+    return value_copy(args[0]);
+}
+
+// sum(list)
+static Value builtin_sum(Value *args, size_t argc) {
+    (void)argc;
+    if (!expect_numeric_list("sum", args[0])) return number_value(0);
+    return number_value(list_sum(args[0].as.list));
+}
+
+// min(list) / max(list)
+static Value extreme(const char *name, Value *args, int want_max) {
+    if (!expect_numeric_list(name, args[0])) return number_value(0);
+    List *list = args[0].as.list;
+    if (list->count == 0) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "%s of an empty list", name);
+        report_error(msg, -1);
+        return number_value(0);
+    }
+    return number_value(want_max ? list_max(list) : list_min(list));
+}
+
+static Value builtin_min(Value *args, size_t argc) {
+    (void)argc;
+    return extreme("min", args, 0);
+}
+
+static Value builtin_max(Value *args, size_t argc) {
+    (void)argc;
+    return extreme("max", args, 1);
+}
+
+// add(list, list) - elementwise sum as a new list
+static Value builtin_add(Value *args, size_t argc) {
+    (void)argc;
+    if (!expect_numeric_list("add", args[0]) || !expect_numeric_list("add", args[1]))
+        return list_value(list_new(0));
+    if (!expect_same_length("add", args[0].as.list, args[1].as.list))
+        return list_value(list_new(0));
+    return list_value(list_add(args[0].as.list, args[1].as.list));
+}
+
+// scale(list, number) - every element multiplied by number, as a new list
+static Value builtin_scale(Value *args, size_t argc) {
+    (void)argc;
+    if (!expect_numeric_list("scale", args[0])) return list_value(list_new(0));
+    if (args[1].type != VAL_NUMBER) {
+        type_error("scale", "a number as its second argument", args[1]);
+        return list_value(list_new(0));
+    }
+    return list_value(list_scale(args[0].as.list, args[1].as.number));
+}
+
+// dot(list, list) - dot product
+static Value builtin_dot(Value *args, size_t argc) {
+    (void)argc;
+    if (!expect_numeric_list("dot", args[0]) || !expect_numeric_list("dot", args[1]))
+        return number_value(0);
+    if (!expect_same_length("dot", args[0].as.list, args[1].as.list))
+        return number_value(0);
+    return number_value(list_dot(args[0].as.list, args[1].as.list));
+}
+
+// get(map, key [, default]) - the default is returned for missing keys;
+// without one a missing key is an error.
+static Value builtin_get(Value *args, size_t argc) {
+    if (args[0].type != VAL_MAP) {
+        type_error("get", "a map", args[0]);
+        return number_value(0);
+    }
+    const InternedString *key;
+    if (!map_key(args[1], 0, &key)) return number_value(0);
+    Value *found = key ? map_get(args[0].as.map, key) : NULL;
+    if (found) return value_copy(*found);
+    if (argc == 3) return value_copy(args[2]);
+    char *text = value_to_string(args[1]);
+    char msg[160];
+    snprintf(msg, sizeof(msg), "Key '%s' not found in map", text);
+    report_error(msg, -1);
+    memory_free(text);
+    return number_value(0);
+}
+
+// set(map, key, value) - stores in place and returns the map
+static Value builtin_set(Value *args, size_t argc) {
+    (void)argc;
+    if (args[0].type != VAL_MAP) {
+        type_error("set", "a map", args[0]);
+        return number_value(0);
+    }
+    const InternedString *key;
+    if (map_key(args[1], 1, &key))
+        map_set(args[0].as.map, key, args[2]);
+    return value_copy(args[0]);
+}
+
+// has(map, key)
+static Value builtin_has(Value *args, size_t argc) {
+    (void)argc;
+    if (args[0].type != VAL_MAP) {
+        type_error("has", "a map", args[0]);
+        return bool_value(0);
+    }
+    const InternedString *key;
+    if (!map_key(args[1], 0, &key) || !key) return bool_value(0);
+    return bool_value(map_get(args[0].as.map, key) != NULL);
+}
+
+// del(map, key) - returns whether the key was present
+static Value builtin_del(Value *args, size_t argc) {
+    (void)argc;
+    if (args[0].type != VAL_MAP) {
+        type_error("del", "a map", args[0]);
+        return bool_value(0);
+    }
+    const InternedString *key;
+    if (!map_key(args[1], 0, &key) || !key) return bool_value(0);
+    return bool_value(map_delete(args[0].as.map, key));
+}
+
+// keys(map) / values(map)
+static Value builtin_keys(Value *args, size_t argc) {
+    (void)argc;
+    if (args[0].type != VAL_MAP) {
+        type_error("keys", "a map", args[0]);
+        return list_value(list_new(0));
+    }
+    return list_value(map_keys(args[0].as.map));
+}
+
+static Value builtin_values(Value *args, size_t argc) {
+    (void)argc;
+    if (args[0].type != VAL_MAP) {
+        type_error("values", "a map", args[0]);
+        return list_value(list_new(0));
+    }
+    return list_value(map_values(args[0].as.map));
+}
+
+// next(generator [, default]) - the generator's next value. Once it has
+// finished the default is returned; without one that is an error.
+static Value builtin_next(Value *args, size_t argc) {
+    if (args[0].type != VAL_GENERATOR) {
+        type_error("next", "a generator", args[0]);
+        return number_value(0);
+    }
+    Value item;
+    if (generator_next(args[0].as.generator, &item)) return item;
+    if (args[0].as.generator->state != GEN_DONE) return number_value(0);  // stopped by an error
+    if (argc == 2) return value_copy(args[1]);
+    report_error("next called on a finished generator", -1);
+    return number_value(0);
+}
+
+// Strings. Positions and lengths count characters (code points), not
+// bytes; the searching, counting and case kernels are in text.c.
+
+static Value string_value(char *owned) {
+    Value v;
+    v.type = VAL_STRING;
+    v.as.string = owned;
+    return v;
+}
+
+static char *copy_bytes(const char *s, size_t n) {
+    char *copy = memory_alloc(n + 1);
+    if (!copy) {
+        report_error("Memory allocation failed for string", -1);
+        exit(1);
+    }
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+static int expect_string(const char *builtin, Value arg) {
+    if (arg.type == VAL_STRING) return 1;
+    type_error(builtin, "a string", arg);
+    return 0;
+}
+
+// Check for a position or count: a whole number that is not negative
+static int expect_count(const char *builtin, Value arg, size_t *out) {
+    if (arg.type == VAL_NUMBER && arg.as.number >= 0 &&
+        arg.as.number == (double)(size_t)arg.as.number) {
+        *out = (size_t)arg.as.number;
+        return 1;
+    }
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%s expects a whole number that is not negative", builtin);
+    report_error(msg, -1);
+    return 0;
+}
+
+// ulen(string) - number of characters
+static Value builtin_ulen(Value *args, size_t argc) {
+    (void)argc;
+    if (!expect_string("ulen", args[0])) return number_value(0);
+    const char *s = args[0].as.string;
+    return number_value((double)text_count_chars(s, strlen(s)));
+}
+
+// find(string, part [, start]) - position of the first occurrence of part
+// at or after start, or -1
+static Value builtin_find(Value *args, size_t argc) {
+    if (!expect_string("find", args[0]) || !expect_string("find", args[1]))
+        return number_value(-1);
+    size_t start = 0;
+    if (argc == 3 && !expect_count("find", args[2], &start)) return number_value(-1);
+    const char *s = args[0].as.string;
+    size_t len = strlen(s);
+    size_t from = text_char_offset(s, len, start);
+    if (from == len && start > text_count_chars(s, len)) return number_value(-1);
+    size_t at = text_find(s, len, args[1].as.string, strlen(args[1].as.string), from);
+    if (at == TEXT_NOT_FOUND) return number_value(-1);
+    return number_value((double)(start + text_count_chars(s + from, at - from)));
+}
+
+// contains(string, part)
+static Value builtin_contains(Value *args, size_t argc) {
+    (void)argc;
+    if (!expect_string("contains", args[0]) || !expect_string("contains", args[1]))
+        return bool_value(0);
+    const char *s = args[0].as.string;
+    const char *part = args[1].as.string;
+    return bool_value(text_find(s, strlen(s), part, strlen(part), 0) != TEXT_NOT_FOUND);
+}
+
+// substr(string, start [, count]) - characters from start to the end, or
+// at most count of them
+static Value builtin_substr(Value *args, size_t argc) {
+    size_t start = 0;
+    size_t count = (size_t)-1;
+    if (!expect_string("substr", args[0]) || !expect_count("substr", args[1], &start) ||
+        (argc == 3 && !expect_count("substr", args[2], &count)))
+        return string_value(copy_bytes("", 0));
+    const char *s = args[0].as.string;
+    size_t len = strlen(s);
+    size_t begin = text_char_offset(s, len, start);
+    size_t end = count == (size_t)-1 ? len : begin + text_char_offset(s + begin, len - begin, count);
+    return string_value(copy_bytes(s + begin, end - begin));
+}
+
+// split(string, separator) - list of the pieces between separators. An
+// empty separator splits the string into characters.
+static Value builtin_split(Value *args, size_t argc) {
+    (void)argc;
+    List *parts = list_new(0);
+    if (!expect_string("split", args[0]) || !expect_string("split", args[1]))
+        return list_value(parts);
+    const char *s = args[0].as.string;
+    const char *sep = args[1].as.string;
+    size_t len = strlen(s);
+    size_t sep_len = strlen(sep);
+    size_t begin = 0;
+    if (sep_len == 0) {
+        while (begin < len) {
+            size_t end = begin + text_char_offset(s + begin, len - begin, 1);
+            list_push(parts, string_value(copy_bytes(s + begin, end - begin)));
+            begin = end;
+        }
+        return list_value(parts);
+    }
+    for (;;) {
+        size_t at = text_find(s, len, sep, sep_len, begin);
+        size_t end = at == TEXT_NOT_FOUND ? len : at;
+        list_push(parts, string_value(copy_bytes(s + begin, end - begin)));
+        if (at == TEXT_NOT_FOUND) break;
+        begin = at + sep_len;
+    }
+    return list_value(parts);
+}
+
+// replace(string, old, new) - copy with every occurrence of old replaced
+static Value builtin_replace(Value *args, size_t argc) {
+    (void)argc;
+    if (!expect_string("replace", args[0]) || !expect_string("replace", args[1]) ||
+        !expect_string("replace", args[2]))
+        return number_value(0);
+    const char *s = args[0].as.string;
+    const char *old = args[1].as.string;
+    const char *new_text = args[2].as.string;
+    size_t len = strlen(s);
+    size_t old_len = strlen(old);
+    size_t new_len = strlen(new_text);
+    if (old_len == 0) {
+        report_error("replace expects a non-empty string to replace", -1);
+        return value_copy(args[0]);
+    }
+    // Count first so the result is allocated once at its final size
+    size_t matches = 0;
+    for (size_t at = text_find(s, len, old, old_len, 0); at != TEXT_NOT_FOUND;
+         at = text_find(s, len, old, old_len, at + old_len))
+        matches++;
+    if (matches == 0) return value_copy(args[0]);
+    char *out = memory_alloc(len - matches * old_len + matches * new_len + 1);
+    if (!out) {
+        report_error("Memory allocation failed for string", -1);
+        exit(1);
+    }
+    size_t o = 0;
+    size_t begin = 0;
+    for (size_t at = text_find(s, len, old, old_len, 0); at != TEXT_NOT_FOUND;
+         at = text_find(s, len, old, old_len, begin)) {
+        memcpy(out + o, s + begin, at - begin);
+        o += at - begin;
+        memcpy(out + o, new_text, new_len);
+        o += new_len;
+        begin = at + old_len;
+    }
+    memcpy(out + o, s + begin, len - begin);
+    out[o + len - begin] = '\0';
+    return string_value(out);
+}
+
+// upper(string) / lower(string)
+static Value builtin_upper(Value *args, size_t argc) {
+    (void)argc;
+    if (!expect_string("upper", args[0])) return number_value(0);
+    return string_value(text_upper(args[0].as.string, strlen(args[0].as.string)));
+}
+
+static Value builtin_lower(Value *args, size_t argc) {
+    (void)argc;
+    if (!expect_string("lower", args[0])) return number_value(0);
+    return string_value(text_lower(args[0].as.string, strlen(args[0].as.string)));
+}
+
+// num(string [, default]): the number a string holds. Without a default
+// a string that is not a number is an error.
+static Value builtin_num(Value *args, size_t argc) {
+    if (args[0].type == VAL_NUMBER) return args[0];
+    double n;
+    if (args[0].type == VAL_STRING &&
+        parse_number(args[0].as.string, strlen(args[0].as.string), &n))
+        return number_value(n);
+    if (argc == 2) return value_copy(args[1]);
+    if (args[0].type != VAL_STRING) {
+        type_error("num", "a string", args[0]);
+    } else {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "num cannot convert '%.64s' to a number", args[0].as.string);
+        report_error(msg, -1);
+    }
+    return number_value(0);
+}
+
+// File input. lines() and records() return native generators reading
+// through a Reader, so a script can walk a file of any size in constant
+// memory.
+typedef struct {
+    Reader reader;
+    char delim;          // record delimiter
+    char sep;            // records(): field separator
+    char *scratch;       // records(): NUL terminated copy of a text field
+    size_t scratch_cap;
+    List *rows[2];       // records(): lists handed out in turn
+    int turn;
+} FileInput;
+
+static void file_input_free(void *state) {
+    FileInput *in = state;
+    reader_close(&in->reader);
+    memory_free(in->scratch);
+    for (int i = 0; i < 2; ++i) {
+        if (in->rows[i]) list_release(in->rows[i]);
+    }
+    memory_free(in);
+}
+
+// Next record without its delimiter or the '\r' of a CRLF line end
+static int next_record(FileInput *in, const char **start, size_t *length) {
+    if (!reader_next(&in->reader, in->delim, start, length)) return 0;
+    if (in->delim == '\n' && *length > 0 && (*start)[*length - 1] == '\r')
+        (*length)--;
+    return 1;
+}
+
+static int next_line(Generator *gen, Value *out) {
+    const char *start;
+    size_t length;
+    if (!next_record(gen->native, &start, &length)) return 0;
+    *out = string_value(copy_bytes(start, length));
+    return 1;
+}
+
+static void append_field(FileInput *in, List *row, const char *start, size_t length) {
+    double n;
+    if (parse_number(start, length, &n)) {
+        list_append(row, number_value(n));
+        return;
+    }
+    if (length + 1 > in->scratch_cap) {
+        in->scratch_cap = length + 1 > 64 ? length + 1 : 64;
+        in->scratch = memory_realloc(in->scratch, in->scratch_cap);
+        if (!in->scratch) {
+            report_error("Memory allocation failed for string", -1);
+            exit(1);
+        }
+    }
+    memcpy(in->scratch, start, length);
+    in->scratch[length] = '\0';
+    Value field;
+    field.type = VAL_STRING;
+    field.as.string = in->scratch;
+    list_append(row, field);  // copies the string
+}
+
+// Rows alternate between two lists. By the time a list comes round again
+// the loop variable has moved on to the other one, so unless the script
+// kept it the generator holds the only reference and refills it in place.
+static int next_row(Generator *gen, Value *out) {
+    FileInput *in = gen->native;
+    const char *start;
+    size_t length;
+    if (!next_record(in, &start, &length)) return 0;
+    List *row = in->rows[in->turn];
+    if (row && row->gc.refcount == 1) {
+        list_clear(row);
+    } else {
+        if (row) list_release(row);
+        row = in->rows[in->turn] = list_new(8);
+    }
+    in->turn ^= 1;
+
+    const char *end = start + length;
+    for (;;) {
+        const char *field_end = memchr(start, in->sep, (size_t)(end - start));
+        if (!field_end) break;
+        append_field(in, row, start, (size_t)(field_end - start));
+        start = field_end + 1;
+    }
+    append_field(in, row, start, (size_t)(end - start));
+    list_retain(row);
+    *out = list_value(row);
+    return 1;
+}
+
+// Check an optional single character argument
+static int expect_char(const char *builtin, Value *args, size_t argc, size_t i, char *out) {
+    if (argc <= i) return 1;
+    if (args[i].type != VAL_STRING || strlen(args[i].as.string) != 1) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%s expects a single character separator", builtin);
+        report_error(msg, -1);
+        return 0;
+    }
+    *out = args[i].as.string[0];
+    return 1;
+}
+
+static Value file_generator(const char *builtin, NativeNext next, Value *args,
+                            char delim, char sep) {
+    Value result;
+    result.type = VAL_GENERATOR;
+    if (args[0].type != VAL_STRING) {
+        type_error(builtin, "a file name", args[0]);
+        return number_value(0);
+    }
+    FileInput *in = memory_calloc(1, sizeof(FileInput));
+    if (!in) {
+        report_error("Memory allocation failed for file input", -1);
+        exit(1);
+    }
+    in->delim = delim;
+    in->sep = sep;
+    if (!reader_open(&in->reader, args[0].as.string)) {
+        char msg[512];
+        snprintf(msg, sizeof(msg), "%s cannot open '%.400s'", builtin, args[0].as.string);
+        report_error(msg, -1);
+        memory_free(in);
+        // An empty generator, so a loop over it does nothing
+        result.as.generator = generator_new_native(builtin, next, NULL, NULL);
+        generator_finish(result.as.generator);
+        return result;
+    }
+    result.as.generator = generator_new_native(builtin, next, file_input_free, in);
+    return result;
+}
+
+// lines(path [, delimiter]): generator of the lines of a file as strings
+static Value builtin_lines(Value *args, size_t argc) {
+    char delim = '\n';
+    if (!expect_char("lines", args, argc, 1, &delim)) return number_value(0);
+    return file_generator("lines", next_line, args, delim, 0);
+}
+
+// records(path [, separator]): generator of the lines of a file split into
+// lists of fields. Fields that are numbers become numbers.
+static Value builtin_records(Value *args, size_t argc) {
+    char sep = ',';
+    if (!expect_char("records", args, argc, 1, &sep)) return number_value(0);
+    return file_generator("records", next_row, args, '\n', sep);
+}
+
+// Channels (see isolate.h)
+
+static Value channel_value(Channel *channel) {
+    Value v;
+    v.type = VAL_CHANNEL;
+    v.as.channel = channel;
+    return v;
+}
+
+static int expect_channel(const char *builtin, Value arg) {
+    if (arg.type == VAL_CHANNEL) return 1;
+    type_error(builtin, "a channel", arg);
+    return 0;
+}
+
+// channel(type [, capacity]) - a channel for values of the named type
+// ("number", "string", "bool", "list", "map" or "channel") holding up to
+// capacity of them (64 by default) before a send waits
+static Value builtin_channel(Value *args, size_t argc) {
+    static const ValueType types[] = { VAL_NUMBER, VAL_STRING, VAL_BOOL, VAL_LIST, VAL_MAP, VAL_CHANNEL };
+    int type = -1;
+    for (size_t i = 0; args[0].type == VAL_STRING && i < sizeof(types) / sizeof(types[0]); ++i) {
+        if (strcmp(args[0].as.string, value_type_name(types[i])) == 0) type = (int)types[i];
+    }
+    if (type < 0) {
+        report_error("channel expects a type name: number, string, bool, list, map or channel", -1);
+        return number_value(0);
+    }
+    size_t capacity = 64;
+    if (argc == 2 && !expect_count("channel", args[1], &capacity)) return number_value(0);
+    if (capacity == 0 || capacity > ((size_t)1 << 24)) {
+        report_error("channel expects a capacity from 1 to 16777216", -1);
+        return number_value(0);
+    }
+    return channel_value(channel_new((ValueType)type, capacity));
+}
+
+// send(channel, value) - queue value, waiting while the channel is full.
+// The value is handed over rather than shared; the receiver gets it as it
+// is when nothing else refers to it, and a copy otherwise.
+static Value builtin_send(Value *args, size_t argc) {
+    (void)argc;
+    if (!expect_channel("send", args[0])) return bool_value(0);
+    Channel *channel = args[0].as.channel;
+    if (args[1].type != channel->type) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "send expects a %s for this channel, got %s",
+                 value_type_name(channel->type), value_type_name(args[1].type));
+        report_error(msg, -1);
+        return bool_value(0);
+    }
+    // Until the value is queued it stays in args[1], so that a variable
+    // it was moved out of gets it back (see Builtin.moves)
+    if (!isolate_transfer(&args[1])) return bool_value(0);
+    Value value = args[1];
+    args[1] = number_value(0);
+    int sent = channel_send(channel, value);
+    if (sent == 0) {
+        args[1] = value;
+        report_error("send called on a closed channel", -1);
+    }
+    return bool_value(sent == 1);
+}
+
+// receive(channel [, default]) - the oldest value queued, waiting while
+// the channel is empty. Once it is closed and empty the default is
+// returned; without one that is an error.
+static Value builtin_receive(Value *args, size_t argc) {
+    if (!expect_channel("receive", args[0])) return number_value(0);
+    Value item;
+    int received = channel_receive(args[0].as.channel, &item);
+    if (received > 0) return item;
+    if (received < 0) return number_value(0);   // the program is stopping
+    if (argc == 2) return value_copy(args[1]);
+    report_error("receive called on a closed channel", -1);
+    return number_value(0);
+}
+
+// close(channel) - no more values can be sent; returns whether it was open
+static Value builtin_close(Value *args, size_t argc) {
+    (void)argc;
+    if (!expect_channel("close", args[0])) return bool_value(0);
+    return bool_value(channel_close(args[0].as.channel));
+}
+
+// clock() - milliseconds on a monotonic clock, for timing parts of a
+// program by the difference of two calls
+static Value builtin_clock(Value *args, size_t argc) {
+    (void)args;
+    (void)argc;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return number_value((double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6);
+}
+
+static const Builtin builtins[] = {
+    { "len", 1, 1, builtin_len, 0, VAL_NUMBER, 0 },
+    { "append", 2, 2, builtin_append, 1, -1, 0 },
+    { "sum", 1, 1, builtin_sum, 0, VAL_NUMBER, 0 },
+    { "min", 1, 1, builtin_min, 0, VAL_NUMBER, 0 },
+    { "max", 1, 1, builtin_max, 0, VAL_NUMBER, 0 },
+    { "add", 2, 2, builtin_add, 0, VAL_LIST, 0 },
+    { "scale", 2, 2, builtin_scale, 0, VAL_LIST, 0 },
+    { "dot", 2, 2, builtin_dot, 0, VAL_NUMBER, 0 },
+    { "get", 2, 3, builtin_get, 0, -1, 0 },
+    { "set", 3, 3, builtin_set, 1, -1, 0 },
+    { "has", 2, 2, builtin_has, 0, VAL_BOOL, 0 },
+    { "del", 2, 2, builtin_del, 1, -1, 0 },
+    { "keys", 1, 1, builtin_keys, 0, VAL_LIST, 0 },
+    { "values", 1, 1, builtin_values, 0, VAL_LIST, 0 },
+    { "next", 1, 2, builtin_next, 0, -1, 0 },
+    { "ulen", 1, 1, builtin_ulen, 0, VAL_NUMBER, 0 },
+    { "find", 2, 3, builtin_find, 0, VAL_NUMBER, 0 },
+    { "contains", 2, 2, builtin_contains, 0, VAL_BOOL, 0 },
+    { "substr", 2, 3, builtin_substr, 0, VAL_STRING, 0 },
+    { "split", 2, 2, builtin_split, 0, VAL_LIST, 0 },
+    { "replace", 3, 3, builtin_replace, 0, -1, 0 },
+    { "upper", 1, 1, builtin_upper, 0, -1, 0 },
+    { "lower", 1, 1, builtin_lower, 0, -1, 0 },
+    { "num", 1, 2, builtin_num, 0, -1, 0 },
+    { "lines", 1, 2, builtin_lines, 0, -1, 0 },
+    { "records", 1, 2, builtin_records, 0, -1, 0 },
+    { "channel", 1, 2, builtin_channel, 0, -1, 0 },
+    { "send", 2, 2, builtin_send, 0, VAL_BOOL, 1 },
+    { "receive", 1, 2, builtin_receive, 0, -1, 0 },
+    { "close", 1, 1, builtin_close, 0, VAL_BOOL, 0 },
+    { "clock", 0, 0, builtin_clock, 0, VAL_NUMBER, 0 },
+};
+
+const Builtin *find_builtin(const char *name) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i) {
+        if (strcmp(builtins[i].name, name) == 0)
+            return &builtins[i];
+    }
+    return NULL;
+}
+
+void builtin_arity_error(const Builtin *builtin, size_t argc) {
+    char msg[160];
+    if (builtin->min_args == builtin->max_args)
+        snprintf(msg, sizeof(msg), "%s expects %zu argument(s), got %zu",
+                 builtin->name, builtin->min_args, argc);
+    else
+        snprintf(msg, sizeof(msg), "%s expects %zu to %zu argument(s), got %zu",
+                 builtin->name, builtin->min_args, builtin->max_args, argc);
+    report_error(msg, -1);
+}
@@ -0,0 +1,30 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "value.h"
+
+// A builtin receives its evaluated arguments (still owned by the caller)
+// and returns a new value owned by the caller.
+typedef Value (*BuiltinFn)(Value *args, size_t argc);
+
+typedef struct {
+    const char *name;
+    size_t min_args;
+    size_t max_args;
+    BuiltinFn fn;
+    int modifies;       // changes its first argument in place
+    int returns;        // type of every result, even after an error, or -1
+    int moves;          // takes over its last argument, leaving a number in
+                        // its place; a local variable passed there is left
+                        // unset if it held a string, list or map, and gets
+                        // the value back if the builtin did not take it
+} Builtin;
+
+// Look up a builtin function by name. Returns NULL if there is none.
+const Builtin *find_builtin(const char *name);
+
+// Report a call of builtin with argc arguments, outside the number it
+// accepts.
+void builtin_arity_error(const Builtin *builtin, size_t argc);
+
+#endif // BUILTINS_H
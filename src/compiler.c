@@ -0,0 +1,1319 @@
+#define _POSIX_C_SOURCE 200809L
+#include "compiler.h"
+#include "builtins.h"
+#include "memory.h"
+#include "module.h"
+#include "types.h"
+#include "util.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Set by the Makefile to the source tree
+#ifndef IGBO_HOME
+#define IGBO_HOME "."
+#endif
+
+// Top-level blocks longer than this are split over several C functions,
+// so the C compiler is never handed one enormous function
+#define PART_STATEMENTS 64
+
+// Same limit as in interpreter.c
+#define MAX_REDUCTIONS 16
+
+// Growable text buffer for generated code
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} Text;
+
+static void text_reserve(Text *t, size_t extra) {
+    if (t->length + extra + 1 <= t->capacity) return;
+    size_t capacity = t->capacity ? t->capacity : 4096;
+    while (capacity < t->length + extra + 1) capacity *= 2;
+    t->data = memory_realloc(t->data, capacity);
+    if (!t->data) {
+        report_error("Memory allocation failed while compiling", -1);
+        exit(1);
+    }
+    t->capacity = capacity;
+}
+
+static void text_vprintf(Text *t, const char *format, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int n = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    text_reserve(t, (size_t)n);
+    vsnprintf(t->data + t->length, (size_t)n + 1, format, args);
+    t->length += (size_t)n;
+}
+
+static void text_printf(Text *t, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    text_vprintf(t, format, args);
+    va_end(args);
+}
+
+static void text_append(Text *t, const Text *other) {
+    if (other->length) text_printf(t, "%s", other->data);
+}
+
+// A C string literal for s. UTF-8 is kept as it is; '?' is escaped so no
+// trigraph can form.
+static void text_literal(Text *t, const char *s) {
+    text_printf(t, "\"");
+    for (const unsigned char *p = (const unsigned char *)s; *p; ++p) {
+        switch (*p) {
+            case '\\': text_printf(t, "\\\\"); break;
+            case '"': text_printf(t, "\\\""); break;
+            case '?': text_printf(t, "\\?"); break;
+            case '\n': text_printf(t, "\\n"); break;
+            case '\t': text_printf(t, "\\t"); break;
+            default:
+                if (*p < 0x20 || *p == 0x7f)
+                    text_printf(t, "\\%03o", *p);
+                else
+                    text_printf(t, "%c", *p);
+        }
+    }
+    text_printf(t, "\"");
+}
+
+// A list of names; a name's index gives its C identifier
+typedef struct {
+    char **items;
+    int count;
+    int capacity;
+} Names;
+
+static int names_find(const Names *n, const char *name) {
+    for (int i = 0; i < n->count; ++i) {
+        if (strcmp(n->items[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int names_push(Names *n, const char *name) {
+    if (n->count == n->capacity) {
+        n->capacity = n->capacity ? n->capacity * 2 : 16;
+        n->items = memory_realloc(n->items, sizeof(char *) * n->capacity);
+        if (!n->items) {
+            report_error("Memory allocation failed while compiling", -1);
+            exit(1);
+        }
+    }
+    n->items[n->count] = string_duplicate(name);
+    return n->count++;
+}
+
+static int names_add(Names *n, const char *name) {
+    int i = names_find(n, name);
+    return i >= 0 ? i : names_push(n, name);
+}
+
+static void names_pop(Names *n) {
+    memory_free(n->items[--n->count]);
+}
+
+static void names_free(Names *n) {
+    while (n->count > 0) names_pop(n);
+    memory_free(n->items);
+}
+
+typedef struct {
+    Text head;        // declarations, in front of all code
+    Text code;        // C functions
+    Names globals;    // g_<i>
+    Names functions;  // fn_<i>: every name defined with 'oru'
+    ASTNode **definitions; // every 'oru' statement, for isolates
+    int definition_count;
+    Names builtins;   // bi_<i>
+    int defs;         // f_<i>: one per 'oru' statement
+    int chunks;       // chunk_<i>: one per parallel loop
+    int parts;        // part_<i>: pieces of long top-level blocks
+    Module **modules; // module_<i>: every imported file, in import order
+    int module_count;
+    const char *file; // file whose top level is being compiled
+    int failed;
+} Compiler;
+
+// Where the code being emitted runs: the top level (main() or one of its
+// parts), a function, a generator body or the body of a parallel loop.
+typedef enum { IN_MAIN, IN_FUNCTION, IN_GENERATOR, IN_PARALLEL } Place;
+
+typedef struct {
+    Compiler *c;
+    Text *out;
+    Place place;
+    const char *leave;   // how to leave after 'laghachi' or a fatal error
+    int left;            // set once 'leave' has been emitted
+    int indent;
+    int temps;
+    Names cleanups;      // C variables holding 'maka' iterables, innermost last
+    int frame_size;      // generator: frame slots in use
+    int counters;        // generator: counters in use
+    int resumes;         // generator: resume points so far
+} Emitter;
+
+static void compile_error(Compiler *c, const char *message) {
+    if (!c->failed) report_error(message, -1);
+    c->failed = 1;
+}
+
+static void line(Emitter *e, const char *format, ...) {
+    text_printf(e->out, "%*s", e->indent * 4, "");
+    va_list args;
+    va_start(args, format);
+    text_vprintf(e->out, format, args);
+    va_end(args);
+    text_printf(e->out, "\n");
+}
+
+static int temp(Emitter *e) {
+    return e->temps++;
+}
+
+// C expression for a frame slot
+static void slot_ref(Emitter *e, int slot, char *buf, size_t size) {
+    snprintf(buf, size, e->place == IN_GENERATOR ? "frame[%d]" : "l%d", slot);
+}
+
+// C expression for the variable named by node
+static void var_ref(Emitter *e, ASTNode *node, char *buf, size_t size) {
+    if (node->slot >= 0)
+        slot_ref(e, node->slot, buf, size);
+    else
+        snprintf(buf, size, "g_%d", names_add(&e->c->globals, node->value));
+}
+
+// Name of the variable in a local slot, for comments
+static const char *slot_name(ASTNode *node, int slot) {
+    if (!node) return NULL;
+    if ((node->type == NODE_IDENTIFIER || node->type == NODE_VAR_DECL ||
+         node->type == NODE_FOR_STMT || node->type == NODE_INDEX_ASSIGN) && node->slot == slot)
+        return node->value;
+    if (node->type == NODE_FUNC_DEF) return NULL;
+    const char *name = slot_name(node->left, slot);
+    if (!name) name = slot_name(node->right, slot);
+    if (!name) name = slot_name(node->third, slot);
+    return name;
+}
+
+static int from_module(Compiler *c, const char *name, ModuleSymbol kind) {
+    for (int i = 0; i < c->module_count; ++i) {
+        if (module_defines(c->modules[i], name, kind)) return 1;
+    }
+    return 0;
+}
+
+// Whether running node can stop the program with a fatal error. Only
+// calls, loops over generators, statements the parallel loop forbids and
+// reads that may load a module can, so plain arithmetic needs no check
+// afterwards.
+static int may_abort(Compiler *c, ASTNode *node) {
+    // The right child is followed in a loop, so long statement chains do
+    // not recurse
+    for (; node != NULL; node = node->right) {
+        switch (node->type) {
+            case NODE_CALL:
+            case NODE_INDEX_ASSIGN:
+            case NODE_PRINT_STMT:
+            case NODE_FUNC_DEF:
+            case NODE_FOR_STMT:
+            case NODE_PARALLEL_FOR:
+            case NODE_SPAWN:
+                return 1;
+            case NODE_IDENTIFIER:
+                return node->slot < 0 && from_module(c, node->value, MODULE_VARIABLE);
+            default:
+                if (may_abort(c, node->left) || may_abort(c, node->third)) return 1;
+                break;
+        }
+    }
+    return 0;
+}
+
+// Free the iterables of the enclosing loops and leave
+static void leave(Emitter *e) {
+    for (int i = e->cleanups.count - 1; i >= 0; --i)
+        line(e, "rt_free(%s);", e->cleanups.items[i]);
+    line(e, "%s", e->leave);
+    e->left = 1;
+}
+
+static void check_abort(Emitter *e, ASTNode *node) {
+    if (!may_abort(e->c, node)) return;
+    line(e, "if (rt_aborted) {");
+    e->indent++;
+    leave(e);
+    e->indent--;
+    line(e, "}");
+}
+
+static int expr(Emitter *e, ASTNode *node);
+static void block(Emitter *e, ASTNode *list);
+static void compile_function(Compiler *c, ASTNode *def, int id);
+
+// Before a function or global that an imported module may define is
+// used, load the first module still waiting to be loaded that defines it,
+// as interpreter.c does. 'defined' is a C condition that holds once the
+// name is defined. Returns 0 if no module defines the name.
+static int load_trigger(Emitter *e, const char *name, ModuleSymbol kind, const char *defined) {
+    Compiler *c = e->c;
+    if (!from_module(c, name, kind)) return 0;
+    Text literal = {0};
+    text_literal(&literal, name);
+    line(e, "if (!(%s)) {", defined);
+    e->indent++;
+    int first = 1;
+    for (int i = 0; i < c->module_count; ++i) {
+        if (!module_defines(c->modules[i], name, kind)) continue;
+        Text module = {0};
+        text_literal(&module, module_name(c->modules[i]));
+        line(e, "%sif (module_%d_state == 1)", first ? "" : "else ", i);
+        line(e, "    rt_load_module(&module_%d_state, module_%d, %s, %s);", i, i, module.data,
+             literal.data);
+        memory_free(module.data);
+        first = 0;
+    }
+    e->indent--;
+    line(e, "}");
+    memory_free(literal.data);
+    return 1;
+}
+
+// Load the module that defines a global that is about to be read
+static void global_trigger(Emitter *e, const char *name) {
+    char defined[48];
+    snprintf(defined, sizeof(defined), "g_%d.type != VAL_UNSET", names_add(&e->c->globals, name));
+    load_trigger(e, name, MODULE_VARIABLE, defined);
+}
+
+// Load the modules that a parallel loop refers to, before it starts
+static void preload(Emitter *e, ASTNode *node) {
+    for (; node != NULL; node = node->right) {
+        if (node->type == NODE_CALL) {
+            int user = names_find(&e->c->functions, node->value);
+            char defined[32];
+            snprintf(defined, sizeof(defined), "fn_%d", user);
+            if (user >= 0) load_trigger(e, node->value, MODULE_FUNCTION, defined);
+        } else if (node->type == NODE_IDENTIFIER && node->slot < 0) {
+            global_trigger(e, node->value);
+        }
+        preload(e, node->left);
+        preload(e, node->third);
+    }
+}
+
+static const char *operator_function(const char *op) {
+    static const char *const ops[][2] = {
+        {"+", "rt_add"}, {"-", "rt_sub"}, {"*", "rt_mul"}, {"/", "rt_div"},
+        {"==", "rt_eq"}, {"!=", "rt_ne"}, {"<", "rt_lt"}, {">", "rt_gt"},
+        {"<=", "rt_le"}, {">=", "rt_ge"}
+    };
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if (strcmp(op, ops[i][0]) == 0) return ops[i][1];
+    }
+    return NULL;
+}
+
+// Evaluate the arguments of a call into an array temporary. Returns its
+// number, or -1 for no arguments. Unless 'moved' is NULL, the last
+// argument is taken out of a local variable rather than copied (see
+// Builtin.moves) and moved, 32 chars long, is set to that variable, or
+// to "" when the argument is not one.
+static int arguments(Emitter *e, ASTNode *args, int *argc, char *moved) {
+    int temps[256];
+    int n = 0;
+    if (moved) moved[0] = '\0';
+    for (ASTNode *a = args; a != NULL; a = a->right) {
+        if (n == 256) {
+            compile_error(e->c, "Too many arguments in a call to compile");
+            break;
+        }
+        ASTNode *arg = a->left;
+        if (moved && !a->right && arg->type == NODE_IDENTIFIER && arg->slot >= 0 &&
+            arg->types != TYPE_NUMBER) {
+            Text name = {0};
+            slot_ref(e, arg->slot, moved, 32);
+            text_literal(&name, arg->value);
+            temps[n] = temp(e);
+            line(e, "Value t%d = rt_take(&%s, %s);", temps[n++], moved, name.data);
+            memory_free(name.data);
+            continue;
+        }
+        temps[n++] = expr(e, arg);
+    }
+    *argc = n;
+    if (n == 0) return -1;
+    int t = temp(e);
+    Text list = {0};
+    for (int i = 0; i < n; ++i)
+        text_printf(&list, i ? ", t%d" : "t%d", temps[i]);
+    line(e, "Value t%d[] = {%s};", t, list.data);
+    memory_free(list.data);
+    return t;
+}
+
+static void array_name(int t, char *buf, size_t size) {
+    if (t < 0)
+        snprintf(buf, size, "NULL");
+    else
+        snprintf(buf, size, "t%d", t);
+}
+
+// A call of a user defined function, which takes precedence over a
+// builtin of the same name once its 'oru' has run
+static int call(Emitter *e, ASTNode *node) {
+    Compiler *c = e->c;
+    int user = names_find(&c->functions, node->value);
+    const Builtin *builtin = find_builtin(node->value);
+    int argc = 0;
+    for (ASTNode *a = node->left; a != NULL; a = a->right)
+        argc++;
+    int t = temp(e);
+    char args[32];
+    line(e, "Value t%d;", t);
+    if (user >= 0) {
+        char defined[32];
+        snprintf(defined, sizeof(defined), "fn_%d", user);
+        if (load_trigger(e, node->value, MODULE_FUNCTION, defined))
+            line(e, "if (rt_aborted) t%d = rt_number(0); else", t);
+        line(e, "if (fn_%d) {", user);
+        e->indent++;
+        array_name(arguments(e, node->left, &argc, NULL), args, sizeof(args));
+        line(e, "t%d = rt_call(fn_%d, %s, %d);", t, user, args, argc);
+        e->indent--;
+        line(e, "} else {");
+        e->indent++;
+    }
+    if (!builtin) {
+        Text name = {0};
+        text_literal(&name, node->value);
+        line(e, "t%d = rt_undefined_function(%s);", t, name.data);
+        memory_free(name.data);
+    } else {
+        int b = names_add(&c->builtins, node->value);
+        if ((size_t)argc < builtin->min_args || (size_t)argc > builtin->max_args) {
+            line(e, "t%d = rt_builtin_arity(bi_%d, %d);", t, b, argc);
+        } else {
+            char moved[32];
+            array_name(arguments(e, node->left, &argc, builtin->moves ? moved : NULL),
+                       args, sizeof(args));
+            if (builtin->moves && moved[0])
+                line(e, "t%d = rt_builtin_moved(bi_%d, %s, %d, &%s);", t, b, args, argc, moved);
+            else
+                line(e, "t%d = rt_builtin(bi_%d, %s, %d);", t, b, args, argc);
+        }
+    }
+    if (user >= 0) {
+        e->indent--;
+        line(e, "}");
+    }
+    return t;
+}
+
+// Emit code that evaluates node into a new temporary and return its number
+static int expr(Emitter *e, ASTNode *node) {
+    char ref[32];
+    int t;
+    switch (node->type) {
+        case NODE_NUMBER: {
+            t = temp(e);
+            double d = atof(node->value);
+            if (isinf(d))
+                line(e, "Value t%d = rt_number(HUGE_VAL);", t);
+            else
+                line(e, "Value t%d = rt_number(%.17g);", t, d);
+            return t;
+        }
+        case NODE_STRING: {
+            t = temp(e);
+            Text s = {0};
+            text_literal(&s, node->value);
+            line(e, "Value t%d = rt_string(%s);", t, s.data);
+            memory_free(s.data);
+            return t;
+        }
+        case NODE_BOOL:
+            t = temp(e);
+            line(e, "Value t%d = rt_bool(%d);", t, strcmp(node->value, "eziokwu") == 0);
+            return t;
+        case NODE_IDENTIFIER: {
+            t = temp(e);
+            var_ref(e, node, ref, sizeof(ref));
+            if (node->types == TYPE_NUMBER) {
+                // Certainly a number: no check and no copy
+                line(e, "Value t%d = %s;", t, ref);
+                return t;
+            }
+            if (node->slot < 0) global_trigger(e, node->value);
+            Text name = {0};
+            text_literal(&name, node->value);
+            line(e, "Value t%d = rt_get(&%s, %s);", t, ref, name.data);
+            memory_free(name.data);
+            return t;
+        }
+        case NODE_BINARY_EXPR: {
+            const char *fn = operator_function(node->value);
+            int a = expr(e, node->left);
+            int b = expr(e, node->right);
+            t = temp(e);
+            if (node->left->types == TYPE_NUMBER && node->right->types == TYPE_NUMBER) {
+                // Inferred numbers (see types.h) need no type checks
+                int compare = strchr("=!<>", node->value[0]) != NULL;
+                line(e, "Value t%d = %s(t%d.as.number %s t%d.as.number);", t,
+                     compare ? "rt_bool" : "rt_number", a, node->value, b);
+            } else if (fn) {
+                line(e, "Value t%d = %s(t%d, t%d);", t, fn, a, b);
+            } else {
+                Text op = {0};
+                text_literal(&op, node->value);
+                line(e, "Value t%d = rt_binary(t%d, t%d, %s);", t, a, b, op.data);
+                memory_free(op.data);
+            }
+            return t;
+        }
+        case NODE_LIST:
+            t = temp(e);
+            line(e, "Value t%d = {VAL_LIST, {.list = list_new(0)}};", t);
+            for (ASTNode *n = node->left; n != NULL; n = n->right) {
+                int item = expr(e, n->left);
+                line(e, "list_push(t%d.as.list, t%d);", t, item);
+            }
+            return t;
+        case NODE_MAP:
+            t = temp(e);
+            line(e, "Value t%d = {VAL_MAP, {.map = map_new()}};", t);
+            for (ASTNode *n = node->left; n != NULL; n = n->right) {
+                int key = expr(e, n->left);
+                int value = expr(e, n->third);
+                line(e, "rt_map_put(t%d.as.map, t%d, t%d);", t, key, value);
+            }
+            return t;
+        case NODE_INDEX: {
+            int target = expr(e, node->left);
+            int index = expr(e, node->right);
+            t = temp(e);
+            line(e, "Value t%d = rt_index(t%d, t%d);", t, target, index);
+            return t;
+        }
+        case NODE_CALL:
+            return call(e, node);
+        default:
+            t = temp(e);
+            line(e, "report_error(\"Invalid expression\", -1);");
+            line(e, "Value t%d = rt_number(0);", t);
+            return t;
+    }
+}
+
+// Condition of 'ma' or 'mgbe' as a C int in c<t>
+static int condition(Emitter *e, ASTNode *node) {
+    int v = expr(e, node);
+    int t = temp(e);
+    if (node->types == TYPE_BOOL) {
+        line(e, "int t%d = t%d.as.boolean;", t, v);
+        return t;
+    }
+    line(e, "int t%d = rt_truthy(t%d);", t, v);
+    line(e, "rt_free(t%d);", v);
+    return t;
+}
+
+static void while_stmt(Emitter *e, ASTNode *node) {
+    // A loop holding a 'nye' keeps its count in the generator, as the
+    // generator may stop inside it
+    char count[48];
+    line(e, "{");
+    e->indent++;
+    if (e->place == IN_GENERATOR && node->yields) {
+        snprintf(count, sizeof(count), "g->counters[%d]", e->counters++);
+        line(e, "%s = 0;", count);
+    } else {
+        snprintf(count, sizeof(count), "t%d", temp(e));
+        line(e, "size_t %s = 0;", count);
+    }
+    line(e, "for (;;) {");
+    e->indent++;
+    line(e, "if (!rt_while_limit(&%s)) break;", count);
+    if (e->place != IN_PARALLEL) line(e, "rt_safe_point();");
+    line(e, "{");
+    e->indent++;
+    int c = condition(e, node->left);
+    line(e, "if (!t%d || rt_aborted) break;", c);
+    e->indent--;
+    line(e, "}");
+    block(e, node->right);
+    e->indent--;
+    line(e, "}");
+    e->indent--;
+    line(e, "}");
+}
+
+static void for_stmt(Emitter *e, ASTNode *node) {
+    char var[32], iterable[48], pos[48];
+    var_ref(e, node, var, sizeof(var));
+    line(e, "{");
+    e->indent++;
+    int v = expr(e, node->left);
+    // The list being walked by a loop holding a 'nye' lives in the
+    // generator's frame, where releasing the generator frees it
+    int in_frame = e->place == IN_GENERATOR && node->yields;
+    if (in_frame) {
+        slot_ref(e, e->frame_size++, iterable, sizeof(iterable));
+        snprintf(pos, sizeof(pos), "g->counters[%d]", e->counters++);
+        line(e, "%s = rt_iterable(t%d, 1);", iterable, v);
+        line(e, "%s = 0;", pos);
+    } else {
+        snprintf(iterable, sizeof(iterable), "t%d", temp(e));
+        snprintf(pos, sizeof(pos), "t%d", temp(e));
+        line(e, "Value %s = rt_iterable(t%d, 0);", iterable, v);
+        line(e, "size_t %s = 0;", pos);
+        names_push(&e->cleanups, iterable);
+    }
+    line(e, "for (;;) {");
+    e->indent++;
+    int item = temp(e);
+    line(e, "Value t%d;", item);
+    line(e, "if (!rt_next(%s, &%s, &t%d)) break;", iterable, pos, item);
+    line(e, "rt_set(&%s, t%d);", var, item);
+    if (e->place != IN_PARALLEL) line(e, "rt_safe_point();");
+    block(e, node->right);
+    e->indent--;
+    line(e, "}");
+    if (in_frame) {
+        line(e, "rt_set(&%s, rt_unset());", iterable);
+    } else {
+        names_pop(&e->cleanups);
+        line(e, "rt_free(%s);", iterable);
+    }
+    e->indent--;
+    line(e, "}");
+}
+
+static void return_stmt(Emitter *e, ASTNode *node) {
+    if (e->place == IN_GENERATOR) {
+        // A generator cannot return a value, so this only ends it
+        leave(e);
+        return;
+    }
+    ASTNode *value = node->left;
+    int callee = node->slot == 1 ? names_find(&e->c->functions, value->value) : -1;
+    if (callee >= 0) {
+        // Tail call: rt_call() runs the callee in place of this call
+        line(e, "if (fn_%d && !fn_%d->yields) {", callee, callee);
+        e->indent++;
+        int argc;
+        char args[32];
+        int t = arguments(e, value->left, &argc, NULL);
+        array_name(t, args, sizeof(args));
+        line(e, "if (!rt_aborted) {");
+        line(e, "    rt_tail_call(fn_%d, %s, %d);", callee, args, argc);
+        if (argc > 0) {
+            line(e, "} else {");
+            line(e, "    for (int i = 0; i < %d; ++i) rt_free(%s[i]);", argc, args);
+        }
+        line(e, "}");
+        leave(e);
+        e->indent--;
+        line(e, "}");
+    }
+    if (value) {
+        int t = expr(e, value);
+        line(e, "result = t%d;", t);
+    }
+    leave(e);
+}
+
+static void yield_stmt(Emitter *e, ASTNode *node) {
+    line(e, "{");
+    e->indent++;
+    int t;
+    if (node->left) {
+        t = expr(e, node->left);
+    } else {
+        t = temp(e);
+        line(e, "Value t%d = rt_bool(0);", t);
+    }
+    line(e, "if (rt_aborted) {");
+    line(e, "    rt_free(t%d);", t);
+    line(e, "    return 0;");
+    line(e, "}");
+    line(e, "*out = t%d;", t);
+    int resume = ++e->resumes;
+    line(e, "g->resume = %d;", resume);
+    line(e, "return 1;");
+    e->indent--;
+    line(e, "}");
+    // Resuming the generator jumps here
+    line(e, "case %d:;", resume);
+}
+
+// Report a private variable of a parallel loop body that has the name of
+// a global, in the order interpreter.c checks them
+static void private_checks(Emitter *e, ASTNode *node, int first, int *checks) {
+    if (!node) return;
+    if ((node->type == NODE_VAR_DECL || node->type == NODE_FOR_STMT) && node->slot >= first) {
+        Text msg = {0};
+        char text[160];
+        snprintf(text, sizeof(text), "Cannot assign global '%s' inside 'mgbe ngwa' (use 'jikota')",
+                 node->value);
+        text_literal(&msg, text);
+        line(e, "%sif (g_%d.type != VAL_UNSET) rt_fatal(%s);", *checks ? "else " : "",
+             names_add(&e->c->globals, node->value), msg.data);
+        memory_free(msg.data);
+        (*checks)++;
+    }
+    private_checks(e, node->left, first, checks);
+    private_checks(e, node->right, first, checks);
+    private_checks(e, node->third, first, checks);
+}
+
+// The body of a parallel loop becomes a chunk function with the loop
+// variable, the reduction variables and the body's own variables as
+// locals, fresh for every iteration
+static void chunk_function(Compiler *c, ASTNode *node, int id, int reductions) {
+    ASTNode *body = node->right->left;
+    int frame = node->slot;
+    Emitter e = {0};
+    Text out = {0};
+    e.c = c;
+    e.out = &out;
+    e.place = IN_PARALLEL;
+    e.leave = "goto done;";
+    text_printf(&out, "static void chunk_%d(void *context, size_t chunk) {\n", id);
+    e.indent = 1;
+    line(&e, "RtParallel *loop = context;");
+    line(&e, "size_t i, end;");
+    line(&e, "if (!rt_chunk_begin(loop, chunk, &i, &end)) return;");
+    for (int s = 0; s < frame; ++s) {
+        const char *name = s == 0 ? node->value : slot_name(node->right, s);
+        if (s >= 1 && s <= reductions)
+            line(&e, "Value l%d = rt_number(rt_identity(loop, %d));  // %s", s, s - 1, name);
+        else
+            line(&e, "Value l%d = rt_unset();  // %s", s, name ? name : "");
+    }
+    line(&e, "for (; i < end && !rt_aborted; ++i) {");
+    e.indent++;
+    line(&e, "rt_set(&l0, rt_number(loop->start + (double)i));");
+    for (int s = 1 + reductions; s < frame; ++s)
+        line(&e, "rt_set(&l%d, rt_unset());", s);
+    block(&e, body);
+    e.indent--;
+    line(&e, "}");
+    if (e.left) text_printf(&out, "done:\n");
+    if (reductions > 0) {
+        Text list = {0};
+        for (int r = 0; r < reductions; ++r)
+            text_printf(&list, r ? ", l%d" : "l%d", r + 1);
+        line(&e, "rt_chunk_end(loop, chunk, (Value[]){%s});", list.data);
+        memory_free(list.data);
+    } else {
+        line(&e, "rt_chunk_end(loop, chunk, NULL);");
+    }
+    for (int s = 0; s < frame; ++s)
+        line(&e, "rt_free(l%d);", s);
+    text_printf(&out, "}\n\n");
+    text_append(&c->code, &out);
+    memory_free(out.data);
+    names_free(&e.cleanups);
+}
+
+static void parallel_stmt(Emitter *e, ASTNode *node) {
+    Compiler *c = e->c;
+    ASTNode *cells = node->right->right;
+    int reductions = 0;
+    for (ASTNode *n = cells; n != NULL; n = n->right)
+        reductions++;
+    if (reductions > MAX_REDUCTIONS) {
+        line(e, "rt_fatal(\"Too many 'jikota' variables\");");
+        return;
+    }
+    int id = c->chunks++;
+    chunk_function(c, node, id, reductions);
+
+    preload(e, node->right->left);
+    for (ASTNode *n = cells; n != NULL; n = n->right)
+        global_trigger(e, n->left->value);
+    line(e, "if (!rt_aborted) {");
+    e->indent++;
+    Text names = {0}, ops = {0}, targets = {0};
+    for (ASTNode *n = cells; n != NULL; n = n->right) {
+        const char *sep = names.length ? ", " : "";
+        text_printf(&names, "%s", sep);
+        text_literal(&names, n->left->value);
+        text_printf(&ops, "%s%s", sep, strcmp(n->value, "sum") == 0 ? "REDUCE_SUM"
+                                     : strcmp(n->value, "min") == 0 ? "REDUCE_MIN" : "REDUCE_MAX");
+        text_printf(&targets, "%s&g_%d", sep, names_add(&c->globals, n->left->value));
+    }
+    if (reductions > 0) {
+        line(e, "static const char *const names[] = {%s};", names.data);
+        line(e, "static const ReduceOp ops[] = {%s};", ops.data);
+        line(e, "RtParallel loop = {%d, names, ops, 0, 0, 0, 0, NULL, 0};", reductions);
+    } else {
+        line(e, "RtParallel loop = {0, NULL, NULL, 0, 0, 0, 0, NULL, 0};");
+    }
+    int from = expr(e, node->left);
+    int to = expr(e, node->third);
+    line(e, "if (rt_parallel_range(&loop, t%d, t%d)) {", from, to);
+    e->indent++;
+    int checks = 0;
+    private_checks(e, node->right->left, 1 + reductions, &checks);
+    if (reductions > 0)
+        line(e, "%srt_parallel_run(&loop, chunk_%d, (Value *const[]){%s});",
+             checks ? "else " : "", id, targets.data);
+    else
+        line(e, "%srt_parallel_run(&loop, chunk_%d, NULL);", checks ? "else " : "", id);
+    e->indent--;
+    line(e, "}");
+    memory_free(names.data);
+    memory_free(ops.data);
+    memory_free(targets.data);
+    e->indent--;
+    line(e, "}");
+}
+
+// Function definitions an isolate can reach through calls. Which
+// definition a name is bound to is only known as the program runs, so
+// every 'oru' of a called name counts.
+typedef struct {
+    ASTNode **defs;
+    int count;
+    int capacity;
+} Reached;
+
+static void reach(Compiler *c, Reached *r, const char *name) {
+    for (int i = 0; i < c->definition_count; ++i) {
+        ASTNode *def = c->definitions[i];
+        int known = strcmp(def->value, name) != 0;
+        for (int j = 0; j < r->count && !known; ++j)
+            known = r->defs[j] == def;
+        if (known) continue;
+        if (r->count == r->capacity) {
+            r->capacity = r->capacity ? r->capacity * 2 : 8;
+            r->defs = memory_realloc(r->defs, sizeof(ASTNode *) * r->capacity);
+            if (!r->defs) {
+                report_error("Memory allocation failed while compiling", -1);
+                exit(1);
+            }
+        }
+        r->defs[r->count++] = def;
+    }
+}
+
+// Walk a reached body as interpreter.c does before an isolate starts:
+// load the modules defining the functions it calls, and return the first
+// use of a global, which an isolate has none of
+static ASTNode *reach_body(Emitter *e, ASTNode *node, Reached *r) {
+    if (!node) return NULL;
+    if ((node->type == NODE_IDENTIFIER || node->type == NODE_INDEX_ASSIGN) && node->slot < 0)
+        return node;
+    if (node->type == NODE_CALL) {
+        int user = names_find(&e->c->functions, node->value);
+        char defined[32];
+        snprintf(defined, sizeof(defined), "fn_%d", user);
+        if (user >= 0) load_trigger(e, node->value, MODULE_FUNCTION, defined);
+        reach(e->c, r, node->value);
+    }
+    ASTNode *global = reach_body(e, node->left, r);
+    if (!global) global = reach_body(e, node->right, r);
+    if (!global) global = reach_body(e, node->third, r);
+    return global;
+}
+
+static void spawn_stmt(Emitter *e, ASTNode *node) {
+    Compiler *c = e->c;
+    ASTNode *call = node->left;
+    int user = names_find(&c->functions, call->value);
+    int argc = 0;
+    for (ASTNode *a = call->left; a != NULL; a = a->right)
+        argc++;
+    char fn[32];
+    snprintf(fn, sizeof(fn), user >= 0 ? "fn_%d" : "NULL", user);
+    if (user >= 0) load_trigger(e, call->value, MODULE_FUNCTION, fn);
+    Text name = {0};
+    text_literal(&name, call->value);
+    line(e, "if (rt_spawnable(%s, %s, %d)) {", fn, name.data, argc);
+    memory_free(name.data);
+    e->indent++;
+    Reached r = {NULL, 0, 0};
+    reach(c, &r, call->value);
+    size_t before = e->out->length;
+    ASTNode *global = NULL;
+    ASTNode *def = NULL;
+    for (int i = 0; i < r.count && !global; ++i) {
+        // Parameters are the first locals, so only the body is walked
+        def = r.defs[i];
+        global = reach_body(e, def->right, &r);
+    }
+    int loads = e->out->length != before;
+    memory_free(r.defs);
+    if (global) {
+        char text[256];
+        Text msg = {0};
+        snprintf(text, sizeof(text), "Function '%s' cannot use global '%s' in an isolate",
+                 def->value, global->value);
+        text_literal(&msg, text);
+        line(e, "%srt_fatal(%s);", loads ? "if (!rt_aborted) " : "", msg.data);
+        memory_free(msg.data);
+    } else {
+        if (loads) {
+            line(e, "if (!rt_aborted) {");
+            e->indent++;
+        }
+        char args[32];
+        array_name(arguments(e, call->left, &argc, NULL), args, sizeof(args));
+        line(e, "rt_spawn(%s, %s, %d);", fn, args, argc);
+        if (loads) {
+            e->indent--;
+            line(e, "}");
+        }
+    }
+    e->indent--;
+    line(e, "}");
+}
+
+static void stmt(Emitter *e, ASTNode *node) {
+    char ref[32];
+    Compiler *c = e->c;
+    if (node->type == NODE_LAZY_BLOCK || node->type == NODE_HOISTED) {
+        compile_error(c, "Cannot compile a lazily parsed program");
+        return;
+    }
+    if (node->type == NODE_YIELD) {
+        // Not wrapped in a block: the resume label must stay outside it
+        yield_stmt(e, node);
+        return;
+    }
+    line(e, "{");
+    e->indent++;
+    switch (node->type) {
+        case NODE_VAR_DECL: {
+            int t = expr(e, node->left);
+            var_ref(e, node, ref, sizeof(ref));
+            line(e, "rt_set(&%s, t%d);", ref, t);
+            break;
+        }
+        case NODE_INDEX_ASSIGN: {
+            var_ref(e, node, ref, sizeof(ref));
+            if (node->slot < 0) global_trigger(e, node->value);
+            Text name = {0};
+            text_literal(&name, node->value);
+            line(e, "if (rt_index_target(&%s, %s)) {", ref, name.data);
+            memory_free(name.data);
+            e->indent++;
+            int index = expr(e, node->right);
+            int value = expr(e, node->left);
+            line(e, "rt_index_store(&%s, t%d, t%d);", ref, index, value);
+            e->indent--;
+            line(e, "}");
+            break;
+        }
+        case NODE_PRINT_STMT: {
+            line(e, "if (rt_print_allowed()) {");
+            e->indent++;
+            int t = expr(e, node->left);
+            line(e, "rt_print(t%d);", t);
+            e->indent--;
+            line(e, "}");
+            break;
+        }
+        case NODE_IF_STMT: {
+            int t = condition(e, node->left);
+            check_abort(e, node->left);
+            line(e, "if (t%d) {", t);
+            e->indent++;
+            block(e, node->right);
+            e->indent--;
+            if (node->third) {
+                line(e, "} else {");
+                e->indent++;
+                block(e, node->third);
+                e->indent--;
+            }
+            line(e, "}");
+            break;
+        }
+        case NODE_WHILE_STMT:
+            while_stmt(e, node);
+            break;
+        case NODE_FOR_STMT:
+            for_stmt(e, node);
+            break;
+        case NODE_FUNC_DEF: {
+            int id = c->defs++;
+            compile_function(c, node, id);
+            line(e, "rt_define(&fn_%d, &fd_%d);", names_find(&c->functions, node->value), id);
+            break;
+        }
+        case NODE_RETURN:
+            return_stmt(e, node);
+            break;
+        case NODE_PARALLEL_FOR:
+            parallel_stmt(e, node);
+            break;
+        case NODE_SPAWN:
+            spawn_stmt(e, node);
+            break;
+        case NODE_IMPORT: {
+            // The module was found by find_modules(), so this cannot fail
+            Module *m = module_import(node->value, c->file);
+            for (int i = 0; i < c->module_count; ++i) {
+                if (c->modules[i] == m) line(e, "if (!module_%d_state) module_%d_state = 1;", i, i);
+            }
+            break;
+        }
+        default: {
+            int t = expr(e, node);
+            line(e, "rt_free(t%d);", t);
+            break;
+        }
+    }
+    check_abort(e, node);
+    e->indent--;
+    line(e, "}");
+}
+
+// Move the statements of a long top-level block into part functions of
+// their own. Variables there are all globals, so a part needs nothing
+// from the block around it; it returns early after a fatal error, which
+// the caller passes on.
+static void part(Emitter *e, ASTNode *list, int count) {
+    Compiler *c = e->c;
+    int id = c->parts++;
+    Emitter p = {0};
+    Text out = {0};
+    p.c = c;
+    p.out = &out;
+    p.place = IN_MAIN;
+    p.leave = "return;";
+    p.indent = 1;
+    text_printf(&out, "static void part_%d(void) {\n", id);
+    for (int i = 0; i < count; ++i, list = list->right)
+        stmt(&p, list->left);
+    text_printf(&out, "}\n\n");
+    text_append(&c->code, &out);
+    memory_free(out.data);
+    names_free(&p.cleanups);
+    text_printf(&c->head, "static void part_%d(void);\n", id);
+    line(e, "part_%d();", id);
+    line(e, "if (rt_aborted) {");
+    e->indent++;
+    leave(e);
+    e->indent--;
+    line(e, "}");
+}
+
+static void block(Emitter *e, ASTNode *list) {
+    int length = 0;
+    for (ASTNode *n = list; n != NULL; n = n->right)
+        length++;
+    if (e->place == IN_MAIN && length > PART_STATEMENTS) {
+        while (list) {
+            int count = 0;
+            ASTNode *next = list;
+            while (next && count < PART_STATEMENTS) {
+                next = next->right;
+                count++;
+            }
+            part(e, list, count);
+            list = next;
+        }
+        return;
+    }
+    for (ASTNode *n = list; n != NULL; n = n->right) {
+        if (e->place == IN_MAIN) line(e, "rt_safe_point();");
+        stmt(e, n->left);
+    }
+}
+
+// A definition becomes f_<id>, which takes the arguments and runs the
+// body, and the descriptor fd_<id> that 'oru' binds the name to. For a
+// generator f_<id> only sets up the generator, whose body is gen_<id>.
+static void compile_function(Compiler *c, ASTNode *def, int id) {
+    int arity = 0;
+    for (ASTNode *p = def->left; p != NULL; p = p->right)
+        arity++;
+    int frame = def->slot;
+    Text name = {0};
+    text_literal(&name, def->value);
+    text_printf(&c->head, "static Value f_%d(Value *args);\n", id);
+    text_printf(&c->head, "static const RtFunction fd_%d = {%s, %d, %d, f_%d};\n",
+                id, name.data, arity, def->yields, id);
+
+    Emitter e = {0};
+    Text out = {0};
+    e.c = c;
+    e.out = &out;
+    e.indent = 1;
+    if (def->yields) {
+        e.place = IN_GENERATOR;
+        e.leave = "return 0;";
+        e.frame_size = frame;
+        text_printf(&out, "static int gen_%d(RtGenerator *g, Value *frame, Value *out) {\n", id);
+        for (int s = 0; s < frame; ++s) {
+            const char *local = slot_name(def->left, s);
+            if (!local) local = slot_name(def->right, s);
+            line(&e, "// frame[%d]: %s", s, local ? local : "");
+        }
+        line(&e, "(void)frame;");
+        line(&e, "(void)out;");
+        line(&e, "switch (g->resume) {");
+        line(&e, "case 0:;");
+        block(&e, def->right);
+        line(&e, "}");
+        line(&e, "return 0;");
+        text_printf(&out, "}\n\n");
+        text_printf(&out, "static Value f_%d(Value *args) {\n", id);
+        text_printf(&out, "    return rt_generator(%s, gen_%d, %d, %d, args, %d);\n",
+                    name.data, id, e.counters, e.frame_size, arity);
+        text_printf(&out, "}\n\n");
+    } else {
+        e.place = IN_FUNCTION;
+        e.leave = "goto out;";
+        text_printf(&out, "static Value f_%d(Value *args) {\n", id);
+        // The arguments are copied out before anything else runs: a tail
+        // call passes them in a buffer that the next call reuses
+        for (int s = 0; s < frame; ++s) {
+            const char *local = slot_name(def->left, s);
+            if (!local) local = slot_name(def->right, s);
+            if (s < arity)
+                line(&e, "Value l%d = args[%d];  // %s", s, s, local ? local : "");
+            else
+                line(&e, "Value l%d = rt_unset();  // %s", s, local ? local : "");
+        }
+        if (arity == 0) line(&e, "(void)args;");
+        line(&e, "Value result = rt_bool(0);");
+        line(&e, "rt_safe_point();");
+        block(&e, def->right);
+        if (e.left) text_printf(&out, "out:\n");
+        for (int s = 0; s < frame; ++s)
+            line(&e, "rt_free(l%d);", s);
+        line(&e, "return result;");
+        text_printf(&out, "}\n\n");
+    }
+    text_append(&c->code, &out);
+    memory_free(out.data);
+    memory_free(name.data);
+    names_free(&e.cleanups);
+}
+
+// Collect every name defined with 'oru', so calls know which names may
+// refer to a user defined function. The right child is followed in a
+// loop, so long statement chains do not recurse.
+static void collect_functions(Compiler *c, ASTNode *node) {
+    for (; node != NULL; node = node->right) {
+        if (node->type == NODE_FUNC_DEF) {
+            names_add(&c->functions, node->value);
+            c->definitions = memory_realloc(c->definitions,
+                                            sizeof(ASTNode *) * (c->definition_count + 1));
+            if (!c->definitions) {
+                report_error("Memory allocation failed while compiling", -1);
+                exit(1);
+            }
+            c->definitions[c->definition_count++] = node;
+        }
+        collect_functions(c, node->left);
+        collect_functions(c, node->third);
+    }
+}
+
+// Find the modules that node imports, directly or through other modules,
+// and collect their functions. All of them are compiled into the program;
+// each one's top level runs the first time the program uses a name it
+// defines, as in the interpreter.
+static void find_modules(Compiler *c, ASTNode *node, const char *from) {
+    for (; node != NULL && !c->failed; node = node->right) {
+        if (node->type == NODE_IMPORT) {
+            Module *m = module_import(node->value, from);
+            ASTNode *tree = NULL;
+            int known = 0;
+            for (int i = 0; i < c->module_count; ++i)
+                known |= c->modules[i] == m;
+            if (!m || (!known && !module_load(m, &tree))) {
+                c->failed = 1;
+                return;
+            }
+            if (!known) {
+                c->modules = memory_realloc(c->modules, sizeof(Module *) * (c->module_count + 1));
+                c->modules[c->module_count++] = m;
+                types_infer(tree, 1);
+                collect_functions(c, tree);
+                find_modules(c, tree, module_path(m));
+            }
+        }
+        find_modules(c, node->left, from);
+        find_modules(c, node->third, from);
+    }
+}
+
+// The top level of module <id> becomes module_<id>
+static void compile_module(Compiler *c, int id) {
+    ASTNode *tree;
+    module_load(c->modules[id], &tree);
+    Emitter e = {0};
+    Text out = {0};
+    e.c = c;
+    e.out = &out;
+    e.place = IN_MAIN;
+    e.leave = "return;";
+    e.indent = 1;
+    c->file = module_path(c->modules[id]);
+    text_printf(&out, "static void module_%d(void) {\n", id);
+    block(&e, tree);
+    text_printf(&out, "}\n\n");
+    text_append(&c->code, &out);
+    memory_free(out.data);
+    names_free(&e.cleanups);
+}
+
+int compile_to_c(ASTNode *program, const char *source, FILE *out) {
+    Compiler c = {0};
+    types_infer(program, 0);
+    collect_functions(&c, program);
+    find_modules(&c, program, source);
+    for (int i = 0; i < c.module_count && !c.failed; ++i) {
+        text_printf(&c.head, "static int module_%d_state = 0;  // %s\n", i,
+                    module_path(c.modules[i]));
+        text_printf(&c.head, "static void module_%d(void);\n", i);
+    }
+    for (int i = 0; i < c.module_count && !c.failed; ++i)
+        compile_module(&c, i);
+    c.file = source;
+
+    Emitter e = {0};
+    Text main_code = {0};
+    e.c = &c;
+    e.out = &main_code;
+    e.place = IN_MAIN;
+    e.leave = "goto out;";
+    e.indent = 1;
+    if (!c.failed) block(&e, program);
+    names_free(&e.cleanups);
+
+    if (!c.failed) {
+        fprintf(out, "// Compiled by igbo from %s\n", source);
+        fprintf(out, "#include \"runtime.h\"\n\n");
+        for (int i = 0; i < c.globals.count; ++i)
+            fprintf(out, "static Value g_%d = {VAL_UNSET, {0}};  // %s\n", i, c.globals.items[i]);
+        if (c.globals.count > 0) {
+            fprintf(out, "static Value *const globals[] = {");
+            for (int i = 0; i < c.globals.count; ++i)
+                fprintf(out, i ? ", &g_%d" : "&g_%d", i);
+            fprintf(out, "};\n");
+        }
+        for (int i = 0; i < c.functions.count; ++i)
+            fprintf(out, "static const RtFunction *fn_%d = NULL;  // %s\n", i, c.functions.items[i]);
+        for (int i = 0; i < c.builtins.count; ++i)
+            fprintf(out, "static const Builtin *bi_%d;  // %s\n", i, c.builtins.items[i]);
+        fprintf(out, "\n%s\n", c.head.length ? c.head.data : "");
+        if (c.code.length) fputs(c.code.data, out);
+        fprintf(out, "int main(void) {\n");
+        if (c.globals.count > 0)
+            fprintf(out, "    rt_start(globals, %d);\n", c.globals.count);
+        else
+            fprintf(out, "    rt_start(NULL, 0);\n");
+        for (int i = 0; i < c.builtins.count; ++i) {
+            Text name = {0};
+            text_literal(&name, c.builtins.items[i]);
+            fprintf(out, "    bi_%d = find_builtin(%s);\n", i, name.data);
+            memory_free(name.data);
+        }
+        if (main_code.length) fputs(main_code.data, out);
+        if (e.left) fprintf(out, "out:\n");
+        fprintf(out, "    return rt_finish();\n}\n");
+    }
+    memory_free(main_code.data);
+    memory_free(c.head.data);
+    memory_free(c.code.data);
+    names_free(&c.globals);
+    names_free(&c.functions);
+    names_free(&c.builtins);
+    memory_free(c.definitions);
+    memory_free(c.modules);
+    if (ferror(out)) {
+        report_error("Could not write the compiled program", -1);
+        return 1;
+    }
+    return c.failed;
+}
+
+// Run argv and wait for it. Returns its exit status, or -1 if it could
+// not be run.
+static int run_command(char *const argv[]) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int compile_executable(ASTNode *program, const char *source, const char *output) {
+    const char *home = getenv("IGBO_HOME");
+    if (!home || !*home) home = IGBO_HOME;
+    size_t length = strlen(home) + 64;
+    char *include = memory_alloc(length);
+    char *library = memory_alloc(length);
+    const char *tmpdir = getenv("TMPDIR");
+    if (!tmpdir || !*tmpdir) tmpdir = "/tmp";
+    char *c_path = memory_alloc(strlen(tmpdir) + 32);
+    if (!include || !library || !c_path) {
+        report_error("Memory allocation failed while compiling", -1);
+        exit(1);
+    }
+    snprintf(include, length, "-I%s/src", home);
+    snprintf(library, length, "%s/build/runtime/libigbo.a", home);
+    sprintf(c_path, "%s/igbo-XXXXXX", tmpdir);
+
+    int status = 1;
+    int fd = -1;
+    FILE *f = NULL;
+    if (access(library, R_OK) != 0) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Runtime library %s not found (run 'make' in %s)", library, home);
+        report_error(msg, -1);
+    } else if ((fd = mkstemp(c_path)) < 0 || !(f = fdopen(fd, "w"))) {
+        report_error("Could not create a temporary file for the compiled program", -1);
+        if (fd >= 0) {
+            close(fd);
+            unlink(c_path);
+        }
+    } else {
+        int failed = compile_to_c(program, source, f);
+        if (fclose(f) != 0) failed = 1;
+        if (!failed) {
+            const char *cc = getenv("CC");
+            if (!cc || !*cc) cc = "gcc";
+            char *argv[] = {(char *)cc, "-std=c99", "-O2", "-pthread", include,
+                            "-o", (char *)output, "-x", "c", c_path, "-x", "none",
+                            library, "-lm", NULL};
+            int result = run_command(argv);
+            if (result == 0) {
+                status = 0;
+            } else {
+                char msg[160];
+                snprintf(msg, sizeof(msg), result < 0 ? "Could not run %s" : "%s failed",
+                         cc);
+                report_error(msg, -1);
+            }
+        }
+        unlink(c_path);
+    }
+    memory_free(include);
+    memory_free(library);
+    memory_free(c_path);
+    return status;
+}
@@ -0,0 +1,29 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stdio.h>
+#include "ast.h"
+
+// Ahead-of-time compilation of a program to C.
+//
+// The syntax tree is translated to one C file that links against the
+// runtime library (runtime.h, built by 'make' into build/runtime). Global
+// variables become C globals, the variables of a function C locals, and
+// user defined functions C functions; arithmetic on numbers is done inline
+// and falls back to the interpreter's operators for anything else.
+// Generators become resumable C functions and parallel loops chunk
+// functions run on the thread pool. The compiled program prints exactly
+// what the interpreter prints for the same script.
+
+// Write the C translation of program to out. 'source' is the script's
+// path, named in a comment. Returns 0 on success, or reports the problem
+// and returns 1.
+int compile_to_c(ASTNode *program, const char *source, FILE *out);
+
+// Compile program to the executable 'output' with the system C compiler
+// ($CC, or gcc). The runtime library and headers are looked for under
+// $IGBO_HOME, or the source tree igbo was built in. Returns 0 on success,
+// or reports the problem and returns 1.
+int compile_executable(ASTNode *program, const char *source, const char *output);
+
+#endif // COMPILER_H
@@ -0,0 +1,82 @@
+#define _POSIX_C_SOURCE 200809L
+#include "exec.h"
+#include "gc.h"
+#include "generator.h"
+#include "list.h"
+#include "map.h"
+#include "util.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+const char EXEC_PARALLEL_LOOP[] = "'mgbe ngwa'";
+const char EXEC_ISOLATE[] = "an isolate";
+THREAD_LOCAL const char *exec_worker = NULL;
+
+static THREAD_LOCAL uintptr_t c_stack_base = 0;
+static THREAD_LOCAL size_t c_stack_budget = 0;
+
+// Parallel loops are numbered so that what they share can be marked with
+// a stamp that needs no clearing
+static unsigned parallel_epoch = 0;
+
+size_t exec_stack_size(void) {
+    struct rlimit limit;
+    size_t size = 8u << 20;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        size = (size_t)limit.rlim_cur;
+    if (size > (256u << 20)) size = 256u << 20;
+    return size;
+}
+
+void exec_stack_guard(void) {
+    char here;
+    c_stack_base = (uintptr_t)&here;
+    c_stack_budget = exec_stack_size() / 4 * 3;
+}
+
+int exec_check_depth(int depth) {
+    char here;
+    uintptr_t addr = (uintptr_t)&here;
+    size_t c_stack_used = addr < c_stack_base ? c_stack_base - addr : addr - c_stack_base;
+    if (depth < MAX_CALL_DEPTH && c_stack_used <= c_stack_budget) return 1;
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Maximum recursion depth exceeded (%d calls)", depth);
+    report_error(msg, -1);
+    return 0;
+}
+
+void exec_share_begin(void) {
+    parallel_epoch++;
+}
+
+void exec_share(Value v) {
+    gc_mark_shared(v, parallel_epoch);
+}
+
+int exec_is_shared(Value v) {
+    if (exec_worker != EXEC_PARALLEL_LOOP) return 0;
+    if (v.type == VAL_LIST) return v.as.list->gc.shared == parallel_epoch;
+    if (v.type == VAL_MAP) return v.as.map->gc.shared == parallel_epoch;
+    if (v.type == VAL_GENERATOR) return v.as.generator->gc.shared == parallel_epoch;
+    return 0;
+}
+
+double exec_reduce(ReduceOp op, double a, double b) {
+    switch (op) {
+        case REDUCE_SUM: return a + b;
+        case REDUCE_MIN: return b < a ? b : a;
+        case REDUCE_MAX: return b > a ? b : a;
+    }
+    return a;
+}
+
+double exec_reduce_identity(ReduceOp op) {
+    switch (op) {
+        case REDUCE_SUM: return 0;
+        case REDUCE_MIN: return HUGE_VAL;
+        case REDUCE_MAX: return -HUGE_VAL;
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include "parallel.h"
+#include "value.h"
+#include <stddef.h>
+
+// Execution state and checks shared by the interpreter and by programs
+// compiled to C (see compiler.h), so that both stop at the same limits
+// and treat parallel loops and isolates alike.
+
+// A 'mgbe' loop that runs more iterations than this is assumed to be stuck
+#define MAX_WHILE_ITERATIONS 10000
+
+// Nested calls allowed on one thread, unless the C stack runs short first
+#define MAX_CALL_DEPTH 5000
+
+// The range of a parallel loop is cut into at most this many chunks
+#define PARALLEL_CHUNKS 256
+
+// What the calling thread is running, for the checks that depend on it:
+// NULL for the program itself, otherwise EXEC_PARALLEL_LOOP or
+// EXEC_ISOLATE, which are also how error messages name it.
+extern const char EXEC_PARALLEL_LOOP[];
+extern const char EXEC_ISOLATE[];
+extern THREAD_LOCAL const char *exec_worker;
+
+// The stack size limit, capped at 256MB. Worker threads and isolates get
+// stacks of this size so scripts recurse equally deep everywhere.
+size_t exec_stack_size(void);
+
+// Guard the calling thread's C stack from here on: three quarters of the
+// stack size limit may be used below this point.
+void exec_stack_guard(void);
+
+// Whether one more call may start on top of 'depth' running ones. Reports
+// an error and returns 0 when it would be too deep.
+int exec_check_depth(int depth);
+
+// Lists, maps and generators reachable from a global while a parallel
+// loop runs are shared by its iterations, which must not change them.
+// exec_share_begin() starts a new loop; every global is then passed to
+// exec_share(). exec_is_shared() tells whether v may not be changed by the
+// calling thread.
+void exec_share_begin(void);
+void exec_share(Value v);
+int exec_is_shared(Value v);
+
+// Reductions of a parallel loop ('jikota sum s, min m, max x')
+typedef enum { REDUCE_SUM, REDUCE_MIN, REDUCE_MAX } ReduceOp;
+
+double exec_reduce(ReduceOp op, double a, double b);
+double exec_reduce_identity(ReduceOp op);
+
+#endif // EXEC_H
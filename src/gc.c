@@ -0,0 +1,550 @@
+#define _POSIX_C_SOURCE 200809L
+#include "gc.h"
+#include "generator.h"
+#include "isolate.h"
+#include "list.h"
+#include "map.h"
+#include "memory.h"
+#include "parallel.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Slabs are cut into cells of one size class. Free cells are kept on
+// per-thread lists; a thread that runs out takes the cells other threads
+// gave back (the depot) before cutting a new slab.
+#define GC_CLASS_SIZE 16
+#define GC_CLASSES 16
+#define GC_SLAB_SIZE 65536
+
+// A collection starts once a thread has buffered this many possible
+// roots. The limit doubles, up to GC_MAX_ROOTS, while collections find
+// little garbage, so a large live structure that keeps getting buffered
+// is not traced over and over.
+#define GC_MIN_ROOTS 4096
+#define GC_MAX_ROOTS (1u << 20)
+
+// BLACK: in use (or freed while buffered). GRAY: being trial-deleted.
+// WHITE: garbage. PURPLE: possible root of a garbage cycle.
+enum { GC_BLACK, GC_GRAY, GC_WHITE, GC_PURPLE };
+
+typedef struct FreeCell {
+    struct FreeCell *next;
+} FreeCell;
+
+typedef struct RootBuffer {
+    GcObject **items;
+    size_t count;
+    size_t capacity;
+    struct RootBuffer *next;
+} RootBuffer;
+
+volatile int gc_pending = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static THREAD_LOCAL FreeCell *free_cells[GC_CLASSES];
+static FreeCell *depot[GC_CLASSES];
+static void **slabs = NULL;
+static size_t slab_count = 0;
+static size_t slab_capacity = 0;
+
+// Every thread that buffers a possible root gets its own buffer; all of
+// them are drained by the collector, which only runs between parallel
+// loops.
+static THREAD_LOCAL RootBuffer *roots = NULL;
+static RootBuffer *all_roots = NULL;
+static size_t root_limit = GC_MIN_ROOTS;
+
+// Objects whose last reference is gone, waiting for gc_release() to free
+// them, and whether a release further up the C stack is freeing them
+static THREAD_LOCAL GcObject **pending = NULL;
+static THREAD_LOCAL size_t pending_count = 0;
+static THREAD_LOCAL size_t pending_capacity = 0;
+static THREAD_LOCAL int releasing = 0;
+
+// Collector work lists, used on the main thread only
+static GcObject **work = NULL;
+static size_t work_count = 0;
+static size_t work_capacity = 0;
+static GcObject **garbage = NULL;
+static size_t garbage_count = 0;
+static size_t garbage_capacity = 0;
+
+// Statistics
+static size_t collections = 0;
+static size_t cycle_frees = 0;
+static uint64_t pause_total = 0;   // nanoseconds
+static uint64_t pause_max = 0;
+static long live = 0;
+static long live_peak = 0;
+
+static void *checked_alloc(void *ptr, size_t size) {
+    void *tmp = memory_realloc(ptr, size);
+    if (!tmp) {
+        report_error("Memory allocation failed for heap", -1);
+        exit(1);
+    }
+    return tmp;
+}
+
+// Take the depot's cells for class c, or cut a new slab into cells
+static FreeCell *refill(size_t c) {
+    size_t size = (c + 1) * GC_CLASS_SIZE;
+    pthread_mutex_lock(&lock);
+    FreeCell *cells = depot[c];
+    depot[c] = NULL;
+    if (!cells) {
+        if (slab_count == slab_capacity) {
+            slab_capacity = slab_capacity ? slab_capacity * 2 : 16;
+            slabs = checked_alloc(slabs, sizeof(void *) * slab_capacity);
+        }
+        char *slab = checked_alloc(NULL, GC_SLAB_SIZE);
+        slabs[slab_count++] = slab;
+        for (size_t at = GC_SLAB_SIZE / size * size; at > 0; at -= size) {
+            FreeCell *cell = (FreeCell *)(slab + at - size);
+            cell->next = cells;
+            cells = cell;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return cells;
+}
+
+void *gc_alloc(size_t size) {
+    if (size > GC_CLASSES * GC_CLASS_SIZE) return checked_alloc(NULL, size);
+    size_t c = (size - 1) / GC_CLASS_SIZE;
+    FreeCell *cell = free_cells[c];
+    if (!cell) cell = refill(c);
+    free_cells[c] = cell->next;
+    return cell;
+}
+
+void gc_free(void *ptr, size_t size) {
+    if (size > GC_CLASSES * GC_CLASS_SIZE) {
+        memory_free(ptr);
+        return;
+    }
+    size_t c = (size - 1) / GC_CLASS_SIZE;
+    FreeCell *cell = ptr;
+    cell->next = free_cells[c];
+    free_cells[c] = cell;
+}
+
+void gc_thread_exit(void) {
+    memory_free(pending);
+    pending = NULL;
+    pending_capacity = 0;
+    pthread_mutex_lock(&lock);
+    for (size_t c = 0; c < GC_CLASSES; ++c) {
+        FreeCell *cell = free_cells[c];
+        if (!cell) continue;
+        while (cell->next) cell = cell->next;
+        cell->next = depot[c];
+        depot[c] = free_cells[c];
+        free_cells[c] = NULL;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static size_t object_size(GcObject *obj) {
+    switch ((GcKind)obj->kind) {
+        case GC_LIST: return sizeof(List);
+        case GC_MAP: return sizeof(Map);
+        case GC_GENERATOR: return sizeof(Generator);
+        case GC_CHANNEL: return sizeof(Channel);
+    }
+    return 0;
+}
+
+static void count_live(long delta) {
+    if (parallel_active) {
+        long now = __atomic_add_fetch(&live, delta, __ATOMIC_RELAXED);
+        if (now > __atomic_load_n(&live_peak, __ATOMIC_RELAXED))
+            __atomic_store_n(&live_peak, now, __ATOMIC_RELAXED);
+    } else {
+        live += delta;
+        if (live > live_peak) live_peak = live;
+    }
+}
+
+void gc_init(GcObject *obj, GcKind kind) {
+    obj->refcount = 1;
+    obj->shared = 0;
+    obj->kind = (unsigned char)kind;
+    obj->color = GC_BLACK;
+    obj->buffered = 0;
+    count_live(1);
+}
+
+static void free_object(GcObject *obj) {
+    gc_free(obj, object_size(obj));
+    count_live(-1);
+}
+
+// Free what obj holds, releasing nested containers, or with 'drop' only
+// forgetting them because the collector frees them itself
+static void destroy(GcObject *obj, int drop) {
+    switch ((GcKind)obj->kind) {
+        case GC_LIST: list_destroy((List *)obj, drop); break;
+        case GC_MAP: map_destroy((Map *)obj, drop); break;
+        case GC_GENERATOR: generator_destroy((Generator *)obj, drop); break;
+        case GC_CHANNEL: channel_destroy((Channel *)obj, drop); break;
+    }
+}
+
+// Objects that cannot hold a container can never be part of a cycle, so
+// they are not buffered: numeric lists and native generators without a
+// frame.
+static int may_cycle(GcObject *obj) {
+    switch ((GcKind)obj->kind) {
+        case GC_LIST: return ((List *)obj)->boxed;
+        case GC_MAP: return 1;
+        case GC_GENERATOR: return ((Generator *)obj)->frame != NULL;
+        case GC_CHANNEL: return 1;
+    }
+    return 0;
+}
+
+// The calling thread's root buffer, registered on first use
+static RootBuffer *root_buffer(void) {
+    if (!roots) {
+        RootBuffer *b = checked_alloc(NULL, sizeof(RootBuffer));
+        b->items = NULL;
+        b->count = 0;
+        b->capacity = 0;
+        pthread_mutex_lock(&lock);
+        b->next = all_roots;
+        all_roots = b;
+        pthread_mutex_unlock(&lock);
+        roots = b;
+    }
+    return roots;
+}
+
+static void push_root(RootBuffer *b, GcObject *obj) {
+    if (b->count == b->capacity) {
+        b->capacity = b->capacity ? b->capacity * 2 : 256;
+        b->items = checked_alloc(b->items, sizeof(GcObject *) * b->capacity);
+    }
+    b->items[b->count++] = obj;
+}
+
+// Buffer obj as a possible root of a garbage cycle
+static void possible_root(GcObject *obj) {
+    if (!may_cycle(obj)) return;
+    if (parallel_active) {
+        // Other threads may be releasing the same object
+        __atomic_store_n(&obj->color, GC_PURPLE, __ATOMIC_RELAXED);
+        if (__atomic_exchange_n(&obj->buffered, 1, __ATOMIC_RELAXED)) return;
+    } else {
+        if (obj->color == GC_PURPLE) return;
+        obj->color = GC_PURPLE;
+        if (obj->buffered) return;
+        obj->buffered = 1;
+    }
+    RootBuffer *b = root_buffer();
+    push_root(b, obj);
+    if (b->count >= root_limit) __atomic_store_n(&gc_pending, 1, __ATOMIC_RELAXED);
+}
+
+void gc_retain(GcObject *obj) {
+    if (parallel_active)
+        __atomic_add_fetch(&obj->refcount, 1, __ATOMIC_RELAXED);
+    else
+        obj->refcount++;
+}
+
+void gc_release(GcObject *obj) {
+    if (parallel_active) {
+        // Buffer before giving up the reference: afterwards another thread
+        // may free the object. The last reference needs no buffering.
+        if (__atomic_load_n(&obj->refcount, __ATOMIC_RELAXED) > 1)
+            possible_root(obj);
+        if (__atomic_sub_fetch(&obj->refcount, 1, __ATOMIC_ACQ_REL) > 0) return;
+    } else if (--obj->refcount > 0) {
+        possible_root(obj);
+        return;
+    }
+    // Freeing a deeply nested structure must not recurse once per level,
+    // so the objects whose last reference went away are stacked, and only
+    // the outermost release frees them, one at a time.
+    if (pending_count == pending_capacity) {
+        pending_capacity = pending_capacity ? pending_capacity * 2 : 64;
+        pending = checked_alloc(pending, sizeof(GcObject *) * pending_capacity);
+    }
+    pending[pending_count++] = obj;
+    if (releasing) return;
+    releasing = 1;
+    while (pending_count > 0) {
+        GcObject *dead = pending[--pending_count];
+        destroy(dead, 0);
+        // A buffered object stays allocated until the collector takes it
+        // out of the buffer
+        dead->color = GC_BLACK;
+        if (!dead->buffered) free_object(dead);
+    }
+    releasing = 0;
+}
+
+// Collection
+
+static void work_push(GcObject *obj) {
+    if (work_count == work_capacity) {
+        work_capacity = work_capacity ? work_capacity * 2 : 256;
+        work = checked_alloc(work, sizeof(GcObject *) * work_capacity);
+    }
+    work[work_count++] = obj;
+}
+
+static GcObject *value_object(Value v) {
+    switch (v.type) {
+        case VAL_LIST: return &v.as.list->gc;
+        case VAL_MAP: return &v.as.map->gc;
+        case VAL_GENERATOR: return &v.as.generator->gc;
+        case VAL_CHANNEL: return &v.as.channel->gc;
+        default: return NULL;
+    }
+}
+
+// The phases below differ only in what they do with each child, so the
+// walk over an object's children is written once, with the phase as a
+// parameter.
+typedef enum { VISIT_MARK_GRAY, VISIT_SCAN, VISIT_SCAN_BLACK, VISIT_COLLECT_WHITE, VISIT_SHARE } Visit;
+
+// The parallel loop stamp gc_mark_shared() is handing out
+static unsigned share_epoch = 0;
+
+static void visit(GcObject *child, Visit phase) {
+    switch (phase) {
+        case VISIT_MARK_GRAY:
+            // Take away the reference held by the parent
+            child->refcount--;
+            if (child->color != GC_GRAY) {
+                child->color = GC_GRAY;
+                work_push(child);
+            }
+            break;
+        case VISIT_SCAN:
+            work_push(child);
+            break;
+        case VISIT_SCAN_BLACK:
+            // Put it back: the parent is in use after all
+            child->refcount++;
+            if (child->color != GC_BLACK) {
+                child->color = GC_BLACK;
+                work_push(child);
+            }
+            break;
+        case VISIT_COLLECT_WHITE:
+            if (child->color == GC_WHITE && !child->buffered) {
+                child->color = GC_BLACK;
+                work_push(child);
+            }
+            break;
+        case VISIT_SHARE:
+            // Values waiting in a channel belong to no iteration
+            if (child->kind != GC_CHANNEL && child->shared != share_epoch) {
+                child->shared = share_epoch;
+                work_push(child);
+            }
+            break;
+    }
+}
+
+static void visit_value(Value v, Visit phase) {
+    GcObject *child = value_object(v);
+    if (child) visit(child, phase);
+}
+
+static void visit_children(GcObject *obj, Visit phase) {
+    switch ((GcKind)obj->kind) {
+        case GC_LIST: {
+            List *list = (List *)obj;
+            if (!list->boxed) return;
+            for (size_t i = 0; i < list->count; ++i)
+                visit_value(list->items[i], phase);
+            break;
+        }
+        case GC_MAP: {
+            Map *map = (Map *)obj;
+            for (size_t i = 0; i < map->capacity; ++i) {
+                if (map->entries[i].distance)
+                    visit_value(map->entries[i].value, phase);
+            }
+            break;
+        }
+        case GC_GENERATOR: {
+            Generator *gen = (Generator *)obj;
+            if (gen->frame) {
+                for (int i = 0; i < gen->frame_size; ++i)
+                    visit_value(gen->frame[i], phase);
+            }
+            for (int i = 0; i < gen->depth; ++i)
+                visit_value(gen->cursors[i].iterable, phase);
+            break;
+        }
+        case GC_CHANNEL: {
+            // The collector only runs while no isolate does, so nothing is
+            // being sent or received
+            Channel *c = (Channel *)obj;
+            for (size_t pos = c->tail; pos != c->head; ++pos)
+                visit_value(c->cells[pos & c->mask].value, phase);
+            break;
+        }
+    }
+}
+
+// Process the work list down to 'base', visiting the children of each
+// object taken from it
+static void drain(size_t base, Visit phase) {
+    while (work_count > base) {
+        GcObject *obj = work[--work_count];
+        if (phase == VISIT_SCAN) {
+            if (obj->color != GC_GRAY) continue;
+            if (obj->refcount > 0) {
+                // Referenced from outside the group: it and everything it
+                // reaches is in use
+                size_t top = work_count;
+                obj->color = GC_BLACK;
+                work_push(obj);
+                drain(top, VISIT_SCAN_BLACK);
+                continue;
+            }
+            obj->color = GC_WHITE;
+        } else if (phase == VISIT_COLLECT_WHITE) {
+            if (garbage_count == garbage_capacity) {
+                garbage_capacity = garbage_capacity ? garbage_capacity * 2 : 256;
+                garbage = checked_alloc(garbage, sizeof(GcObject *) * garbage_capacity);
+            }
+            garbage[garbage_count++] = obj;
+        }
+        visit_children(obj, phase);
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void gc_collect(void) {
+    uint64_t start = now_ns();
+    gc_pending = 0;
+
+    // Gather every thread's possible roots into this thread's buffer
+    RootBuffer *mine = root_buffer();
+    for (RootBuffer *b = all_roots; b; b = b->next) {
+        if (b == mine) continue;
+        for (size_t i = 0; i < b->count; ++i)
+            push_root(mine, b->items[i]);
+        b->count = 0;
+    }
+
+    // Trial-delete the references inside the subgraph below each purple
+    // root. Roots that were retained since, or freed, leave the buffer.
+    size_t kept = 0;
+    for (size_t i = 0; i < mine->count; ++i) {
+        GcObject *obj = mine->items[i];
+        if (obj->color == GC_PURPLE) {
+            obj->color = GC_GRAY;
+            work_push(obj);
+            drain(0, VISIT_MARK_GRAY);
+            mine->items[kept++] = obj;
+        } else {
+            obj->buffered = 0;
+            if (obj->color == GC_BLACK && obj->refcount == 0) free_object(obj);
+        }
+    }
+    mine->count = kept;
+
+    // Whatever still has references left is in use; the rest is garbage
+    for (size_t i = 0; i < kept; ++i) {
+        work_push(mine->items[i]);
+        drain(0, VISIT_SCAN);
+    }
+    for (size_t i = 0; i < kept; ++i)
+        mine->items[i]->buffered = 0;
+    for (size_t i = 0; i < kept; ++i) {
+        GcObject *obj = mine->items[i];
+        if (obj->color == GC_WHITE) {
+            obj->color = GC_BLACK;
+            work_push(obj);
+            drain(0, VISIT_COLLECT_WHITE);
+        }
+    }
+    mine->count = 0;
+
+    // The references between garbage objects are not released: every one
+    // of them is freed here. Freeing may release objects outside the
+    // garbage and buffer new roots, which is why the buffer is empty by now.
+    size_t freed = garbage_count;
+    for (size_t i = 0; i < freed; ++i)
+        destroy(garbage[i], 1);
+    for (size_t i = 0; i < freed; ++i)
+        free_object(garbage[i]);
+    garbage_count = 0;
+
+    // Mostly live roots: wait for more before tracing them again
+    if (freed * 4 < kept)
+        root_limit = root_limit * 2 < GC_MAX_ROOTS ? root_limit * 2 : GC_MAX_ROOTS;
+    else
+        root_limit = GC_MIN_ROOTS;
+
+    uint64_t pause = now_ns() - start;
+    collections++;
+    cycle_frees += freed;
+    pause_total += pause;
+    if (pause > pause_max) pause_max = pause;
+}
+
+void gc_mark_shared(Value v, unsigned epoch) {
+    GcObject *obj = value_object(v);
+    if (!obj) return;
+    share_epoch = epoch;
+    visit(obj, VISIT_SHARE);
+    drain(0, VISIT_SHARE);
+}
+
+void gc_print_stats(void) {
+    fprintf(stderr, "gc: %zu collections, %zu objects freed in cycles\n",
+            collections, cycle_frees);
+    fprintf(stderr, "gc: pauses %.3f ms total, %.3f ms max\n",
+            pause_total / 1e6, pause_max / 1e6);
+    fprintf(stderr, "gc: %ld live objects, peak %ld, %zu KB of slabs\n",
+            live, live_peak, slab_count * (GC_SLAB_SIZE / 1024));
+}
+
+void gc_shutdown(void) {
+    for (size_t i = 0; i < slab_count; ++i)
+        memory_free(slabs[i]);
+    memory_free(slabs);
+    slabs = NULL;
+    slab_count = 0;
+    slab_capacity = 0;
+    for (size_t c = 0; c < GC_CLASSES; ++c) {
+        free_cells[c] = NULL;
+        depot[c] = NULL;
+    }
+    while (all_roots) {
+        RootBuffer *next = all_roots->next;
+        memory_free(all_roots->items);
+        memory_free(all_roots);
+        all_roots = next;
+    }
+    roots = NULL;
+    memory_free(pending);
+    pending = NULL;
+    pending_capacity = 0;
+    memory_free(work);
+    work = NULL;
+    work_count = work_capacity = 0;
+    memory_free(garbage);
+    garbage = NULL;
+    garbage_count = garbage_capacity = 0;
+    root_limit = GC_MIN_ROOTS;
+}
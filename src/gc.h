@@ -0,0 +1,67 @@
+#ifndef GC_H
+#define GC_H
+
+#include "value.h"
+#include <stddef.h>
+
+// Managed heap for lists, maps, generators and channels. Each of them
+// starts with a GcObject header and is freed as soon as its reference
+// count drops to zero. Reference counting alone cannot free a group of containers that
+// refer to each other, so a container whose count drops without reaching
+// zero is remembered as a possible root of such a cycle, and once enough
+// of them have piled up the interpreter runs a cycle collection at the
+// next statement (synchronous trial deletion, as described by Bacon and
+// Rajan: subtract the references that come from inside the group and free
+// whatever is left with none).
+//
+// The structs themselves come from per-thread free lists carved out of
+// 64KB slabs, one list per 16 byte size class.
+
+typedef enum { GC_LIST, GC_MAP, GC_GENERATOR, GC_CHANNEL } GcKind;
+
+typedef struct GcObject {
+    int refcount;
+    unsigned shared;         // last parallel loop that found it reachable from a global
+    unsigned char kind;      // GcKind
+    unsigned char color;     // collector state
+    unsigned char buffered;  // in the buffer of possible cycle roots
+} GcObject;
+
+// Set by any thread once enough possible roots are buffered; checked by
+// the interpreter between statements.
+extern volatile int gc_pending;
+
+// Allocate and free from the slab size classes. Sizes above the largest
+// class go to memory_alloc().
+void *gc_alloc(size_t size);
+void gc_free(void *ptr, size_t size);
+
+// Fill in the header of a new object with a reference count of one.
+void gc_init(GcObject *obj, GcKind kind);
+
+// Reference counting. Counts are updated atomically while a parallel loop
+// runs. Releasing the last reference frees the object and releases
+// everything it holds.
+void gc_retain(GcObject *obj);
+void gc_release(GcObject *obj);
+
+// Free every unreachable cycle among the buffered possible roots. Must
+// not be called while a parallel loop runs.
+void gc_collect(void);
+
+// Stamp the list, map or generator v and everything reachable from it
+// with 'epoch', the number of the parallel loop about to start. Main
+// thread only, while no parallel loop runs.
+void gc_mark_shared(Value v, unsigned epoch);
+
+// Hand the calling worker thread's free lists back for reuse by others.
+void gc_thread_exit(void);
+
+// Print collection statistics to stderr.
+void gc_print_stats(void);
+
+// Release all slabs once the program has finished. Objects still alive
+// at that point are freed with them.
+void gc_shutdown(void);
+
+#endif // GC_H
@@ -0,0 +1,118 @@
+#include "generator.h"
+#include "memory.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+Generator *generator_new(ASTNode *def, Value *args, int argc) {
+    Generator *gen = gc_alloc(sizeof(Generator));
+    size_t size = (size_t)def->slot;
+    Value *frame = memory_alloc(sizeof(Value) * (size ? size : 1));
+    if (!frame) {
+        report_error("Memory allocation failed for generator", -1);
+        exit(1);
+    }
+    memcpy(frame, args, sizeof(Value) * argc);
+    for (size_t i = (size_t)argc; i < size; ++i)
+        frame[i].type = VAL_UNSET;
+    gc_init(&gen->gc, GC_GENERATOR);
+    gen->state = GEN_READY;
+    gen->name = def->value;
+    gen->def = def;
+    gen->frame = frame;
+    gen->frame_size = def->slot;
+    gen->cursors = NULL;
+    gen->depth = 0;
+    gen->capacity = 0;
+    gen->native_next = NULL;
+    gen->native_free = NULL;
+    gen->native = NULL;
+    generator_push(gen, CURSOR_BLOCK, NULL, def->right);
+    return gen;
+}
+
+Generator *generator_new_native(const char *name, NativeNext next,
+                                void (*free_state)(void *state), void *state) {
+    Generator *gen = gc_alloc(sizeof(Generator));
+    gc_init(&gen->gc, GC_GENERATOR);
+    gen->state = GEN_READY;
+    gen->name = name;
+    gen->def = NULL;
+    gen->frame = NULL;
+    gen->frame_size = 0;
+    gen->cursors = NULL;
+    gen->depth = 0;
+    gen->capacity = 0;
+    gen->native_next = next;
+    gen->native_free = free_state;
+    gen->native = state;
+    return gen;
+}
+
+void generator_native_frame(Generator *gen, int size, Value *args, int argc) {
+    Value *frame = memory_alloc(sizeof(Value) * (size ? size : 1));
+    if (!frame) {
+        report_error("Memory allocation failed for generator", -1);
+        exit(1);
+    }
+    if (argc > 0) memcpy(frame, args, sizeof(Value) * argc);
+    for (int i = argc; i < size; ++i)
+        frame[i].type = VAL_UNSET;
+    gen->frame = frame;
+    gen->frame_size = size;
+}
+
+void generator_retain(Generator *gen) {
+    gc_retain(&gen->gc);
+}
+
+void generator_release(Generator *gen) {
+    gc_release(&gen->gc);
+}
+
+Cursor *generator_push(Generator *gen, CursorKind kind, ASTNode *node, ASTNode *block) {
+    if (gen->depth == gen->capacity) {
+        gen->capacity = gen->capacity ? gen->capacity * 2 : 4;
+        gen->cursors = memory_realloc(gen->cursors, sizeof(Cursor) * gen->capacity);
+        if (!gen->cursors) {
+            report_error("Memory allocation failed for generator", -1);
+            exit(1);
+        }
+    }
+    Cursor *c = &gen->cursors[gen->depth++];
+    c->kind = kind;
+    c->node = node;
+    c->next = block;
+    c->iterations = 0;
+    c->iterable.type = VAL_UNSET;
+    c->index = 0;
+    return c;
+}
+
+void generator_pop(Generator *gen) {
+    value_free(gen->cursors[--gen->depth].iterable);
+}
+
+void generator_finish(Generator *gen) {
+    generator_destroy(gen, 0);
+    gen->state = GEN_DONE;
+}
+
+void generator_destroy(Generator *gen, int drop) {
+    void (*discard)(Value) = drop ? value_drop : value_free;
+    while (gen->depth > 0)
+        discard(gen->cursors[--gen->depth].iterable);
+    memory_free(gen->cursors);
+    gen->cursors = NULL;
+    gen->capacity = 0;
+    if (gen->frame) {
+        for (int i = 0; i < gen->frame_size; ++i)
+            discard(gen->frame[i]);
+        memory_free(gen->frame);
+        gen->frame = NULL;
+    }
+    if (gen->native) {
+        gen->native_free(gen->native);
+        gen->native = NULL;
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "ast.h"
+#include "gc.h"
+#include "value.h"
+
+// A generator is a call of a function whose body contains 'nye'. It does
+// not run on the C stack between values: its locals live in a heap frame
+// and its position in the body is a stack of cursors, one per block being
+// run, from the function body inwards. Resuming it (interpreter.c) picks up
+// at the innermost cursor.
+//
+// Builtins such as lines() make native generators instead: they have no
+// definition or frame, and each value comes from a C callback.
+
+typedef enum {
+    CURSOR_BLOCK,   // function body or a branch of 'ma'
+    CURSOR_WHILE,   // body of a 'mgbe' loop
+    CURSOR_FOR      // body of a 'maka' loop
+} CursorKind;
+
+typedef struct {
+    CursorKind kind;
+    ASTNode *node;       // the loop statement, or NULL for a plain block
+    ASTNode *next;       // next statement cell of the block, NULL at its end
+    int iterations;      // 'mgbe' iterations so far
+    Value iterable;      // 'maka': the list, generator or channel walked
+    size_t index;        // 'maka' over a list: position of the next item
+} Cursor;
+
+typedef enum { GEN_READY, GEN_RUNNING, GEN_DONE } GeneratorState;
+
+struct Generator;
+
+// Produce the next value into *out and return 1, or return 0 when there
+// are no more.
+typedef int (*NativeNext)(struct Generator *gen, Value *out);
+
+typedef struct Generator {
+    GcObject gc;
+    GeneratorState state;
+    const char *name;    // shown when the generator is printed
+    ASTNode *def;        // NODE_FUNC_DEF of the generator function, or NULL
+    Value *frame;        // local variable slots, or NULL
+    int frame_size;
+    Cursor *cursors;
+    int depth;
+    int capacity;
+    NativeNext native_next;
+    void (*native_free)(void *state);
+    void *native;        // state of a native generator
+} Generator;
+
+// Create a generator for def, positioned at the start of its body. Takes
+// ownership of the argc arguments.
+Generator *generator_new(ASTNode *def, Value *args, int argc);
+// Create a native generator that calls next() for each value. free_state
+// is called on state once the generator finishes or is released.
+Generator *generator_new_native(const char *name, NativeNext next,
+                                void (*free_state)(void *state), void *state);
+void generator_retain(Generator *gen);
+void generator_release(Generator *gen);
+
+// Enter a block; the new cursor becomes the innermost one.
+Cursor *generator_push(Generator *gen, CursorKind kind, ASTNode *node, ASTNode *block);
+
+// Leave the innermost block.
+void generator_pop(Generator *gen);
+
+// Give a native generator a frame of size slots holding the argc
+// arguments (which it takes ownership of) followed by unset slots. Values
+// a native generator keeps there rather than in its state are seen by the
+// cycle collector; compiled programs keep generator variables in it.
+void generator_native_frame(Generator *gen, int size, Value *args, int argc);
+
+// Drop the frame and every cursor once the body has finished, so a
+// finished generator holds no values.
+void generator_finish(Generator *gen);
+
+// Free the frame, cursors and native state of a generator that is being
+// freed, as list_destroy() does.
+void generator_destroy(Generator *gen, int drop);
+
+#endif // GENERATOR_H
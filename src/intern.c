@@ -0,0 +1,128 @@
+#include "intern.h"
+#include "memory.h"
+#include "parallel.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Open addressing table of interned strings with linear probing. The hash
+// is kept next to each pointer so probing rarely touches the strings.
+typedef struct {
+    uint64_t hash;
+    InternedString *str;
+} InternSlot;
+
+static InternSlot *slots = NULL;
+static size_t slot_count = 0;     // power of two
+static size_t used = 0;
+
+// Threads of a parallel loop share the table; it is only locked while one
+// is running.
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hash_bytes(const char *data, size_t length) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h = (h ^ word) * 0x100000001b3ULL;
+        h = (h << 31) | (h >> 33);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, length - i);
+    h = (h ^ tail) * 0x100000001b3ULL;
+    return mix64(h);
+}
+
+static void grow(void) {
+    size_t new_count = slot_count ? slot_count * 2 : 1024;
+    InternSlot *new_slots = memory_calloc(new_count, sizeof(InternSlot));
+    if (!new_slots) {
+        report_error("Memory allocation failed for string table", -1);
+        exit(1);
+    }
+    for (size_t i = 0; i < slot_count; ++i) {
+        if (!slots[i].str) continue;
+        size_t j = slots[i].hash & (new_count - 1);
+        while (new_slots[j].str)
+            j = (j + 1) & (new_count - 1);
+        new_slots[j] = slots[i];
+    }
+    memory_free(slots);
+    slots = new_slots;
+    slot_count = new_count;
+}
+
+static const InternedString *find(const char *data, size_t length, uint64_t hash) {
+    if (!slot_count) return NULL;
+    size_t mask = slot_count - 1;
+    for (size_t j = hash & mask; slots[j].str; j = (j + 1) & mask) {
+        InternedString *s = slots[j].str;
+        if (slots[j].hash == hash && s->length == length &&
+            memcmp(s->chars, data, length) == 0)
+            return s;
+    }
+    return NULL;
+}
+
+const InternedString *intern_find(const char *data, size_t length, uint64_t hash) {
+    if (!parallel_active) return find(data, length, hash);
+    pthread_mutex_lock(&table_lock);
+    const InternedString *found = find(data, length, hash);
+    pthread_mutex_unlock(&table_lock);
+    return found;
+}
+
+static const InternedString *add(const char *data, size_t length, uint64_t hash) {
+    const InternedString *found = find(data, length, hash);
+    if (found) return found;
+
+    if ((used + 1) * 2 > slot_count) grow();
+    InternedString *s = memory_alloc(sizeof(InternedString) + length + 1);
+    if (!s) {
+        report_error("Memory allocation failed for string table", -1);
+        exit(1);
+    }
+    s->hash = hash;
+    s->length = length;
+    memcpy(s->chars, data, length);
+    s->chars[length] = '\0';
+
+    size_t mask = slot_count - 1;
+    size_t j = hash & mask;
+    while (slots[j].str)
+        j = (j + 1) & mask;
+    slots[j].hash = hash;
+    slots[j].str = s;
+    used++;
+    return s;
+}
+
+const InternedString *intern(const char *data, size_t length) {
+    uint64_t hash = hash_bytes(data, length);
+    if (!parallel_active) return add(data, length, hash);
+    pthread_mutex_lock(&table_lock);
+    const InternedString *s = add(data, length, hash);
+    pthread_mutex_unlock(&table_lock);
+    return s;
+}
+
+void intern_free_all(void) {
+    for (size_t i = 0; i < slot_count; ++i)
+        memory_free(slots[i].str);
+    memory_free(slots);
+    slots = NULL;
+    slot_count = 0;
+    used = 0;
+}
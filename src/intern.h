@@ -0,0 +1,30 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// An interned string. Each distinct string is stored once, so two interned
+// strings are equal exactly when their pointers are equal, and the hash is
+// computed only when the string is first interned.
+typedef struct InternedString {
+    uint64_t hash;
+    size_t length;
+    char chars[];
+} InternedString;
+
+// Hash a byte string with the same function the interner uses.
+uint64_t hash_bytes(const char *data, size_t length);
+
+// Return the interned copy of the given bytes, adding it if needed.
+const InternedString *intern(const char *data, size_t length);
+
+// Return the interned copy if it exists, or NULL. Never adds a string,
+// which lets lookups of missing map keys avoid growing the table.
+const InternedString *intern_find(const char *data, size_t length, uint64_t hash);
+
+// Release every interned string. Only call this once nothing refers to
+// them any more (at interpreter shutdown).
+void intern_free_all(void);
+
+#endif // INTERN_H
@@ -1,20 +1,28 @@
+#define _POSIX_C_SOURCE 200809L
 #include "interpreter.h"
+#include "builtins.h"
+#include "exec.h"
+#include "gc.h"
+#include "generator.h"
+#include "intern.h"
+#include "isolate.h"
+#include "list.h"
+#include "map.h"
+#include "memory.h"
+#include "module.h"
+#include "ops.h"
+#include "optimizer.h"
+#include "types.h"
+#include "parallel.h"
+#include "parser.h"
+#include "snapshot.h"
 #include "util.h"
+#include "value.h"
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-typedef enum { VAL_NUMBER, VAL_STRING, VAL_BOOL } ValueType;
-
-typedef struct {
-    ValueType type;
-    union {
-        double number;
-        char *string;
-        int boolean;
-    } as;
-} Value;
-
 typedef struct {
     char *name;
     Value value;
@@ -37,7 +45,7 @@ static void set_var(const char *name, Value value) {
     if (!v) {
         if (var_count + 1 > var_capacity) {
             var_capacity = var_capacity ? var_capacity * 2 : 8;
-            vars = realloc(vars, sizeof(Variable) * var_capacity);
+            vars = memory_realloc(vars, sizeof(Variable) * var_capacity);
             if (!vars) {
                 report_error("Memory allocation failed for variables", -1);
                 exit(1);
@@ -46,200 +54,1033 @@ static void set_var(const char *name, Value value) {
         v = &vars[var_count++];
         v->name = string_duplicate(name);
     } else {
-        if (v->value.type == VAL_STRING)
-            free(v->value.as.string);
-    }
-    v->value.type = value.type;
-    if (value.type == VAL_STRING) {
-        v->value.as.string = string_duplicate(value.as.string);
-    } else if (value.type == VAL_BOOL) {
-        v->value.as.boolean = value.as.boolean;
-    } else {
-        v->value.as.number = value.as.number;
+        value_free(v->value);
     }
+    v->value = value_copy(value);
 }
 
-static Value get_var_value(const char *name) {
+static int load_module_for(const char *name, ModuleSymbol kind);
+
+// A global that is about to be read. A variable that is not defined yet
+// may be one of an imported module that has not been loaded.
+static Variable *find_global(const char *name) {
     Variable *v = find_var(name);
+    if (!v && load_module_for(name, MODULE_VARIABLE)) v = find_var(name);
+    return v;
+}
+
+// Report an error about a name, such as "Undefined variable '%s'". The
+// message is built out of line so that eval(), exec_stmt() and the other
+// functions every script level call recurses through need no buffer for
+// it in their C stack frames.
+static void report_named(const char *format, const char *name) {
+    char msg[160];
+    snprintf(msg, sizeof(msg), format, name);
+    report_error(msg, -1);
+}
+
+static Value get_var_value(const char *name) {
+    Variable *v = find_global(name);
     if (!v) {
-        char msg[128];
-        snprintf(msg, sizeof(msg), "Undefined variable '%s'", name);
-        report_error(msg, -1);
+        report_named("Undefined variable '%s'", name);
         Value err = {VAL_NUMBER, {.number = 0}};
         return err;
     }
-    if (v->value.type == VAL_STRING) {
-        Value copy = {VAL_STRING, {.string = string_duplicate(v->value.as.string)}};
-        return copy;
-    } else if (v->value.type == VAL_BOOL) {
-        return (Value){VAL_BOOL, {.boolean = v->value.as.boolean}};
+    return value_copy(v->value);
+}
+
+// User defined functions, in definition order. Redefining a function
+// replaces its entry.
+typedef struct {
+    char *name;
+    ASTNode *def;       // NODE_FUNC_DEF
+} Function;
+
+static Function *funcs = NULL;
+static size_t func_count = 0;
+static size_t func_capacity = 0;
+static size_t definitions = 0;   // number of times define_function() ran
+
+static Function *find_function(const char *name) {
+    for (size_t i = 0; i < func_count; ++i) {
+        if (strcmp(funcs[i].name, name) == 0)
+            return &funcs[i];
+    }
+    return NULL;
+}
+
+static void define_function(ASTNode *def) {
+    Function *f = find_function(def->value);
+    if (!f) {
+        if (func_count + 1 > func_capacity) {
+            func_capacity = func_capacity ? func_capacity * 2 : 8;
+            funcs = memory_realloc(funcs, sizeof(Function) * func_capacity);
+            if (!funcs) {
+                report_error("Memory allocation failed for functions", -1);
+                exit(1);
+            }
+        }
+        f = &funcs[func_count++];
+        f->name = string_duplicate(def->value);
     }
-    return (Value){VAL_NUMBER, {.number = v->value.as.number}};
+    f->def = def;
+    definitions++;
+}
+
+// Call frames live in one contiguous value stack allocated on the first
+// call, so calling a function never allocates. 'frame' points at the slots
+// of the running function and is NULL at the top level.
+#define STACK_SLOTS 65536
+
+// Each script level call also recurses through exec_stmt() and eval() in C.
+// Besides the depth limit, calls are refused once the C stack in use gets
+// close to the process limit, so deep recursion fails with an error rather
+// than a crash.
+//
+// The call machinery below is per thread: each worker of a parallel loop
+// has its own value stack, frames and error state.
+static THREAD_LOCAL Value *stack = NULL;
+static THREAD_LOCAL size_t stack_top = 0;
+static THREAD_LOCAL Value *frame = NULL;
+static THREAD_LOCAL int call_depth = 0;
+
+// Status returned by statements so that 'laghachi' can unwind out of
+// nested blocks and loops. EXEC_TAIL_CALL asks the enclosing call to
+// reuse its frame for the pending call; EXEC_ABORT stops the program after
+// a fatal error.
+typedef enum { EXEC_NORMAL, EXEC_RETURN, EXEC_TAIL_CALL, EXEC_ABORT } ExecStatus;
+
+static THREAD_LOCAL Value return_value;
+static THREAD_LOCAL Function *tail_function = NULL;
+static THREAD_LOCAL size_t tail_argc = 0;
+static THREAD_LOCAL int aborted = 0;
+
+static void fatal_error(const char *message) {
+    report_error(message, -1);
+    aborted = 1;
+}
+
+// Path of the file whose top level is running, against which 'bubata'
+// resolves relative paths: the program, or a module being loaded
+static const char *import_path = NULL;
+
+static void free_functions(void) {
+    for (size_t i = 0; i < func_count; ++i)
+        memory_free(funcs[i].name);
+    memory_free(funcs);
+    funcs = NULL;
+    func_count = 0;
+    func_capacity = 0;
+    memory_free(stack);
+    stack = NULL;
+    stack_top = 0;
 }
 
 static void free_vars(void) {
     for (size_t i = 0; i < var_count; ++i) {
-        free(vars[i].name);
-        if (vars[i].value.type == VAL_STRING)
-            free(vars[i].value.as.string);
+        memory_free(vars[i].name);
+        value_free(vars[i].value);
     }
-    free(vars);
+    memory_free(vars);
     vars = NULL;
     var_count = 0;
     var_capacity = 0;
 }
 
+// Assign to a variable: a frame slot inside a function, otherwise a global
+static void assign(ASTNode *node, Value value) {
+    if (node->slot >= 0) {
+        Value old = frame[node->slot];
+        frame[node->slot] = value_copy(value);
+        value_free(old);
+    } else {
+        set_var(node->value, value);
+    }
+}
+
 static Value eval(ASTNode *node);
-static void exec_stmt(ASTNode *node);
+static int eval_condition(ASTNode *node);
+static ExecStatus exec_stmt(ASTNode *node);
 
-static void exec_block(ASTNode *block) {
+static ExecStatus exec_block(ASTNode *block) {
     for (ASTNode *n = block; n != NULL; n = n->right) {
-        exec_stmt(n->left);
+        ExecStatus status = exec_stmt(n->left);
+        if (status != EXEC_NORMAL) return status;
     }
+    return EXEC_NORMAL;
 }
 
-static void exec_stmt(ASTNode *node) {
-    if (!node) return;
+// The next item of a generator or channel being walked by 'maka'
+static int next_item(Value iterable, Value *item) {
+    if (iterable.type == VAL_GENERATOR) return generator_next(iterable.as.generator, item);
+    return channel_receive(iterable.as.channel, item) > 0;
+}
+
+// maka name na iterable { body }
+// Maps are iterated over a snapshot of their keys, so the body may add or
+// remove entries safely. A generator is resumed for each item, and a
+// channel received from until it is closed and empty.
+static ExecStatus exec_for(ASTNode *node) {
+    Value iterable = eval(node->left);
+    if (iterable.type == VAL_GENERATOR || iterable.type == VAL_CHANNEL) {
+        ExecStatus status = EXEC_NORMAL;
+        Value item;
+        while (next_item(iterable, &item)) {
+            assign(node, item);
+            value_free(item);
+            status = exec_block(node->right);
+            if (status != EXEC_NORMAL) break;
+        }
+        value_free(iterable);
+        return aborted ? EXEC_ABORT : status;
+    }
+    if (iterable.type == VAL_MAP) {
+        List *keys = map_keys(iterable.as.map);
+        value_free(iterable);
+        iterable.type = VAL_LIST;
+        iterable.as.list = keys;
+    }
+    if (iterable.type != VAL_LIST) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Cannot iterate over a %s", value_type_name(iterable.type));
+        report_error(msg, -1);
+        value_free(iterable);
+        return EXEC_NORMAL;
+    }
+    List *list = iterable.as.list;
+    ExecStatus status = EXEC_NORMAL;
+    // The length is re-read every iteration so elements appended by the
+    // body are visited too, like a 'mgbe' loop over an index would.
+    for (size_t i = 0; i < list->count; ++i) {
+        Value item = list_get(list, i);
+        assign(node, item);
+        value_free(item);
+        status = exec_block(node->right);
+        if (status != EXEC_NORMAL) break;
+    }
+    value_free(iterable);
+    return status;
+}
+
+// The storage of the variable named by node, or NULL if it is undefined
+static Value *lookup(ASTNode *node) {
+    if (node->slot >= 0)
+        return frame[node->slot].type == VAL_UNSET ? NULL : &frame[node->slot];
+    Variable *v = find_global(node->value);
+    return v ? &v->value : NULL;
+}
+
+// Cached values of hoisted loop-invariant expressions, indexed by the
+// slot of their NODE_HOISTED. A loop claims its cells on entry and puts
+// back the previous contents on exit, so a recursive call that runs the
+// same loop again cannot leave values from another frame behind. A loop
+// that was already running when a recursive call created the plan never
+// claimed the cells, and evaluates its hoisted expressions uncached.
+typedef struct {
+    double value;
+    int valid;
+    int owned;
+} HoistCell;
+
+static THREAD_LOCAL HoistCell *cells = NULL;
+static THREAD_LOCAL int cell_capacity = 0;
+
+static void enter_cells(const LoopPlan *plan, HoistCell *saved) {
+    int needed = optimizer_cell_count();
+    if (needed > cell_capacity) {
+        cells = memory_realloc(cells, sizeof(HoistCell) * needed);
+        if (!cells) {
+            report_error("Memory allocation failed for loop cells", -1);
+            exit(1);
+        }
+        memset(cells + cell_capacity, 0, sizeof(HoistCell) * (needed - cell_capacity));
+        cell_capacity = needed;
+    }
+    for (int i = 0; i < plan->cell_count; ++i) {
+        saved[i] = cells[plan->first_cell + i];
+        cells[plan->first_cell + i].valid = 0;
+        cells[plan->first_cell + i].owned = 1;
+    }
+}
+
+static void leave_cells(const LoopPlan *plan, const HoistCell *saved) {
+    for (int i = 0; i < plan->cell_count; ++i)
+        cells[plan->first_cell + i] = saved[i];
+}
+
+// Evaluate an invariant expression only if that cannot report an error:
+// every variable must be a defined number and every operator arithmetic.
+// Returns 0 when the generic eval() has to be used instead.
+static int eval_number(ASTNode *node, double *out) {
+    switch (node->type) {
+        case NODE_NUMBER:
+            *out = atof(node->value);
+            return 1;
+        case NODE_IDENTIFIER: {
+            Value *v = lookup(node);
+            if (!v || v->type != VAL_NUMBER) return 0;
+            *out = v->as.number;
+            return 1;
+        }
+        case NODE_HOISTED:
+            if (cells[node->slot].valid) {
+                *out = cells[node->slot].value;
+                return 1;
+            }
+            return eval_number(node->left, out);
+        case NODE_BINARY_EXPR: {
+            double a, b;
+            if (!eval_number(node->left, &a) || !eval_number(node->right, &b)) return 0;
+            switch (node->value[0]) {
+                case '+': *out = a + b; return 1;
+                case '-': *out = a - b; return 1;
+                case '*': *out = a * b; return 1;
+                case '/': *out = a / b; return 1;
+            }
+            return 0;
+        }
+        default:
+            return 0;
+    }
+}
+
+static Value eval_hoisted(ASTNode *node) {
+    HoistCell *cell = &cells[node->slot];
+    if (!cell->owned) return eval(node->left);
+    if (!cell->valid) {
+        double d;
+        if (!eval_number(node->left, &d)) return eval(node->left);
+        cell->value = d;
+        cell->valid = 1;
+    }
+    return (Value){VAL_NUMBER, {.number = cell->value}};
+}
+
+// Fused loop state: where the induction variable lives and the bound.
+// Globals are remembered by index because defining a new global may move
+// the variable table.
+typedef struct {
+    int slot;          // frame slot, or -1 for a global
+    size_t index;      // index into vars for a global
+    double bound;
+} FusedLoop;
+
+static int start_fused(const LoopPlan *plan, FusedLoop *f) {
+    if (!plan->fused) return 0;
+    Value *v = lookup(plan->var);
+    if (!v || v->type != VAL_NUMBER) return 0;
+    if (!eval_number(plan->bound, &f->bound)) return 0;
+    f->slot = plan->var->slot;
+    if (f->slot < 0) f->index = (size_t)(find_var(plan->var->value) - vars);
+    return 1;
+}
+
+static Value *fused_var(const FusedLoop *f) {
+    return f->slot >= 0 ? &frame[f->slot] : &vars[f->index].value;
+}
+
+static int fused_compare(CompareOp op, double a, double b) {
+    switch (op) {
+        case CMP_LESS: return a < b;
+        case CMP_LESS_EQUAL: return a <= b;
+        case CMP_GREATER: return a > b;
+        case CMP_GREATER_EQUAL: return a >= b;
+        case CMP_EQUAL: return a == b;
+        case CMP_NOT_EQUAL: return a != b;
+    }
+    return 0;
+}
+
+// mgbe cond { body }
+// The loop is handed to the optimizer after its first iteration, once a
+// lazily parsed body has been parsed. From then on hoisted expressions are
+// cached and, when the plan allows it and the types check out, the
+// condition and the increment run as plain double operations. Analysis
+// rewrites the tree, so loops first reached inside a parallel loop are
+// left unoptimized.
+static ExecStatus exec_while(ASTNode *node) {
+    const LoopPlan *plan = node->slot >= 0 ? optimize_loop(node) : NULL;
+    HoistCell saved[MAX_HOISTED];
+    FusedLoop fused;
+    int is_fused = 0;
+    if (plan) {
+        enter_cells(plan, saved);
+        is_fused = start_fused(plan, &fused);
+    }
+    ExecStatus status = EXEC_NORMAL;
+    int iter = 0;
+    while (1) {
+        if (iter++ > MAX_WHILE_ITERATIONS) {
+            report_error("Possible infinite loop detected", -1);
+            break;
+        }
+        if (iter == 2 && !plan && !parallel_active) {
+            plan = optimize_loop(node);
+            enter_cells(plan, saved);
+            is_fused = start_fused(plan, &fused);
+        }
+        if (is_fused) {
+            if (!fused_compare(plan->op, fused_var(&fused)->as.number, fused.bound)) break;
+            // Everything but the increment, which is done in place
+            for (ASTNode *n = plan->body; n->right != NULL; n = n->right) {
+                status = exec_stmt(n->left);
+                if (status != EXEC_NORMAL) break;
+            }
+            if (status != EXEC_NORMAL) break;
+            fused_var(&fused)->as.number += plan->step;
+            continue;
+        }
+        if (!eval_condition(node->left) || aborted) break;
+        status = exec_block(node->right);
+        if (status != EXEC_NORMAL) break;
+    }
+    if (plan) leave_cells(plan, saved);
+    return status;
+}
+
+static void shared_error(void) {
+    fatal_error("Cannot modify a list or map shared with other iterations of 'mgbe ngwa'");
+}
+
+// dee name[index] = value
+static void exec_index_assign(ASTNode *node) {
+    Value *target = lookup(node);
+    if (!target) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Undefined variable '%s'", node->value);
+        report_error(msg, -1);
+        return;
+    }
+    if (target->type != VAL_LIST && target->type != VAL_MAP) {
+        report_error("Only lists and maps can be indexed", -1);
+        return;
+    }
+    if (exec_is_shared(*target)) {
+        shared_error();
+        return;
+    }
+    Value index = eval(node->right);
+    Value val = eval(node->left);
+    // Evaluating the operands may have replaced the variable, so look at
+    // its current value again.
+    target = lookup(node);
+    size_t pos;
+    const InternedString *key;
+    if (target && target->type == VAL_LIST) {
+        if (ops_list_index(target->as.list, index, &pos))
+            list_set(target->as.list, pos, val);
+    } else if (target && target->type == VAL_MAP) {
+        if (map_key(index, 1, &key))
+            map_set(target->as.map, key, val);
+    }
+    value_free(index);
+    value_free(val);
+}
+
+static ExecStatus exec_return(ASTNode *node);
+static ExecStatus exec_while(ASTNode *node);
+static ExecStatus exec_parallel(ASTNode *node);
+static void exec_spawn(ASTNode *node);
+
+static ExecStatus exec_stmt(ASTNode *node) {
+    if (!node) return EXEC_NORMAL;
+    // Statement boundaries are the collector's safe points, and where
+    // every thread stops once an isolate has failed or the memory block
+    // given with --memory has run out
+    if (!parallel_active && gc_pending) gc_collect();
+    if (isolates_stopping || memory_exhausted) {
+        aborted = 1;
+        return EXEC_ABORT;
+    }
+    ExecStatus status = EXEC_NORMAL;
     switch (node->type) {
         case NODE_VAR_DECL: {
             Value val = eval(node->left);
-            set_var(node->value, val);
-            if (val.type == VAL_STRING)
-                free(val.as.string);
+            assign(node, val);
+            value_free(val);
             break;
         }
-        case NODE_PRINT_STMT: {
-            Value val = eval(node->left);
-            if (val.type == VAL_STRING) {
-                printf("%s\n", val.as.string);
-                free(val.as.string);
-            } else if (val.type == VAL_NUMBER) {
-                printf("%g\n", val.as.number);
+        case NODE_FUNC_DEF:
+            if (exec_worker) {
+                report_named("Functions cannot be defined inside %s", exec_worker);
+                aborted = 1;
+            } else if (parallel_active) {
+                // Isolates look functions up as they run
+                fatal_error("Functions cannot be defined while isolates are running");
             } else {
-                printf(val.as.boolean ? "eziokwu\n" : "ụgha\n");
+                define_function(node);
             }
             break;
+        case NODE_RETURN:
+            status = exec_return(node);
+            break;
+        case NODE_INDEX_ASSIGN:
+            exec_index_assign(node);
+            break;
+        case NODE_PRINT_STMT: {
+            if (exec_worker) {
+                // The order of output would depend on thread scheduling
+                report_named("'gosi' is not allowed inside %s", exec_worker);
+                aborted = 1;
+                break;
+            }
+            Value val = eval(node->left);
+            // nothing to print after a fatal error
+            if (!aborted) ops_print(val);
+            value_free(val);
+            break;
         }
         case NODE_IF_STMT: {
-            Value cond = eval(node->left);
-            int truth = 0;
-            if (cond.type == VAL_BOOL) truth = cond.as.boolean;
-            else if (cond.type == VAL_NUMBER) truth = cond.as.number != 0;
-            else if (cond.type == VAL_STRING) truth = cond.as.string[0] != '\0';
-            if (cond.type == VAL_STRING) free(cond.as.string);
+            int truth = eval_condition(node->left);
+            if (aborted) break;
             if (truth)
-                exec_block(node->right);
+                status = exec_block(node->right);
             else if (node->third)
-                exec_block(node->third);
+                status = exec_block(node->third);
             break;
         }
-        case NODE_WHILE_STMT: {
-            const int MAX_ITERS = 10000;
-            int iter = 0;
-            while (1) {
-                if (iter++ > MAX_ITERS) {
-                    report_error("Possible infinite loop detected", -1);
-                    break;
-                }
-                Value cond = eval(node->left);
-                int truth = 0;
-                if (cond.type == VAL_BOOL) truth = cond.as.boolean;
-                else if (cond.type == VAL_NUMBER) truth = cond.as.number != 0;
-                else if (cond.type == VAL_STRING) truth = cond.as.string[0] != '\0';
-                if (cond.type == VAL_STRING) free(cond.as.string);
-                if (!truth) break;
-                exec_block(node->right);
+        case NODE_WHILE_STMT:
+            status = exec_while(node);
+            break;
+        case NODE_FOR_STMT:
+            status = exec_for(node);
+            break;
+        case NODE_PARALLEL_FOR:
+            status = exec_parallel(node);
+            break;
+        case NODE_SPAWN:
+            exec_spawn(node);
+            break;
+        case NODE_IMPORT:
+            // Only registers the module; it is loaded on first use
+            if (!module_import(node->value, import_path))
+                aborted = 1;
+            break;
+        case NODE_LAZY_BLOCK:
+            // Parsed the first time it runs. The parser has reported any
+            // syntax error, which stops the program.
+            if (!parse_lazy_block(node)) {
+                aborted = 1;
+                break;
             }
+            status = exec_block(node->left);
             break;
-        }
         default: {
             Value val = eval(node);
-            if (val.type == VAL_STRING)
-                free(val.as.string);
+            value_free(val);
             break;
         }
     }
+    return aborted ? EXEC_ABORT : status;
 }
 
-static Value eval_binary(Value left, Value right, const char *op) {
-    if (strcmp(op, "+") == 0) {
-        if (left.type == VAL_STRING || right.type == VAL_STRING) {
-            const char *lstr = left.type == VAL_STRING ? left.as.string : NULL;
-            const char *rstr = right.type == VAL_STRING ? right.as.string : NULL;
-            char buf[64];
-            if (!lstr) {
-                snprintf(buf, sizeof(buf), "%g", left.as.number);
-                lstr = buf;
-            }
-            char buf2[64];
-            if (!rstr) {
-                snprintf(buf2, sizeof(buf2), "%g", right.as.number);
-                rstr = buf2;
+static int count_args(ASTNode *args) {
+    int argc = 0;
+    for (ASTNode *n = args; n != NULL; n = n->right)
+        argc++;
+    return argc;
+}
+
+static int check_arity(Function *fn, int argc) {
+    int params = count_args(fn->def->left);
+    if (argc == params) return 1;
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%s expects %d argument(s), got %d", fn->name, params, argc);
+    report_error(msg, -1);
+    return 0;
+}
+
+static void ensure_stack(void) {
+    if (stack) return;
+    stack = memory_alloc(sizeof(Value) * STACK_SLOTS);
+    if (!stack) {
+        report_error("Memory allocation failed for call stack", -1);
+        exit(1);
+    }
+}
+
+// Place args (already owned by the callee) in the first slots of a fresh
+// frame starting at stack[base], marking the remaining slots unset.
+static int enter_frame(size_t base, ASTNode *def, Value *args, int argc) {
+    size_t size = (size_t)def->slot;
+    if (base + size > STACK_SLOTS) {
+        fatal_error("Call stack overflow: too many local variables in active calls");
+        return 0;
+    }
+    memmove(&stack[base], args, sizeof(Value) * argc);
+    for (size_t i = (size_t)argc; i < size; ++i)
+        stack[base + i].type = VAL_UNSET;
+    stack_top = base + size;
+    return 1;
+}
+
+static void leave_frame(size_t base) {
+    for (size_t i = base; i < stack_top; ++i)
+        value_free(stack[i]);
+    stack_top = base;
+}
+
+// Run a user defined function. The callee takes ownership of args. A tail
+// call made by the body reuses the same frame, so tail recursion runs in
+// constant C and value stack space.
+// Stop the program if one more nested call would be too deep
+static void check_call_depth(void) {
+    if (!exec_check_depth(call_depth)) aborted = 1;
+}
+
+static Value call_function(Function *fn, Value *args, int argc) {
+    Value result = {VAL_BOOL, {.boolean = 0}};
+    check_call_depth();
+    if (aborted || !check_arity(fn, argc)) {
+        for (int i = 0; i < argc; ++i)
+            value_free(args[i]);
+        return result;
+    }
+    if (fn->def->yields) {
+        // Calling a generator function only sets up the generator
+        result.type = VAL_GENERATOR;
+        result.as.generator = generator_new(fn->def, args, argc);
+        return result;
+    }
+    ensure_stack();
+
+    size_t base = stack_top;
+    Value *saved_frame = frame;
+    ASTNode *def = fn->def;
+    if (!enter_frame(base, def, args, argc)) {
+        for (int i = 0; i < argc; ++i)
+            value_free(args[i]);
+        return result;
+    }
+    frame = &stack[base];
+    call_depth++;
+
+    for (;;) {
+        ExecStatus status = exec_block(def->right);
+        if (status == EXEC_RETURN) {
+            result = return_value;
+        } else if (status == EXEC_TAIL_CALL) {
+            // The arguments were staged just above the current frame.
+            size_t staged = stack_top;
+            int n = (int)tail_argc;
+            for (size_t i = base; i < staged; ++i)
+                value_free(stack[i]);
+            if (check_arity(tail_function, n)) {
+                def = tail_function->def;
+                if (enter_frame(base, def, &stack[staged], n))
+                    continue;
+            } else {
+                for (int i = 0; i < n; ++i)
+                    value_free(stack[staged + i]);
             }
-            char *res = malloc(strlen(lstr) + strlen(rstr) + 1);
-            strcpy(res, lstr);
-            strcat(res, rstr);
-            Value v = {VAL_STRING, {.string = res}};
-            return v;
-        } else {
-            Value v = {VAL_NUMBER, {.number = left.as.number + right.as.number}};
-            return v;
+            stack_top = base;
         }
-    } else if (strcmp(op, "-") == 0) {
-        if (left.type != VAL_NUMBER || right.type != VAL_NUMBER) {
-            report_error("Operands must be numbers for '-'", -1);
-            return (Value){VAL_NUMBER, {.number = 0}};
+        break;
+    }
+
+    leave_frame(base);
+    frame = saved_frame;
+    call_depth--;
+    return result;
+}
+
+// laghachi [expression]
+static ExecStatus exec_return(ASTNode *node) {
+    ASTNode *call = node->left;
+    Function *callee = node->slot == 1 ? find_function(call->value) : NULL;
+    if (callee && !callee->def->yields) {
+        // Tail call: evaluate the arguments into the free space above the
+        // frame and let call_function reuse the frame for the callee.
+        int argc = 0;
+        for (ASTNode *n = call->left; n != NULL; n = n->right) {
+            // Evaluating an argument may call other functions, which use
+            // the stack above stack_top, so each value is staged only after
+            // it has been computed.
+            Value arg = eval(n->left);
+            if (stack_top >= STACK_SLOTS) {
+                value_free(arg);
+                leave_frame(stack_top - argc);
+                fatal_error("Call stack overflow");
+                return EXEC_ABORT;
+            }
+            stack[stack_top++] = arg;
+            argc++;
         }
-        return (Value){VAL_NUMBER, {.number = left.as.number - right.as.number}};
-    } else if (strcmp(op, "*") == 0) {
-        if (left.type != VAL_NUMBER || right.type != VAL_NUMBER) {
-            report_error("Operands must be numbers for '*'", -1);
-            return (Value){VAL_NUMBER, {.number = 0}};
+        stack_top -= argc;
+        tail_function = callee;
+        tail_argc = (size_t)argc;
+        return aborted ? EXEC_ABORT : EXEC_TAIL_CALL;
+    }
+    if (node->left)
+        return_value = eval(node->left);
+    else
+        return_value = (Value){VAL_BOOL, {.boolean = 0}};
+    return EXEC_RETURN;
+}
+
+// Modules
+//
+// 'bubata' only registers a module (see module.h). The first time a name
+// it defines is called or read, its top level runs as if it were part of
+// the program at that point, defining its functions and globals. That can
+// happen in the middle of a function call, so it runs with no frame.
+
+static int load_module_for(const char *name, ModuleSymbol kind) {
+    Module *m = module_defining(name, kind);
+    if (!m) return 0;
+    if (exec_worker || parallel_active) {
+        // Worker threads cannot run a module's top level, and the program
+        // cannot define its functions while isolates look functions up
+        char msg[256];
+        if (exec_worker)
+            snprintf(msg, sizeof(msg), "Module '%s' must be loaded before %s uses '%s'",
+                     module_name(m), exec_worker, name);
+        else
+            snprintf(msg, sizeof(msg), "Module '%s' cannot be loaded while isolates are running (for '%s')",
+                     module_name(m), name);
+        fatal_error(msg);
+        return 0;
+    }
+    ASTNode *tree;
+    if (!module_load(m, &tree)) {
+        aborted = 1;
+        return 0;
+    }
+    types_infer(tree, 1);
+    Value *saved_frame = frame;
+    const char *saved_path = import_path;
+    frame = NULL;
+    import_path = module_path(m);
+    exec_block(tree);
+    frame = saved_frame;
+    import_path = saved_path;
+    return !aborted;
+}
+
+// Load the modules that a parallel loop refers to, before it starts
+static void preload_modules(ASTNode *node) {
+    if (!node || aborted) return;
+    if (node->type == NODE_CALL)
+        load_module_for(node->value, MODULE_FUNCTION);
+    else if (node->type == NODE_IDENTIFIER && node->slot < 0)
+        load_module_for(node->value, MODULE_VARIABLE);
+    preload_modules(node->left);
+    preload_modules(node->right);
+    preload_modules(node->third);
+}
+
+void interpreter_set_path(const char *path) {
+    import_path = path;
+}
+
+// Generators
+//
+// A generator body is run by a small loop over the generator's cursor
+// stack instead of by recursive exec_stmt() calls, so it can stop at a
+// 'nye' and carry on later without keeping a C stack. Only statements
+// marked by the parser as containing a 'nye' go through the cursors; all
+// others run through exec_stmt() as usual, which can never suspend.
+
+// Start the next pass of the loop owning cursor c, or return 0 when the
+// loop is over (or c is a plain block).
+static int next_pass(Cursor *c) {
+    if (c->kind == CURSOR_WHILE) {
+        if (c->iterations++ > MAX_WHILE_ITERATIONS) {
+            report_error("Possible infinite loop detected", -1);
+            return 0;
         }
-        return (Value){VAL_NUMBER, {.number = left.as.number * right.as.number}};
-    } else if (strcmp(op, "/") == 0) {
-        if (left.type != VAL_NUMBER || right.type != VAL_NUMBER) {
-            report_error("Operands must be numbers for '/'", -1);
-            return (Value){VAL_NUMBER, {.number = 0}};
+        if (!eval_condition(c->node->left) || aborted) return 0;
+    } else if (c->kind == CURSOR_FOR) {
+        Value item;
+        if (c->iterable.type != VAL_LIST) {
+            if (!next_item(c->iterable, &item)) return 0;
+        } else {
+            // The length is re-read each time, as in exec_for()
+            List *list = c->iterable.as.list;
+            if (c->index >= list->count) return 0;
+            item = list_get(list, c->index++);
         }
-        return (Value){VAL_NUMBER, {.number = left.as.number / right.as.number}};
-    } else if (strcmp(op, "==") == 0) {
-        if (left.type == VAL_STRING && right.type == VAL_STRING) {
-            return (Value){VAL_BOOL, {.boolean = strcmp(left.as.string, right.as.string) == 0}};
-        } else if (left.type == VAL_NUMBER && right.type == VAL_NUMBER) {
-            return (Value){VAL_BOOL, {.boolean = left.as.number == right.as.number}};
-        } else if (left.type == VAL_BOOL && right.type == VAL_BOOL) {
-            return (Value){VAL_BOOL, {.boolean = left.as.boolean == right.as.boolean}};
+        assign(c->node, item);
+        value_free(item);
+    } else {
+        return 0;
+    }
+    c->next = c->node->right;
+    return 1;
+}
+
+// Run gen from its current position to the next 'nye'. Returns 1 with the
+// value in *out, or 0 when the body has finished.
+static int run_generator(Generator *gen, Value *out) {
+    while (gen->depth > 0 && !aborted) {
+        Cursor *c = &gen->cursors[gen->depth - 1];
+        if (!c->next) {
+            if (!next_pass(c)) generator_pop(gen);
+            continue;
         }
-        report_error("Type mismatch for '=='", -1);
-        return (Value){VAL_BOOL, {.boolean = 0}};
-    } else if (strcmp(op, "!=") == 0) {
-        if (left.type == VAL_STRING && right.type == VAL_STRING) {
-            return (Value){VAL_BOOL, {.boolean = strcmp(left.as.string, right.as.string) != 0}};
-        } else if (left.type == VAL_NUMBER && right.type == VAL_NUMBER) {
-            return (Value){VAL_BOOL, {.boolean = left.as.number != right.as.number}};
-        } else if (left.type == VAL_BOOL && right.type == VAL_BOOL) {
-            return (Value){VAL_BOOL, {.boolean = left.as.boolean != right.as.boolean}};
+        ASTNode *stmt = c->next->left;
+        c->next = c->next->right;
+        if (!stmt->yields || stmt->type == NODE_FUNC_DEF) {
+            ExecStatus status = exec_stmt(stmt);
+            if (status == EXEC_RETURN) value_free(return_value);
+            if (status != EXEC_NORMAL) return 0;
+            continue;
         }
-        report_error("Type mismatch for '!='", -1);
-        return (Value){VAL_BOOL, {.boolean = 0}};
-    } else if (strcmp(op, "<") == 0 || strcmp(op, ">") == 0 ||
-               strcmp(op, "<=") == 0 || strcmp(op, ">=") == 0) {
-        if (left.type != VAL_NUMBER || right.type != VAL_NUMBER) {
-            report_error("Operands must be numbers for comparison", -1);
-            return (Value){VAL_BOOL, {.boolean = 0}};
+        switch (stmt->type) {
+            case NODE_YIELD:
+                *out = stmt->left ? eval(stmt->left) : (Value){VAL_BOOL, {.boolean = 0}};
+                if (!aborted) return 1;
+                value_free(*out);
+                return 0;
+            case NODE_IF_STMT: {
+                int truth = eval_condition(stmt->left);
+                ASTNode *branch = truth ? stmt->right : stmt->third;
+                if (branch && !aborted) generator_push(gen, CURSOR_BLOCK, NULL, branch);
+                break;
+            }
+            case NODE_WHILE_STMT:
+                // The condition is checked by next_pass() when the empty
+                // cursor is reached
+                generator_push(gen, CURSOR_WHILE, stmt, NULL);
+                break;
+            case NODE_FOR_STMT: {
+                Value iterable = eval(stmt->left);
+                if (iterable.type == VAL_MAP) {
+                    List *keys = map_keys(iterable.as.map);
+                    value_free(iterable);
+                    iterable.type = VAL_LIST;
+                    iterable.as.list = keys;
+                }
+                if (aborted) {
+                    value_free(iterable);
+                    break;
+                }
+                if (iterable.type != VAL_LIST && iterable.type != VAL_GENERATOR &&
+                    iterable.type != VAL_CHANNEL) {
+                    char msg[128];
+                    snprintf(msg, sizeof(msg), "Cannot iterate over a %s",
+                             value_type_name(iterable.type));
+                    report_error(msg, -1);
+                    value_free(iterable);
+                    break;
+                }
+                generator_push(gen, CURSOR_FOR, stmt, NULL)->iterable = iterable;
+                break;
+            }
+            default:
+                // 'laghachi' without a value
+                return 0;
         }
-        int result = 0;
-        if (strcmp(op, "<") == 0) result = left.as.number < right.as.number;
-        else if (strcmp(op, ">") == 0) result = left.as.number > right.as.number;
-        else if (strcmp(op, "<=") == 0) result = left.as.number <= right.as.number;
-        else if (strcmp(op, ">=") == 0) result = left.as.number >= right.as.number;
-        return (Value){VAL_BOOL, {.boolean = result}};
     }
-    report_error("Unknown binary operator", -1);
-    return (Value){VAL_NUMBER, {.number = 0}};
+    return 0;
 }
 
+int generator_next(Generator *gen, Value *out) {
+    if (gen->state == GEN_DONE) return 0;
+    if (gen->state == GEN_RUNNING) {
+        fatal_error("Generator resumed while it is running");
+        return 0;
+    }
+    if (exec_is_shared((Value){VAL_GENERATOR, {.generator = gen}})) {
+        shared_error();
+        return 0;
+    }
+    if (gen->native_next) {
+        gen->state = GEN_RUNNING;
+        int produced = gen->native_next(gen, out);
+        if (produced)
+            gen->state = GEN_READY;
+        else
+            generator_finish(gen);
+        return produced;
+    }
+    check_call_depth();
+    if (aborted) return 0;
+    gen->state = GEN_RUNNING;
+    Value *saved_frame = frame;
+    frame = gen->frame;
+    call_depth++;
+    int yielded = run_generator(gen, out);
+    frame = saved_frame;
+    call_depth--;
+    // After a fatal error the generator is left as it is; the program is
+    // stopping anyway
+    if (yielded || aborted)
+        gen->state = GEN_READY;
+    else
+        generator_finish(gen);
+    return yielded;
+}
+
+// The argument of a builtin that takes over its last argument (see
+// Builtin.moves). A string, list or map in a local variable is moved out
+// of it rather than copied, so the builtin holds the only reference;
+// *slot is set to the variable's slot then, and is -1 otherwise.
+static Value eval_moved(ASTNode *node, int *slot) {
+    *slot = -1;
+    if (node->type != NODE_IDENTIFIER || node->slot < 0) return eval(node);
+    Value v = frame[node->slot];
+    if (v.type != VAL_STRING && v.type != VAL_LIST && v.type != VAL_MAP) return eval(node);
+    frame[node->slot].type = VAL_UNSET;
+    *slot = node->slot;
+    return v;
+}
+
+// Call a user defined function or a builtin by name
+static Value eval_call(ASTNode *node) {
+    Function *fn = find_function(node->value);
+    if (!fn && load_module_for(node->value, MODULE_FUNCTION))
+        fn = find_function(node->value);
+    if (aborted) return (Value){VAL_NUMBER, {.number = 0}};
+    const Builtin *builtin = fn ? NULL : find_builtin(node->value);
+    if (!fn && !builtin) {
+        report_named("Undefined function '%s'", node->value);
+        return (Value){VAL_NUMBER, {.number = 0}};
+    }
+    size_t argc = (size_t)count_args(node->left);
+    if (builtin && (argc < builtin->min_args || argc > builtin->max_args)) {
+        builtin_arity_error(builtin, argc);
+        return (Value){VAL_NUMBER, {.number = 0}};
+    }
+    Value args[argc + 1];
+    size_t i = 0;
+    int moved = -1;
+    for (ASTNode *n = node->left; n != NULL; n = n->right) {
+        if (builtin && builtin->moves && !n->right)
+            args[i++] = eval_moved(n->left, &moved);
+        else
+            args[i++] = eval(n->left);
+    }
+    if (fn)
+        return call_function(fn, args, (int)argc);
+    Value result = {VAL_NUMBER, {.number = 0}};
+    if (builtin->modifies && exec_is_shared(args[0]))
+        shared_error();
+    else
+        result = builtin->fn(args, argc);
+    // Not taken over after all: the variable keeps its value
+    if (moved >= 0 && args[argc - 1].type != VAL_NUMBER) {
+        frame[moved] = args[argc - 1];
+        args[argc - 1].type = VAL_NUMBER;
+    }
+    for (i = 0; i < argc; ++i)
+        value_free(args[i]);
+    // A channel operation cut short because the program is stopping
+    if (isolates_stopping) aborted = 1;
+    return result;
+}
+
+// Expressions whose operands type inference proved to be numbers (see
+// types.h) run on plain doubles. Nothing can go wrong with them, so no
+// error needs to be reported either.
+static double eval_known_number(ASTNode *node);
+
+static Value eval_numeric_binary(ASTNode *node) {
+    double a = eval_known_number(node->left);
+    double b = eval_known_number(node->right);
+    const char *op = node->value;
+    switch (op[0]) {
+        case '+': return (Value){VAL_NUMBER, {.number = a + b}};
+        case '-': return (Value){VAL_NUMBER, {.number = a - b}};
+        case '*': return (Value){VAL_NUMBER, {.number = a * b}};
+        case '/': return (Value){VAL_NUMBER, {.number = a / b}};
+        case '=': return (Value){VAL_BOOL, {.boolean = a == b}};
+        case '!': return (Value){VAL_BOOL, {.boolean = a != b}};
+        case '<': return (Value){VAL_BOOL, {.boolean = op[1] == '=' ? a <= b : a < b}};
+        default: return (Value){VAL_BOOL, {.boolean = op[1] == '=' ? a >= b : a > b}};
+    }
+}
+
+static double eval_known_number(ASTNode *node) {
+    switch (node->type) {
+        case NODE_NUMBER:
+            return atof(node->value);
+        case NODE_IDENTIFIER:
+            if (node->slot >= 0) return frame[node->slot].as.number;
+            break;
+        case NODE_BINARY_EXPR:
+            if (node->left->types == TYPE_NUMBER && node->right->types == TYPE_NUMBER)
+                return eval_numeric_binary(node).as.number;
+            break;
+        default:
+            break;
+    }
+    // Some other expression that yields a number, which needs no freeing
+    return eval(node).as.number;
+}
+
+// Truth of a 'ma' or 'mgbe' condition
+static int eval_condition(ASTNode *node) {
+    Value cond = eval(node);
+    if (node->types == TYPE_BOOL) return cond.as.boolean;
+    int truth = value_truthy(cond);
+    value_free(cond);
+    return truth;
+}
+
+static Value eval_binary(ASTNode *node) {
+    if (node->left->types == TYPE_NUMBER && node->right->types == TYPE_NUMBER)
+        return eval_numeric_binary(node);
+    Value left = eval(node->left);
+    Value right = eval(node->right);
+    // After a fatal error the operands are placeholders; skip the
+    // operator so it does not report follow-on errors.
+    Value result = aborted ? (Value){VAL_NUMBER, {.number = 0}}
+                           : ops_binary(left, right, node->value);
+    value_free(left);
+    value_free(right);
+    return result;
+}
+
+static Value eval_list(ASTNode *node) {
+    List *list = list_new(0);
+    for (ASTNode *n = node->left; n != NULL; n = n->right) {
+        Value item = eval(n->left);
+        list_append(list, item);
+        value_free(item);
+    }
+    Value v;
+    v.type = VAL_LIST;
+    v.as.list = list;
+    return v;
+}
+
+static Value eval_map(ASTNode *node) {
+    Map *map = map_new();
+    for (ASTNode *n = node->left; n != NULL; n = n->right) {
+        Value key = eval(n->left);
+        Value val = eval(n->third);
+        const InternedString *interned;
+        if (map_key(key, 1, &interned))
+            map_set(map, interned, val);
+        value_free(key);
+        value_free(val);
+    }
+    Value v;
+    v.type = VAL_MAP;
+    v.as.map = map;
+    return v;
+}
+
+static Value eval_index(ASTNode *node) {
+    Value target = eval(node->left);
+    Value index = eval(node->right);
+    Value result = {VAL_NUMBER, {.number = 0}};
+    size_t pos;
+    if (target.type == VAL_MAP)
+        result = ops_map_index(target.as.map, index);
+    else if (target.type != VAL_LIST)
+        report_error("Only lists and maps can be indexed", -1);
+    else if (ops_list_index(target.as.list, index, &pos))
+        result = list_get(target.as.list, pos);
+    value_free(target);
+    value_free(index);
+    return result;
+}
+
+// Every script level call goes through eval() more than once, so the
+// work of each kind of expression is done in a function of its own and
+// eval() keeps a small C stack frame.
 static Value eval(ASTNode *node) {
     switch (node->type) {
         case NODE_NUMBER:
@@ -247,25 +1088,474 @@ static Value eval(ASTNode *node) {
         case NODE_STRING:
             return (Value){VAL_STRING, {.string = string_duplicate(node->value)}};
         case NODE_IDENTIFIER:
+            // A local that is certainly a number needs neither checks nor a copy
+            if (node->types == TYPE_NUMBER && node->slot >= 0) return frame[node->slot];
+            if (node->slot >= 0) {
+                if (frame[node->slot].type == VAL_UNSET) {
+                    report_named("Undefined variable '%s'", node->value);
+                    return (Value){VAL_NUMBER, {.number = 0}};
+                }
+                return value_copy(frame[node->slot]);
+            }
             return get_var_value(node->value);
         case NODE_BOOL:
             return (Value){VAL_BOOL, {.boolean = strcmp(node->value, "eziokwu") == 0}};
-        case NODE_BINARY_EXPR: {
-            Value left = eval(node->left);
-            Value right = eval(node->right);
-            Value result = eval_binary(left, right, node->value);
-            if (left.type == VAL_STRING) free(left.as.string);
-            if (right.type == VAL_STRING) free(right.as.string);
-            return result;
-        }
+        case NODE_BINARY_EXPR:
+            return eval_binary(node);
+        case NODE_LIST:
+            return eval_list(node);
+        case NODE_MAP:
+            return eval_map(node);
+        case NODE_INDEX:
+            return eval_index(node);
+        case NODE_CALL:
+            return eval_call(node);
+        case NODE_HOISTED:
+            return eval_hoisted(node);
         default:
             report_error("Invalid expression", -1);
             return (Value){VAL_NUMBER, {.number = 0}};
     }
 }
 
-void interpret(ASTNode *ast) {
-    exec_block(ast);
+// Parallel loops
+//
+// mgbe ngwa i site A ruo B jikota sum s { body }
+//
+// The range A..B (inclusive) is cut into at most PARALLEL_CHUNKS chunks of
+// consecutive iterations. Chunk boundaries depend only on the range, never
+// on the number of threads, and each chunk runs in order on one thread
+// with its reduction variables starting at the identity of their
+// operator. The partial results are then combined in chunk order, so a
+// reduction gives the same answer however the chunks were scheduled.
+//
+// The body runs in its own frame, so every 'dee' in it assigns a private
+// variable. The parser rejects statements that would write shared data;
+// what it cannot see (lists reached through globals, functions called
+// from the body) is checked while the loop runs.
+#define MAX_REDUCTIONS 16
+
+typedef struct {
+    ASTNode *body;
+    ASTNode *reductions;   // chain of EXPR_LIST cells from the parser
+    int reduction_count;
+    ReduceOp ops[MAX_REDUCTIONS];
+    size_t frame_size;
+    double start;
+    size_t count;          // number of iterations
+    size_t grain;          // iterations per chunk
+    double *partials;      // [chunk * reduction_count + r]
+    int failed;            // set by the first chunk that stops with an error
+} ParallelLoop;
+
+static int pool_threads = 0;
+static int gc_stats = 0;
+static const char *snapshot_path = NULL;
+
+void interpreter_set_threads(int threads) {
+    pool_threads = threads;
+}
+
+void interpreter_set_gc_stats(int enabled) {
+    gc_stats = enabled;
+}
+
+void interpreter_set_snapshot(const char *path) {
+    snapshot_path = path;
+}
+
+int interpreter_load_snapshot(const char *path) {
+    return snapshot_load(path, set_var) ? 0 : 1;
+}
+
+// Save the globals once the program has run to the end
+static int save_snapshot(void) {
+    if (aborted) {
+        report_error("Snapshot not saved because the program stopped with an error", -1);
+        return 0;
+    }
+    SnapshotGlobal *globals = memory_alloc(sizeof(SnapshotGlobal) * (var_count ? var_count : 1));
+    if (!globals) {
+        report_error("Memory allocation failed for snapshot", -1);
+        exit(1);
+    }
+    for (size_t i = 0; i < var_count; ++i) {
+        globals[i].name = vars[i].name;
+        globals[i].value = vars[i].value;
+    }
+    int ok = snapshot_save(snapshot_path, globals, var_count);
+    memory_free(globals);
+    return ok;
+}
+
+static void worker_start(void) {
+    exec_stack_guard();
+}
+
+static void worker_exit(void) {
+    memory_free(stack);
+    stack = NULL;
+    memory_free(cells);
+    cells = NULL;
+    cell_capacity = 0;
+    gc_thread_exit();
+}
+
+// Report a private variable of the body that has the name of a global.
+// The parser catches globals assigned before the loop; this covers ones
+// it could not see, such as those assigned in lazily parsed blocks.
+static int check_private(ASTNode *node, int first) {
+    if (!node) return 1;
+    if ((node->type == NODE_VAR_DECL || node->type == NODE_FOR_STMT) &&
+        node->slot >= first && find_var(node->value)) {
+        char msg[160];
+        snprintf(msg, sizeof(msg), "Cannot assign global '%s' inside 'mgbe ngwa' (use 'jikota')",
+                 node->value);
+        fatal_error(msg);
+        return 0;
+    }
+    return check_private(node->left, first) && check_private(node->right, first) &&
+           check_private(node->third, first);
+}
+
+// Analyse the 'mgbe' loops of the body up front, inner loops first as
+// they would be when run serially.
+static void prepare_loops(ASTNode *node) {
+    if (!node) return;
+    prepare_loops(node->left);
+    prepare_loops(node->right);
+    prepare_loops(node->third);
+    if (node->type == NODE_WHILE_STMT) optimize_loop(node);
+}
+
+static void run_chunk(void *context, size_t chunk) {
+    ParallelLoop *loop = context;
+    if (__atomic_load_n(&loop->failed, __ATOMIC_RELAXED)) return;
+    ensure_stack();
+    size_t base = stack_top;
+    if (base + loop->frame_size > STACK_SLOTS) {
+        fatal_error("Call stack overflow: too many local variables in active calls");
+        __atomic_store_n(&loop->failed, 1, __ATOMIC_RELAXED);
+        aborted = 0;
+        return;
+    }
+    Value *saved_frame = frame;
+    frame = &stack[base];
+    stack_top = base + loop->frame_size;
+    exec_worker = EXEC_PARALLEL_LOOP;
+    size_t first_private = 1 + (size_t)loop->reduction_count;
+    for (size_t k = 0; k < loop->frame_size; ++k)
+        frame[k].type = VAL_UNSET;
+    for (int r = 0; r < loop->reduction_count; ++r)
+        frame[1 + r] = (Value){VAL_NUMBER, {.number = exec_reduce_identity(loop->ops[r])}};
+
+    size_t end = (chunk + 1) * loop->grain;
+    if (end > loop->count) end = loop->count;
+    for (size_t i = chunk * loop->grain; i < end && !aborted; ++i) {
+        frame[0] = (Value){VAL_NUMBER, {.number = loop->start + (double)i}};
+        for (size_t k = first_private; k < loop->frame_size; ++k) {
+            value_free(frame[k]);
+            frame[k].type = VAL_UNSET;
+        }
+        exec_block(loop->body);
+    }
+
+    double *partial = &loop->partials[chunk * (size_t)loop->reduction_count];
+    ASTNode *cell = loop->reductions;
+    for (int r = 0; r < loop->reduction_count && !aborted; ++r, cell = cell->right) {
+        Value v = frame[1 + r];
+        if (v.type != VAL_NUMBER) {
+            char msg[160];
+            snprintf(msg, sizeof(msg), "Reduction variable '%s' must be a number",
+                     cell->left->value);
+            fatal_error(msg);
+            break;
+        }
+        partial[r] = v.as.number;
+    }
+    leave_frame(base);
+    frame = saved_frame;
+    exec_worker = NULL;
+    if (aborted) {
+        // Reported already; the thread that started the loop stops the program
+        __atomic_store_n(&loop->failed, 1, __ATOMIC_RELAXED);
+        aborted = 0;
+    }
+}
+
+static ExecStatus exec_parallel(ASTNode *node) {
+    ParallelLoop loop;
+    memset(&loop, 0, sizeof(loop));
+    loop.body = node->right->left;
+    loop.reductions = node->right->right;
+    loop.frame_size = (size_t)node->slot;
+    for (ASTNode *n = loop.reductions; n != NULL; n = n->right) {
+        if (loop.reduction_count == MAX_REDUCTIONS) {
+            fatal_error("Too many 'jikota' variables");
+            return EXEC_ABORT;
+        }
+        loop.ops[loop.reduction_count++] = strcmp(n->value, "sum") == 0 ? REDUCE_SUM
+                                         : strcmp(n->value, "min") == 0 ? REDUCE_MIN
+                                                                        : REDUCE_MAX;
+    }
+    preload_modules(loop.body);
+    for (ASTNode *n = loop.reductions; n != NULL; n = n->right)
+        load_module_for(n->left->value, MODULE_VARIABLE);
+    if (aborted) return EXEC_ABORT;
+
+    Value from = eval(node->left);
+    Value to = eval(node->third);
+    if (aborted) return EXEC_ABORT;
+    if (from.type != VAL_NUMBER || to.type != VAL_NUMBER) {
+        report_error("Range of 'mgbe ngwa' must be numbers", -1);
+        value_free(from);
+        value_free(to);
+        return EXEC_NORMAL;
+    }
+    double span = to.as.number - from.as.number;
+    if (!(span < 9007199254740992.0)) {
+        report_error("Range of 'mgbe ngwa' is too large", -1);
+        return EXEC_NORMAL;
+    }
+    loop.start = from.as.number;
+    loop.count = span >= 0 ? (size_t)span + 1 : 0;
+    if (!check_private(loop.body, 1 + loop.reduction_count)) return EXEC_ABORT;
+
+    size_t chunks = 0;
+    if (loop.count > 0) {
+        loop.grain = (loop.count + PARALLEL_CHUNKS - 1) / PARALLEL_CHUNKS;
+        chunks = (loop.count + loop.grain - 1) / loop.grain;
+        loop.partials = memory_alloc(sizeof(double) * chunks * (loop.reduction_count + 1));
+        if (!loop.partials) {
+            report_error("Memory allocation failed for parallel loop", -1);
+            exit(1);
+        }
+    }
+
+    prepare_loops(loop.body);
+    parallel_init(pool_threads, exec_stack_size(), worker_start, worker_exit);
+    exec_share_begin();
+    for (size_t i = 0; i < var_count; ++i)
+        exec_share(vars[i].value);
+    // Counted rather than set, as isolates may be running too
+    __atomic_add_fetch(&parallel_active, 1, __ATOMIC_SEQ_CST);
+    parallel_run(chunks, run_chunk, &loop);
+    __atomic_sub_fetch(&parallel_active, 1, __ATOMIC_SEQ_CST);
+
+    if (loop.failed) {
+        memory_free(loop.partials);
+        aborted = 1;
+        return EXEC_ABORT;
+    }
+    // Combine the partial results in chunk order, then with the value the
+    // variable had before the loop
+    ASTNode *cell = loop.reductions;
+    for (int r = 0; r < loop.reduction_count; ++r, cell = cell->right) {
+        ReduceOp op = loop.ops[r];
+        double result = exec_reduce_identity(op);
+        for (size_t c = 0; c < chunks; ++c)
+            result = exec_reduce(op, result, loop.partials[c * (size_t)loop.reduction_count + r]);
+        Variable *v = find_var(cell->left->value);
+        if (v && v->value.type == VAL_NUMBER) {
+            result = exec_reduce(op, v->value.as.number, result);
+        } else if (v) {
+            char msg[160];
+            snprintf(msg, sizeof(msg), "Reduction variable '%s' must be a number",
+                     cell->left->value);
+            report_error(msg, -1);
+            continue;
+        }
+        set_var(cell->left->value, (Value){VAL_NUMBER, {.number = result}});
+    }
+    memory_free(loop.partials);
+    return EXEC_NORMAL;
+}
+
+// Isolates
+//
+// malite f(args)
+//
+// f runs on a thread of its own (see isolate.h), with its arguments
+// handed over as 'send' hands values over. Before it starts, the functions
+// it can reach through calls are checked for globals, which an isolate has
+// none of, and made ready so that running them never changes shared state:
+// the modules defining them are loaded and, unless other isolates are
+// running already, their 'mgbe' loops analysed.
+
+typedef struct {
+    Function *fn;
+    int argc;
+    Value args[];
+} IsolateCall;
+
+// Function definitions reached from the one being started
+typedef struct {
+    ASTNode **defs;
+    size_t count;
+    size_t capacity;
+} Reached;
+
+static void reach(Reached *r, ASTNode *def) {
+    for (size_t i = 0; i < r->count; ++i) {
+        if (r->defs[i] == def) return;
+    }
+    if (r->count == r->capacity) {
+        r->capacity = r->capacity ? r->capacity * 2 : 8;
+        r->defs = memory_realloc(r->defs, sizeof(ASTNode *) * r->capacity);
+        if (!r->defs) {
+            report_error("Memory allocation failed for isolate", -1);
+            exit(1);
+        }
+    }
+    r->defs[r->count++] = def;
+}
+
+static void prepare_body(ASTNode *node, ASTNode *def, Reached *r) {
+    if (!node || aborted) return;
+    if ((node->type == NODE_IDENTIFIER || node->type == NODE_INDEX_ASSIGN) && node->slot < 0) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Function '%s' cannot use global '%s' in an isolate",
+                 def->value, node->value);
+        fatal_error(msg);
+        return;
+    }
+    if (node->type == NODE_CALL) {
+        Function *fn = find_function(node->value);
+        if (!fn && load_module_for(node->value, MODULE_FUNCTION)) fn = find_function(node->value);
+        if (fn) reach(r, fn->def);
+    }
+    prepare_body(node->left, def, r);
+    prepare_body(node->right, def, r);
+    prepare_body(node->third, def, r);
+}
+
+static int prepare_isolate(Function *fn) {
+    Reached r = { NULL, 0, 0 };
+    reach(&r, fn->def);
+    for (size_t i = 0; i < r.count && !aborted; ++i) {
+        // Parameters are the first locals, so only the body is walked
+        prepare_body(r.defs[i]->right, r.defs[i], &r);
+        if (!parallel_active) prepare_loops(r.defs[i]->right);
+    }
+    memory_free(r.defs);
+    return !aborted;
+}
+
+static int run_isolate(void *context) {
+    IsolateCall *call = context;
+    exec_stack_guard();
+    exec_worker = EXEC_ISOLATE;
+    value_free(call_function(call->fn, call->args, call->argc));
+    memory_free(call);
+    int failed = aborted;
+    worker_exit();
+    return failed;
+}
+
+static void exec_spawn(ASTNode *node) {
+    ASTNode *call = node->left;
+    Function *fn = find_function(call->value);
+    if (!fn && load_module_for(call->value, MODULE_FUNCTION)) fn = find_function(call->value);
+    if (aborted) return;
+    char msg[160];
+    if (!fn || fn->def->yields) {
+        snprintf(msg, sizeof(msg), fn ? "Generator '%s' cannot run as an isolate"
+                                      : "Undefined function '%s'", call->value);
+        report_error(msg, -1);
+        return;
+    }
+    int argc = count_args(call->left);
+    if (!check_arity(fn, argc) || !prepare_isolate(fn)) return;
+    IsolateCall *isolate = memory_alloc(sizeof(IsolateCall) + sizeof(Value) * (size_t)argc);
+    if (!isolate) {
+        report_error("Memory allocation failed for isolate", -1);
+        exit(1);
+    }
+    isolate->fn = fn;
+    isolate->argc = argc;
+    int i = 0;
+    int sendable = 1;
+    for (ASTNode *n = call->left; n != NULL; n = n->right) {
+        isolate->args[i] = eval(n->left);
+        if (sendable && !aborted) sendable = isolate_transfer(&isolate->args[i]);
+        i++;
+    }
+    if (sendable && !aborted && isolate_start(run_isolate, isolate, exec_stack_size())) return;
+    if (sendable && !aborted) fatal_error("Could not start an isolate");
+    for (i = 0; i < argc; ++i)
+        value_free(isolate->args[i]);
+    memory_free(isolate);
+}
+
+// Top-level statements executed by interpret_statement() that defined a
+// function. Function entries point into them, so they are kept until
+// interpreter_finish().
+static ASTNode **retained = NULL;
+static size_t retained_count = 0;
+static size_t retained_capacity = 0;
+
+void interpreter_init(void) {
+    exec_stack_guard();
+    isolate_init();
+}
+
+int interpret_statement(ASTNode *stmt) {
+    size_t before = definitions;
+    types_infer(stmt, 1);
+    exec_stmt(stmt);
+    if (definitions == before) {
+        free_ast_node(stmt);
+    } else {
+        if (retained_count == retained_capacity) {
+            retained_capacity = retained_capacity ? retained_capacity * 2 : 8;
+            retained = memory_realloc(retained, sizeof(ASTNode *) * retained_capacity);
+            if (!retained) {
+                report_error("Memory allocation failed for functions", -1);
+                exit(1);
+            }
+        }
+        retained[retained_count++] = stmt;
+    }
+    return aborted;
+}
+
+int interpreter_finish(void) {
+    // Isolates still running use the functions and the tree freed below
+    if (memory_exhausted) aborted = 1;
+    if (aborted) isolate_stop();
+    if (isolate_join()) aborted = 1;
+    int status = aborted ? 1 : 0;
+    if (snapshot_path && !save_snapshot()) status = 1;
+    parallel_shutdown();
+    optimizer_reset();
+    memory_free(cells);
+    cells = NULL;
+    cell_capacity = 0;
     free_vars();
+    free_functions();
+    module_free_all();
+    gc_collect();
+    if (gc_stats) {
+        gc_print_stats();
+        memory_print_stats();
+    }
+    gc_shutdown();
+    intern_free_all();
+    for (size_t i = 0; i < retained_count; ++i)
+        free_ast_node(retained[i]);
+    memory_free(retained);
+    retained = NULL;
+    retained_count = 0;
+    retained_capacity = 0;
+    aborted = 0;
+    return status;
+}
+
+int interpret(ASTNode *ast) {
+    interpreter_init();
+    // Functions restored from a snapshot may take the place of builtins
+    types_infer(ast, func_count > 0);
+    exec_block(ast);
+    return interpreter_finish();
 }
 
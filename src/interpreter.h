@@ -2,7 +2,50 @@
 #define INTERPRETER_H
 
 #include "ast.h"
+#include "generator.h"
 
-void interpret(ASTNode *ast);
+// Run a program. Returns 0 on success, or 1 if execution was stopped by a
+// fatal error such as exceeding the maximum recursion depth or using up
+// the memory block given to memory_use() (see memory.h).
+int interpret(ASTNode *ast);
+
+// Incremental interface used for streaming execution: call
+// interpreter_init() once, hand each top-level statement to
+// interpret_statement() as soon as it has been parsed, then call
+// interpreter_finish(), which returns the same status as interpret().
+void interpreter_init(void);
+
+// Execute one top-level statement and take ownership of it. The node is
+// freed straight away unless it defined a function, in which case it is
+// kept until interpreter_finish(). Returns nonzero once execution has
+// been stopped by a fatal error.
+int interpret_statement(ASTNode *stmt);
+
+int interpreter_finish(void);
+
+// Run a generator to its next 'nye'. Returns 1 and stores the value
+// (owned by the caller) in *out, or returns 0 once the generator has
+// finished.
+int generator_next(Generator *gen, Value *out);
+
+// Path of the program, against which 'bubata' resolves relative paths.
+// Without one they are relative to the working directory.
+void interpreter_set_path(const char *path);
+
+// Number of threads 'mgbe ngwa' loops run on, counting the main thread.
+// 0 (the default) uses one per CPU. Takes effect when the first parallel
+// loop starts the thread pool.
+void interpreter_set_threads(int threads);
+
+// Print garbage collection statistics to stderr when the program ends.
+void interpreter_set_gc_stats(int enabled);
+
+// Save the global variables to a snapshot file (see snapshot.h) when the
+// program finishes without an error.
+void interpreter_set_snapshot(const char *path);
+
+// Define the global variables saved in a snapshot, before a program runs.
+// Returns 0 on success, or reports the problem and returns 1.
+int interpreter_load_snapshot(const char *path);
 
 #endif // INTERPRETER_H
@@ -0,0 +1,458 @@
+#define _POSIX_C_SOURCE 200809L
+#include "isolate.h"
+#include "list.h"
+#include "map.h"
+#include "memory.h"
+#include "parallel.h"
+#include "util.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A send or receive that cannot go ahead retries this many times, giving
+// up the CPU in between, before it goes to sleep
+#define CHANNEL_SPINS 64
+
+volatile int isolates_stopping = 0;
+
+// Sleeping threads wait on one condition variable. A thread that makes
+// progress on any channel wakes all of them, but only when 'sleepers' says
+// there are any, so the common case takes no lock.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static int sleepers = 0;
+
+// A sleeping thread and what it waits for. The list lets the last thread
+// to fall asleep see that none of the others can ever be woken.
+typedef struct Waiter {
+    Channel *channel;    // NULL: waiting for every isolate to finish
+    int sending;
+    int counted;
+    struct Waiter *next;
+} Waiter;
+
+// Everything below is guarded by lock. The threads counted in deadlock
+// detection are the program's own and the isolates; the workers of a
+// parallel loop are not, and while one runs no deadlock is reported.
+static Waiter *waiters = NULL;
+static int isolates = 0;       // isolates running
+static int parked = 0;         // counted threads asleep
+static int failed = 0;
+static pthread_t *threads = NULL;
+static size_t thread_count = 0;
+static size_t thread_capacity = 0;
+
+static THREAD_LOCAL int counted = 0;
+
+static void *checked_alloc(void *ptr, size_t size) {
+    void *tmp = memory_realloc(ptr, size);
+    if (!tmp) {
+        report_error("Memory allocation failed for isolates", -1);
+        exit(1);
+    }
+    return tmp;
+}
+
+// Channels
+
+Channel *channel_new(ValueType type, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size *= 2;
+    Channel *c = gc_alloc(sizeof(Channel));
+    gc_init(&c->gc, GC_CHANNEL);
+    c->type = type;
+    c->closed = 0;
+    c->mask = size - 1;
+    c->cells = checked_alloc(NULL, sizeof(ChannelCell) * size);
+    for (size_t i = 0; i < size; ++i)
+        c->cells[i].sequence = i;
+    c->head = 0;
+    c->tail = 0;
+    return c;
+}
+
+void channel_retain(Channel *channel) {
+    gc_retain(&channel->gc);
+}
+
+void channel_release(Channel *channel) {
+    gc_release(&channel->gc);
+}
+
+void channel_destroy(Channel *channel, int drop) {
+    for (size_t pos = channel->tail; pos != channel->head; ++pos) {
+        Value v = channel->cells[pos & channel->mask].value;
+        if (drop)
+            value_drop(v);
+        else
+            value_free(v);
+    }
+    memory_free(channel->cells);
+}
+
+// A cell is free to send into when its sequence equals the position of
+// the send, and holds a value once a send has moved it one further. A
+// receive moves it on by the capacity, ready for the next lap.
+static int try_send(Channel *c, Value value) {
+    size_t pos = __atomic_load_n(&c->head, __ATOMIC_RELAXED);
+    for (;;) {
+        ChannelCell *cell = &c->cells[pos & c->mask];
+        size_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&c->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->value = value;
+                __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;   // full
+        } else {
+            pos = __atomic_load_n(&c->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int try_receive(Channel *c, Value *out) {
+    size_t pos = __atomic_load_n(&c->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        ChannelCell *cell = &c->cells[pos & c->mask];
+        size_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&c->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *out = cell->value;
+                __atomic_store_n(&cell->sequence, pos + c->mask + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;   // empty
+        } else {
+            pos = __atomic_load_n(&c->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Wake the sleeping threads after a send, receive or close. The fence
+// pairs with the one in wait_for(): either the sleeper sees the change
+// before it sleeps, or this sees the sleeper.
+static void progress(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sleepers, __ATOMIC_RELAXED) == 0) return;
+    pthread_mutex_lock(&lock);
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+static int ready(const Waiter *w) {
+    if (!w->channel) return isolates == 0;
+    Channel *c = w->channel;
+    if (__atomic_load_n(&c->closed, __ATOMIC_ACQUIRE)) return 1;
+    size_t pos = __atomic_load_n(w->sending ? &c->head : &c->tail, __ATOMIC_RELAXED);
+    size_t seq = __atomic_load_n(&c->cells[pos & c->mask].sequence, __ATOMIC_ACQUIRE);
+    return seq == (w->sending ? pos : pos + 1);
+}
+
+// Every counted thread is asleep, no parallel loop is running that could
+// wake one, and none of them can go ahead
+static int deadlocked(void) {
+    if (parked < isolates + 1 || parallel_active != isolates) return 0;
+    for (Waiter *w = waiters; w; w = w->next) {
+        if (ready(w)) return 0;
+    }
+    return 1;
+}
+
+static void stop(void) {
+    isolates_stopping = 1;
+    pthread_cond_broadcast(&wake);
+}
+
+// Sleep until w can go ahead. Returns 0 if the program is stopping
+// instead; waiting for the isolates to finish goes on regardless.
+static int wait_for(Waiter *w) {
+    for (int i = 0; w->channel && i < CHANNEL_SPINS; ++i) {
+        if (ready(w) || isolates_stopping) break;
+        sched_yield();
+    }
+    pthread_mutex_lock(&lock);
+    __atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+    w->counted = counted;
+    w->next = waiters;
+    waiters = w;
+    if (w->counted) parked++;
+    while (!ready(w)) {
+        if (w->channel && isolates_stopping) break;
+        if (!isolates_stopping && deadlocked()) {
+            report_error("Deadlock: every isolate is waiting on a channel", -1);
+            failed = 1;
+            stop();
+            continue;
+        }
+        pthread_cond_wait(&wake, &lock);
+    }
+    Waiter **link = &waiters;
+    while (*link != w) link = &(*link)->next;
+    *link = w->next;
+    if (w->counted) parked--;
+    __atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+    int go = !isolates_stopping || !w->channel;
+    pthread_mutex_unlock(&lock);
+    return go;
+}
+
+int channel_send(Channel *channel, Value value) {
+    Waiter w = { channel, 1, 0, NULL };
+    for (;;) {
+        if (__atomic_load_n(&channel->closed, __ATOMIC_ACQUIRE)) return 0;
+        if (try_send(channel, value)) {
+            progress();
+            return 1;
+        }
+        if (!wait_for(&w)) {
+            value_free(value);
+            return -1;
+        }
+    }
+}
+
+int channel_receive(Channel *channel, Value *out) {
+    Waiter w = { channel, 0, 0, NULL };
+    for (;;) {
+        if (try_receive(channel, out)) {
+            progress();
+            return 1;
+        }
+        if (__atomic_load_n(&channel->closed, __ATOMIC_ACQUIRE)) {
+            // A value sent just before the close is still delivered
+            if (!try_receive(channel, out)) return 0;
+            progress();
+            return 1;
+        }
+        if (!wait_for(&w)) return -1;
+    }
+}
+
+int channel_close(Channel *channel) {
+    int was_closed = __atomic_exchange_n(&channel->closed, 1, __ATOMIC_ACQ_REL);
+    progress();
+    return !was_closed;
+}
+
+// Isolates
+
+typedef struct {
+    int (*run)(void *context);
+    void *context;
+} IsolateStart;
+
+static void *isolate_main(void *arg) {
+    IsolateStart start = *(IsolateStart *)arg;
+    memory_free(arg);
+    counted = 1;
+    int error = start.run(start.context);
+    pthread_mutex_lock(&lock);
+    if (error) {
+        failed = 1;
+        isolates_stopping = 1;
+    }
+    isolates--;
+    __atomic_sub_fetch(&parallel_active, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+void isolate_init(void) {
+    counted = 1;
+}
+
+int isolate_start(int (*run)(void *context), void *context, size_t stack_size) {
+    IsolateStart *start = checked_alloc(NULL, sizeof(IsolateStart));
+    start->run = run;
+    start->context = context;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, stack_size);
+    pthread_mutex_lock(&lock);
+    if (thread_count == thread_capacity) {
+        thread_capacity = thread_capacity ? thread_capacity * 2 : 8;
+        threads = checked_alloc(threads, sizeof(pthread_t) * thread_capacity);
+    }
+    // Counted before the thread exists, so reference counts are updated
+    // atomically from here on
+    isolates++;
+    __atomic_add_fetch(&parallel_active, 1, __ATOMIC_SEQ_CST);
+    int ok = pthread_create(&threads[thread_count], &attr, isolate_main, start) == 0;
+    if (ok) {
+        thread_count++;
+    } else {
+        isolates--;
+        __atomic_sub_fetch(&parallel_active, 1, __ATOMIC_SEQ_CST);
+        memory_free(start);
+    }
+    pthread_mutex_unlock(&lock);
+    pthread_attr_destroy(&attr);
+    return ok;
+}
+
+void isolate_stop(void) {
+    pthread_mutex_lock(&lock);
+    stop();
+    pthread_mutex_unlock(&lock);
+}
+
+int isolate_join(void) {
+    Waiter w = { NULL, 0, 0, NULL };
+    wait_for(&w);
+    for (size_t i = 0; i < thread_count; ++i)
+        pthread_join(threads[i], NULL);
+    memory_free(threads);
+    threads = NULL;
+    thread_count = thread_capacity = 0;
+    int status = failed;
+    failed = 0;
+    isolates_stopping = 0;
+    return status;
+}
+
+// Handing values over
+
+// Nothing but this reference reaches v or anything in it. A container in
+// a cycle is referenced from inside the cycle as well, so the walk never
+// goes round one.
+static int exclusive(Value v) {
+    if (v.type == VAL_LIST) {
+        List *list = v.as.list;
+        if (__atomic_load_n(&list->gc.refcount, __ATOMIC_ACQUIRE) != 1) return 0;
+        if (!list->boxed) return 1;
+        for (size_t i = 0; i < list->count; ++i) {
+            if (!exclusive(list->items[i])) return 0;
+        }
+        return 1;
+    }
+    if (v.type == VAL_MAP) {
+        Map *map = v.as.map;
+        if (__atomic_load_n(&map->gc.refcount, __ATOMIC_ACQUIRE) != 1) return 0;
+        for (size_t i = 0; i < map->capacity; ++i) {
+            if (map->entries[i].distance && !exclusive(map->entries[i].value)) return 0;
+        }
+        return 1;
+    }
+    return v.type != VAL_GENERATOR;
+}
+
+// Containers copied so far, by address, so one reached twice (or through
+// a cycle) is copied once and the copy keeps the original's shape
+typedef struct {
+    const void *from;
+    Value to;
+} Copied;
+
+typedef struct {
+    Copied *slots;
+    size_t capacity;    // power of two
+    size_t count;
+    int generator;      // a generator was found, which cannot be sent
+} CopyTable;
+
+static size_t pointer_hash(const void *p) {
+    uintptr_t h = (uintptr_t)p;
+    h ^= h >> 17;
+    h *= (uintptr_t)0xed5ad4bbu;
+    h ^= h >> 11;
+    return (size_t)h;
+}
+
+static Copied *copied_slot(CopyTable *t, const void *from) {
+    size_t i = pointer_hash(from) & (t->capacity - 1);
+    while (t->slots[i].from && t->slots[i].from != from)
+        i = (i + 1) & (t->capacity - 1);
+    return &t->slots[i];
+}
+
+static void remember(CopyTable *t, const void *from, Value to) {
+    if ((t->count + 1) * 2 > t->capacity) {
+        Copied *old = t->slots;
+        size_t old_capacity = t->capacity;
+        t->capacity = old_capacity ? old_capacity * 2 : 16;
+        t->slots = checked_alloc(NULL, sizeof(Copied) * t->capacity);
+        memset(t->slots, 0, sizeof(Copied) * t->capacity);
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old[i].from) *copied_slot(t, old[i].from) = old[i];
+        }
+        memory_free(old);
+    }
+    Copied *slot = copied_slot(t, from);
+    slot->from = from;
+    slot->to = to;
+    t->count++;
+}
+
+static Value deep_copy(Value v, CopyTable *t) {
+    const void *from = v.type == VAL_LIST ? (const void *)v.as.list
+                     : v.type == VAL_MAP ? (const void *)v.as.map : NULL;
+    if (from && t->capacity) {
+        Copied *seen = copied_slot(t, from);
+        if (seen->from) return value_copy(seen->to);
+    }
+    switch (v.type) {
+        case VAL_STRING:
+            v.as.string = string_duplicate(v.as.string);
+            return v;
+        case VAL_LIST: {
+            List *list = v.as.list;
+            List *copy = list_new(list->boxed ? 0 : list->count);
+            Value result = { VAL_LIST, { .list = copy } };
+            remember(t, list, result);
+            if (!list->boxed) {
+                if (list->count) memcpy(copy->nums, list->nums, sizeof(double) * list->count);
+                copy->count = list->count;
+                return result;
+            }
+            for (size_t i = 0; i < list->count; ++i)
+                list_push(copy, deep_copy(list->items[i], t));
+            return result;
+        }
+        case VAL_MAP: {
+            Map *map = v.as.map;
+            Map *copy = map_new();
+            Value result = { VAL_MAP, { .map = copy } };
+            remember(t, map, result);
+            map_reserve(copy, map->count);
+            size_t pos = 0;
+            MapEntry *entry;
+            while ((entry = map_next(map, &pos)) != NULL) {
+                Value item = deep_copy(entry->value, t);
+                map_set(copy, entry->key, item);
+                value_free(item);
+            }
+            return result;
+        }
+        case VAL_GENERATOR:
+            t->generator = 1;
+            return (Value){ VAL_NUMBER, { .number = 0 } };
+        default:
+            return value_copy(v);
+    }
+}
+
+int isolate_transfer(Value *value) {
+    if (exclusive(*value)) return 1;
+    CopyTable table = { NULL, 0, 0, 0 };
+    Value copy = deep_copy(*value, &table);
+    memory_free(table.slots);
+    if (table.generator) {
+        value_free(copy);
+        report_error("Cannot send a generator to another isolate", -1);
+        return 0;
+    }
+    value_free(*value);
+    *value = copy;
+    return 1;
+}
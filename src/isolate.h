@@ -0,0 +1,102 @@
+#ifndef ISOLATE_H
+#define ISOLATE_H
+
+#include "gc.h"
+#include "value.h"
+#include <stddef.h>
+
+// Isolates and channels.
+//
+// 'malite f(args)' runs the function f on a thread of its own: an
+// isolate. Isolates have their own value stack and frames like the
+// workers of a parallel loop, but never see the program's globals; the
+// only way values get in or out of one is through its arguments and
+// through channels.
+//
+// A channel is a bounded queue of values of one type, shared by any
+// number of senders and receivers. It is a ring of cells, each carrying a
+// sequence number that says whether it is ready to be written or read in
+// the current lap (Vyukov's bounded MPMC queue), so a send or a receive
+// that finds room or a value takes no lock. One that does not spins for a
+// short while and then sleeps until another thread makes progress.
+//
+// A value sent to another isolate is handed over, not shared: a string,
+// list or map that nothing else refers to moves as it is, anything else is
+// copied first (see isolate_transfer()), so two isolates never hold the
+// same container.
+
+typedef struct {
+    size_t sequence;
+    Value value;
+} ChannelCell;
+
+// Keeps head and tail on cache lines of their own, away from the fields
+// every operation reads.
+#define CHANNEL_PAD 64
+
+typedef struct Channel {
+    GcObject gc;
+    ValueType type;          // type of every value sent
+    int closed;
+    size_t mask;             // capacity - 1; the capacity is a power of two
+    ChannelCell *cells;
+    char pad0[CHANNEL_PAD];
+    size_t head;             // next cell to send into
+    char pad1[CHANNEL_PAD];
+    size_t tail;             // next cell to receive from
+    char pad2[CHANNEL_PAD];
+} Channel;
+
+// Create a channel for values of the given type holding up to capacity
+// of them (rounded up to a power of two, at least 2).
+Channel *channel_new(ValueType type, size_t capacity);
+void channel_retain(Channel *channel);
+void channel_release(Channel *channel);
+
+// Free the values still queued in a channel that is being freed, as
+// list_destroy() does.
+void channel_destroy(Channel *channel, int drop);
+
+// Send value (which the channel takes ownership of), waiting while the
+// channel is full. Returns 1 once it is queued, 0 if the channel is
+// closed, leaving the value to the caller, and -1 if the program is
+// stopping, when the value is freed.
+int channel_send(Channel *channel, Value value);
+
+// Receive the oldest value into *out, waiting while the channel is empty.
+// Returns 1 with a value, 0 once the channel is closed and empty and -1
+// if the program is stopping.
+int channel_receive(Channel *channel, Value *out);
+
+// No more values can be sent. Values already queued can still be
+// received. Returns 1 if the channel was open.
+int channel_close(Channel *channel);
+
+// Set once an isolate has stopped with an error, or every isolate is
+// waiting on a channel that nothing will ever send to or receive from.
+// Every thread of the program stops at its next statement.
+extern volatile int isolates_stopping;
+
+// Called by the thread that runs the program before it starts, so it is
+// counted when looking for a deadlock.
+void isolate_init(void);
+
+// Run run(context) on a new thread with the given stack size. The
+// thread's return value says whether it stopped with an error, which
+// stops the program. Returns 0 if the thread could not be started.
+int isolate_start(int (*run)(void *context), void *context, size_t stack_size);
+
+// Turn *value into one that can be handed to another isolate: strings,
+// lists and maps only this reference reaches are kept, others are
+// replaced by a copy. Reports an error and returns 0 for a value that
+// cannot be sent (a generator), leaving *value as it was.
+int isolate_transfer(Value *value);
+
+// Stop every isolate at its next statement.
+void isolate_stop(void);
+
+// Wait for every isolate to finish. Returns 1 if one of them stopped with
+// an error or they deadlocked.
+int isolate_join(void);
+
+#endif // ISOLATE_H
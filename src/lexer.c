@@ -1,20 +1,23 @@
 #include "lexer.h"
+#include "memory.h"
+#include "unicode.h"
 #include "util.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 
 // Internal helper to grow the token array when needed
-static void ensure_capacity(Token **tokens, size_t *capacity, size_t count) {
+static int ensure_capacity(Token **tokens, size_t *capacity, size_t count) {
     if (count + 1 >= *capacity) {
         *capacity *= 2;
-        Token *tmp = realloc(*tokens, sizeof(Token) * (*capacity));
+        Token *tmp = memory_realloc(*tokens, sizeof(Token) * (*capacity));
         if (!tmp) {
             report_error("Memory allocation failed while tokenizing", -1);
-            return;
+            return 0;
         }
         *tokens = tmp;
     }
+    return 1;
 }
 
 // Convert a token type to a human readable string
@@ -25,6 +28,11 @@ const char *token_type_string(TokenType type) {
         case TOKEN_MANA: return "MANA";
         case TOKEN_MGBE: return "MGBE";
         case TOKEN_GOSI: return "GOSI";
+        case TOKEN_MAKA: return "MAKA";
+        case TOKEN_NA: return "NA";
+        case TOKEN_ORU: return "ORU";
+        case TOKEN_LAGHACHI: return "LAGHACHI";
+        case TOKEN_NYE: return "NYE";
         case TOKEN_EZIOKWU: return "EZIOKWU";
         case TOKEN_UGHA: return "UGHA";
         case TOKEN_IDENTIFIER: return "IDENTIFIER";
@@ -45,6 +53,10 @@ const char *token_type_string(TokenType type) {
         case TOKEN_RPAREN: return "RPAREN";
         case TOKEN_LBRACE: return "LBRACE";
         case TOKEN_RBRACE: return "RBRACE";
+        case TOKEN_LBRACKET: return "LBRACKET";
+        case TOKEN_RBRACKET: return "RBRACKET";
+        case TOKEN_COMMA: return "COMMA";
+        case TOKEN_COLON: return "COLON";
         case TOKEN_EOF: return "EOF";
         default: return "UNKNOWN";
     }
@@ -54,284 +66,364 @@ const char *token_type_string(TokenType type) {
 void free_tokens(Token *tokens) {
     if (!tokens) return;
     for (size_t i = 0; tokens[i].type != TOKEN_EOF; ++i) {
-        free(tokens[i].value);
+        memory_free(tokens[i].value);
+    }
+    memory_free(tokens);
+}
+
+void lexer_init_buffer(Lexer *lexer, const char *source, size_t length) {
+    // The buffer is never written in string mode.
+    lexer->buf = (char *)source;
+    lexer->len = length;
+    lexer->pos = 0;
+    lexer->start = 0;
+    lexer->cap = 0;
+    lexer->in = NULL;
+    lexer->line = 1;
+    lexer->done = 0;
+    lexer->quiet = 0;
+    lexer->errors = 0;
+    lexer->checked = 0;
+    lexer->offset = 0;
+    lexer->invalid = 0;
+}
+
+void lexer_init_string(Lexer *lexer, const char *source) {
+    lexer_init_buffer(lexer, source, strlen(source));
+}
+
+void lexer_init_file(Lexer *lexer, FILE *in) {
+    lexer->buf = memory_alloc(LEXER_BUFFER_SIZE);
+    if (!lexer->buf) {
+        report_error("Memory allocation failed for lexer buffer", -1);
+        exit(1);
+    }
+    lexer->len = 0;
+    lexer->pos = 0;
+    lexer->start = 0;
+    lexer->cap = LEXER_BUFFER_SIZE;
+    lexer->in = in;
+    lexer->line = 1;
+    lexer->done = 0;
+    lexer->quiet = 0;
+    lexer->errors = 0;
+    lexer->checked = 0;
+    lexer->offset = 0;
+    lexer->invalid = 0;
+}
+
+void lexer_free(Lexer *lexer) {
+    if (lexer->in) memory_free(lexer->buf);
+    lexer->buf = NULL;
+}
+
+static void lex_error(Lexer *lexer, const char *message, int line_number) {
+    lexer->errors++;
+    if (!lexer->quiet)
+        report_error(message, line_number);
+}
+
+// Validate the bytes added to the window since the last check. Unless
+// the input has ended, a character cut off at the end of the window is
+// left for the next check. On an error the window is cut short before the
+// bad byte, so lexing stops there.
+static void check_utf8(Lexer *lexer, int at_end) {
+    int truncated;
+    size_t bad = lexer->checked + unicode_validate(lexer->buf + lexer->checked,
+                                                   lexer->len - lexer->checked, &truncated);
+    lexer->checked = bad;
+    if (bad == lexer->len || (truncated && !at_end)) return;
+    int line = lexer->line;
+    for (size_t i = lexer->pos; i < bad; ++i) {
+        if (lexer->buf[i] == '\n') line++;
     }
-    free(tokens);
+    char msg[80];
+    snprintf(msg, sizeof(msg), "Invalid UTF-8 at byte offset %zu", lexer->offset + bad);
+    lex_error(lexer, msg, line);
+    lexer->invalid = 1;
+    lexer->len = bad;
+}
+
+// Read more input into the window, keeping the token being scanned.
+// Returns 0 once the stream is exhausted.
+static int refill(Lexer *lexer) {
+    if (!lexer->in || lexer->invalid) return 0;
+    if (lexer->start > 0) {
+        memmove(lexer->buf, lexer->buf + lexer->start, lexer->len - lexer->start);
+        lexer->len -= lexer->start;
+        lexer->pos -= lexer->start;
+        lexer->checked -= lexer->start;
+        lexer->offset += lexer->start;
+        lexer->start = 0;
+    }
+    if (lexer->len == lexer->cap) {
+        // A single token fills the whole window
+        size_t cap = lexer->cap * 2;
+        char *tmp = memory_realloc(lexer->buf, cap);
+        if (!tmp) {
+            lex_error(lexer, "Memory allocation failed for lexer buffer", lexer->line);
+            return 0;
+        }
+        lexer->buf = tmp;
+        lexer->cap = cap;
+    }
+    size_t n = fread(lexer->buf + lexer->len, 1, lexer->cap - lexer->len, lexer->in);
+    lexer->len += n;
+    if (lexer->checked < lexer->len) check_utf8(lexer, n == 0);
+    return n > 0 && !lexer->invalid;
+}
+
+static char peek_slow(Lexer *lexer, size_t k) {
+    while (lexer->pos + k >= lexer->len) {
+        if (!refill(lexer)) return '\0';
+    }
+    return lexer->buf[lexer->pos + k];
+}
+
+// Character k bytes ahead of the current position, or '\0' past the end
+static inline char peek_char(Lexer *lexer, size_t k) {
+    if (lexer->pos + k < lexer->len)
+        return lexer->buf[lexer->pos + k];
+    return peek_slow(lexer, k);
+}
+
+// Copy the bytes of the current token from start to end into a new string
+static char *token_text(Lexer *lexer, size_t start, size_t end) {
+    size_t len = end - start;
+    char *text = memory_alloc(len + 1);
+    if (!text) return NULL;
+    memcpy(text, lexer->buf + start, len);
+    text[len] = '\0';
+    return text;
+}
+
+static TokenType keyword_type(const char *text) {
+    if (strcmp(text, "dee") == 0)
+        return TOKEN_DEE;
+    else if (strcmp(text, "ma") == 0)
+        return TOKEN_MA;
+    else if (strcmp(text, "mana") == 0)
+        return TOKEN_MANA;
+    else if (strcmp(text, "mgbe") == 0)
+        return TOKEN_MGBE;
+    else if (strcmp(text, "gosi") == 0)
+        return TOKEN_GOSI;
+    else if (strcmp(text, "maka") == 0)
+        return TOKEN_MAKA;
+    else if (strcmp(text, "na") == 0)
+        return TOKEN_NA;
+    else if (strcmp(text, "oru") == 0)
+        return TOKEN_ORU;
+    else if (strcmp(text, "laghachi") == 0)
+        return TOKEN_LAGHACHI;
+    else if (strcmp(text, "nye") == 0)
+        return TOKEN_NYE;
+    else if (strcmp(text, "eziokwu") == 0)
+        return TOKEN_EZIOKWU;
+    else if (strcmp(text, "ụgha") == 0)
+        return TOKEN_UGHA;
+    return TOKEN_IDENTIFIER;
+}
+
+static void make_token(Lexer *lexer, Token *token, TokenType type, char *value) {
+    token->type = type;
+    token->value = value;
+    token->line_number = lexer->line;
+}
+
+// Stop lexing: the current and every later call yield TOKEN_EOF
+static void finish(Lexer *lexer, Token *token) {
+    lexer->done = 1;
+    make_token(lexer, token, TOKEN_EOF, NULL);
 }
 
 // Main lexer implementation
-Token *tokenize(const char *source) {
-    size_t capacity = 64;
-    size_t count = 0;
-    Token *tokens = malloc(sizeof(Token) * capacity);
-    if (!tokens) {
-        report_error("Memory allocation failed for tokens", -1);
-        return NULL;
+void lexer_next(Lexer *lexer, Token *token) {
+    if (lexer->done) {
+        make_token(lexer, token, TOKEN_EOF, NULL);
+        return;
+    }
+    // The whole string is checked up front
+    if (!lexer->in && lexer->checked < lexer->len) check_utf8(lexer, 1);
+    if (lexer->invalid) {
+        finish(lexer, token);
+        return;
     }
 
-    size_t i = 0;
-    int line = 1;
+    for (;;) {
+        lexer->start = lexer->pos;
+        char c = peek_char(lexer, 0);
 
-    while (source[i]) {
-        char c = source[i];
+        if (c == '\0') {
+            finish(lexer, token);
+            return;
+        }
 
         // Skip whitespace
         if (c == ' ' || c == '\t' || c == '\r') {
-            i++;
+            lexer->pos++;
             continue;
         }
 
         if (c == '\n') {
-            line++;
-            i++;
+            lexer->line++;
+            lexer->pos++;
             continue;
         }
 
         // Skip comments
-        if (c == '/' && source[i + 1] == '/') {
-            i += 2;
-            while (source[i] && source[i] != '\n')
-                i++;
+        if (c == '/' && peek_char(lexer, 1) == '/') {
+            lexer->pos += 2;
+            for (;;) {
+                lexer->start = lexer->pos;
+                char d = peek_char(lexer, 0);
+                if (!d || d == '\n') break;
+                lexer->pos++;
+            }
             continue;
         }
 
         // Identifiers and keywords
         if (isalpha((unsigned char)c) || c == '_' || (c & 0x80)) {
-            size_t start = i;
-            while (isalnum((unsigned char)source[i]) || source[i] == '_' || (source[i] & 0x80))
-                i++;
-            size_t len = i - start;
-            char *text = malloc(len + 1);
+            int wide = c & 0x80;
+            for (;;) {
+                char d = peek_char(lexer, 0);
+                if (!(isalnum((unsigned char)d) || d == '_' || (d & 0x80))) break;
+                wide |= d & 0x80;
+                lexer->pos++;
+            }
+            // Only names with non-ASCII letters can need normalizing
+            char *text = wide ? unicode_nfc(lexer->buf + lexer->start, lexer->pos - lexer->start)
+                              : token_text(lexer, lexer->start, lexer->pos);
             if (!text) {
-                report_error("Memory allocation failed", line);
-                break;
+                lex_error(lexer, "Memory allocation failed", lexer->line);
+                finish(lexer, token);
+                return;
             }
-            memcpy(text, &source[start], len);
-            text[len] = '\0';
-
-            TokenType type = TOKEN_IDENTIFIER;
-            if (strcmp(text, "dee") == 0)
-                type = TOKEN_DEE;
-            else if (strcmp(text, "ma") == 0)
-                type = TOKEN_MA;
-            else if (strcmp(text, "mana") == 0)
-                type = TOKEN_MANA;
-            else if (strcmp(text, "mgbe") == 0)
-                type = TOKEN_MGBE;
-            else if (strcmp(text, "gosi") == 0)
-                type = TOKEN_GOSI;
-            else if (strcmp(text, "eziokwu") == 0)
-                type = TOKEN_EZIOKWU;
-            else if (strcmp(text, "ụgha") == 0)
-                type = TOKEN_UGHA;
-
-            ensure_capacity(&tokens, &capacity, count);
-            tokens[count].type = type;
-            tokens[count].value = text;
-            tokens[count].line_number = line;
-            count++;
-            continue;
+            make_token(lexer, token, keyword_type(text), text);
+            return;
         }
 
         // Numbers
         if (isdigit((unsigned char)c)) {
-            size_t start = i;
-            while (isdigit((unsigned char)source[i]))
-                i++;
-            size_t len = i - start;
-            char *num = malloc(len + 1);
+            while (isdigit((unsigned char)peek_char(lexer, 0)))
+                lexer->pos++;
+            char *num = token_text(lexer, lexer->start, lexer->pos);
             if (!num) {
-                report_error("Memory allocation failed", line);
-                break;
+                lex_error(lexer, "Memory allocation failed", lexer->line);
+                finish(lexer, token);
+                return;
             }
-            memcpy(num, &source[start], len);
-            num[len] = '\0';
-
-            ensure_capacity(&tokens, &capacity, count);
-            tokens[count].type = TOKEN_NUMBER;
-            tokens[count].value = num;
-            tokens[count].line_number = line;
-            count++;
-            continue;
+            make_token(lexer, token, TOKEN_NUMBER, num);
+            return;
         }
 
         // Strings
         if (c == '"') {
-            i++; // skip opening quote
-            size_t start = i;
-            while (source[i] && source[i] != '"') {
-                if (source[i] == '\n')
-                    line++;
-                i++;
+            lexer->pos++; // skip opening quote
+            for (;;) {
+                char d = peek_char(lexer, 0);
+                if (!d || d == '"') break;
+                if (d == '\n')
+                    lexer->line++;
+                lexer->pos++;
             }
-            if (source[i] != '"') {
-                report_error("Unterminated string", line);
-                break;
+            if (peek_char(lexer, 0) != '"') {
+                lex_error(lexer, "Unterminated string", lexer->line);
+                finish(lexer, token);
+                return;
             }
-            size_t len = i - start;
-            char *str = malloc(len + 1);
+            char *str = token_text(lexer, lexer->start + 1, lexer->pos);
             if (!str) {
-                report_error("Memory allocation failed", line);
-                break;
+                lex_error(lexer, "Memory allocation failed", lexer->line);
+                finish(lexer, token);
+                return;
             }
-            memcpy(str, &source[start], len);
-            str[len] = '\0';
-            i++; // skip closing quote
-
-            ensure_capacity(&tokens, &capacity, count);
-            tokens[count].type = TOKEN_STRING;
-            tokens[count].value = str;
-            tokens[count].line_number = line;
-            count++;
-            continue;
+            lexer->pos++; // skip closing quote
+            make_token(lexer, token, TOKEN_STRING, str);
+            return;
         }
 
         // Operators and punctuation
+        TokenType type = TOKEN_EOF;
+        size_t width = 1;
+        char next = peek_char(lexer, 1);
         switch (c) {
             case '=':
-                if (source[i + 1] == '=') {
-                    ensure_capacity(&tokens, &capacity, count);
-                    tokens[count].type = TOKEN_EQUAL;
-                    tokens[count].value = string_duplicate("==");
-                    tokens[count].line_number = line;
-                    count++;
-                    i += 2;
-                } else {
-                    ensure_capacity(&tokens, &capacity, count);
-                    tokens[count].type = TOKEN_ASSIGN;
-                    tokens[count].value = string_duplicate("=");
-                    tokens[count].line_number = line;
-                    count++;
-                    i++;
-                }
-                continue;
+                if (next == '=') { type = TOKEN_EQUAL; width = 2; }
+                else type = TOKEN_ASSIGN;
+                break;
             case '!':
-                if (source[i + 1] == '=') {
-                    ensure_capacity(&tokens, &capacity, count);
-                    tokens[count].type = TOKEN_NOT_EQUAL;
-                    tokens[count].value = string_duplicate("!=");
-                    tokens[count].line_number = line;
-                    count++;
-                    i += 2;
-                    continue;
-                }
+                if (next == '=') { type = TOKEN_NOT_EQUAL; width = 2; }
                 break;
             case '<':
-                if (source[i + 1] == '=') {
-                    ensure_capacity(&tokens, &capacity, count);
-                    tokens[count].type = TOKEN_LESS_EQUAL;
-                    tokens[count].value = string_duplicate("<=");
-                    tokens[count].line_number = line;
-                    count++;
-                    i += 2;
-                } else {
-                    ensure_capacity(&tokens, &capacity, count);
-                    tokens[count].type = TOKEN_LESS;
-                    tokens[count].value = string_duplicate("<");
-                    tokens[count].line_number = line;
-                    count++;
-                    i++;
-                }
-                continue;
+                if (next == '=') { type = TOKEN_LESS_EQUAL; width = 2; }
+                else type = TOKEN_LESS;
+                break;
             case '>':
-                if (source[i + 1] == '=') {
-                    ensure_capacity(&tokens, &capacity, count);
-                    tokens[count].type = TOKEN_GREATER_EQUAL;
-                    tokens[count].value = string_duplicate(">=");
-                    tokens[count].line_number = line;
-                    count++;
-                    i += 2;
-                } else {
-                    ensure_capacity(&tokens, &capacity, count);
-                    tokens[count].type = TOKEN_GREATER;
-                    tokens[count].value = string_duplicate(">");
-                    tokens[count].line_number = line;
-                    count++;
-                    i++;
-                }
-                continue;
-            case '+':
-                ensure_capacity(&tokens, &capacity, count);
-                tokens[count].type = TOKEN_PLUS;
-                tokens[count].value = string_duplicate("+");
-                tokens[count].line_number = line;
-                count++;
-                i++;
-                continue;
-            case '-':
-                ensure_capacity(&tokens, &capacity, count);
-                tokens[count].type = TOKEN_MINUS;
-                tokens[count].value = string_duplicate("-");
-                tokens[count].line_number = line;
-                count++;
-                i++;
-                continue;
-            case '*':
-                ensure_capacity(&tokens, &capacity, count);
-                tokens[count].type = TOKEN_MULTIPLY;
-                tokens[count].value = string_duplicate("*");
-                tokens[count].line_number = line;
-                count++;
-                i++;
-                continue;
-            case '/':
-                ensure_capacity(&tokens, &capacity, count);
-                tokens[count].type = TOKEN_DIVIDE;
-                tokens[count].value = string_duplicate("/");
-                tokens[count].line_number = line;
-                count++;
-                i++;
-                continue;
-            case '(':
-                ensure_capacity(&tokens, &capacity, count);
-                tokens[count].type = TOKEN_LPAREN;
-                tokens[count].value = string_duplicate("(");
-                tokens[count].line_number = line;
-                count++;
-                i++;
-                continue;
-            case ')':
-                ensure_capacity(&tokens, &capacity, count);
-                tokens[count].type = TOKEN_RPAREN;
-                tokens[count].value = string_duplicate(")");
-                tokens[count].line_number = line;
-                count++;
-                i++;
-                continue;
-            case '{':
-                ensure_capacity(&tokens, &capacity, count);
-                tokens[count].type = TOKEN_LBRACE;
-                tokens[count].value = string_duplicate("{");
-                tokens[count].line_number = line;
-                count++;
-                i++;
-                continue;
-            case '}':
-                ensure_capacity(&tokens, &capacity, count);
-                tokens[count].type = TOKEN_RBRACE;
-                tokens[count].value = string_duplicate("}");
-                tokens[count].line_number = line;
-                count++;
-                i++;
-                continue;
+                if (next == '=') { type = TOKEN_GREATER_EQUAL; width = 2; }
+                else type = TOKEN_GREATER;
+                break;
+            case '+': type = TOKEN_PLUS; break;
+            case '-': type = TOKEN_MINUS; break;
+            case '*': type = TOKEN_MULTIPLY; break;
+            case '/': type = TOKEN_DIVIDE; break;
+            case '(': type = TOKEN_LPAREN; break;
+            case ')': type = TOKEN_RPAREN; break;
+            case '{': type = TOKEN_LBRACE; break;
+            case '}': type = TOKEN_RBRACE; break;
+            case '[': type = TOKEN_LBRACKET; break;
+            case ']': type = TOKEN_RBRACKET; break;
+            case ',': type = TOKEN_COMMA; break;
+            case ':': type = TOKEN_COLON; break;
+        }
+        if (type != TOKEN_EOF) {
+            lexer->pos += width;
+            char *text = token_text(lexer, lexer->start, lexer->pos);
+            make_token(lexer, token, type, text);
+            return;
         }
 
         // If we reach here, the character was unexpected
         char msg[64];
         snprintf(msg, sizeof(msg), "Unexpected character '%c'", c);
-        report_error(msg, line);
-        i++;
+        lex_error(lexer, msg, lexer->line);
+        lexer->pos++;
     }
+}
 
-    // Append EOF token
-    ensure_capacity(&tokens, &capacity, count);
-    tokens[count].type = TOKEN_EOF;
-    tokens[count].value = NULL;
-    tokens[count].line_number = line;
-    count++;
+Token *tokenize(const char *source) {
+    size_t capacity = 64;
+    size_t count = 0;
+    Token *tokens = memory_alloc(sizeof(Token) * capacity);
+    if (!tokens) {
+        report_error("Memory allocation failed for tokens", -1);
+        return NULL;
+    }
+
+    Lexer lexer;
+    lexer_init_string(&lexer, source);
+    for (;;) {
+        Token token;
+        lexer_next(&lexer, &token);
+        if (!ensure_capacity(&tokens, &capacity, count)) {
+            memory_free(token.value);
+            memory_free(tokens[count - 1].value);
+            token.type = TOKEN_EOF;
+            token.value = NULL;
+            tokens[count - 1] = token;  // keep the array terminated
+            break;
+        }
+        tokens[count++] = token;
+        if (token.type == TOKEN_EOF) break;
+    }
 
     // Shrink array to exact size
-    Token *result = realloc(tokens, sizeof(Token) * count);
-    return result ? result : tokens;
+    Token *result = memory_realloc(tokens, sizeof(Token) * count);
+    if (!result) result = tokens;
+    if (lexer.invalid) {
+        free_tokens(result);
+        return NULL;
+    }
+    return result;
 }
-
@@ -1,14 +1,70 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <stdio.h>
 #include "token.h"
 
+// Size of the read window used when lexing from a FILE. The window only
+// grows if a single token is longer than this.
+#ifndef LEXER_BUFFER_SIZE
+#define LEXER_BUFFER_SIZE 65536
+#endif
+
+// Pull-based lexer. It reads either from a NUL terminated string held in
+// memory or from a FILE through a fixed size window, producing one token
+// per call to lexer_next(). Input is checked to be valid UTF-8 before it
+// is lexed: all of it on the first call in string mode, and each window
+// as it is read in file mode. Identifiers are put in Unicode Normalization
+// Form C, so the same name typed with precomposed letters or with
+// combining marks is the same identifier.
+typedef struct Lexer {
+    char *buf;       // source text (string mode) or read window (file mode)
+    size_t len;      // bytes available in buf
+    size_t pos;      // next byte to examine
+    size_t start;    // first byte of the token being scanned
+    size_t cap;      // allocated size of buf in file mode
+    FILE *in;        // NULL in string mode
+    int line;
+    int done;        // set once TOKEN_EOF has been produced
+    int quiet;       // count errors without printing them
+    int errors;      // number of errors found so far
+    size_t checked;  // bytes of buf known to be valid UTF-8
+    size_t offset;   // bytes dropped from the front of the window so far
+    int invalid;     // the input is not valid UTF-8; lexing has stopped
+} Lexer;
+
+// Lex a string that stays alive for as long as the lexer is used.
+void lexer_init_string(Lexer *lexer, const char *source);
+
+// Lex the first 'length' bytes of 'source', which need not be NUL
+// terminated.
+void lexer_init_buffer(Lexer *lexer, const char *source, size_t length);
+
+// Lex a stream, reading it in LEXER_BUFFER_SIZE chunks.
+void lexer_init_file(Lexer *lexer, FILE *in);
+
+// Produce the next token into *token. The token's value is newly
+// allocated and owned by the caller. After the end of the input (or an
+// unrecoverable error) every call yields a TOKEN_EOF token.
+void lexer_next(Lexer *lexer, Token *token);
+
+// Release the read window of a file lexer. Does not close the FILE.
+void lexer_free(Lexer *lexer);
+
 // Tokenize the given source code and return a dynamically allocated
-// array of tokens terminated by a TOKEN_EOF entry.
+// array of tokens terminated by a TOKEN_EOF entry, or NULL if the source
+// is not valid UTF-8.
 // The caller is responsible for freeing the returned array using
 // free_tokens().
 Token *tokenize(const char *source_code);
 
+// Tokenize on up to 'threads' threads by splitting the source into chunks
+// at line starts outside string literals. The result is identical to
+// tokenize(), which is used directly for small inputs and whenever the
+// source has a lexical error (so messages appear once and in order).
+// A 'threads' value of 0 means one per online CPU.
+Token *tokenize_parallel(const char *source_code, int threads);
+
 // Utility to free an array of tokens returned by tokenize().
 void free_tokens(Token *tokens);
 
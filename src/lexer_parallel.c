@@ -0,0 +1,227 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lexer.h"
+#include "memory.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Parallel front end for tokenize(). The source is cut into one chunk per
+// thread at line starts. Comments end at a newline, so the only construct
+// that can cross a cut is a string literal. Each chunk is first pre-scanned
+// (in parallel) to learn whether it ends inside a string, both for the case
+// where it starts outside one and where it starts inside one. A serial pass
+// then walks the chunks in order and moves every cut that falls inside a
+// string forward to the first line start after the string closes. Finally
+// the chunks are lexed in parallel and their tokens stitched together, with
+// line numbers shifted by the number of newlines in the chunks before them.
+
+// Inputs with less than this many bytes per thread are lexed serially
+#define MIN_CHUNK_BYTES (256 * 1024)
+#define MAX_THREADS 64
+
+typedef enum { SCAN_NORMAL, SCAN_STRING } ScanState;
+
+typedef struct {
+    const char *start;       // first byte, always at a line start
+    const char *end;         // one past the last byte
+    // Pre-scan results, indexed by the state the chunk is entered in
+    ScanState exit_state[2];
+    const char *safe_start;  // entered in a string: first line start after it closes
+    // Lexing results
+    Token *tokens;
+    size_t count;
+    int newlines;
+    int errors;
+} Chunk;
+
+// Follow the lexer's view of strings and comments from p to end. When
+// 'safe' is given, it receives the first line start reached outside a
+// string (or NULL if there is none).
+static ScanState scan(const char *p, const char *end, ScanState state, const char **safe) {
+    if (safe) *safe = NULL;
+    while (p < end) {
+        if (state == SCAN_STRING) {
+            const char *quote = memchr(p, '"', (size_t)(end - p));
+            if (!quote) return SCAN_STRING;
+            p = quote + 1;
+            state = SCAN_NORMAL;
+            continue;
+        }
+        char c = *p;
+        if (c == '"') {
+            state = SCAN_STRING;
+            p++;
+        } else if (c == '/' && p + 1 < end && p[1] == '/') {
+            const char *newline = memchr(p, '\n', (size_t)(end - p));
+            if (!newline) return SCAN_NORMAL;
+            p = newline;
+        } else if (c == '\n') {
+            p++;
+            if (safe && !*safe && p < end) *safe = p;
+        } else {
+            p++;
+        }
+    }
+    return state;
+}
+
+static void *prescan_chunk(void *arg) {
+    Chunk *chunk = arg;
+    chunk->exit_state[SCAN_NORMAL] = scan(chunk->start, chunk->end, SCAN_NORMAL, NULL);
+    chunk->exit_state[SCAN_STRING] =
+        scan(chunk->start, chunk->end, SCAN_STRING, &chunk->safe_start);
+    return NULL;
+}
+
+static void *lex_chunk(void *arg) {
+    Chunk *chunk = arg;
+    size_t capacity = 1024;
+    chunk->tokens = memory_alloc(sizeof(Token) * capacity);
+    if (!chunk->tokens) {
+        chunk->errors = 1;
+        return NULL;
+    }
+    Lexer lexer;
+    lexer_init_buffer(&lexer, chunk->start, (size_t)(chunk->end - chunk->start));
+    lexer.quiet = 1;
+    for (;;) {
+        Token token;
+        lexer_next(&lexer, &token);
+        if (token.type == TOKEN_EOF) break;
+        if (chunk->count == capacity) {
+            capacity *= 2;
+            Token *tmp = memory_realloc(chunk->tokens, sizeof(Token) * capacity);
+            if (!tmp) {
+                memory_free(token.value);
+                lexer.errors++;
+                break;
+            }
+            chunk->tokens = tmp;
+        }
+        chunk->tokens[chunk->count++] = token;
+    }
+    chunk->newlines = lexer.line - 1;
+    chunk->errors = lexer.errors;
+    return NULL;
+}
+
+// Run fn on every non-empty chunk, one thread each. A chunk whose thread
+// cannot be started is handled on the calling thread.
+static void run_chunks(Chunk *chunks, int count, void *(*fn)(void *)) {
+    pthread_t threads[MAX_THREADS];
+    int started[MAX_THREADS];
+    for (int i = 0; i < count; ++i) {
+        started[i] = 0;
+        if (chunks[i].start == chunks[i].end) continue;
+        if (i > 0 && pthread_create(&threads[i], NULL, fn, &chunks[i]) == 0)
+            started[i] = 1;
+    }
+    // The calling thread takes the first chunk and any that failed to start
+    for (int i = 0; i < count; ++i) {
+        if (!started[i] && chunks[i].start != chunks[i].end)
+            fn(&chunks[i]);
+    }
+    for (int i = 0; i < count; ++i) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+}
+
+static void free_chunk_tokens(Chunk *chunks, int count) {
+    for (int i = 0; i < count; ++i) {
+        for (size_t j = 0; j < chunks[i].count; ++j)
+            memory_free(chunks[i].tokens[j].value);
+        memory_free(chunks[i].tokens);
+    }
+}
+
+Token *tokenize_parallel(const char *source, int threads) {
+    size_t length = strlen(source);
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if ((size_t)threads > length / MIN_CHUNK_BYTES)
+        threads = (int)(length / MIN_CHUNK_BYTES);
+    if (threads <= 1) return tokenize(source);
+
+    // Cut at the line start following each even split point
+    Chunk chunks[MAX_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+    const char *end = source + length;
+    const char *cut = source;
+    for (int i = 0; i < threads; ++i) {
+        chunks[i].start = cut;
+        if (i == threads - 1) {
+            cut = end;
+        } else {
+            const char *split = source + length / threads * (i + 1);
+            if (split < cut) split = cut;
+            const char *newline = memchr(split, '\n', (size_t)(end - split));
+            cut = newline ? newline + 1 : end;
+        }
+        chunks[i].end = cut;
+    }
+
+    run_chunks(chunks, threads, prescan_chunk);
+
+    // Move cuts that fall inside a string literal. A chunk entered in a
+    // string hands the bytes up to its first safe line start to the last
+    // chunk before it that still has bytes; with no safe line start it
+    // is merged into that chunk entirely.
+    ScanState state = chunks[0].exit_state[SCAN_NORMAL];
+    int last = 0;
+    for (int i = 1; i < threads; ++i) {
+        Chunk *chunk = &chunks[i];
+        if (chunk->start == chunk->end) continue;
+        ScanState entry = state;
+        state = chunk->exit_state[entry];
+        if (entry == SCAN_STRING) {
+            const char *safe = chunk->safe_start ? chunk->safe_start : chunk->end;
+            chunks[last].end = safe;
+            chunk->start = safe;
+            if (chunk->start == chunk->end) continue;
+        }
+        last = i;
+    }
+
+    run_chunks(chunks, threads, lex_chunk);
+
+    // Any lexical error: redo the work serially so messages come out once,
+    // in order, exactly as tokenize() reports them.
+    size_t total = 0;
+    int errors = 0;
+    for (int i = 0; i < threads; ++i) {
+        total += chunks[i].count;
+        errors += chunks[i].errors;
+    }
+    if (errors) {
+        free_chunk_tokens(chunks, threads);
+        return tokenize(source);
+    }
+
+    Token *tokens = memory_alloc(sizeof(Token) * (total + 1));
+    if (!tokens) {
+        free_chunk_tokens(chunks, threads);
+        report_error("Memory allocation failed for tokens", -1);
+        return NULL;
+    }
+    size_t pos = 0;
+    int line_offset = 0;
+    for (int i = 0; i < threads; ++i) {
+        Chunk *chunk = &chunks[i];
+        for (size_t j = 0; j < chunk->count; ++j) {
+            tokens[pos] = chunk->tokens[j];
+            tokens[pos].line_number += line_offset;
+            pos++;
+        }
+        line_offset += chunk->newlines;
+        memory_free(chunk->tokens);
+    }
+    tokens[pos].type = TOKEN_EOF;
+    tokens[pos].value = NULL;
+    tokens[pos].line_number = line_offset + 1;
+    return tokens;
+}
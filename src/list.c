@@ -0,0 +1,290 @@
+#include "list.h"
+#include "memory.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static void *checked_realloc(void *ptr, size_t size) {
+    void *tmp = memory_realloc(ptr, size);
+    if (!tmp && size) {
+        report_error("Memory allocation failed for list", -1);
+        exit(1);
+    }
+    return tmp;
+}
+
+List *list_new(size_t capacity) {
+    List *list = gc_alloc(sizeof(List));
+    gc_init(&list->gc, GC_LIST);
+    list->boxed = 0;
+    list->count = 0;
+    list->capacity = capacity;
+    list->nums = capacity ? checked_realloc(NULL, sizeof(double) * capacity) : NULL;
+    list->items = NULL;
+    return list;
+}
+
+void list_retain(List *list) {
+    gc_retain(&list->gc);
+}
+
+void list_release(List *list) {
+    gc_release(&list->gc);
+}
+
+void list_destroy(List *list, int drop) {
+    if (list->boxed) {
+        for (size_t i = 0; i < list->count; ++i) {
+            if (drop)
+                value_drop(list->items[i]);
+            else
+                value_free(list->items[i]);
+        }
+        memory_free(list->items);
+    } else {
+        memory_free(list->nums);
+    }
+}
+
+// Switch a numeric list over to boxed Value storage
+static void list_box(List *list) {
+    Value *items = checked_realloc(NULL, sizeof(Value) * (list->capacity ? list->capacity : 1));
+    for (size_t i = 0; i < list->count; ++i) {
+        items[i].type = VAL_NUMBER;
+        items[i].as.number = list->nums[i];
+    }
+    memory_free(list->nums);
+    list->nums = NULL;
+    list->items = items;
+    list->boxed = 1;
+}
+
+void list_append(List *list, Value value) {
+    list_push(list, value_copy(value));
+}
+
+void list_push(List *list, Value value) {
+    if (!list->boxed && value.type != VAL_NUMBER)
+        list_box(list);
+    if (list->count + 1 > list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 8;
+        if (list->boxed)
+            list->items = checked_realloc(list->items, sizeof(Value) * list->capacity);
+        else
+            list->nums = checked_realloc(list->nums, sizeof(double) * list->capacity);
+    }
+    if (list->boxed)
+        list->items[list->count++] = value;
+    else
+        list->nums[list->count++] = value.as.number;
+}
+
+void list_clear(List *list) {
+    if (list->boxed) {
+        for (size_t i = 0; i < list->count; ++i)
+            value_free(list->items[i]);
+    }
+    list->count = 0;
+}
+
+Value list_get(List *list, size_t i) {
+    if (list->boxed)
+        return value_copy(list->items[i]);
+    return (Value){VAL_NUMBER, {.number = list->nums[i]}};
+}
+
+void list_set(List *list, size_t i, Value value) {
+    if (!list->boxed && value.type != VAL_NUMBER)
+        list_box(list);
+    if (list->boxed) {
+        Value old = list->items[i];
+        list->items[i] = value_copy(value);
+        value_free(old);
+    } else {
+        list->nums[i] = value.as.number;
+    }
+}
+
+int list_is_numeric(List *list) {
+    if (!list->boxed) return 1;
+    for (size_t i = 0; i < list->count; ++i) {
+        if (list->items[i].type != VAL_NUMBER) return 0;
+    }
+    return 1;
+}
+
+// Kernels operate on plain double arrays. Boxed lists that only hold
+// numbers are unpacked into a temporary array first.
+static const double *numbers_of(List *list, double **scratch) {
+    *scratch = NULL;
+    if (!list->boxed) return list->nums;
+    double *tmp = checked_realloc(NULL, sizeof(double) * (list->count ? list->count : 1));
+    for (size_t i = 0; i < list->count; ++i)
+        tmp[i] = list->items[i].as.number;
+    *scratch = tmp;
+    return tmp;
+}
+
+// The reductions keep four partial results (element i goes into partial
+// i % 4) in both the SIMD and scalar versions, and combine them in the same
+// order, so results do not depend on which path was compiled in.
+
+static double kernel_sum(const double *x, size_t n) {
+    size_t i = 0;
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+#if defined(__SSE2__)
+    __m128d a01 = _mm_setzero_pd();
+    __m128d a23 = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        a01 = _mm_add_pd(a01, _mm_loadu_pd(x + i));
+        a23 = _mm_add_pd(a23, _mm_loadu_pd(x + i + 2));
+    }
+    double lanes[4];
+    _mm_storeu_pd(lanes, a01);
+    _mm_storeu_pd(lanes + 2, a23);
+    s0 = lanes[0]; s1 = lanes[1]; s2 = lanes[2]; s3 = lanes[3];
+#else
+    for (; i + 4 <= n; i += 4) {
+        s0 += x[i];
+        s1 += x[i + 1];
+        s2 += x[i + 2];
+        s3 += x[i + 3];
+    }
+#endif
+    double total = (s0 + s2) + (s1 + s3);
+    for (; i < n; ++i) total += x[i];
+    return total;
+}
+
+static double kernel_dot(const double *x, const double *y, size_t n) {
+    size_t i = 0;
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+#if defined(__SSE2__)
+    __m128d a01 = _mm_setzero_pd();
+    __m128d a23 = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        a01 = _mm_add_pd(a01, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+        a23 = _mm_add_pd(a23, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+    }
+    double lanes[4];
+    _mm_storeu_pd(lanes, a01);
+    _mm_storeu_pd(lanes + 2, a23);
+    s0 = lanes[0]; s1 = lanes[1]; s2 = lanes[2]; s3 = lanes[3];
+#else
+    for (; i + 4 <= n; i += 4) {
+        s0 += x[i] * y[i];
+        s1 += x[i + 1] * y[i + 1];
+        s2 += x[i + 2] * y[i + 2];
+        s3 += x[i + 3] * y[i + 3];
+    }
+#endif
+    double total = (s0 + s2) + (s1 + s3);
+    for (; i < n; ++i) total += x[i] * y[i];
+    return total;
+}
+
+// Minimum (want_max == 0) or maximum (want_max == 1) of a non-empty array
+static double kernel_extreme(const double *x, size_t n, int want_max) {
+    size_t i = 0;
+    double best = x[0];
+#if defined(__SSE2__)
+    if (n >= 4) {
+        __m128d a = _mm_loadu_pd(x);
+        __m128d b = _mm_loadu_pd(x + 2);
+        for (i = 4; i + 4 <= n; i += 4) {
+            __m128d va = _mm_loadu_pd(x + i);
+            __m128d vb = _mm_loadu_pd(x + i + 2);
+            a = want_max ? _mm_max_pd(a, va) : _mm_min_pd(a, va);
+            b = want_max ? _mm_max_pd(b, vb) : _mm_min_pd(b, vb);
+        }
+        a = want_max ? _mm_max_pd(a, b) : _mm_min_pd(a, b);
+        double lanes[2];
+        _mm_storeu_pd(lanes, a);
+        best = lanes[0];
+        if (want_max ? lanes[1] > best : lanes[1] < best) best = lanes[1];
+    }
+#endif
+    for (; i < n; ++i) {
+        if (want_max ? x[i] > best : x[i] < best) best = x[i];
+    }
+    return best;
+}
+
+static void kernel_add(double *out, const double *x, const double *y, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+#endif
+    for (; i < n; ++i) out[i] = x[i] + y[i];
+}
+
+static void kernel_scale(double *out, const double *x, double k, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128d vk = _mm_set1_pd(k);
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(x + i), vk));
+#endif
+    for (; i < n; ++i) out[i] = x[i] * k;
+}
+
+double list_sum(List *list) {
+    double *scratch;
+    const double *x = numbers_of(list, &scratch);
+    double result = kernel_sum(x, list->count);
+    memory_free(scratch);
+    return result;
+}
+
+double list_min(List *list) {
+    double *scratch;
+    const double *x = numbers_of(list, &scratch);
+    double result = kernel_extreme(x, list->count, 0);
+    memory_free(scratch);
+    return result;
+}
+
+double list_max(List *list) {
+    double *scratch;
+    const double *x = numbers_of(list, &scratch);
+    double result = kernel_extreme(x, list->count, 1);
+    memory_free(scratch);
+    return result;
+}
+
+double list_dot(List *a, List *b) {
+    double *sa, *sb;
+    const double *x = numbers_of(a, &sa);
+    const double *y = numbers_of(b, &sb);
+    double result = kernel_dot(x, y, a->count);
+    memory_free(sa);
+    memory_free(sb);
+    return result;
+}
+
+List *list_add(List *a, List *b) {
+    double *sa, *sb;
+    const double *x = numbers_of(a, &sa);
+    const double *y = numbers_of(b, &sb);
+    List *out = list_new(a->count);
+    kernel_add(out->nums, x, y, a->count);
+    out->count = a->count;
+    memory_free(sa);
+    memory_free(sb);
+    return out;
+}
+
+List *list_scale(List *list, double factor) {
+    double *scratch;
+    const double *x = numbers_of(list, &scratch);
+    List *out = list_new(list->count);
+    kernel_scale(out->nums, x, factor, list->count);
+    out->count = list->count;
+    memory_free(scratch);
+    return out;
+}
@@ -0,0 +1,56 @@
+#ifndef LIST_H
+#define LIST_H
+
+#include "gc.h"
+#include "value.h"
+
+// Lists start out storing unboxed doubles in one contiguous array so the
+// numeric builtins can run over them with SIMD kernels. The first time a
+// non-number is stored the list is converted to boxed Value storage.
+typedef struct List {
+    GcObject gc;
+    int boxed;          // 0: nums holds the elements, 1: items does
+    size_t count;
+    size_t capacity;
+    double *nums;
+    Value *items;
+} List;
+
+List *list_new(size_t capacity);
+void list_retain(List *list);
+void list_release(List *list);
+
+// Free the elements and storage of a list that is being freed. Nested
+// lists, maps and generators are released, or with 'drop' set (by the
+// cycle collector, which frees them itself) just forgotten.
+void list_destroy(List *list, int drop);
+
+// Append a copy of value to the list.
+void list_append(List *list, Value value);
+
+// Append value itself; the list takes ownership of it.
+void list_push(List *list, Value value);
+
+// Remove every element, keeping the storage for reuse.
+void list_clear(List *list);
+
+// Return a copy of element i. The index must be in range.
+Value list_get(List *list, size_t i);
+
+// Replace element i with a copy of value. The index must be in range.
+void list_set(List *list, size_t i, Value value);
+
+// Return 1 if every element is a number (always true for unboxed lists).
+int list_is_numeric(List *list);
+
+// Numeric kernels. They require list_is_numeric() to be true for their
+// operands; the caller is responsible for checking this and for checking
+// that lengths match where two lists are involved.
+double list_sum(List *list);
+double list_min(List *list);
+double list_max(List *list);
+double list_dot(List *a, List *b);
+List *list_add(List *a, List *b);
+List *list_scale(List *list, double factor);
+
+#endif // LIST_H
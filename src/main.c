@@ -1,10 +1,16 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "token.h"
 #include "lexer.h"
 #include "ast.h"
 #include "util.h"
 #include "parser.h"
 #include "interpreter.h"
+#include "compiler.h"
+#include "module.h"
+#include "memory.h"
+#include "types.h"
 
 static char *read_file(const char *path) {
     FILE *f = fopen(path, "r");
@@ -12,7 +18,7 @@ static char *read_file(const char *path) {
     fseek(f, 0, SEEK_END);
     long len = ftell(f);
     fseek(f, 0, SEEK_SET);
-    char *buf = malloc(len + 1);
+    char *buf = memory_alloc(len + 1);
     if (!buf) { fclose(f); return NULL; }
     fread(buf, 1, len, f);
     buf[len] = '\0';
@@ -20,22 +26,245 @@ static char *read_file(const char *path) {
     return buf;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s program.igbo\n", argv[0]);
+// Lex, parse and run one top-level statement at a time, so memory use
+// does not grow with the size of the program.
+static int run_stream(FILE *in) {
+    Lexer lexer;
+    lexer_init_file(&lexer, in);
+    Parser *parser = parser_new_stream(&lexer);
+    interpreter_init();
+    ASTNode *stmt;
+    while ((stmt = parse_next_statement(parser)) != NULL) {
+        // A statement cut short by invalid UTF-8 is not run
+        if (lexer.invalid) {
+            free_ast_node(stmt);
+            break;
+        }
+        if (interpret_statement(stmt)) break;
+    }
+    int status = interpreter_finish();
+    if (lexer.invalid) status = 1;
+    parser_free(parser);
+    lexer_free(&lexer);
+    return status;
+}
+
+// igbo build program.igbo [-o output] and igbo --emit-c program.igbo
+// [-o file.c]: compile the program instead of running it
+static int build(const char *path, const char *output, int emit_c) {
+    char *source = read_file(path);
+    if (!source) {
+        fprintf(stderr, "Could not read file: %s\n", path);
         return 1;
     }
-    char *source = read_file(argv[1]);
+    int errors = error_count();
+    Token *tokens = tokenize(source);
+    memory_free(source);
+    if (!tokens) return 1;
+    ASTNode *ast = parse(tokens);
+    int status = 1;
+    // A program with syntax errors is not compiled
+    if (error_count() == errors) {
+        if (!emit_c) {
+            // The executable is named after the program, without '.igbo'
+            char *name = NULL;
+            if (!output) {
+                size_t len = strlen(path);
+                name = string_duplicate(path);
+                if (len > 5 && strcmp(path + len - 5, ".igbo") == 0)
+                    name[len - 5] = '\0';
+                else
+                    name = strcat(memory_realloc(name, len + 5), ".out");
+                output = name;
+            }
+            status = compile_executable(ast, path, output);
+            memory_free(name);
+        } else if (!output) {
+            status = compile_to_c(ast, path, stdout);
+        } else {
+            FILE *f = fopen(output, "w");
+            if (!f) {
+                fprintf(stderr, "Could not write file: %s\n", output);
+            } else {
+                status = compile_to_c(ast, path, f);
+                if (fclose(f) != 0) status = 1;
+            }
+        }
+    }
+    free_ast_node(ast);
+    free_tokens(tokens);
+    module_free_all();
+    return status;
+}
+
+// igbo --check program.igbo: report syntax errors and the type errors
+// inference can prove, without running the program
+static int check(const char *path) {
+    char *source = read_file(path);
     if (!source) {
-        fprintf(stderr, "Could not read file: %s\n", argv[1]);
+        fprintf(stderr, "Could not read file: %s\n", path);
         return 1;
     }
+    int errors = error_count();
     Token *tokens = tokenize(source);
-    free(source);
+    memory_free(source);
     if (!tokens) return 1;
     ASTNode *ast = parse(tokens);
-    interpret(ast);
+    int status = 1;
+    if (error_count() == errors) {
+        types_infer(ast, 0);
+        status = types_check(ast) > 0;
+    }
+    free_ast_node(ast);
+    free_tokens(tokens);
+    return status;
+}
+
+// Size for --memory: a number of bytes, optionally followed by K, M or G.
+// Returns 0 if it is not one.
+static size_t parse_size(const char *text) {
+    char *end;
+    unsigned long long n = strtoull(text, &end, 10);
+    int shift = 0;
+    if (*end == 'K' || *end == 'k') shift = 10;
+    else if (*end == 'M' || *end == 'm') shift = 20;
+    else if (*end == 'G' || *end == 'g') shift = 30;
+    if (shift) end++;
+    if (end == text || *end || text[0] == '-' || n > ((size_t)-1 >> shift)) return 0;
+    return (size_t)n << shift;
+}
+
+int main(int argc, char *argv[]) {
+    int compile = 0;
+    int emit_c = 0;
+    int check_only = 0;
+    const char *output = NULL;
+    int stream = 0;
+    int lazy = 0;
+    int strict = 0;
+    int lex_only = 0;
+    int threads = 1;
+    const char *path = NULL;
+    const char *snapshot = NULL;
+    size_t memory = 0;
+    int usage_error = 0;
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "build") == 0) {
+        compile = 1;
+        first = 2;
+    }
+    for (int i = first; i < argc; ++i) {
+        if (strcmp(argv[i], "--emit-c") == 0)
+            emit_c = 1;
+        else if (strcmp(argv[i], "--check") == 0)
+            check_only = 1;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (strcmp(argv[i], "--stream") == 0)
+            stream = 1;
+        else if (strcmp(argv[i], "--lazy") == 0)
+            lazy = 1;
+        else if (strcmp(argv[i], "--strict") == 0)
+            strict = 1;
+        else if (strcmp(argv[i], "--lex-only") == 0)
+            lex_only = 1;
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            interpreter_set_threads(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--gc-stats") == 0)
+            interpreter_set_gc_stats(1);
+        else if (strcmp(argv[i], "--save-snapshot") == 0 && i + 1 < argc)
+            interpreter_set_snapshot(argv[++i]);
+        else if (strcmp(argv[i], "--load-snapshot") == 0 && i + 1 < argc)
+            snapshot = argv[++i];
+        else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+            memory = parse_size(argv[++i]);
+            if (!memory) usage_error = 1;
+        }
+        else if (!path)
+            path = argv[i];
+        else
+            usage_error = 1;
+    }
+    if (!path || usage_error || (output && !compile && !emit_c)) {
+        fprintf(stderr, "Usage: %s [--stream | --lazy [--strict]] [-j N] [--lex-only] [--threads N] [--gc-stats]\n"
+                "       [--save-snapshot FILE] [--load-snapshot FILE] [--memory SIZE] program.igbo | -\n"
+                "       %s build program.igbo [-o output]\n"
+                "       %s --emit-c program.igbo [-o file.c]\n"
+                "       %s --check program.igbo\n",
+                argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    if (check_only) {
+        if (strcmp(path, "-") == 0) {
+            fprintf(stderr, "Cannot check a program read from standard input\n");
+            return 1;
+        }
+        return check(path);
+    }
+    if (compile || emit_c) {
+        if (strcmp(path, "-") == 0) {
+            fprintf(stderr, "Cannot compile a program read from standard input\n");
+            return 1;
+        }
+        return build(path, output, emit_c && !compile);
+    }
+    if (lazy && (stream || strcmp(path, "-") == 0)) {
+        // Lazy blocks point back into the token array, which streaming
+        // does not keep.
+        fprintf(stderr, "--lazy cannot be combined with streaming\n");
+        return 1;
+    }
+    if ((lex_only || threads != 1) && (stream || strcmp(path, "-") == 0)) {
+        fprintf(stderr, "-j and --lex-only cannot be combined with streaming\n");
+        return 1;
+    }
+    if (memory) {
+        // Everything from here on is carved out of this block. It is
+        // touched now so that the run takes no page faults in it either.
+        void *block = malloc(memory);
+        if (!block) {
+            fprintf(stderr, "Could not allocate a memory block of %zu bytes\n", memory);
+            return 1;
+        }
+        memset(block, 0, memory);
+        memory_use(block, memory);
+    }
+    if (snapshot && interpreter_load_snapshot(snapshot)) return 1;
+    if (strcmp(path, "-") == 0)
+        return run_stream(stdin);
+    if (stream) {
+        interpreter_set_path(path);
+        FILE *f = fopen(path, "r");
+        if (!f) {
+            fprintf(stderr, "Could not read file: %s\n", path);
+            return 1;
+        }
+        int status = run_stream(f);
+        fclose(f);
+        return status;
+    }
+    interpreter_set_path(path);
+    char *source = read_file(path);
+    if (!source) {
+        fprintf(stderr, "Could not read file: %s\n", path);
+        return 1;
+    }
+    Token *tokens = threads == 1 ? tokenize(source) : tokenize_parallel(source, threads);
+    memory_free(source);
+    if (!tokens) return 1;
+    if (lex_only) {
+        // Stop after lexing, for measuring the lexer on its own
+        size_t count = 0;
+        while (tokens[count].type != TOKEN_EOF) count++;
+        printf("%zu tokens\n", count);
+        free_tokens(tokens);
+        return 0;
+    }
+    ASTNode *ast = lazy ? parse_lazy(tokens, strict) : parse(tokens);
+    int status = interpret(ast);
     free_ast_node(ast);
     free_tokens(tokens);
-    return 0;
+    return status;
 }
@@ -0,0 +1,212 @@
+#include "map.h"
+#include "list.h"
+#include "memory.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Grow once the table is 7/8 full; Robin Hood probing keeps probe
+// sequences short even at high load.
+#define MAP_MAX_LOAD_NUM 7
+#define MAP_MAX_LOAD_DEN 8
+
+Map *map_new(void) {
+    Map *map = gc_alloc(sizeof(Map));
+    gc_init(&map->gc, GC_MAP);
+    map->count = 0;
+    map->capacity = 0;
+    map->entries = NULL;
+    return map;
+}
+
+void map_retain(Map *map) {
+    gc_retain(&map->gc);
+}
+
+void map_release(Map *map) {
+    gc_release(&map->gc);
+}
+
+void map_destroy(Map *map, int drop) {
+    for (size_t i = 0; i < map->capacity; ++i) {
+        if (!map->entries[i].distance) continue;
+        if (drop)
+            value_drop(map->entries[i].value);
+        else
+            value_free(map->entries[i].value);
+    }
+    memory_free(map->entries);
+}
+
+// Insert an entry known not to be present, taking ownership of its value
+static void insert_entry(Map *map, MapEntry entry) {
+    size_t mask = map->capacity - 1;
+    size_t i = entry.hash & mask;
+    entry.distance = 1;
+    for (;;) {
+        MapEntry *slot = &map->entries[i];
+        if (!slot->distance) {
+            *slot = entry;
+            return;
+        }
+        // Robin Hood: the entry further from home keeps the slot
+        if (slot->distance < entry.distance) {
+            MapEntry displaced = *slot;
+            *slot = entry;
+            entry = displaced;
+        }
+        entry.distance++;
+        i = (i + 1) & mask;
+    }
+}
+
+static void resize(Map *map, size_t capacity) {
+    MapEntry *old = map->entries;
+    size_t old_capacity = map->capacity;
+    map->entries = memory_calloc(capacity, sizeof(MapEntry));
+    if (!map->entries) {
+        report_error("Memory allocation failed for map", -1);
+        exit(1);
+    }
+    map->capacity = capacity;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old[i].distance)
+            insert_entry(map, old[i]);
+    }
+    memory_free(old);
+}
+
+static MapEntry *find_entry(Map *map, const InternedString *key) {
+    if (!map->capacity) return NULL;
+    size_t mask = map->capacity - 1;
+    uint32_t hash = (uint32_t)key->hash;
+    size_t i = hash & mask;
+    for (uint32_t distance = 1;; ++distance) {
+        MapEntry *slot = &map->entries[i];
+        // An empty slot, or one closer to home than we would be, means the
+        // key cannot be further along the probe sequence.
+        if (slot->distance < distance) return NULL;
+        if (slot->key == key) return slot;
+        i = (i + 1) & mask;
+    }
+}
+
+Value *map_get(Map *map, const InternedString *key) {
+    MapEntry *entry = find_entry(map, key);
+    return entry ? &entry->value : NULL;
+}
+
+void map_set(Map *map, const InternedString *key, Value value) {
+    MapEntry *entry = find_entry(map, key);
+    if (entry) {
+        Value old = entry->value;
+        entry->value = value_copy(value);
+        value_free(old);
+        return;
+    }
+    if ((map->count + 1) * MAP_MAX_LOAD_DEN > map->capacity * MAP_MAX_LOAD_NUM)
+        resize(map, map->capacity ? map->capacity * 2 : 8);
+    MapEntry fresh;
+    fresh.key = key;
+    fresh.hash = (uint32_t)key->hash;
+    fresh.distance = 0;
+    fresh.value = value_copy(value);
+    insert_entry(map, fresh);
+    map->count++;
+}
+
+void map_reserve(Map *map, size_t count) {
+    if (!count) return;
+    size_t capacity = map->capacity ? map->capacity : 8;
+    while (count * MAP_MAX_LOAD_DEN > capacity * MAP_MAX_LOAD_NUM) capacity *= 2;
+    if (capacity != map->capacity) resize(map, capacity);
+}
+
+int map_delete(Map *map, const InternedString *key) {
+    MapEntry *entry = find_entry(map, key);
+    if (!entry) return 0;
+    value_free(entry->value);
+    // Backward-shift deletion: pull following entries one slot closer to
+    // home until reaching an empty slot or an entry already at home.
+    size_t mask = map->capacity - 1;
+    size_t i = (size_t)(entry - map->entries);
+    for (;;) {
+        size_t next = (i + 1) & mask;
+        MapEntry *n = &map->entries[next];
+        if (n->distance <= 1) {
+            map->entries[i].distance = 0;
+            break;
+        }
+        map->entries[i] = *n;
+        map->entries[i].distance--;
+        i = next;
+    }
+    map->count--;
+    return 1;
+}
+
+MapEntry *map_next(Map *map, size_t *pos) {
+    while (*pos < map->capacity) {
+        MapEntry *entry = &map->entries[(*pos)++];
+        if (entry->distance) return entry;
+    }
+    return NULL;
+}
+
+List *map_keys(Map *map) {
+    List *list = list_new(0);
+    size_t pos = 0;
+    MapEntry *entry;
+    while ((entry = map_next(map, &pos)) != NULL) {
+        Value key;
+        key.type = VAL_STRING;
+        key.as.string = (char *)entry->key->chars;
+        list_append(list, key);
+    }
+    return list;
+}
+
+List *map_values(Map *map) {
+    List *list = list_new(0);
+    size_t pos = 0;
+    MapEntry *entry;
+    while ((entry = map_next(map, &pos)) != NULL)
+        list_append(list, entry->value);
+    return list;
+}
+
+// The text of a number key: whole numbers below 2^53 in full, anything
+// else with as few digits as read back to the same number, so distinct
+// numbers never share a key
+static void number_key(double x, char *buf, size_t size) {
+    if (x > -9007199254740992.0 && x < 9007199254740992.0 && x == (double)(long long)x) {
+        snprintf(buf, size, "%lld", (long long)x);
+        return;
+    }
+    snprintf(buf, size, "%.15g", x);
+    if (strtod(buf, NULL) != x) snprintf(buf, size, "%.17g", x);
+}
+
+int map_key(Value key, int create, const InternedString **out) {
+    char buf[64];
+    const char *text;
+    if (key.type == VAL_STRING) {
+        text = key.as.string;
+    } else if (key.type == VAL_NUMBER) {
+        number_key(key.as.number, buf, sizeof(buf));
+        text = buf;
+    } else {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Map keys must be strings or numbers, got %s",
+                 value_type_name(key.type));
+        report_error(msg, -1);
+        return 0;
+    }
+    size_t length = strlen(text);
+    if (create)
+        *out = intern(text, length);
+    else
+        *out = intern_find(text, length, hash_bytes(text, length));
+    return 1;
+}
@@ -0,0 +1,64 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include "gc.h"
+#include "intern.h"
+#include "value.h"
+#include <stdint.h>
+
+// One slot of the table. 'distance' is how far the entry sits from its
+// home slot plus one, so zero marks an empty slot.
+typedef struct {
+    const InternedString *key;
+    uint32_t hash;
+    uint32_t distance;
+    Value value;
+} MapEntry;
+
+// Hash map from interned strings to values, using open addressing with
+// Robin Hood probing and backward-shift deletion. Entries are stored
+// inline in one array so a lookup usually touches a single cache line.
+typedef struct Map {
+    GcObject gc;
+    size_t count;
+    size_t capacity;    // power of two, or zero before the first insert
+    MapEntry *entries;
+} Map;
+
+Map *map_new(void);
+void map_retain(Map *map);
+void map_release(Map *map);
+
+// Free the entries of a map that is being freed, as list_destroy() does.
+void map_destroy(Map *map, int drop);
+
+// Return the value stored for key, or NULL. The pointer is only valid
+// until the map is next modified.
+Value *map_get(Map *map, const InternedString *key);
+
+// Store a copy of value under key, replacing any previous value.
+void map_set(Map *map, const InternedString *key, Value value);
+
+// Make room for count entries in total, so inserting them never grows
+// the table.
+void map_reserve(Map *map, size_t count);
+
+// Remove key. Returns 1 if it was present.
+int map_delete(Map *map, const InternedString *key);
+
+// Convert a value to a map key. Strings are used as they are; whole
+// numbers are written out in full and other numbers with enough digits to
+// tell them apart. Other types are reported as errors and make the
+// function return 0. When create is 0 a key that was never interned is
+// returned as NULL, since no map can contain it.
+int map_key(Value key, int create, const InternedString **out);
+
+// Iterate over entries: start with *pos = 0 and call until it returns NULL.
+MapEntry *map_next(Map *map, size_t *pos);
+
+// Return a new list of the map's keys (as strings) or values, in
+// iteration order.
+struct List *map_keys(Map *map);
+struct List *map_values(Map *map);
+
+#endif // MAP_H
@@ -0,0 +1,162 @@
+#include "memory.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Four size classes per power of two: 16, 32, 48 and 64 bytes, then 80,
+// 96, 112, 128, 160, ... enough to cover any block.
+#define MEMORY_CLASSES 240
+
+// The end of the block is held back until the rest is used up, so that
+// the statement that runs out can finish: a sixteenth of the block, at
+// most this much.
+#define MEMORY_RESERVE (1u << 20)
+
+// In front of every block carved out; 16 bytes keep the memory after it
+// aligned for any type.
+typedef struct {
+    size_t size_class;
+    size_t unused;
+} Header;
+
+volatile int memory_exhausted = 0;
+
+static char *block_start = NULL;   // NULL while the system allocator is used
+static char *block_end = NULL;
+static char *bump = NULL;          // start of the memory not handed out yet
+static char *limit = NULL;         // the reserve until the block runs out, then block_end
+static void *free_lists[MEMORY_CLASSES];   // linked through their first word
+static size_t in_use = 0;
+static size_t peak = 0;
+
+// Taken for every allocation from the block: isolates, parallel loops and
+// the parallel lexer allocate from several threads.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int size_class(size_t size) {
+    if (size <= 64) return size ? (int)((size - 1) / 16) : 0;
+    // 2^p < size <= 2^(p + 1), cut into four steps
+    int p = 63 - __builtin_clzll((unsigned long long)(size - 1));
+    size_t step = (size_t)1 << (p - 2);
+    return 4 + (p - 6) * 4 + (int)((size - ((size_t)1 << p) - 1) / step);
+}
+
+static size_t class_size(int c) {
+    if (c < 4) return (size_t)(c + 1) * 16;
+    int p = 6 + (c - 4) / 4;
+    return ((size_t)1 << p) + (size_t)((c - 4) % 4 + 1) * ((size_t)1 << (p - 2));
+}
+
+static int inside(const void *ptr) {
+    uintptr_t p = (uintptr_t)ptr;
+    return p >= (uintptr_t)block_start && p < (uintptr_t)block_end;
+}
+
+void memory_use(void *block, size_t size) {
+    // Align the start for the headers
+    uintptr_t start = ((uintptr_t)block + 15) & ~(uintptr_t)15;
+    size_t skipped = (size_t)(start - (uintptr_t)block);
+    block_start = block && size > skipped ? (char *)start : NULL;
+    block_end = block_start ? (char *)block + size : NULL;
+    bump = block_start;
+    size_t reserve = block_start ? (size_t)(block_end - block_start) / 16 : 0;
+    if (reserve > MEMORY_RESERVE) reserve = MEMORY_RESERVE;
+    limit = block_start ? block_end - reserve : NULL;
+    memset(free_lists, 0, sizeof(free_lists));
+    in_use = 0;
+    peak = 0;
+    memory_exhausted = 0;
+}
+
+// A block of at least size bytes from the block, or NULL once it has none
+static void *take(size_t size) {
+    if (size > (size_t)(block_end - block_start)) return NULL;
+    int c = size_class(size);
+    pthread_mutex_lock(&lock);
+    Header *h = free_lists[c];
+    if (h) {
+        free_lists[c] = *(void **)(h + 1);
+    } else if ((size_t)(limit - bump) >= sizeof(Header) + class_size(c)) {
+        h = (Header *)bump;
+        h->size_class = (size_t)c;
+        bump += sizeof(Header) + class_size(c);
+    } else {
+        // Nothing left to hand out: settle for a larger block freed earlier
+        for (int k = c + 1; k < MEMORY_CLASSES && !h; ++k) {
+            if (free_lists[k]) {
+                h = free_lists[k];
+                free_lists[k] = *(void **)(h + 1);
+            }
+        }
+    }
+    if (h) {
+        in_use += class_size((int)h->size_class);
+        if (in_use > peak) peak = in_use;
+    }
+    pthread_mutex_unlock(&lock);
+    return h ? h + 1 : NULL;
+}
+
+// Hand out the reserve, once. Whatever does not fit in it fails.
+static void *exhausted(size_t size) {
+    pthread_mutex_lock(&lock);
+    limit = block_end;
+    pthread_mutex_unlock(&lock);
+    if (!__atomic_exchange_n(&memory_exhausted, 1, __ATOMIC_SEQ_CST)) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Out of memory: the memory block of %zu bytes is used up",
+                 (size_t)(block_end - block_start));
+        report_error(msg, -1);
+    }
+    return take(size);
+}
+
+void *memory_alloc(size_t size) {
+    if (!block_start) return malloc(size);
+    void *ptr = take(size);
+    return ptr ? ptr : exhausted(size);
+}
+
+void *memory_calloc(size_t count, size_t size) {
+    if (!block_start) return calloc(count, size);
+    if (size && count > (size_t)-1 / size) return NULL;
+    void *ptr = memory_alloc(count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void *memory_realloc(void *ptr, size_t size) {
+    if (!ptr) return memory_alloc(size);
+    if (!inside(ptr)) return realloc(ptr, size);
+    size_t old = class_size((int)((Header *)ptr - 1)->size_class);
+    if (size <= old) return ptr;
+    void *moved = memory_alloc(size);
+    if (!moved) return NULL;
+    memcpy(moved, ptr, old);
+    memory_free(ptr);
+    return moved;
+}
+
+void memory_free(void *ptr) {
+    if (!ptr) return;
+    if (!inside(ptr)) {
+        free(ptr);
+        return;
+    }
+    Header *h = (Header *)ptr - 1;
+    pthread_mutex_lock(&lock);
+    *(void **)ptr = free_lists[h->size_class];
+    free_lists[h->size_class] = h;
+    in_use -= class_size((int)h->size_class);
+    pthread_mutex_unlock(&lock);
+}
+
+void memory_print_stats(void) {
+    if (!block_start) return;
+    fprintf(stderr, "memory: %zu KB block, %zu KB handed out, peak %zu KB in use%s\n",
+            (size_t)(block_end - block_start) / 1024, (size_t)(bump - block_start) / 1024,
+            peak / 1024, memory_exhausted ? ", exhausted" : "");
+}
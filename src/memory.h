@@ -0,0 +1,51 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+
+// Every allocation the interpreter makes goes through these functions.
+// Normally they are malloc(), calloc(), realloc() and free(). Once a
+// host has handed over a block of memory with memory_use() (the --memory
+// option), every allocation is carved out of that block instead, and the
+// system allocator is not called again:
+//
+// - Requests are rounded up to one of a set of size classes, four per
+//   power of two, and each class keeps a list of the blocks freed in it.
+// - A request whose class list is empty takes fresh memory from the end
+//   of what has been handed out so far (a bump pointer), and once the
+//   block is all handed out, a free block of a larger class.
+// - Free blocks are never split or merged: memory freed in one class
+//   only serves requests of that class, or of smaller ones once the bump
+//   pointer has reached the end. A program whose allocation sizes shift
+//   over time can run out with much of the block free.
+//
+// When none of that can satisfy a request the block is exhausted:
+// memory_exhausted is set, an error is reported, and the reserve, a
+// sixteenth of the block (at most 1MB) held back until then, is handed
+// out so the statement that ran out can finish. The interpreter then
+// stops at the next statement, as for any other fatal error, and the run
+// ends with an error status. A request the reserve cannot satisfy either
+// fails like a failed malloc(), which stops the program at once. Nothing
+// is ever taken from the system allocator.
+
+// Set once the block given to memory_use() has run out
+extern volatile int memory_exhausted;
+
+// Allocate from the block starting at 'block', 'size' bytes long, until
+// the next call; memory_use(NULL, 0) goes back to the system allocator.
+// Nothing allocated from a previous block may be used afterwards.
+void memory_use(void *block, size_t size);
+
+void *memory_alloc(size_t size);
+void *memory_calloc(size_t count, size_t size);
+void *memory_realloc(void *ptr, size_t size);
+
+// Free memory from any of the above. Memory that did not come from the
+// block (allocated before it was set up, or by the C library) goes back
+// to the system allocator.
+void memory_free(void *ptr);
+
+// Print how much of the block was used to stderr, if one is in use.
+void memory_print_stats(void);
+
+#endif // MEMORY_H
@@ -0,0 +1,601 @@
+#define _XOPEN_SOURCE 700
+#include "module.h"
+#include "intern.h"
+#include "lexer.h"
+#include "memory.h"
+#include "parser.h"
+#include "util.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MODULE_MAGIC "IGBOMOD"
+#define MODULE_BYTE_ORDER 0x01020304u
+
+// A cache entry is the header, the symbols (each a 32-bit kind and length
+// followed by the name) and the encoded tree. The symbols and the tree
+// have separate checksums so importing only has to read the symbols.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;     // MODULE_BYTE_ORDER as stored by the writer
+    uint64_t source_hash;    // hash_bytes() of the source text
+    uint64_t source_length;
+    uint64_t size;           // of the whole file
+    uint64_t symbol_count;
+    uint64_t tree;           // offset of the tree; the symbols end there
+    uint64_t symbol_checksum;
+    uint64_t tree_checksum;
+} ModuleHeader;
+
+typedef struct {
+    char *name;
+    ModuleSymbol kind;
+} Symbol;
+
+struct Module {
+    char *name;              // as written in 'bubata'
+    char *path;              // resolved
+    uint64_t hash;           // of the source
+    int loaded;
+    Symbol *symbols;
+    size_t symbol_count;
+    size_t symbol_capacity;
+    ASTNode *tree;           // parsed in this process
+    const char *cached;      // or still in the mapped cache entry
+    size_t cached_size;
+};
+
+static Module **modules = NULL;
+static size_t module_count = 0;
+static size_t module_capacity = 0;
+static size_t pending = 0;   // modules not loaded yet
+
+// Symbols of all imported modules, by name and kind, each mapped to the
+// first module that defines it. Open addressing with linear probing.
+typedef struct {
+    const char *name;
+    ModuleSymbol kind;
+    Module *module;
+} SymbolEntry;
+
+static SymbolEntry *symbol_table = NULL;
+static size_t table_capacity = 0;
+static size_t table_count = 0;
+
+static void out_of_memory(void) {
+    report_error("Memory allocation failed for modules", -1);
+    exit(1);
+}
+
+static size_t symbol_slot(const char *name, ModuleSymbol kind, size_t capacity) {
+    return (size_t)(hash_bytes(name, strlen(name)) ^ (uint64_t)kind) & (capacity - 1);
+}
+
+static SymbolEntry *find_entry(SymbolEntry *table, size_t capacity, const char *name,
+                               ModuleSymbol kind) {
+    size_t s = symbol_slot(name, kind, capacity);
+    while (table[s].name &&
+           (table[s].kind != kind || strcmp(table[s].name, name) != 0))
+        s = (s + 1) & (capacity - 1);
+    return &table[s];
+}
+
+static void table_add(const char *name, ModuleSymbol kind, Module *module) {
+    if ((table_count + 1) * 2 > table_capacity) {
+        size_t capacity = table_capacity ? table_capacity * 2 : 64;
+        SymbolEntry *table = memory_calloc(capacity, sizeof(SymbolEntry));
+        if (!table) out_of_memory();
+        for (size_t i = 0; i < table_capacity; ++i) {
+            if (symbol_table[i].name)
+                *find_entry(table, capacity, symbol_table[i].name, symbol_table[i].kind) =
+                    symbol_table[i];
+        }
+        memory_free(symbol_table);
+        symbol_table = table;
+        table_capacity = capacity;
+    }
+    SymbolEntry *e = find_entry(symbol_table, table_capacity, name, kind);
+    if (e->name) return;   // an earlier module defines it too
+    e->name = name;
+    e->kind = kind;
+    e->module = module;
+    table_count++;
+}
+
+static void add_symbol(Module *m, const char *name, ModuleSymbol kind) {
+    if (module_defines(m, name, kind)) return;
+    if (m->symbol_count == m->symbol_capacity) {
+        m->symbol_capacity = m->symbol_capacity ? m->symbol_capacity * 2 : 16;
+        m->symbols = memory_realloc(m->symbols, sizeof(Symbol) * m->symbol_capacity);
+        if (!m->symbols) out_of_memory();
+    }
+    m->symbols[m->symbol_count].name = string_duplicate(name);
+    m->symbols[m->symbol_count].kind = kind;
+    m->symbol_count++;
+}
+
+// The functions and globals defined by a block of top-level statements.
+// Function bodies have scopes of their own, and the variables of a
+// parallel loop body are private apart from its reduction variables.
+static void collect_symbols(Module *m, const ASTNode *block) {
+    for (const ASTNode *n = block; n != NULL; n = n->right) {
+        const ASTNode *stmt = n->left;
+        switch (stmt->type) {
+            case NODE_FUNC_DEF:
+                add_symbol(m, stmt->value, MODULE_FUNCTION);
+                break;
+            case NODE_VAR_DECL:
+                add_symbol(m, stmt->value, MODULE_VARIABLE);
+                break;
+            case NODE_FOR_STMT:
+                add_symbol(m, stmt->value, MODULE_VARIABLE);
+                collect_symbols(m, stmt->right);
+                break;
+            case NODE_IF_STMT:
+                collect_symbols(m, stmt->right);
+                collect_symbols(m, stmt->third);
+                break;
+            case NODE_WHILE_STMT:
+                collect_symbols(m, stmt->right);
+                break;
+            case NODE_PARALLEL_FOR:
+                for (const ASTNode *r = stmt->right->right; r != NULL; r = r->right)
+                    add_symbol(m, r->left->value, MODULE_VARIABLE);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Encoding. Each node is a presence byte, its type, 'yields', slot and
+// value, then its left and third children; the right child follows as the
+// next node, so long statement and argument chains are written and read
+// in a loop rather than by recursion.
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+static void buffer_put(Buffer *b, const void *data, size_t n) {
+    if (!n) return;
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (b->len + n > cap) cap *= 2;
+        char *tmp = memory_realloc(b->data, cap);
+        if (!tmp) out_of_memory();
+        b->data = tmp;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+}
+
+static void encode_tree(Buffer *b, const ASTNode *node) {
+    for (;;) {
+        uint8_t present = node != NULL;
+        buffer_put(b, &present, 1);
+        if (!node) return;
+        uint8_t head[2] = { (uint8_t)node->type, (uint8_t)node->yields };
+        int32_t slot = node->slot;
+        uint32_t length = node->value ? (uint32_t)strlen(node->value) + 1 : 0;
+        buffer_put(b, head, sizeof(head));
+        buffer_put(b, &slot, sizeof(slot));
+        buffer_put(b, &length, sizeof(length));
+        if (length) buffer_put(b, node->value, length - 1);
+        encode_tree(b, node->left);
+        encode_tree(b, node->third);
+        node = node->right;
+    }
+}
+
+typedef struct {
+    const char *at;
+    const char *end;
+    int bad;
+} Reader;
+
+static int take(Reader *r, void *out, size_t n) {
+    if (r->bad || (size_t)(r->end - r->at) < n) {
+        r->bad = 1;
+        return 0;
+    }
+    memcpy(out, r->at, n);
+    r->at += n;
+    return 1;
+}
+
+static ASTNode *decode_tree(Reader *r) {
+    ASTNode *first = NULL;
+    ASTNode **link = &first;
+    for (;;) {
+        uint8_t present, head[2];
+        int32_t slot;
+        uint32_t length;
+        if (!take(r, &present, 1) || !present) break;
+        if (!take(r, head, sizeof(head)) || !take(r, &slot, sizeof(slot)) ||
+            !take(r, &length, sizeof(length)) || head[0] > NODE_SPAWN ||
+            (length && (size_t)(r->end - r->at) < length - 1)) {
+            r->bad = 1;
+            break;
+        }
+        char *value = NULL;
+        if (length) {
+            value = memory_alloc(length);
+            if (!value) out_of_memory();
+            memcpy(value, r->at, length - 1);
+            value[length - 1] = '\0';
+            r->at += length - 1;
+        }
+        ASTNode *node = create_ast_node((NodeType)head[0], NULL, NULL, NULL, NULL);
+        node->value = value;
+        node->yields = head[1];
+        node->slot = slot;
+        *link = node;
+        node->left = decode_tree(r);
+        node->third = decode_tree(r);
+        link = &node->right;
+    }
+    return first;
+}
+
+// The cache
+
+static const char *cache_dir(void) {
+    static char *dir = NULL;
+    static int checked = 0;
+    if (checked) return dir;
+    checked = 1;
+    const char *base = getenv("IGBO_CACHE_DIR");
+    const char *suffix = "";
+    if (!base || !*base) {
+        base = getenv("XDG_CACHE_HOME");
+        suffix = "/igbo";
+        if (!base || !*base) {
+            base = getenv("HOME");
+            suffix = "/.cache/igbo";
+        }
+        if (!base || !*base) return NULL;
+    }
+    size_t length = strlen(base) + strlen(suffix) + 1;
+    dir = memory_alloc(length);
+    if (!dir) out_of_memory();
+    snprintf(dir, length, "%s%s", base, suffix);
+    // Create it and any missing parents
+    for (char *p = dir + 1; ; ++p) {
+        if (*p == '/' || *p == '\0') {
+            char saved = *p;
+            *p = '\0';
+            mkdir(dir, 0755);
+            *p = saved;
+            if (!saved) break;
+        }
+    }
+    return dir;
+}
+
+static char *cache_file(uint64_t hash) {
+    const char *dir = cache_dir();
+    if (!dir) return NULL;
+    size_t length = strlen(dir) + 32;
+    char *path = memory_alloc(length);
+    if (!path) out_of_memory();
+    snprintf(path, length, "%s/%016llx.igbc", dir, (unsigned long long)hash);
+    return path;
+}
+
+// Store the symbols and tree of m under the hash of its source. Failing
+// to write the cache is not an error.
+static void write_cache(const Module *m, uint64_t hash, size_t source_length) {
+    char *path = cache_file(hash);
+    if (!path) return;
+    Buffer symbols = { NULL, 0, 0 };
+    Buffer tree = { NULL, 0, 0 };
+    for (size_t i = 0; i < m->symbol_count; ++i) {
+        uint32_t kind = m->symbols[i].kind;
+        uint32_t length = (uint32_t)strlen(m->symbols[i].name);
+        buffer_put(&symbols, &kind, sizeof(kind));
+        buffer_put(&symbols, &length, sizeof(length));
+        buffer_put(&symbols, m->symbols[i].name, length);
+    }
+    encode_tree(&tree, m->tree);
+
+    ModuleHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MODULE_MAGIC, sizeof(h.magic));
+    h.version = MODULE_CACHE_VERSION;
+    h.byte_order = MODULE_BYTE_ORDER;
+    h.source_hash = hash;
+    h.source_length = source_length;
+    h.symbol_count = m->symbol_count;
+    h.tree = sizeof(h) + symbols.len;
+    h.size = h.tree + tree.len;
+    h.symbol_checksum = hash_bytes(symbols.data ? symbols.data : "", symbols.len);
+    h.tree_checksum = hash_bytes(tree.data, tree.len);
+
+    // Written under a name of its own and renamed into place, so processes
+    // importing the same module at the same time never see a partial file
+    size_t length = strlen(path) + 32;
+    char *tmp = memory_alloc(length);
+    if (!tmp) out_of_memory();
+    snprintf(tmp, length, "%s.%ld.tmp", path, (long)getpid());
+    FILE *f = fopen(tmp, "wb");
+    int ok = f && fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(symbols.data, 1, symbols.len, f) == symbols.len &&
+             fwrite(tree.data, 1, tree.len, f) == tree.len;
+    if (f && fclose(f) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) remove(tmp);
+    memory_free(tmp);
+    memory_free(path);
+    memory_free(symbols.data);
+    memory_free(tree.data);
+}
+
+// Map the cache entry for the source with this hash and length and read
+// its symbols into m. The tree is decoded by module_load(). Returns 0 if
+// there is no usable entry.
+static int read_cache(Module *m, uint64_t hash, size_t source_length) {
+    char *path = cache_file(hash);
+    if (!path) return 0;
+    int fd = open(path, O_RDONLY);
+    memory_free(path);
+    if (fd < 0) return 0;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ModuleHeader))
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+    size_t size = (size_t)st.st_size;
+    const char *base = map;
+    ModuleHeader h;
+    memcpy(&h, base, sizeof(h));
+    if (memcmp(h.magic, MODULE_MAGIC, sizeof(h.magic)) != 0 || h.version != MODULE_CACHE_VERSION ||
+        h.byte_order != MODULE_BYTE_ORDER || h.source_hash != hash ||
+        h.source_length != source_length || h.size != size || h.tree < sizeof(h) ||
+        h.tree > size ||
+        hash_bytes(base + sizeof(h), h.tree - sizeof(h)) != h.symbol_checksum) {
+        munmap(map, size);
+        return 0;
+    }
+    Reader r = { base + sizeof(h), base + h.tree, 0 };
+    for (uint64_t i = 0; i < h.symbol_count && !r.bad; ++i) {
+        uint32_t kind, length;
+        if (!take(&r, &kind, sizeof(kind)) || !take(&r, &length, sizeof(length)) ||
+            (size_t)(r.end - r.at) < length || kind > MODULE_VARIABLE) {
+            r.bad = 1;
+            break;
+        }
+        char *name = memory_alloc((size_t)length + 1);
+        if (!name) out_of_memory();
+        memcpy(name, r.at, length);
+        name[length] = '\0';
+        r.at += length;
+        add_symbol(m, name, (ModuleSymbol)kind);
+        memory_free(name);
+    }
+    if (r.bad) {
+        munmap(map, size);
+        for (size_t i = 0; i < m->symbol_count; ++i)
+            memory_free(m->symbols[i].name);
+        m->symbol_count = 0;
+        return 0;
+    }
+    m->cached = base;
+    m->cached_size = size;
+    return 1;
+}
+
+static char *read_source(const char *path, size_t *length) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = len >= 0 ? memory_alloc((size_t)len + 1) : NULL;
+    if (!buf || fread(buf, 1, (size_t)len, f) != (size_t)len) {
+        memory_free(buf);
+        fclose(f);
+        return NULL;
+    }
+    buf[len] = '\0';
+    fclose(f);
+    *length = (size_t)len;
+    return buf;
+}
+
+// Lex and parse the source of m. Returns 0 after reporting an error.
+static int parse_source(Module *m, const char *source) {
+    int errors = error_count();
+    Token *tokens = tokenize(source);
+    if (tokens) {
+        m->tree = parse(tokens);
+        free_tokens(tokens);
+    }
+    if (tokens && error_count() == errors) return 1;
+    char msg[512];
+    snprintf(msg, sizeof(msg), "Cannot import '%s': it has syntax errors", m->name);
+    report_error(msg, -1);
+    free_ast_node(m->tree);
+    m->tree = NULL;
+    return 0;
+}
+
+// Resolve path against the directory of 'from'
+static char *resolve(const char *path, const char *from) {
+    size_t dir = 0;
+    if (path[0] != '/' && from) {
+        const char *slash = strrchr(from, '/');
+        if (slash) dir = (size_t)(slash - from) + 1;
+    }
+    char *joined = memory_alloc(dir + strlen(path) + 1);
+    if (!joined) out_of_memory();
+    memcpy(joined, from, dir);
+    strcpy(joined + dir, path);
+    char *resolved = realpath(joined, NULL);
+    memory_free(joined);
+    return resolved;
+}
+
+Module *module_import(const char *path, const char *from) {
+    char msg[512];
+    char *resolved = resolve(path, from);
+    if (!resolved) {
+        snprintf(msg, sizeof(msg), "Cannot import '%s': file not found", path);
+        report_error(msg, -1);
+        return NULL;
+    }
+    for (size_t i = 0; i < module_count; ++i) {
+        if (strcmp(modules[i]->path, resolved) == 0) {
+            memory_free(resolved);
+            return modules[i];
+        }
+    }
+    size_t length;
+    char *source = read_source(resolved, &length);
+    if (!source) {
+        snprintf(msg, sizeof(msg), "Cannot import '%s': file could not be read", path);
+        report_error(msg, -1);
+        memory_free(resolved);
+        return NULL;
+    }
+    Module *m = memory_calloc(1, sizeof(Module));
+    if (!m) out_of_memory();
+    m->name = string_duplicate(path);
+    m->path = resolved;
+    uint64_t hash = hash_bytes(source, length);
+    m->hash = hash;
+    if (!read_cache(m, hash, length)) {
+        if (!parse_source(m, source)) {
+            memory_free(source);
+            memory_free(m->name);
+            memory_free(m->path);
+            memory_free(m);
+            return NULL;
+        }
+        collect_symbols(m, m->tree);
+        write_cache(m, hash, length);
+    }
+    memory_free(source);
+
+    if (module_count == module_capacity) {
+        module_capacity = module_capacity ? module_capacity * 2 : 8;
+        modules = memory_realloc(modules, sizeof(Module *) * module_capacity);
+        if (!modules) out_of_memory();
+    }
+    modules[module_count++] = m;
+    for (size_t i = 0; i < m->symbol_count; ++i)
+        table_add(m->symbols[i].name, m->symbols[i].kind, m);
+    pending++;
+    return m;
+}
+
+Module *module_defining(const char *name, ModuleSymbol kind) {
+    if (!pending) return NULL;
+    SymbolEntry *e = find_entry(symbol_table, table_capacity, name, kind);
+    if (!e->name) return NULL;
+    if (!e->module->loaded) return e->module;
+    // The first module defining it is loaded already; a later one may not be
+    for (size_t i = 0; i < module_count; ++i) {
+        if (!modules[i]->loaded && module_defines(modules[i], name, kind))
+            return modules[i];
+    }
+    return NULL;
+}
+
+int module_defines(const Module *m, const char *name, ModuleSymbol kind) {
+    for (size_t i = 0; i < m->symbol_count; ++i) {
+        if (m->symbols[i].kind == kind && strcmp(m->symbols[i].name, name) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+int module_load(Module *m, ASTNode **tree) {
+    if (!m->loaded) {
+        m->loaded = 1;
+        pending--;
+    }
+    if (m->cached) {
+        const ModuleHeader *h = (const ModuleHeader *)m->cached;
+        uint64_t offset, size;
+        memcpy(&offset, &h->tree, sizeof(offset));
+        memcpy(&size, &h->size, sizeof(size));
+        uint64_t checksum;
+        memcpy(&checksum, &h->tree_checksum, sizeof(checksum));
+        Reader r = { m->cached + offset, m->cached + size, 0 };
+        if (hash_bytes(r.at, (size_t)(size - offset)) == checksum) {
+            m->tree = decode_tree(&r);
+            if (r.bad || r.at != r.end) {
+                free_ast_node(m->tree);
+                m->tree = NULL;
+                r.bad = 1;
+            }
+        } else {
+            r.bad = 1;
+        }
+        munmap((void *)m->cached, m->cached_size);
+        m->cached = NULL;
+        if (r.bad) {
+            // A damaged entry: drop it so the next import writes a new one,
+            // and parse the source after all
+            char *path = cache_file(m->hash);
+            if (path) remove(path);
+            memory_free(path);
+            size_t length;
+            char *source = read_source(m->path, &length);
+            if (!source) {
+                char msg[512];
+                snprintf(msg, sizeof(msg), "Cannot import '%s': file could not be read", m->name);
+                report_error(msg, -1);
+            }
+            int ok = source && parse_source(m, source);
+            memory_free(source);
+            if (!ok) {
+                *tree = NULL;
+                return 0;
+            }
+        }
+    }
+    *tree = m->tree;
+    return 1;
+}
+
+const char *module_path(const Module *m) {
+    return m->path;
+}
+
+const char *module_name(const Module *m) {
+    return m->name;
+}
+
+void module_free_all(void) {
+    for (size_t i = 0; i < module_count; ++i) {
+        Module *m = modules[i];
+        for (size_t k = 0; k < m->symbol_count; ++k)
+            memory_free(m->symbols[k].name);
+        memory_free(m->symbols);
+        free_ast_node(m->tree);
+        if (m->cached) munmap((void *)m->cached, m->cached_size);
+        memory_free(m->name);
+        memory_free(m->path);
+        memory_free(m);
+    }
+    memory_free(modules);
+    modules = NULL;
+    module_count = 0;
+    module_capacity = 0;
+    pending = 0;
+    memory_free(symbol_table);
+    symbol_table = NULL;
+    table_capacity = 0;
+    table_count = 0;
+}
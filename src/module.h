@@ -0,0 +1,57 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include "ast.h"
+
+// Modules: other program files brought in with 'bubata "path.igbo"'.
+//
+// Importing a file registers it and reads only the names of the
+// functions and global variables its top level defines. The module is
+// loaded (its syntax tree built and, by the interpreter, its top level
+// run) when one of those names is first used. Each file is parsed at most
+// once per process, and the parsed tree is also kept in a cache
+// directory under a hash of the source text, so later processes that
+// import the same file skip lexing and parsing altogether:
+//
+//   $IGBO_CACHE_DIR, else $XDG_CACHE_HOME/igbo, else $HOME/.cache/igbo
+//
+// A cache entry records the source hash and length, a format version and
+// a checksum; entries that do not match are ignored and rewritten. The
+// cache is only an optimization: when the directory cannot be written,
+// modules are simply parsed every time.
+
+// Bump whenever the syntax tree or its encoding changes
+#define MODULE_CACHE_VERSION 1
+
+typedef struct Module Module;
+
+typedef enum { MODULE_FUNCTION, MODULE_VARIABLE } ModuleSymbol;
+
+// Register the file at path, which is relative to the directory of the
+// importing file 'from' (or to the working directory when from is NULL).
+// Importing a file again returns the module registered the first time.
+// Returns NULL after reporting an error.
+Module *module_import(const char *path, const char *from);
+
+// The first module, in import order, that defines name as a function or
+// global variable and has not been loaded yet, or NULL. Cheap when no
+// module is waiting to be loaded.
+Module *module_defining(const char *name, ModuleSymbol kind);
+
+// Whether module m defines name at its top level
+int module_defines(const Module *m, const char *name, ModuleSymbol kind);
+
+// Mark m as loaded and store its syntax tree (NULL for a file without
+// statements) in *tree. The tree stays owned by the module. Returns 0
+// after reporting an error.
+int module_load(Module *m, ASTNode **tree);
+
+// The resolved path of m, against which its own imports are resolved,
+// and the path as written in the first 'bubata' that named it
+const char *module_path(const Module *m);
+const char *module_name(const Module *m);
+
+// Forget all modules and free their trees
+void module_free_all(void);
+
+#endif // MODULE_H
@@ -0,0 +1,136 @@
+#include "ops.h"
+#include "memory.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Value ops_binary(Value left, Value right, const char *op) {
+    if (strcmp(op, "+") == 0) {
+        if (left.type == VAL_STRING || right.type == VAL_STRING) {
+            const char *lstr = left.type == VAL_STRING ? left.as.string : NULL;
+            const char *rstr = right.type == VAL_STRING ? right.as.string : NULL;
+            char *lalloc = NULL;
+            char *ralloc = NULL;
+            char buf[64];
+            if (!lstr && left.type == VAL_NUMBER) {
+                snprintf(buf, sizeof(buf), "%g", left.as.number);
+                lstr = buf;
+            } else if (!lstr) {
+                lstr = lalloc = value_to_string(left);
+            }
+            char buf2[64];
+            if (!rstr && right.type == VAL_NUMBER) {
+                snprintf(buf2, sizeof(buf2), "%g", right.as.number);
+                rstr = buf2;
+            } else if (!rstr) {
+                rstr = ralloc = value_to_string(right);
+            }
+            char *res = memory_alloc(strlen(lstr) + strlen(rstr) + 1);
+            if (!res) {
+                report_error("Memory allocation failed for string", -1);
+                exit(1);
+            }
+            strcpy(res, lstr);
+            strcat(res, rstr);
+            memory_free(lalloc);
+            memory_free(ralloc);
+            Value v = {VAL_STRING, {.string = res}};
+            return v;
+        } else {
+            if (left.type != VAL_NUMBER || right.type != VAL_NUMBER) {
+                report_error("Operands must be numbers or strings for '+'", -1);
+                return (Value){VAL_NUMBER, {.number = 0}};
+            }
+            Value v = {VAL_NUMBER, {.number = left.as.number + right.as.number}};
+            return v;
+        }
+    } else if (strcmp(op, "-") == 0) {
+        if (left.type != VAL_NUMBER || right.type != VAL_NUMBER) {
+            report_error("Operands must be numbers for '-'", -1);
+            return (Value){VAL_NUMBER, {.number = 0}};
+        }
+        return (Value){VAL_NUMBER, {.number = left.as.number - right.as.number}};
+    } else if (strcmp(op, "*") == 0) {
+        if (left.type != VAL_NUMBER || right.type != VAL_NUMBER) {
+            report_error("Operands must be numbers for '*'", -1);
+            return (Value){VAL_NUMBER, {.number = 0}};
+        }
+        return (Value){VAL_NUMBER, {.number = left.as.number * right.as.number}};
+    } else if (strcmp(op, "/") == 0) {
+        if (left.type != VAL_NUMBER || right.type != VAL_NUMBER) {
+            report_error("Operands must be numbers for '/'", -1);
+            return (Value){VAL_NUMBER, {.number = 0}};
+        }
+        return (Value){VAL_NUMBER, {.number = left.as.number / right.as.number}};
+    } else if (strcmp(op, "==") == 0) {
+        if (left.type == right.type)
+            return (Value){VAL_BOOL, {.boolean = value_equals(left, right)}};
+        report_error("Type mismatch for '=='", -1);
+        return (Value){VAL_BOOL, {.boolean = 0}};
+    } else if (strcmp(op, "!=") == 0) {
+        if (left.type == right.type)
+            return (Value){VAL_BOOL, {.boolean = !value_equals(left, right)}};
+        report_error("Type mismatch for '!='", -1);
+        return (Value){VAL_BOOL, {.boolean = 0}};
+    } else if (strcmp(op, "<") == 0 || strcmp(op, ">") == 0 ||
+               strcmp(op, "<=") == 0 || strcmp(op, ">=") == 0) {
+        if (left.type != VAL_NUMBER || right.type != VAL_NUMBER) {
+            report_error("Operands must be numbers for comparison", -1);
+            return (Value){VAL_BOOL, {.boolean = 0}};
+        }
+        int result = 0;
+        if (strcmp(op, "<") == 0) result = left.as.number < right.as.number;
+        else if (strcmp(op, ">") == 0) result = left.as.number > right.as.number;
+        else if (strcmp(op, "<=") == 0) result = left.as.number <= right.as.number;
+        else if (strcmp(op, ">=") == 0) result = left.as.number >= right.as.number;
+        return (Value){VAL_BOOL, {.boolean = result}};
+    }
+    report_error("Unknown binary operator", -1);
+    return (Value){VAL_NUMBER, {.number = 0}};
+}
+
+void ops_print(Value value) {
+    if (value.type == VAL_STRING) {
+        printf("%s\n", value.as.string);
+    } else if (value.type == VAL_NUMBER) {
+        printf("%g\n", value.as.number);
+    } else if (value.type == VAL_BOOL) {
+        printf(value.as.boolean ? "eziokwu\n" : "ụgha\n");
+    } else {
+        char *text = value_to_string(value);
+        printf("%s\n", text);
+        memory_free(text);
+    }
+}
+
+int ops_list_index(List *list, Value index, size_t *out) {
+    if (index.type != VAL_NUMBER) {
+        report_error("List index must be a number", -1);
+        return 0;
+    }
+    double n = index.as.number;
+    if (n < 0 || n != (double)(size_t)n || (size_t)n >= list->count) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "List index %g out of range (length %zu)", n, list->count);
+        report_error(msg, -1);
+        return 0;
+    }
+    *out = (size_t)n;
+    return 1;
+}
+
+Value ops_map_index(Map *map, Value index) {
+    const InternedString *key;
+    if (!map_key(index, 0, &key)) return (Value){VAL_NUMBER, {.number = 0}};
+    Value *found = key ? map_get(map, key) : NULL;
+    if (!found) {
+        char *text = value_to_string(index);
+        char msg[160];
+        snprintf(msg, sizeof(msg), "Key '%s' not found in map", text);
+        report_error(msg, -1);
+        memory_free(text);
+        return (Value){VAL_NUMBER, {.number = 0}};
+    }
+    return value_copy(*found);
+}
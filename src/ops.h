@@ -0,0 +1,28 @@
+#ifndef OPS_H
+#define OPS_H
+
+#include "list.h"
+#include "map.h"
+#include "value.h"
+
+// Operations on values shared by the interpreter and by programs compiled
+// to C (see compiler.h), so both give the same results and report the
+// same errors. Errors are reported and leave a placeholder result; none
+// of them stops the program.
+
+// Apply a binary operator ("+", "-", "*", "/", "==", "!=", "<", ">", "<="
+// or ">=") to two borrowed operands and return a new value.
+Value ops_binary(Value left, Value right, const char *op);
+
+// Print a value on its own line, as 'gosi' does.
+void ops_print(Value value);
+
+// Validate a list index and convert it to a position in the list.
+// Returns 0 after reporting an error if it is not a valid index.
+int ops_list_index(List *list, Value index, size_t *out);
+
+// Return a copy of the value stored under index in map, reporting an
+// error (and returning 0) when it is missing.
+Value ops_map_index(Map *map, Value index);
+
+#endif // OPS_H
@@ -0,0 +1,227 @@
+#include "optimizer.h"
+#include "memory.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Plans are indexed by the slot of their NODE_WHILE_STMT. Each is
+// allocated on its own so pointers stay valid while loops nest.
+static LoopPlan **plans = NULL;
+static size_t plan_count = 0;
+static size_t plan_capacity = 0;
+static int cell_count = 0;
+
+// Variables assigned anywhere inside a loop. 'opaque' is set when part of
+// the loop has not been parsed yet, so nothing can be assumed about it.
+typedef struct {
+    ASTNode **nodes;   // VAR_DECL, INDEX_ASSIGN and FOR_STMT nodes
+    int count;
+    int capacity;
+    int opaque;
+} Assigned;
+
+static void add_assigned(Assigned *a, ASTNode *node) {
+    if (a->count == a->capacity) {
+        a->capacity = a->capacity ? a->capacity * 2 : 8;
+        a->nodes = memory_realloc(a->nodes, sizeof(ASTNode *) * a->capacity);
+        if (!a->nodes) {
+            report_error("Memory allocation failed in optimizer", -1);
+            exit(1);
+        }
+    }
+    a->nodes[a->count++] = node;
+}
+
+static void collect_assigned(ASTNode *node, Assigned *a) {
+    if (!node) return;
+    switch (node->type) {
+        case NODE_VAR_DECL:
+        case NODE_INDEX_ASSIGN:
+        case NODE_FOR_STMT:
+            add_assigned(a, node);
+            break;
+        case NODE_FUNC_DEF:
+            // Runs in its own frame and cannot assign our variables
+            return;
+        case NODE_PARALLEL_FOR:
+            // Assigns its reduction variables when it finishes
+            a->opaque = 1;
+            return;
+        case NODE_LAZY_BLOCK:
+            if (node->slot >= 0) {
+                a->opaque = 1;
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    collect_assigned(node->left, a);
+    collect_assigned(node->right, a);
+    collect_assigned(node->third, a);
+}
+
+// Does 'target' (named node with a slot) refer to the same variable as
+// identifier 'id'? Locals are compared by slot, globals by name.
+static int same_variable(const ASTNode *target, const ASTNode *id) {
+    if (id->slot >= 0) return target->slot == id->slot;
+    return target->slot < 0 && strcmp(target->value, id->value) == 0;
+}
+
+static int times_assigned(const Assigned *a, const ASTNode *id) {
+    int n = 0;
+    for (int i = 0; i < a->count; ++i) {
+        if (same_variable(a->nodes[i], id)) n++;
+    }
+    return n;
+}
+
+static int is_arithmetic(const ASTNode *node) {
+    if (node->type != NODE_BINARY_EXPR) return 0;
+    const char *op = node->value;
+    return op[1] == '\0' && (op[0] == '+' || op[0] == '-' || op[0] == '*' || op[0] == '/');
+}
+
+static int is_invariant(const ASTNode *node, const Assigned *a) {
+    switch (node->type) {
+        case NODE_NUMBER:
+            return 1;
+        case NODE_HOISTED:
+            // Hoisted out of an inner loop, which says nothing about this one
+            return is_invariant(node->left, a);
+        case NODE_IDENTIFIER:
+            return times_assigned(a, node) == 0;
+        case NODE_BINARY_EXPR:
+            return is_arithmetic(node) && is_invariant(node->left, a) &&
+                   is_invariant(node->right, a);
+        default:
+            return 0;
+    }
+}
+
+// Wrap the largest invariant arithmetic subexpressions below *ref
+static void hoist(ASTNode **ref, const Assigned *a, LoopPlan *plan) {
+    ASTNode *node = *ref;
+    if (!node || plan->cell_count == MAX_HOISTED) return;
+    switch (node->type) {
+        case NODE_FUNC_DEF:
+        case NODE_HOISTED:
+            return;
+        case NODE_BINARY_EXPR:
+            if (is_invariant(node, a)) {
+                ASTNode *wrap = create_ast_node(NODE_HOISTED, NULL, node, NULL, NULL);
+                wrap->slot = cell_count++;
+                wrap->types = node->types;
+                plan->cell_count++;
+                *ref = wrap;
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    hoist(&node->left, a, plan);
+    hoist(&node->right, a, plan);
+    hoist(&node->third, a, plan);
+}
+
+static int compare_op(const char *op, CompareOp *out) {
+    if (strcmp(op, "<") == 0) *out = CMP_LESS;
+    else if (strcmp(op, "<=") == 0) *out = CMP_LESS_EQUAL;
+    else if (strcmp(op, ">") == 0) *out = CMP_GREATER;
+    else if (strcmp(op, ">=") == 0) *out = CMP_GREATER_EQUAL;
+    else if (strcmp(op, "==") == 0) *out = CMP_EQUAL;
+    else if (strcmp(op, "!=") == 0) *out = CMP_NOT_EQUAL;
+    else return 0;
+    return 1;
+}
+
+// Match 'dee var = var + C' or 'dee var = var - C'
+static int match_increment(const ASTNode *stmt, const ASTNode *var, double *step) {
+    if (!stmt || stmt->type != NODE_VAR_DECL || !same_variable(stmt, var)) return 0;
+    const ASTNode *rhs = stmt->left;
+    if (rhs->type != NODE_BINARY_EXPR) return 0;
+    int negate = strcmp(rhs->value, "-") == 0;
+    if (!negate && strcmp(rhs->value, "+") != 0) return 0;
+    if (rhs->left->type != NODE_IDENTIFIER || !same_variable(rhs->left, var)) return 0;
+    if (rhs->right->type != NODE_NUMBER) return 0;
+    // Same conversion as eval() uses for number literals
+    double c = atof(rhs->right->value);
+    *step = negate ? -c : c;
+    return 1;
+}
+
+static void analyse(ASTNode *loop, LoopPlan *plan) {
+    memset(plan, 0, sizeof(*plan));
+    plan->first_cell = cell_count;
+
+    // A body parsed lazily is a single NODE_LAZY_BLOCK statement
+    ASTNode *body = loop->right;
+    if (body && !body->right && body->left->type == NODE_LAZY_BLOCK) {
+        if (body->left->slot >= 0) return;
+        body = body->left->left;
+    }
+    plan->body = body;
+
+    Assigned a = { NULL, 0, 0, 0 };
+    collect_assigned(loop->left, &a);
+    collect_assigned(body, &a);
+    if (a.opaque) {
+        memory_free(a.nodes);
+        return;
+    }
+
+    hoist(&loop->left, &a, plan);
+    for (ASTNode *n = body; n != NULL; n = n->right) {
+        hoist(&n->left, &a, plan);
+        if (!n->right) plan->increment = n->left;
+    }
+
+    ASTNode *cond = loop->left;
+    if (cond && cond->type == NODE_BINARY_EXPR && compare_op(cond->value, &plan->op) &&
+        cond->left->type == NODE_IDENTIFIER &&
+        (cond->right->type == NODE_NUMBER || cond->right->type == NODE_HOISTED ||
+         (cond->right->type == NODE_IDENTIFIER && times_assigned(&a, cond->right) == 0)) &&
+        times_assigned(&a, cond->left) == 1 &&
+        match_increment(plan->increment, cond->left, &plan->step)) {
+        plan->fused = 1;
+        plan->var = cond->left;
+        plan->bound = cond->right;
+    }
+    memory_free(a.nodes);
+}
+
+const LoopPlan *optimize_loop(ASTNode *loop) {
+    if (loop->slot >= 0) return plans[loop->slot];
+    if (plan_count == plan_capacity) {
+        plan_capacity = plan_capacity ? plan_capacity * 2 : 16;
+        plans = memory_realloc(plans, sizeof(LoopPlan *) * plan_capacity);
+        if (!plans) {
+            report_error("Memory allocation failed in optimizer", -1);
+            exit(1);
+        }
+    }
+    LoopPlan *plan = memory_alloc(sizeof(LoopPlan));
+    if (!plan) {
+        report_error("Memory allocation failed in optimizer", -1);
+        exit(1);
+    }
+    loop->slot = (int)plan_count;
+    plans[plan_count++] = plan;
+    analyse(loop, plan);
+    return plan;
+}
+
+int optimizer_cell_count(void) {
+    return cell_count;
+}
+
+void optimizer_reset(void) {
+    for (size_t i = 0; i < plan_count; ++i)
+        memory_free(plans[i]);
+    memory_free(plans);
+    plans = NULL;
+    plan_count = 0;
+    plan_capacity = 0;
+    cell_count = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ast.h"
+
+// Loop optimizer for 'mgbe' loops. A loop is analysed the first time it
+// runs (so that lazily parsed bodies are available) and two things are
+// recorded:
+//
+//  * Invariant arithmetic subexpressions of the condition and body, whose
+//    variables are never assigned inside the loop, are wrapped in
+//    NODE_HOISTED nodes. Each owns a cache cell in the interpreter that is
+//    filled on first use and cleared every time the loop is entered.
+//
+//  * When the condition is 'i OP bound' and the body ends with
+//    'dee i = i + C' (or 'i - C') that is the only assignment to 'i', the
+//    loop plan is marked fused: if 'i' and 'bound' are numbers on entry,
+//    the interpreter compares and steps 'i' directly instead of going
+//    through eval(). Since 'i + C' keeps a number a number and 'bound' is
+//    invariant, checking the types once on entry is enough; otherwise the
+//    loop runs through the generic path.
+
+// Most hoisted expressions recorded for one loop
+#define MAX_HOISTED 16
+
+typedef enum {
+    CMP_LESS,
+    CMP_LESS_EQUAL,
+    CMP_GREATER,
+    CMP_GREATER_EQUAL,
+    CMP_EQUAL,
+    CMP_NOT_EQUAL
+} CompareOp;
+
+typedef struct {
+    int fused;           // condition and increment can run as numeric ops
+    CompareOp op;
+    ASTNode *var;        // identifier on the left of the condition
+    ASTNode *bound;      // right operand of the condition
+    double step;         // amount added to var by the increment
+    ASTNode *body;       // statement chain of the body
+    ASTNode *increment;  // last statement of 'body'
+    int first_cell;      // hoisted expressions use cells
+    int cell_count;      // [first_cell, first_cell + cell_count)
+} LoopPlan;
+
+// Analyse a NODE_WHILE_STMT on its first call and return its plan.
+// The plan is remembered through the node's slot.
+const LoopPlan *optimize_loop(ASTNode *loop);
+
+// Total number of hoisted expression cells handed out so far.
+int optimizer_cell_count(void);
+
+// Forget all plans. Called when the interpreter finishes.
+void optimizer_reset(void);
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,216 @@
+#define _POSIX_C_SOURCE 200809L
+#include "parallel.h"
+#include "memory.h"
+#include "util.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_POOL_THREADS 64
+
+volatile int parallel_active = 0;
+
+// Chase-Lev work-stealing deque of task indices. The owner pushes and
+// takes at the bottom; other threads steal from the top. The buffer is
+// sized for the whole run, so it never has to grow.
+typedef struct {
+    long top;
+    long bottom;
+    size_t *tasks;
+    size_t capacity;
+} Deque;
+
+#define DEQUE_EMPTY ((size_t)-1)
+#define DEQUE_RETRY ((size_t)-2)
+
+static void deque_push(Deque *d, size_t task) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    d->tasks[(size_t)b % d->capacity] = task;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+static size_t deque_take(Deque *d) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return DEQUE_EMPTY;
+    }
+    size_t task = d->tasks[(size_t)b % d->capacity];
+    if (t == b) {
+        // Last task: race any thief for it
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            task = DEQUE_EMPTY;
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+static size_t deque_steal(Deque *d) {
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return DEQUE_EMPTY;
+    size_t task = d->tasks[(size_t)t % d->capacity];
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return DEQUE_RETRY;
+    return task;
+}
+
+// Pool state. Workers sleep on 'wake' until 'generation' changes, run the
+// current job, then report back through 'busy' and 'done'.
+static pthread_t workers[MAX_POOL_THREADS];
+static Deque deques[MAX_POOL_THREADS];
+static int thread_count = 0;     // including the thread that runs jobs
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static unsigned long generation = 0;
+static int busy = 0;
+static int stopping = 0;
+static void (*on_thread_start)(void) = NULL;
+static void (*on_thread_exit)(void) = NULL;
+
+// The job being run
+static ParallelTask job_task = NULL;
+static void *job_context = NULL;
+static size_t job_remaining = 0;
+
+// Work until every task of the current job has finished
+static void work(int self) {
+    unsigned seed = (unsigned)self * 2654435761u + 1;
+    while (__atomic_load_n(&job_remaining, __ATOMIC_ACQUIRE) > 0) {
+        size_t task = deque_take(&deques[self]);
+        if (task == DEQUE_EMPTY) {
+            // Try the other deques, starting at a pseudo-random victim
+            seed = seed * 1103515245u + 12345u;
+            int start = (int)(seed >> 16) % thread_count;
+            for (int k = 0; k < thread_count && task >= DEQUE_RETRY; ++k) {
+                int victim = (start + k) % thread_count;
+                if (victim != self) task = deque_steal(&deques[victim]);
+            }
+            if (task >= DEQUE_RETRY) {
+                sched_yield();
+                continue;
+            }
+        }
+        job_task(job_context, task);
+        __atomic_sub_fetch(&job_remaining, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void *worker_main(void *arg) {
+    int self = (int)(size_t)arg;
+    unsigned long seen = 0;
+    if (on_thread_start) on_thread_start();
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (generation == seen && !stopping)
+            pthread_cond_wait(&wake, &lock);
+        if (stopping) break;
+        seen = generation;
+        pthread_mutex_unlock(&lock);
+        work(self);
+        pthread_mutex_lock(&lock);
+        if (--busy == 0) pthread_cond_signal(&done);
+    }
+    pthread_mutex_unlock(&lock);
+    if (on_thread_exit) on_thread_exit();
+    return NULL;
+}
+
+void parallel_init(int threads, size_t stack_size,
+                   void (*thread_start)(void), void (*thread_exit)(void)) {
+    if (thread_count) return;
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > MAX_POOL_THREADS) threads = MAX_POOL_THREADS;
+    on_thread_start = thread_start;
+    on_thread_exit = thread_exit;
+    stopping = 0;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, stack_size);
+    thread_count = 1;
+    for (int i = 1; i < threads; ++i) {
+        if (pthread_create(&workers[i], &attr, worker_main, (void *)(size_t)i) != 0)
+            break;  // run with the threads we have
+        thread_count++;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+int parallel_threads(void) {
+    return thread_count ? thread_count : 1;
+}
+
+void parallel_run(size_t count, ParallelTask task, void *context) {
+    if (count == 0) return;
+    if (thread_count <= 1) {
+        for (size_t i = 0; i < count; ++i)
+            task(context, i);
+        return;
+    }
+
+    // Deal the tasks out round robin. Each deque takes its own tasks from
+    // the bottom, so pushing in reverse makes owners run them in order.
+    size_t per_thread = count / (size_t)thread_count + 1;
+    for (int i = 0; i < thread_count; ++i) {
+        Deque *d = &deques[i];
+        if (d->capacity < per_thread) {
+            memory_free(d->tasks);
+            d->tasks = memory_alloc(sizeof(size_t) * per_thread);
+            if (!d->tasks) {
+                report_error("Memory allocation failed for thread pool", -1);
+                exit(1);
+            }
+            d->capacity = per_thread;
+        }
+        d->top = 0;
+        d->bottom = 0;
+    }
+    for (size_t i = count; i-- > 0;)
+        deque_push(&deques[i % (size_t)thread_count], i);
+
+    job_task = task;
+    job_context = context;
+    __atomic_store_n(&job_remaining, count, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&lock);
+    generation++;
+    busy = thread_count - 1;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+
+    work(0);
+
+    pthread_mutex_lock(&lock);
+    while (busy > 0)
+        pthread_cond_wait(&done, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+void parallel_shutdown(void) {
+    if (!thread_count) return;
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    for (int i = 1; i < thread_count; ++i)
+        pthread_join(workers[i], NULL);
+    for (int i = 0; i < thread_count; ++i) {
+        memory_free(deques[i].tasks);
+        deques[i].tasks = NULL;
+        deques[i].capacity = 0;
+    }
+    thread_count = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+// Storage class for interpreter state that every worker thread keeps its
+// own copy of (value stack, current frame, error flag, ...).
+#define THREAD_LOCAL __thread
+
+// Nonzero while worker threads may be running interpreter code. Shared
+// structures that are normally used by one thread only (reference counts,
+// the string interner) switch to thread-safe operation while it is set,
+// and one-time work such as loop analysis is put off.
+extern volatile int parallel_active;
+
+typedef void (*ParallelTask)(void *context, size_t task);
+
+// Start the worker pool. 'threads' counts the calling thread as well;
+// 0 means one per online CPU. Each worker runs thread_start() before its
+// first task and thread_exit() when the pool shuts down. Calling it again
+// while the pool is running does nothing.
+void parallel_init(int threads, size_t stack_size,
+                   void (*thread_start)(void), void (*thread_exit)(void));
+
+// Number of threads (including the caller) that parallel_run() uses.
+int parallel_threads(void);
+
+// Run task(context, i) for every i in [0, count) on the pool and return
+// once all of them have finished. The calling thread works too. Tasks
+// are dealt out to per-thread work-stealing deques, so idle threads take
+// work from busy ones.
+void parallel_run(size_t count, ParallelTask task, void *context);
+
+// Stop and join the worker threads.
+void parallel_shutdown(void);
+
+#endif // PARALLEL_H
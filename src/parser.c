@@ -1,20 +1,120 @@
 #include "parser.h"
+#include "builtins.h"
+#include "intern.h"
+#include "lexer.h"
+#include "memory.h"
 #include "util.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // Simple recursive descent parser implementation following the grammar
 // specified in the project instructions.
 
+// Local variables of the function currently being parsed. Each name is
+// given the next frame slot the first time it is assigned with 'dee' (or
+// bound by a parameter or 'maka'); identifiers that do not name a local at
+// that point in the source refer to globals.
 typedef struct {
+    char **names;
+    int count;
+    int capacity;
+} Scope;
+
+// Names assigned outside functions, in an open addressing table. The
+// names are interned, so they are compared by pointer and are not copied
+// and freed again by every parse.
+typedef struct {
+    const InternedString **names;   // NULL entries are free
+    size_t capacity;
+    size_t count;
+} NameSet;
+
+// In streaming mode tokens are pulled from the lexer as the parser looks
+// at them and kept in fixed size chunks, so a Token pointer stays valid
+// while the statement that holds it is being parsed. Chunks behind the
+// last finished top-level statement are released.
+#define TOKEN_CHUNK 256
+
+struct Parser {
     Token *tokens;   // array of tokens terminated by TOKEN_EOF
     size_t current;  // current token index
-} Parser;
+    int failed;      // set when an error was reported in a nested list
+    Scope *scope;    // innermost function scope, NULL at the top level
+    int lazy;        // leave top-level block bodies unparsed
+    int strict;      // with lazy, still check unparsed blocks for errors
+    int errors;      // number of syntax errors reported
+    int parallel;    // parsing the body of a 'mgbe ngwa' loop
+    int yields;      // 'nye' statements in the function being parsed
+    int returns;     // 'laghachi' with a value in the function being parsed
+    NameSet globals; // names assigned outside functions so far
+
+    // Streaming mode only
+    Lexer *lexer;
+    Token **chunks;      // chunks[i] holds tokens from base + i * TOKEN_CHUNK
+    size_t chunk_count;
+    size_t chunk_capacity;
+    size_t base;         // index of the first token still held
+    size_t count;        // number of tokens pulled from the lexer so far
+    size_t released;     // tokens below this index have been freed
+    int stopped;         // a statement failed to parse
+};
+
+// Pull tokens from the lexer until token 'index' is available
+static Token *stream_token(Parser *p, size_t index) {
+    while (index >= p->count) {
+        size_t offset = p->count - p->base;
+        if (offset / TOKEN_CHUNK == p->chunk_count) {
+            if (p->chunk_count == p->chunk_capacity) {
+                p->chunk_capacity = p->chunk_capacity ? p->chunk_capacity * 2 : 8;
+                p->chunks = memory_realloc(p->chunks, sizeof(Token *) * p->chunk_capacity);
+                if (!p->chunks) {
+                    report_error("Memory allocation failed for tokens", -1);
+                    exit(1);
+                }
+            }
+            p->chunks[p->chunk_count] = memory_alloc(sizeof(Token) * TOKEN_CHUNK);
+            if (!p->chunks[p->chunk_count]) {
+                report_error("Memory allocation failed for tokens", -1);
+                exit(1);
+            }
+            p->chunk_count++;
+        }
+        Token *slot = &p->chunks[offset / TOKEN_CHUNK][offset % TOKEN_CHUNK];
+        lexer_next(p->lexer, slot);
+        p->count++;
+    }
+    size_t offset = index - p->base;
+    return &p->chunks[offset / TOKEN_CHUNK][offset % TOKEN_CHUNK];
+}
+
+static Token *peek(Parser *p) {
+    if (p->lexer) return stream_token(p, p->current);
+    return &p->tokens[p->current];
+}
+
+static Token *previous(Parser *p) {
+    if (p->lexer) return stream_token(p, p->current - 1);
+    return &p->tokens[p->current - 1];
+}
 
-static Token *peek(Parser *p) { return &p->tokens[p->current]; }
-static Token *previous(Parser *p) { return &p->tokens[p->current - 1]; }
 static int is_at_end(Parser *p) { return peek(p)->type == TOKEN_EOF; }
 
+// The token 'ahead' places after the current one, or EOF
+static Token *peek_ahead(Parser *p, size_t ahead) {
+    size_t i = p->current;
+    for (;;) {
+        Token *t = p->lexer ? stream_token(p, i) : &p->tokens[i];
+        if (ahead-- == 0 || t->type == TOKEN_EOF) return t;
+        i++;
+    }
+}
+
+// Contextual keywords such as 'ngwa' are ordinary identifiers
+static int is_word(const Token *t, const char *word) {
+    return t->type == TOKEN_IDENTIFIER && strcmp(t->value, word) == 0;
+}
+
 static Token *advance(Parser *p) {
     if (!is_at_end(p)) p->current++;
     return previous(p);
@@ -33,9 +133,107 @@ static int match(Parser *p, TokenType type) {
 }
 
 static void parser_error(Parser *p, const char *message) {
+    p->errors++;
+    // Input cut short by invalid UTF-8 has already been reported
+    if (p->lexer && p->lexer->invalid) return;
     report_error(message, peek(p)->line_number);
 }
 
+static int scope_find(const Scope *scope, const char *name) {
+    for (int i = 0; i < scope->count; ++i) {
+        if (strcmp(scope->names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Index of name in scope, adding it if it is not there yet
+static int scope_add(Scope *scope, const char *name) {
+    int slot = scope_find(scope, name);
+    if (slot >= 0) return slot;
+    if (scope->count + 1 > scope->capacity) {
+        scope->capacity = scope->capacity ? scope->capacity * 2 : 8;
+        char **tmp = memory_realloc(scope->names, sizeof(char *) * scope->capacity);
+        if (!tmp) {
+            report_error("Memory allocation failed while parsing", -1);
+            exit(1);
+        }
+        scope->names = tmp;
+    }
+    scope->names[scope->count] = string_duplicate(name);
+    return scope->count++;
+}
+
+// Slot of a local variable, or -1 if name is not a local (or we are not
+// inside a function).
+static int resolve_local(Parser *p, const char *name) {
+    return p->scope ? scope_find(p->scope, name) : -1;
+}
+
+// Where name is in the set, or the free entry where it would go
+static size_t name_position(const NameSet *set, const InternedString *name) {
+    size_t mask = set->capacity - 1;
+    size_t i = (size_t)name->hash & mask;
+    while (set->names[i] && set->names[i] != name)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static void add_global(Parser *p, const char *name) {
+    NameSet *set = &p->globals;
+    if ((set->count + 1) * 2 > set->capacity) {
+        const InternedString **old = set->names;
+        size_t old_capacity = set->capacity;
+        set->capacity = old_capacity ? old_capacity * 2 : 64;
+        set->names = memory_calloc(set->capacity, sizeof(const InternedString *));
+        if (!set->names) {
+            report_error("Memory allocation failed while parsing", -1);
+            exit(1);
+        }
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old[i]) set->names[name_position(set, old[i])] = old[i];
+        }
+        memory_free(old);
+    }
+    const InternedString *interned = intern(name, strlen(name));
+    size_t i = name_position(set, interned);
+    if (!set->names[i]) {
+        set->names[i] = interned;
+        set->count++;
+    }
+}
+
+static int is_global(const Parser *p, const char *name) {
+    if (!p->globals.count) return 0;
+    size_t length = strlen(name);
+    const InternedString *interned = intern_find(name, length, hash_bytes(name, length));
+    return interned && p->globals.names[name_position(&p->globals, interned)] == interned;
+}
+
+// Slot for a variable being assigned: inside a function every assignment
+// targets a local, creating it on first use. Globals are remembered so
+// that a parallel loop can refuse to assign them.
+static int declare_local(Parser *p, const char *name) {
+    if (!p->scope) {
+        add_global(p, name);
+        return -1;
+    }
+    return scope_add(p->scope, name);
+}
+
+// Report an error whose message names a variable
+static void parallel_error(Parser *p, const char *format, const char *name) {
+    char msg[160];
+    snprintf(msg, sizeof(msg), format, name);
+    parser_error(p, msg);
+}
+
+static void free_scope(Scope *scope) {
+    for (int i = 0; i < scope->count; ++i)
+        memory_free(scope->names[i]);
+    memory_free(scope->names);
+}
+
 // Forward declarations
 static ASTNode *statement(Parser *p);
 static ASTNode *block(Parser *p);
@@ -45,7 +243,11 @@ static ASTNode *comparison(Parser *p);
 static ASTNode *term(Parser *p);
 static ASTNode *factor(Parser *p);
 static ASTNode *unary(Parser *p);
+static ASTNode *postfix(Parser *p);
 static ASTNode *primary(Parser *p);
+static ASTNode *expression_list(Parser *p, TokenType closing, const char *message);
+static ASTNode *function_definition(Parser *p);
+static ASTNode *parallel_for(Parser *p);
 
 // program -> statement*
 static ASTNode *program(Parser *p) {
@@ -64,12 +266,63 @@ static ASTNode *program(Parser *p) {
     return head;
 }
 
+// Token array that lazy blocks refer to, set by parse_lazy()
+static Token *lazy_tokens = NULL;
+
+static ASTNode *block_body(Parser *p);
+
+// Skip over a block body by matching braces and return a NODE_LAZY_BLOCK
+// that remembers where the body starts (in its slot). The '{' has been
+// consumed. Map literals are balanced too, so counting is enough.
+static ASTNode *lazy_block(Parser *p) {
+    size_t start = p->current;
+    if (p->strict) {
+        // Parse the body once to report its errors. A block with errors is
+        // kept as parsed, just as without lazy mode.
+        int errors = p->errors;
+        p->lazy = 0;
+        ASTNode *body = block_body(p);
+        p->lazy = 1;
+        if (p->errors != errors) return body;
+        free_ast_node(body);
+        p->current = start;
+    }
+    int depth = 1;
+    while (!is_at_end(p)) {
+        TokenType type = peek(p)->type;
+        if (type == TOKEN_LBRACE) {
+            depth++;
+        } else if (type == TOKEN_RBRACE && --depth == 0) {
+            break;
+        }
+        advance(p);
+    }
+    if (!match(p, TOKEN_RBRACE)) {
+        parser_error(p, "Expected '}' after block");
+        return NULL;
+    }
+    if (p->current - start == 1) return NULL;  // empty block
+    ASTNode *node = create_ast_node(NODE_LAZY_BLOCK, NULL, NULL, NULL, NULL);
+    node->slot = (int)start;
+    return create_ast_node(NODE_PROGRAM, NULL, node, NULL, NULL);
+}
+
 // block -> "{" statement* "}"
+// In lazy mode, blocks outside functions are only brace matched here and
+// parsed by parse_lazy_block() when they first run. Function bodies are
+// always parsed so that their local slots are known.
 static ASTNode *block(Parser *p) {
     if (!match(p, TOKEN_LBRACE)) {
         parser_error(p, "Expected '{' to start block");
         return NULL;
     }
+    if (p->lazy && !p->scope)
+        return lazy_block(p);
+    return block_body(p);
+}
+
+// The statements of a block up to and including its closing '}'
+static ASTNode *block_body(Parser *p) {
     ASTNode *head = NULL;
     ASTNode *tail = NULL;
     while (!check(p, TOKEN_RBRACE) && !is_at_end(p)) {
@@ -88,7 +341,175 @@ static ASTNode *block(Parser *p) {
     return head;
 }
 
-// statement -> varDecl | printStmt | exprStmt
+// funcDef -> "oru" IDENTIFIER "(" ( IDENTIFIER ( "," IDENTIFIER )* )? ")" block
+// The parameters take the first frame slots; the node's slot holds the
+// total frame size once the body has been parsed.
+static ASTNode *function_definition(Parser *p) {
+    if (p->parallel) {
+        parser_error(p, "Functions cannot be defined inside 'mgbe ngwa'");
+        return NULL;
+    }
+    if (!check(p, TOKEN_IDENTIFIER)) {
+        parser_error(p, "Expected function name after 'oru'");
+        return NULL;
+    }
+    Token *name = advance(p);
+    if (!match(p, TOKEN_LPAREN)) {
+        parser_error(p, "Expected '(' after function name");
+        return NULL;
+    }
+    Scope scope = { NULL, 0, 0 };
+    Scope *enclosing = p->scope;
+    p->scope = &scope;
+    ASTNode *params = NULL;
+    ASTNode *tail = NULL;
+    if (!check(p, TOKEN_RPAREN)) {
+        do {
+            if (!check(p, TOKEN_IDENTIFIER)) {
+                parser_error(p, "Expected parameter name");
+                goto fail;
+            }
+            Token *param = advance(p);
+            if (resolve_local(p, param->value) >= 0) {
+                parser_error(p, "Duplicate parameter name");
+                goto fail;
+            }
+            ASTNode *id = create_ast_node(NODE_IDENTIFIER, param->value, NULL, NULL, NULL);
+            id->slot = declare_local(p, param->value);
+            ASTNode *cell = create_ast_node(NODE_EXPR_LIST, NULL, id, NULL, NULL);
+            if (!params)
+                params = cell;
+            else
+                tail->right = cell;
+            tail = cell;
+        } while (match(p, TOKEN_COMMA));
+    }
+    if (!match(p, TOKEN_RPAREN)) {
+        parser_error(p, "Expected ')' after parameters");
+        goto fail;
+    }
+    int yields = p->yields;
+    int returns = p->returns;
+    p->yields = 0;
+    p->returns = 0;
+    ASTNode *body = block(p);
+    ASTNode *node = create_ast_node(NODE_FUNC_DEF, name->value, params, body, NULL);
+    node->slot = scope.count;
+    node->yields = p->yields > 0;
+    int bad_return = p->yields > 0 && p->returns > 0;
+    p->yields = yields;
+    p->returns = returns;
+    p->scope = enclosing;
+    free_scope(&scope);
+    if (bad_return) {
+        report_error("A generator cannot return a value with 'laghachi'", name->line_number);
+        p->errors++;
+        free_ast_node(node);
+        return NULL;
+    }
+    return node;
+
+fail:
+    p->scope = enclosing;
+    free_scope(&scope);
+    free_ast_node(params);
+    return NULL;
+}
+
+// parallelFor -> "mgbe" "ngwa" IDENTIFIER "site" expression "ruo" expression
+//                ( "jikota" reduction ( "," reduction )* )? block
+// reduction   -> ( "sum" | "min" | "max" ) IDENTIFIER
+// 'mgbe' has been consumed. The body gets its own frame like a function:
+// the loop variable takes slot 0 and the reduction variables the slots
+// after it. The node keeps the range in left and third, and in right an
+// EXPR_LIST whose left is the body and whose right chains the reductions
+// (cells holding the operator, with the variable in left).
+static ASTNode *parallel_for(Parser *p) {
+    // A nested loop is parsed anyway so that no follow-on errors are
+    // reported for the rest of it
+    int errors = p->errors;
+    if (p->scope)
+        parser_error(p, "'mgbe ngwa' is only allowed outside functions and other 'mgbe ngwa' loops");
+    advance(p);  // ngwa
+    Token *var = advance(p);
+    advance(p);  // site
+    ASTNode *from = expression(p);
+    if (!from) return NULL;
+    if (!is_word(peek(p), "ruo")) {
+        parser_error(p, "Expected 'ruo' after start of range");
+        free_ast_node(from);
+        return NULL;
+    }
+    advance(p);
+    ASTNode *to = expression(p);
+    if (!to) {
+        free_ast_node(from);
+        return NULL;
+    }
+
+    Scope scope = { NULL, 0, 0 };
+    Scope *enclosing = p->scope;
+    int parallel = p->parallel;
+    p->scope = &scope;
+    declare_local(p, var->value);
+    ASTNode *reductions = NULL;
+    ASTNode *tail = NULL;
+    ASTNode *body = NULL;
+    if (is_word(peek(p), "jikota")) {
+        advance(p);
+        do {
+            Token *op = peek(p);
+            if (!is_word(op, "sum") && !is_word(op, "min") && !is_word(op, "max")) {
+                parser_error(p, "Expected 'sum', 'min' or 'max' after 'jikota'");
+                goto fail;
+            }
+            advance(p);
+            if (!check(p, TOKEN_IDENTIFIER)) {
+                parser_error(p, "Expected variable name after reduction");
+                goto fail;
+            }
+            Token *name = advance(p);
+            if (resolve_local(p, name->value) >= 0) {
+                parser_error(p, "Duplicate variable in 'mgbe ngwa'");
+                goto fail;
+            }
+            ASTNode *id = create_ast_node(NODE_IDENTIFIER, name->value, NULL, NULL, NULL);
+            id->slot = declare_local(p, name->value);
+            ASTNode *cell = create_ast_node(NODE_EXPR_LIST, op->value, id, NULL, NULL);
+            if (!reductions)
+                reductions = cell;
+            else
+                tail->right = cell;
+            tail = cell;
+        } while (match(p, TOKEN_COMMA));
+    }
+    p->parallel = 1;
+    body = block(p);
+    p->parallel = parallel;
+    if (p->errors != errors) goto fail;
+
+    ASTNode *node = create_ast_node(NODE_PARALLEL_FOR, var->value, from,
+                                    create_ast_node(NODE_EXPR_LIST, NULL, body, reductions, NULL),
+                                    to);
+    node->slot = scope.count;
+    p->scope = enclosing;
+    free_scope(&scope);
+    return node;
+
+fail:
+    p->scope = enclosing;
+    p->parallel = parallel;
+    free_scope(&scope);
+    free_ast_node(from);
+    free_ast_node(to);
+    free_ast_node(reductions);
+    free_ast_node(body);
+    return NULL;
+}
+
+// statement -> varDecl | indexAssign | ifStmt | whileStmt | forStmt
+//            | funcDef | returnStmt | yieldStmt | importStmt | spawnStmt
+//            | printStmt | exprStmt
 static ASTNode *statement(Parser *p) {
     if (match(p, TOKEN_DEE)) {
         // "dee" already consumed
@@ -97,14 +518,55 @@ static ASTNode *statement(Parser *p) {
             return NULL;
         }
         Token *name = advance(p);
+        if (match(p, TOKEN_LBRACKET)) {
+            // indexAssign -> "dee" IDENTIFIER "[" expression "]" "=" expression
+            ASTNode *index = expression(p);
+            if (!index) return NULL;
+            if (!match(p, TOKEN_RBRACKET)) {
+                parser_error(p, "Expected ']' after index");
+                free_ast_node(index);
+                return NULL;
+            }
+            if (!match(p, TOKEN_ASSIGN)) {
+                parser_error(p, "Expected '=' after index");
+                free_ast_node(index);
+                return NULL;
+            }
+            ASTNode *value = expression(p);
+            if (!value) {
+                free_ast_node(index);
+                return NULL;
+            }
+            ASTNode *node = create_ast_node(NODE_INDEX_ASSIGN, name->value, value, index, NULL);
+            node->line = name->line_number;
+            node->slot = resolve_local(p, name->value);
+            if (p->parallel && node->slot < 0) {
+                parallel_error(p, "Cannot modify global '%s' inside 'mgbe ngwa'", name->value);
+                free_ast_node(node);
+                return NULL;
+            }
+            return node;
+        }
         if (!match(p, TOKEN_ASSIGN)) {
             parser_error(p, "Expected '=' after variable name");
             return NULL;
         }
         ASTNode *value = expression(p);
         if (!value) return NULL;
-        return create_ast_node(NODE_VAR_DECL, name->value, value, NULL, NULL);
+        if (p->parallel && resolve_local(p, name->value) < 0 &&
+            is_global(p, name->value)) {
+            parallel_error(p, "Cannot assign global '%s' inside 'mgbe ngwa' (use 'jikota')",
+                           name->value);
+            free_ast_node(value);
+            return NULL;
+        }
+        ASTNode *node = create_ast_node(NODE_VAR_DECL, name->value, value, NULL, NULL);
+        node->line = name->line_number;
+        node->slot = declare_local(p, name->value);
+        return node;
     }
+    // 'ma', 'mgbe' and 'maka' are marked when their blocks contain a 'nye'
+    int yields = p->yields;
     if (match(p, TOKEN_MA)) {
         ASTNode *cond = expression(p);
         ASTNode *thenBranch = block(p);
@@ -112,14 +574,124 @@ static ASTNode *statement(Parser *p) {
         if (match(p, TOKEN_MANA)) {
             elseBranch = block(p);
         }
-        return create_ast_node(NODE_IF_STMT, NULL, cond, thenBranch, elseBranch);
+        ASTNode *node = create_ast_node(NODE_IF_STMT, NULL, cond, thenBranch, elseBranch);
+        node->yields = p->yields != yields;
+        return node;
     }
     if (match(p, TOKEN_MGBE)) {
+        if (is_word(peek(p), "ngwa") && peek_ahead(p, 1)->type == TOKEN_IDENTIFIER &&
+            is_word(peek_ahead(p, 2), "site"))
+            return parallel_for(p);
         ASTNode *cond = expression(p);
         ASTNode *body = block(p);
-        return create_ast_node(NODE_WHILE_STMT, NULL, cond, body, NULL);
+        ASTNode *node = create_ast_node(NODE_WHILE_STMT, NULL, cond, body, NULL);
+        node->yields = p->yields != yields;
+        return node;
+    }
+    if (match(p, TOKEN_MAKA)) {
+        // forStmt -> "maka" IDENTIFIER "na" expression block
+        if (!check(p, TOKEN_IDENTIFIER)) {
+            parser_error(p, "Expected identifier after 'maka'");
+            return NULL;
+        }
+        Token *name = advance(p);
+        if (!match(p, TOKEN_NA)) {
+            parser_error(p, "Expected 'na' after loop variable");
+            return NULL;
+        }
+        ASTNode *iterable = expression(p);
+        if (!iterable) return NULL;
+        if (p->parallel && resolve_local(p, name->value) < 0 &&
+            is_global(p, name->value)) {
+            parallel_error(p, "Cannot assign global '%s' inside 'mgbe ngwa' (use 'jikota')",
+                           name->value);
+            free_ast_node(iterable);
+            return NULL;
+        }
+        int slot = declare_local(p, name->value);
+        ASTNode *body = block(p);
+        ASTNode *node = create_ast_node(NODE_FOR_STMT, name->value, iterable, body, NULL);
+        node->line = name->line_number;
+        node->slot = slot;
+        node->yields = p->yields != yields;
+        return node;
+    }
+    if (match(p, TOKEN_ORU))
+        return function_definition(p);
+    if (match(p, TOKEN_LAGHACHI)) {
+        // returnStmt -> "laghachi" expression?
+        // The value may be left out when nothing follows on the same line.
+        Token *keyword = previous(p);
+        ASTNode *value = NULL;
+        if (!check(p, TOKEN_RBRACE) && !is_at_end(p) &&
+            peek(p)->line_number == keyword->line_number) {
+            value = expression(p);
+            if (!value) return NULL;
+        }
+        if (!p->scope || p->parallel) {
+            report_error(p->parallel ? "'laghachi' is not allowed inside 'mgbe ngwa'"
+                                     : "'laghachi' outside of a function",
+                         keyword->line_number);
+            p->errors++;
+            free_ast_node(value);
+            return NULL;
+        }
+        ASTNode *node = create_ast_node(NODE_RETURN, NULL, value, NULL, NULL);
+        node->slot = value && value->type == NODE_CALL ? 1 : 0;
+        if (value) p->returns++;
+        return node;
+    }
+    if (match(p, TOKEN_NYE)) {
+        // yieldStmt -> "nye" expression?
+        // Like 'laghachi', the value may be left out at the end of a line.
+        Token *keyword = previous(p);
+        ASTNode *value = NULL;
+        if (!check(p, TOKEN_RBRACE) && !is_at_end(p) &&
+            peek(p)->line_number == keyword->line_number) {
+            value = expression(p);
+            if (!value) return NULL;
+        }
+        if (!p->scope || p->parallel) {
+            report_error(p->parallel ? "'nye' is not allowed inside 'mgbe ngwa'"
+                                     : "'nye' outside of a function",
+                         keyword->line_number);
+            p->errors++;
+            free_ast_node(value);
+            return NULL;
+        }
+        p->yields++;
+        ASTNode *node = create_ast_node(NODE_YIELD, NULL, value, NULL, NULL);
+        node->yields = 1;
+        return node;
+    }
+    if (is_word(peek(p), "bubata") && peek_ahead(p, 1)->type == TOKEN_STRING &&
+        peek_ahead(p, 1)->line_number == peek(p)->line_number) {
+        // importStmt -> "bubata" STRING
+        advance(p);
+        if (p->scope) {
+            parser_error(p, "'bubata' is only allowed outside functions and 'mgbe ngwa' loops");
+            return NULL;
+        }
+        return create_ast_node(NODE_IMPORT, advance(p)->value, NULL, NULL, NULL);
+    }
+    if (is_word(peek(p), "malite") && peek_ahead(p, 1)->type == TOKEN_IDENTIFIER &&
+        peek_ahead(p, 2)->type == TOKEN_LPAREN &&
+        peek_ahead(p, 2)->line_number == peek(p)->line_number) {
+        // spawnStmt -> "malite" call
+        advance(p);
+        if (p->parallel) {
+            parser_error(p, "'malite' is not allowed inside 'mgbe ngwa'");
+            return NULL;
+        }
+        ASTNode *call = primary(p);
+        if (!call) return NULL;
+        return create_ast_node(NODE_SPAWN, NULL, call, NULL, NULL);
     }
     if (match(p, TOKEN_GOSI)) {
+        if (p->parallel) {
+            parser_error(p, "'gosi' is not allowed inside 'mgbe ngwa'");
+            return NULL;
+        }
         if (!match(p, TOKEN_LPAREN)) {
             parser_error(p, "Expected '(' after 'gosi'");
             return NULL;
@@ -148,6 +720,7 @@ static ASTNode *equality(Parser *p) {
         Token *op = previous(p);
         ASTNode *right = comparison(p);
         node = create_ast_node(NODE_BINARY_EXPR, op->value, node, right, NULL);
+        node->line = op->line_number;
     }
     return node;
 }
@@ -160,6 +733,7 @@ static ASTNode *comparison(Parser *p) {
         Token *op = previous(p);
         ASTNode *right = term(p);
         node = create_ast_node(NODE_BINARY_EXPR, op->value, node, right, NULL);
+        node->line = op->line_number;
     }
     return node;
 }
@@ -171,6 +745,7 @@ static ASTNode *term(Parser *p) {
         Token *op = previous(p);
         ASTNode *right = factor(p);
         node = create_ast_node(NODE_BINARY_EXPR, op->value, node, right, NULL);
+        node->line = op->line_number;
     }
     return node;
 }
@@ -182,16 +757,111 @@ static ASTNode *factor(Parser *p) {
         Token *op = previous(p);
         ASTNode *right = unary(p);
         node = create_ast_node(NODE_BINARY_EXPR, op->value, node, right, NULL);
+        node->line = op->line_number;
     }
     return node;
 }
 
-// unary -> primary
+// unary -> postfix
 static ASTNode *unary(Parser *p) {
-    return primary(p);
+    return postfix(p);
+}
+
+// postfix -> primary ( "[" expression "]" )*
+// The '[' must be on the same line as the end of the indexed expression so
+// that a list literal starting the next line is not read as an index.
+static ASTNode *postfix(Parser *p) {
+    ASTNode *node = primary(p);
+    while (node && check(p, TOKEN_LBRACKET) &&
+           peek(p)->line_number == previous(p)->line_number) {
+        Token *bracket = advance(p);
+        ASTNode *index = expression(p);
+        if (!index || !match(p, TOKEN_RBRACKET)) {
+            if (index) parser_error(p, "Expected ']' after index");
+            free_ast_node(index);
+            free_ast_node(node);
+            return NULL;
+        }
+        node = create_ast_node(NODE_INDEX, NULL, node, index, NULL);
+        node->line = bracket->line_number;
+    }
+    return node;
+}
+
+// expressionList -> ( expression ( "," expression )* )? closing
+// Returns a chain of NODE_EXPR_LIST cells, or NULL for an empty list.
+// Sets p->failed when an error was reported.
+static ASTNode *expression_list(Parser *p, TokenType closing, const char *message) {
+    ASTNode *head = NULL;
+    ASTNode *tail = NULL;
+    if (!check(p, closing)) {
+        do {
+            ASTNode *expr = expression(p);
+            if (!expr) {
+                free_ast_node(head);
+                p->failed = 1;
+                return NULL;
+            }
+            ASTNode *cell = create_ast_node(NODE_EXPR_LIST, NULL, expr, NULL, NULL);
+            if (!head)
+                head = cell;
+            else
+                tail->right = cell;
+            tail = cell;
+        } while (match(p, TOKEN_COMMA));
+    }
+    if (!match(p, closing)) {
+        parser_error(p, message);
+        free_ast_node(head);
+        p->failed = 1;
+        return NULL;
+    }
+    return head;
+}
+
+// map -> "{" ( expression ":" expression ( "," expression ":" expression )* )? "}"
+// Entries are NODE_EXPR_LIST cells with the key in left and the value in third.
+static ASTNode *map_literal(Parser *p) {
+    ASTNode *head = NULL;
+    ASTNode *tail = NULL;
+    if (!check(p, TOKEN_RBRACE)) {
+        do {
+            ASTNode *key = expression(p);
+            if (!key) {
+                free_ast_node(head);
+                return NULL;
+            }
+            if (!match(p, TOKEN_COLON)) {
+                parser_error(p, "Expected ':' after map key");
+                free_ast_node(key);
+                free_ast_node(head);
+                return NULL;
+            }
+            ASTNode *value = expression(p);
+            if (!value) {
+                free_ast_node(key);
+                free_ast_node(head);
+                return NULL;
+            }
+            ASTNode *cell = create_ast_node(NODE_EXPR_LIST, NULL, key, NULL, value);
+            if (!head)
+                head = cell;
+            else
+                tail->right = cell;
+            tail = cell;
+        } while (match(p, TOKEN_COMMA));
+    }
+    if (!match(p, TOKEN_RBRACE)) {
+        parser_error(p, "Expected '}' after map entries");
+        free_ast_node(head);
+        return NULL;
+    }
+    return create_ast_node(NODE_MAP, NULL, head, NULL, NULL);
 }
 
-// primary -> NUMBER | STRING | IDENTIFIER | "(" expression ")"
+// primary -> NUMBER | STRING | IDENTIFIER | call | list | map | "(" expression ")"
+// call    -> IDENTIFIER "(" expressionList ")"
+// list    -> "[" expressionList "]"
 static ASTNode *primary(Parser *p) {
     if (match(p, TOKEN_NUMBER)) {
         Token *num = previous(p);
@@ -203,7 +873,34 @@ static ASTNode *primary(Parser *p) {
     }
     if (match(p, TOKEN_IDENTIFIER)) {
         Token *id = previous(p);
-        return create_ast_node(NODE_IDENTIFIER, id->value, NULL, NULL, NULL);
+        if (check(p, TOKEN_LPAREN) && peek(p)->line_number == id->line_number) {
+            advance(p);
+            ASTNode *args = expression_list(p, TOKEN_RPAREN, "Expected ')' after arguments");
+            if (p->failed) return NULL;
+            const Builtin *builtin = p->parallel ? find_builtin(id->value) : NULL;
+            if (builtin && builtin->modifies && args &&
+                (args->left->type != NODE_IDENTIFIER || args->left->slot < 0)) {
+                parallel_error(p, "'%s' can only modify local variables inside 'mgbe ngwa'",
+                               id->value);
+                free_ast_node(args);
+                return NULL;
+            }
+            ASTNode *call = create_ast_node(NODE_CALL, id->value, args, NULL, NULL);
+            call->line = id->line_number;
+            return call;
+        }
+        ASTNode *node = create_ast_node(NODE_IDENTIFIER, id->value, NULL, NULL, NULL);
+        node->line = id->line_number;
+        node->slot = resolve_local(p, id->value);
+        return node;
+    }
+    if (match(p, TOKEN_LBRACKET)) {
+        ASTNode *items = expression_list(p, TOKEN_RBRACKET, "Expected ']' after list elements");
+        if (p->failed) return NULL;
+        return create_ast_node(NODE_LIST, NULL, items, NULL, NULL);
+    }
+    if (match(p, TOKEN_LBRACE)) {
+        return map_literal(p);
     }
     if (match(p, TOKEN_EZIOKWU)) {
         return create_ast_node(NODE_BOOL, "eziokwu", NULL, NULL, NULL);
@@ -226,7 +923,79 @@ static ASTNode *primary(Parser *p) {
 
 // Entry point exposed to other modules
 ASTNode *parse(Token *tokens) {
-    Parser p = { tokens, 0 };
-    return program(&p);
+    Parser p = { .tokens = tokens };
+    ASTNode *ast = program(&p);
+    memory_free(p.globals.names);
+    return ast;
+}
+
+ASTNode *parse_lazy(Token *tokens, int strict) {
+    Parser p = { .tokens = tokens };
+    p.lazy = 1;
+    p.strict = strict;
+    lazy_tokens = tokens;
+    ASTNode *ast = program(&p);
+    memory_free(p.globals.names);
+    return ast;
+}
+
+int parse_lazy_block(ASTNode *node) {
+    if (node->slot < 0) return 1;
+    Parser p = { .tokens = lazy_tokens };
+    p.current = (size_t)node->slot;
+    p.lazy = 1;
+    node->left = block_body(&p);
+    node->slot = -1;
+    memory_free(p.globals.names);
+    return p.errors == 0;
+}
+
+Parser *parser_new_stream(Lexer *lexer) {
+    Parser *p = memory_calloc(1, sizeof(Parser));
+    if (!p) {
+        report_error("Memory allocation failed for parser", -1);
+        exit(1);
+    }
+    p->lexer = lexer;
+    return p;
+}
+
+// Free the tokens before 'upto' and any chunk they no longer share with
+// tokens that are still needed.
+static void release_tokens(Parser *p, size_t upto) {
+    for (; p->released < upto; p->released++) {
+        size_t offset = p->released - p->base;
+        memory_free(p->chunks[offset / TOKEN_CHUNK][offset % TOKEN_CHUNK].value);
+    }
+    size_t done = (upto - p->base) / TOKEN_CHUNK;
+    if (done == 0) return;
+    for (size_t i = 0; i < done; ++i)
+        memory_free(p->chunks[i]);
+    memmove(p->chunks, p->chunks + done, sizeof(Token *) * (p->chunk_count - done));
+    p->chunk_count -= done;
+    p->base += done * TOKEN_CHUNK;
+}
+
+ASTNode *parse_next_statement(Parser *p) {
+    if (p->stopped || is_at_end(p)) return NULL;
+    ASTNode *stmt = statement(p);
+    if (!stmt) {
+        // Like parse(), stop at the first statement that fails
+        p->stopped = 1;
+        return NULL;
+    }
+    // Keep the last consumed token: previous() may still look at it
+    release_tokens(p, p->current - 1);
+    return stmt;
+}
+
+void parser_free(Parser *p) {
+    if (!p) return;
+    release_tokens(p, p->count);
+    for (size_t i = 0; i < p->chunk_count; ++i)
+        memory_free(p->chunks[i]);
+    memory_free(p->chunks);
+    memory_free(p->globals.names);
+    memory_free(p);
 }
 
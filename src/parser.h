@@ -3,9 +3,34 @@
 
 #include "token.h"
 #include "ast.h"
+#include "lexer.h"
+
+typedef struct Parser Parser;
 
 // Parse the given array of tokens and return the root of the AST.
 // The returned tree should be freed with free_ast_node().
 ASTNode *parse(Token *tokens);
 
+// Like parse(), but blocks outside functions are only brace matched and
+// left as NODE_LAZY_BLOCK nodes to be parsed on first execution. The
+// token array must stay alive as long as the AST. With 'strict' set the
+// skipped blocks are still parsed once to report syntax errors up front.
+ASTNode *parse_lazy(Token *tokens, int strict);
+
+// Parse the body of a NODE_LAZY_BLOCK into its left child, if that has
+// not happened yet. Returns 0 if a syntax error was reported.
+int parse_lazy_block(ASTNode *node);
+
+// Create a parser that pulls tokens from 'lexer' as it needs them. Only
+// the tokens of the statement being parsed are kept in memory.
+Parser *parser_new_stream(Lexer *lexer);
+
+// Parse the next top-level statement. Returns NULL at the end of the
+// input or after a syntax error has been reported. The caller owns the
+// returned node.
+ASTNode *parse_next_statement(Parser *parser);
+
+// Free a streaming parser and the tokens it still holds.
+void parser_free(Parser *parser);
+
 #endif // PARSER_H
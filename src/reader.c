@@ -0,0 +1,97 @@
+#define _POSIX_C_SOURCE 200809L
+#include "reader.h"
+#include "memory.h"
+#include "util.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READER_BUFFER_SIZE (1u << 20)
+
+int reader_open(Reader *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0) return 0;
+    struct stat st;
+    if (fstat(r->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, r->fd, 0);
+        if (map != MAP_FAILED) {
+            posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+            r->map = map;
+            r->size = (size_t)st.st_size;
+        }
+    }
+    return 1;
+}
+
+// Buffered mode: move the unread bytes to the front and read more,
+// growing the buffer when a single record fills it. Returns 0 at the end
+// of the input.
+static int refill(Reader *r) {
+    if (r->eof) return 0;
+    if (r->pos) {
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+    }
+    if (r->len == r->cap) {
+        r->cap = r->cap ? r->cap * 2 : READER_BUFFER_SIZE;
+        r->buf = memory_realloc(r->buf, r->cap);
+        if (!r->buf) {
+            report_error("Memory allocation failed for file buffer", -1);
+            exit(1);
+        }
+    }
+    ssize_t got = read(r->fd, r->buf + r->len, r->cap - r->len);
+    if (got <= 0) {
+        r->eof = 1;
+        return 0;
+    }
+    r->len += (size_t)got;
+    return 1;
+}
+
+int reader_next(Reader *r, char delim, const char **start, size_t *length) {
+    if (r->map) {
+        if (r->pos >= r->size) return 0;
+        const char *begin = r->map + r->pos;
+        const char *end = memchr(begin, delim, r->size - r->pos);
+        size_t n = end ? (size_t)(end - begin) : r->size - r->pos;
+        *start = begin;
+        *length = n;
+        r->pos += n + (end ? 1 : 0);
+        return 1;
+    }
+    size_t scanned = 0;
+    for (;;) {
+        const char *begin = r->buf + r->pos;
+        size_t unscanned = r->len - r->pos - scanned;
+        const char *end = unscanned ? memchr(begin + scanned, delim, unscanned) : NULL;
+        if (end) {
+            *start = begin;
+            *length = (size_t)(end - begin);
+            r->pos += *length + 1;
+            return 1;
+        }
+        scanned = r->len - r->pos;
+        if (!refill(r)) break;
+    }
+    // Last record without a trailing delimiter
+    if (r->pos >= r->len) return 0;
+    *start = r->buf + r->pos;
+    *length = r->len - r->pos;
+    r->pos = r->len;
+    return 1;
+}
+
+void reader_close(Reader *r) {
+    if (r->map) munmap((void *)r->map, r->size);
+    memory_free(r->buf);
+    if (r->fd >= 0) close(r->fd);
+    r->map = NULL;
+    r->buf = NULL;
+    r->fd = -1;
+}
@@ -0,0 +1,31 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+
+// Sequential reader for data files. Regular files are memory mapped and
+// records are found with memchr directly in the mapping; anything that
+// cannot be mapped (pipes, devices, empty files) is read through a large
+// buffer instead.
+typedef struct {
+    int fd;
+    const char *map;     // whole file when mapped, else NULL
+    size_t size;
+    char *buf;           // buffered mode
+    size_t cap;
+    size_t len;
+    int eof;
+    size_t pos;          // start of the next record in map or buf
+} Reader;
+
+// Open path for reading. Returns 0 if it cannot be opened.
+int reader_open(Reader *r, const char *path);
+
+// Find the next record ending in delim (or at the end of the input) and
+// point *start and *length at it, without the delimiter. The bytes stay
+// valid until the next call. Returns 0 once the input is exhausted.
+int reader_next(Reader *r, char delim, const char **start, size_t *length);
+
+void reader_close(Reader *r);
+
+#endif // READER_H
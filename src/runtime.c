@@ -0,0 +1,501 @@
+#define _POSIX_C_SOURCE 200809L
+#include "runtime.h"
+#include "intern.h"
+#include "isolate.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+THREAD_LOCAL int rt_aborted = 0;
+
+// Call depth, per thread as in interpreter.c
+static THREAD_LOCAL int call_depth = 0;
+
+// Arguments of a pending tail call, staged by rt_tail_call() for the
+// rt_call() further up
+static THREAD_LOCAL const RtFunction *tail_function = NULL;
+static THREAD_LOCAL Value *tail_args = NULL;
+static THREAD_LOCAL int tail_argc = 0;
+static THREAD_LOCAL int tail_capacity = 0;
+
+static Value *const *program_globals = NULL;
+static size_t program_global_count = 0;
+
+void rt_fatal(const char *message) {
+    report_error(message, -1);
+    rt_aborted = 1;
+}
+
+Value rt_string(const char *text) {
+    return (Value){VAL_STRING, {.string = string_duplicate(text)}};
+}
+
+Value rt_undefined(const char *name) {
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Undefined variable '%s'", name);
+    report_error(msg, -1);
+    return rt_number(0);
+}
+
+Value rt_binary(Value a, Value b, const char *op) {
+    // After a fatal error the operands are placeholders; skip the
+    // operator so it does not report follow-on errors.
+    Value result = rt_aborted ? rt_number(0) : ops_binary(a, b, op);
+    rt_free(a);
+    rt_free(b);
+    return result;
+}
+
+Value rt_index(Value target, Value index) {
+    Value result = rt_number(0);
+    size_t pos;
+    if (target.type == VAL_MAP)
+        result = ops_map_index(target.as.map, index);
+    else if (target.type != VAL_LIST)
+        report_error("Only lists and maps can be indexed", -1);
+    else if (ops_list_index(target.as.list, index, &pos))
+        result = list_get(target.as.list, pos);
+    rt_free(target);
+    rt_free(index);
+    return result;
+}
+
+void rt_map_put(Map *map, Value key, Value value) {
+    const InternedString *interned;
+    if (map_key(key, 1, &interned))
+        map_set(map, interned, value);
+    rt_free(key);
+    rt_free(value);
+}
+
+static void shared_error(void) {
+    rt_fatal("Cannot modify a list or map shared with other iterations of 'mgbe ngwa'");
+}
+
+int rt_index_target(const Value *slot, const char *name) {
+    if (slot->type == VAL_UNSET) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Undefined variable '%s'", name);
+        report_error(msg, -1);
+        return 0;
+    }
+    if (slot->type != VAL_LIST && slot->type != VAL_MAP) {
+        report_error("Only lists and maps can be indexed", -1);
+        return 0;
+    }
+    if (exec_is_shared(*slot)) {
+        shared_error();
+        return 0;
+    }
+    return 1;
+}
+
+void rt_index_store(Value *slot, Value index, Value value) {
+    size_t pos;
+    const InternedString *key;
+    if (slot->type == VAL_LIST) {
+        if (ops_list_index(slot->as.list, index, &pos))
+            list_set(slot->as.list, pos, value);
+    } else if (slot->type == VAL_MAP) {
+        if (map_key(index, 1, &key))
+            map_set(slot->as.map, key, value);
+    }
+    rt_free(index);
+    rt_free(value);
+}
+
+int rt_print_allowed(void) {
+    if (!exec_worker) return 1;
+    // The order of output would depend on thread scheduling
+    char msg[96];
+    snprintf(msg, sizeof(msg), "'gosi' is not allowed inside %s", exec_worker);
+    rt_fatal(msg);
+    return 0;
+}
+
+void rt_print(Value v) {
+    // nothing to print after a fatal error
+    if (!rt_aborted) ops_print(v);
+    rt_free(v);
+}
+
+void rt_define(const RtFunction **name, const RtFunction *def) {
+    if (exec_worker) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "Functions cannot be defined inside %s", exec_worker);
+        rt_fatal(msg);
+    } else if (parallel_active) {
+        // Isolates look functions up as they run
+        rt_fatal("Functions cannot be defined while isolates are running");
+    } else {
+        *name = def;
+    }
+}
+
+void rt_load_module(int *state, void (*body)(void), const char *module, const char *name) {
+    if (exec_worker || parallel_active) {
+        // Worker threads cannot run a module's top level, and the program
+        // cannot define its functions while isolates look functions up
+        char msg[256];
+        if (exec_worker)
+            snprintf(msg, sizeof(msg), "Module '%s' must be loaded before %s uses '%s'",
+                     module, exec_worker, name);
+        else
+            snprintf(msg, sizeof(msg), "Module '%s' cannot be loaded while isolates are running (for '%s')",
+                     module, name);
+        rt_fatal(msg);
+        return;
+    }
+    *state = 2;
+    body();
+}
+
+// Stop the program if one more nested call would be too deep
+static void check_call_depth(void) {
+    if (!exec_check_depth(call_depth)) rt_aborted = 1;
+}
+
+static int check_arity(const RtFunction *fn, int argc) {
+    if (argc == fn->arity) return 1;
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%s expects %d argument(s), got %d", fn->name, fn->arity, argc);
+    report_error(msg, -1);
+    return 0;
+}
+
+static void free_args(Value *args, int argc) {
+    for (int i = 0; i < argc; ++i)
+        rt_free(args[i]);
+}
+
+void rt_tail_call(const RtFunction *fn, Value *args, int argc) {
+    if (argc > tail_capacity) {
+        tail_capacity = argc;
+        tail_args = memory_realloc(tail_args, sizeof(Value) * tail_capacity);
+        if (!tail_args) {
+            report_error("Memory allocation failed for call stack", -1);
+            exit(1);
+        }
+    }
+    memcpy(tail_args, args, sizeof(Value) * argc);
+    tail_argc = argc;
+    tail_function = fn;
+}
+
+// A tail call made by the body is run by the same loop, so tail
+// recursion does not nest C calls or count towards the depth limit.
+Value rt_call(const RtFunction *fn, Value *args, int argc) {
+    Value result = rt_bool(0);
+    check_call_depth();
+    if (rt_aborted || !check_arity(fn, argc)) {
+        free_args(args, argc);
+        return result;
+    }
+    // Calling a generator function only sets up the generator
+    if (fn->yields) return fn->code(args);
+    call_depth++;
+    for (;;) {
+        result = fn->code(args);
+        if (!tail_function) break;
+        // The callee copies its arguments out of the staging area first
+        // thing, so the area is free again by the time it can be reused.
+        fn = tail_function;
+        tail_function = NULL;
+        args = tail_args;
+        argc = tail_argc;
+        if (!check_arity(fn, argc)) {
+            free_args(args, argc);
+            break;
+        }
+    }
+    call_depth--;
+    return result;
+}
+
+Value rt_builtin(const Builtin *builtin, Value *args, size_t argc) {
+    return rt_builtin_moved(builtin, args, argc, NULL);
+}
+
+Value rt_builtin_moved(const Builtin *builtin, Value *args, size_t argc, Value *slot) {
+    Value result = rt_number(0);
+    if (builtin->modifies && argc > 0 && exec_is_shared(args[0]))
+        shared_error();
+    else
+        result = builtin->fn(args, argc);
+    // Not taken over after all: the variable keeps its value
+    if (slot && slot->type == VAL_UNSET && args[argc - 1].type != VAL_NUMBER) {
+        *slot = args[argc - 1];
+        args[argc - 1].type = VAL_NUMBER;
+    }
+    free_args(args, (int)argc);
+    // A channel operation cut short because the program is stopping
+    if (isolates_stopping) rt_aborted = 1;
+    return result;
+}
+
+Value rt_undefined_function(const char *name) {
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Undefined function '%s'", name);
+    report_error(msg, -1);
+    return rt_number(0);
+}
+
+Value rt_builtin_arity(const Builtin *builtin, size_t argc) {
+    builtin_arity_error(builtin, argc);
+    return rt_number(0);
+}
+
+Value rt_iterable(Value v, int in_generator) {
+    if (v.type == VAL_MAP) {
+        // Walk a snapshot of the keys, so the body may change the map
+        List *keys = map_keys(v.as.map);
+        value_free(v);
+        v.type = VAL_LIST;
+        v.as.list = keys;
+    }
+    if (in_generator && rt_aborted) {
+        rt_free(v);
+        return rt_unset();
+    }
+    if (v.type != VAL_LIST && v.type != VAL_GENERATOR && v.type != VAL_CHANNEL) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Cannot iterate over a %s", value_type_name(v.type));
+        report_error(msg, -1);
+        rt_free(v);
+        return rt_unset();
+    }
+    return v;
+}
+
+// Generators
+
+static int resume_generator(Generator *gen, Value *out) {
+    check_call_depth();
+    if (rt_aborted) return 0;
+    RtGenerator *g = gen->native;
+    call_depth++;
+    int produced = g->body(g, gen->frame, out);
+    call_depth--;
+    return produced;
+}
+
+Value rt_generator(const char *name, RtGeneratorBody body, int counters,
+                   int frame_size, Value *args, int argc) {
+    RtGenerator *g = memory_calloc(1, sizeof(RtGenerator) + sizeof(size_t) * (size_t)counters);
+    if (!g) {
+        report_error("Memory allocation failed for generator", -1);
+        exit(1);
+    }
+    g->body = body;
+    Generator *gen = generator_new_native(name, resume_generator, memory_free, g);
+    generator_native_frame(gen, frame_size, args, argc);
+    return (Value){VAL_GENERATOR, {.generator = gen}};
+}
+
+int generator_next(Generator *gen, Value *out) {
+    if (gen->state == GEN_DONE) return 0;
+    if (gen->state == GEN_RUNNING) {
+        rt_fatal("Generator resumed while it is running");
+        return 0;
+    }
+    if (exec_is_shared((Value){VAL_GENERATOR, {.generator = gen}})) {
+        shared_error();
+        return 0;
+    }
+    gen->state = GEN_RUNNING;
+    int produced = gen->native_next(gen, out);
+    // After a fatal error the generator is left as it is; the program is
+    // stopping anyway
+    if (produced || rt_aborted)
+        gen->state = GEN_READY;
+    else
+        generator_finish(gen);
+    return produced;
+}
+
+// Parallel loops
+
+static void worker_exit(void) {
+    memory_free(tail_args);
+    tail_args = NULL;
+    tail_capacity = 0;
+    gc_thread_exit();
+}
+
+double rt_identity(const RtParallel *loop, int reduction) {
+    return exec_reduce_identity(loop->ops[reduction]);
+}
+
+int rt_parallel_range(RtParallel *loop, Value from, Value to) {
+    if (rt_aborted) {
+        rt_free(from);
+        rt_free(to);
+        return 0;
+    }
+    if (from.type != VAL_NUMBER || to.type != VAL_NUMBER) {
+        report_error("Range of 'mgbe ngwa' must be numbers", -1);
+        rt_free(from);
+        rt_free(to);
+        return 0;
+    }
+    double span = to.as.number - from.as.number;
+    if (!(span < 9007199254740992.0)) {
+        report_error("Range of 'mgbe ngwa' is too large", -1);
+        return 0;
+    }
+    loop->start = from.as.number;
+    loop->count = span >= 0 ? (size_t)span + 1 : 0;
+    return 1;
+}
+
+void rt_parallel_run(RtParallel *loop, ParallelTask body, Value *const *targets) {
+    loop->chunks = 0;
+    if (loop->count > 0) {
+        loop->grain = (loop->count + PARALLEL_CHUNKS - 1) / PARALLEL_CHUNKS;
+        loop->chunks = (loop->count + loop->grain - 1) / loop->grain;
+        loop->partials = memory_alloc(sizeof(double) * loop->chunks * (loop->reduction_count + 1));
+        if (!loop->partials) {
+            report_error("Memory allocation failed for parallel loop", -1);
+            exit(1);
+        }
+    }
+
+    parallel_init(0, exec_stack_size(), exec_stack_guard, worker_exit);
+    exec_share_begin();
+    for (size_t i = 0; i < program_global_count; ++i)
+        exec_share(*program_globals[i]);
+    // Counted rather than set, as isolates may be running too
+    __atomic_add_fetch(&parallel_active, 1, __ATOMIC_SEQ_CST);
+    parallel_run(loop->chunks, body, loop);
+    __atomic_sub_fetch(&parallel_active, 1, __ATOMIC_SEQ_CST);
+
+    if (loop->failed) {
+        memory_free(loop->partials);
+        rt_aborted = 1;
+        return;
+    }
+    // Combine the partial results in chunk order, then with the value the
+    // variable had before the loop
+    for (int r = 0; r < loop->reduction_count; ++r) {
+        ReduceOp op = loop->ops[r];
+        double result = rt_identity(loop, r);
+        for (size_t c = 0; c < loop->chunks; ++c)
+            result = exec_reduce(op, result, loop->partials[c * (size_t)loop->reduction_count + r]);
+        Value *target = targets[r];
+        if (target->type == VAL_NUMBER) {
+            result = exec_reduce(op, target->as.number, result);
+        } else if (target->type != VAL_UNSET) {
+            char msg[160];
+            snprintf(msg, sizeof(msg), "Reduction variable '%s' must be a number", loop->names[r]);
+            report_error(msg, -1);
+            continue;
+        }
+        rt_set(target, rt_number(result));
+    }
+    memory_free(loop->partials);
+}
+
+int rt_chunk_begin(RtParallel *loop, size_t chunk, size_t *first, size_t *end) {
+    if (__atomic_load_n(&loop->failed, __ATOMIC_RELAXED)) return 0;
+    *first = chunk * loop->grain;
+    *end = (chunk + 1) * loop->grain;
+    if (*end > loop->count) *end = loop->count;
+    exec_worker = EXEC_PARALLEL_LOOP;
+    return 1;
+}
+
+void rt_chunk_end(RtParallel *loop, size_t chunk, const Value *reductions) {
+    double *partial = &loop->partials[chunk * (size_t)loop->reduction_count];
+    for (int r = 0; r < loop->reduction_count && !rt_aborted; ++r) {
+        if (reductions[r].type != VAL_NUMBER) {
+            char msg[160];
+            snprintf(msg, sizeof(msg), "Reduction variable '%s' must be a number",
+                     loop->names[r]);
+            rt_fatal(msg);
+            break;
+        }
+        partial[r] = reductions[r].as.number;
+    }
+    if (rt_aborted) {
+        // Reported already; the thread that started the loop stops the program
+        __atomic_store_n(&loop->failed, 1, __ATOMIC_RELAXED);
+        rt_aborted = 0;
+    }
+    exec_worker = NULL;
+}
+
+// Isolates, started as interpreter.c starts them. The compiler has
+// checked the functions the isolate can reach for globals already.
+
+typedef struct {
+    const RtFunction *fn;
+    int argc;
+    Value args[];
+} IsolateCall;
+
+int rt_spawnable(const RtFunction *fn, const char *name, int argc) {
+    if (rt_aborted) return 0;
+    if (!fn || fn->yields) {
+        char msg[160];
+        snprintf(msg, sizeof(msg), fn ? "Generator '%s' cannot run as an isolate"
+                                      : "Undefined function '%s'", name);
+        report_error(msg, -1);
+        return 0;
+    }
+    return check_arity(fn, argc);
+}
+
+static int run_isolate(void *context) {
+    IsolateCall *call = context;
+    exec_stack_guard();
+    exec_worker = EXEC_ISOLATE;
+    rt_free(rt_call(call->fn, call->args, call->argc));
+    memory_free(call);
+    int failed = rt_aborted;
+    worker_exit();
+    return failed;
+}
+
+void rt_spawn(const RtFunction *fn, Value *args, int argc) {
+    IsolateCall *isolate = memory_alloc(sizeof(IsolateCall) + sizeof(Value) * (size_t)argc);
+    if (!isolate) {
+        report_error("Memory allocation failed for isolate", -1);
+        exit(1);
+    }
+    isolate->fn = fn;
+    isolate->argc = argc;
+    int sendable = !rt_aborted;
+    for (int i = 0; i < argc; ++i) {
+        isolate->args[i] = args[i];
+        if (sendable) sendable = isolate_transfer(&isolate->args[i]);
+    }
+    if (sendable && isolate_start(run_isolate, isolate, exec_stack_size())) return;
+    if (sendable) rt_fatal("Could not start an isolate");
+    free_args(isolate->args, argc);
+    memory_free(isolate);
+}
+
+void rt_start(Value *const *globals, size_t count) {
+    exec_stack_guard();
+    isolate_init();
+    program_globals = globals;
+    program_global_count = count;
+}
+
+int rt_finish(void) {
+    // Isolates still running use the functions and globals released below
+    if (rt_aborted) isolate_stop();
+    if (isolate_join()) rt_aborted = 1;
+    int status = rt_aborted ? 1 : 0;
+    parallel_shutdown();
+    for (size_t i = 0; i < program_global_count; ++i)
+        rt_set(program_globals[i], rt_unset());
+    memory_free(tail_args);
+    tail_args = NULL;
+    tail_capacity = 0;
+    gc_collect();
+    gc_shutdown();
+    intern_free_all();
+    return status;
+}
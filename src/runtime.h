@@ -0,0 +1,258 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include "builtins.h"
+#include "exec.h"
+#include "gc.h"
+#include "generator.h"
+#include "interpreter.h"
+#include "isolate.h"
+#include "list.h"
+#include "map.h"
+#include "ops.h"
+#include "parallel.h"
+#include "util.h"
+#include "value.h"
+#include <math.h>
+#include <stddef.h>
+
+// Support library for programs compiled to C by 'igbo build' (see
+// compiler.h). It is built from the interpreter's value, container,
+// builtin and thread pool modules plus this file, and does what
+// interpreter.c does for a running script: variable checks, calls with
+// their depth limit and tail calls, loops, generators and parallel loops.
+// The behaviour, including every error message, follows interpreter.c so
+// a compiled program prints exactly what the interpreter would.
+//
+// Generated code keeps every value in a C variable it owns: functions
+// taking a Value consume it unless they say otherwise.
+
+// Set by a fatal error, such as exceeding the recursion limit. Generated
+// code unwinds to the end of the program once it sees it.
+extern THREAD_LOCAL int rt_aborted;
+
+// A compiled user defined function. code() takes ownership of exactly
+// 'arity' arguments.
+typedef struct RtFunction {
+    const char *name;
+    int arity;
+    int yields;          // a generator function
+    Value (*code)(Value *args);
+} RtFunction;
+
+static inline Value rt_number(double n) {
+    return (Value){VAL_NUMBER, {.number = n}};
+}
+
+static inline Value rt_bool(int b) {
+    return (Value){VAL_BOOL, {.boolean = b}};
+}
+
+static inline Value rt_unset(void) {
+    return (Value){VAL_UNSET, {.number = 0}};
+}
+
+Value rt_string(const char *text);
+
+static inline Value rt_copy(Value v) {
+    if (v.type == VAL_NUMBER || v.type == VAL_BOOL) return v;
+    return value_copy(v);
+}
+
+static inline void rt_free(Value v) {
+    if (v.type != VAL_NUMBER && v.type != VAL_BOOL && v.type != VAL_UNSET) value_free(v);
+}
+
+static inline int rt_truthy(Value v) {
+    if (v.type == VAL_BOOL) return v.as.boolean;
+    if (v.type == VAL_NUMBER) return v.as.number != 0;
+    return value_truthy(v);
+}
+
+// Report a read of a variable that has not been assigned
+Value rt_undefined(const char *name);
+
+// A copy of the variable in *slot
+static inline Value rt_get(const Value *slot, const char *name) {
+    if (slot->type == VAL_UNSET) return rt_undefined(name);
+    return rt_copy(*slot);
+}
+
+// The last argument of a builtin that takes it over (see Builtin.moves):
+// a string, list or map is moved out of the local *slot, not copied
+static inline Value rt_take(Value *slot, const char *name) {
+    Value v = *slot;
+    if (v.type != VAL_STRING && v.type != VAL_LIST && v.type != VAL_MAP) return rt_get(slot, name);
+    slot->type = VAL_UNSET;
+    return v;
+}
+
+// Store v in the variable *slot
+static inline void rt_set(Value *slot, Value v) {
+    Value old = *slot;
+    *slot = v;
+    rt_free(old);
+}
+
+// Binary operators. Numbers are handled inline; anything else goes
+// through ops_binary(), unless a fatal error is being unwound.
+Value rt_binary(Value a, Value b, const char *op);
+
+#define RT_ARITHMETIC(name, op, text)                                    \
+    static inline Value name(Value a, Value b) {                         \
+        if (a.type == VAL_NUMBER && b.type == VAL_NUMBER)                \
+            return rt_number(a.as.number op b.as.number);                \
+        return rt_binary(a, b, text);                                    \
+    }
+#define RT_COMPARISON(name, op, text)                                    \
+    static inline Value name(Value a, Value b) {                         \
+        if (a.type == VAL_NUMBER && b.type == VAL_NUMBER)                \
+            return rt_bool(a.as.number op b.as.number);                  \
+        return rt_binary(a, b, text);                                    \
+    }
+RT_ARITHMETIC(rt_add, +, "+")
+RT_ARITHMETIC(rt_sub, -, "-")
+RT_ARITHMETIC(rt_mul, *, "*")
+RT_ARITHMETIC(rt_div, /, "/")
+RT_COMPARISON(rt_eq, ==, "==")
+RT_COMPARISON(rt_ne, !=, "!=")
+RT_COMPARISON(rt_lt, <, "<")
+RT_COMPARISON(rt_gt, >, ">")
+RT_COMPARISON(rt_le, <=, "<=")
+RT_COMPARISON(rt_ge, >=, ">=")
+#undef RT_ARITHMETIC
+#undef RT_COMPARISON
+
+// target[index]
+Value rt_index(Value target, Value index);
+
+// Add key: value to a map literal
+void rt_map_put(Map *map, Value key, Value value);
+
+// dee name[index] = value: rt_index_target() checks the variable before
+// the index and value are evaluated, rt_index_store() then stores into
+// whatever the variable holds by that time.
+int rt_index_target(const Value *slot, const char *name);
+void rt_index_store(Value *slot, Value index, Value value);
+
+// 'gosi'. rt_print_allowed() is checked before the value is evaluated.
+int rt_print_allowed(void);
+void rt_print(Value v);
+
+// Bind a function name to a definition when its 'oru' runs
+void rt_define(const RtFunction **name, const RtFunction *def);
+
+// Run the top level of an imported module whose state is 1 (imported,
+// not loaded yet) the first time name, which it defines, is used. The
+// state becomes 2 before body runs.
+void rt_load_module(int *state, void (*body)(void), const char *module, const char *name);
+
+// Calls. rt_call() runs a user defined function (which may be NULL when
+// the name is not defined yet) and rt_builtin() a builtin.
+// rt_builtin_moved() calls a builtin whose last argument rt_take() moved
+// out of *slot, and puts it back there if the builtin did not take it.
+Value rt_call(const RtFunction *fn, Value *args, int argc);
+Value rt_builtin(const Builtin *builtin, Value *args, size_t argc);
+Value rt_builtin_moved(const Builtin *builtin, Value *args, size_t argc, Value *slot);
+Value rt_undefined_function(const char *name);
+Value rt_builtin_arity(const Builtin *builtin, size_t argc);
+
+// 'laghachi f(...)': make the enclosing rt_call() call fn with args next,
+// in place of the current call
+void rt_tail_call(const RtFunction *fn, Value *args, int argc);
+
+// Loops. rt_while_limit() counts an iteration and reports a loop that
+// runs too long. rt_iterable() prepares the value of a 'maka' loop (the
+// keys of a map, or the unset value after reporting something that cannot
+// be iterated); in_generator selects the order of checks the generator
+// runner uses. rt_next() fetches the next item.
+static inline int rt_while_limit(size_t *iterations) {
+    if ((*iterations)++ > MAX_WHILE_ITERATIONS) {
+        report_error("Possible infinite loop detected", -1);
+        return 0;
+    }
+    return 1;
+}
+
+Value rt_iterable(Value v, int in_generator);
+
+static inline int rt_next(Value iterable, size_t *pos, Value *item) {
+    if (iterable.type == VAL_LIST) {
+        if (*pos >= iterable.as.list->count) return 0;
+        *item = list_get(iterable.as.list, (*pos)++);
+        return 1;
+    }
+    if (iterable.type == VAL_GENERATOR) return generator_next(iterable.as.generator, item);
+    if (iterable.type == VAL_CHANNEL) return channel_receive(iterable.as.channel, item) > 0;
+    return 0;
+}
+
+// Run the cycle collector if it is due, and stop once an isolate has
+// failed. Generated code calls this where the interpreter would: between
+// statements.
+static inline void rt_safe_point(void) {
+    if (gc_pending && !parallel_active) gc_collect();
+    if (isolates_stopping) rt_aborted = 1;
+}
+
+// Generators. A compiled generator function is turned into a resumable
+// body: a switch on 'resume' jumps back to the 'nye' it stopped at. Its
+// variables, and the lists being walked by 'maka' loops around a 'nye',
+// live in the generator's frame; loop positions and counts in counters.
+typedef struct RtGenerator {
+    int (*body)(struct RtGenerator *g, Value *frame, Value *out);
+    int resume;          // 0 at the start, then the 'nye' to carry on after
+    size_t counters[];
+} RtGenerator;
+
+typedef int (*RtGeneratorBody)(RtGenerator *g, Value *frame, Value *out);
+
+Value rt_generator(const char *name, RtGeneratorBody body, int counters,
+                   int frame_size, Value *args, int argc);
+
+// Parallel loops, run as interpreter.c runs them: the range is cut into
+// the same chunks, each chunk runs the compiled body with private
+// variables, and the partial results are combined in chunk order.
+typedef struct {
+    int reduction_count;
+    const char *const *names;    // reduction variables
+    const ReduceOp *ops;
+    double start;
+    size_t count;                // number of iterations
+    size_t grain;                // iterations per chunk
+    size_t chunks;
+    double *partials;            // [chunk * reduction_count + r]
+    int failed;
+} RtParallel;
+
+// Check the range (consuming from and to). Returns 0 if the loop must be
+// skipped after an error.
+int rt_parallel_range(RtParallel *loop, Value from, Value to);
+
+// Run body over the chunks, then fold the results into the globals in
+// targets, one per reduction variable.
+void rt_parallel_run(RtParallel *loop, ParallelTask body, Value *const *targets);
+
+// Start and finish a chunk: rt_chunk_begin() sets the iteration range
+// and returns 0 if the loop has failed already; rt_chunk_end() records
+// the chunk's reduction values (borrowed).
+int rt_chunk_begin(RtParallel *loop, size_t chunk, size_t *first, size_t *end);
+double rt_identity(const RtParallel *loop, int reduction);
+void rt_chunk_end(RtParallel *loop, size_t chunk, const Value *reductions);
+
+// 'malite f(args)'. rt_spawnable() reports an f that cannot run as an
+// isolate with argc arguments; rt_spawn() then hands the arguments over
+// and starts it.
+int rt_spawnable(const RtFunction *fn, const char *name, int argc);
+void rt_spawn(const RtFunction *fn, Value *args, int argc);
+
+// Report a fatal error
+void rt_fatal(const char *message);
+
+// Program start and end. The globals are needed by parallel loops, which
+// mark what they can reach as shared. rt_finish() releases them and
+// returns the exit status.
+void rt_start(Value *const *globals, size_t count);
+int rt_finish(void);
+
+#endif // RUNTIME_H
@@ -0,0 +1,513 @@
+#define _POSIX_C_SOURCE 200809L
+#include "snapshot.h"
+#include "generator.h"
+#include "intern.h"
+#include "list.h"
+#include "map.h"
+#include "memory.h"
+#include "util.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_MAGIC "IGBOSNAP"
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+// All records are a multiple of 8 bytes and every section starts on an 8
+// byte boundary, so numbers and offsets can be read in place.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;     // SNAPSHOT_BYTE_ORDER as stored by the writer
+    uint64_t size;           // of the whole file
+    uint64_t checksum;       // hash_bytes() of everything after the header
+    uint64_t object_count;
+    uint64_t var_count;
+    uint64_t table;          // object_count offsets into the objects section
+    uint64_t vars;
+    uint64_t objects;
+    uint64_t strings;
+} SnapshotHeader;
+
+enum { SNAP_NUMBER = 1, SNAP_STRING, SNAP_BOOL, SNAP_LIST, SNAP_MAP };
+
+// A list of numbers is stored as a plain array of doubles
+enum { SNAP_NUMBERS = 1, SNAP_ITEMS, SNAP_ENTRIES };
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    union {
+        double number;
+        uint64_t ref;        // bool, string offset or object index
+    } as;
+} SnapValue;
+
+// Followed by count doubles, SnapValues or SnapEntries
+typedef struct {
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t count;
+} SnapObject;
+
+typedef struct {
+    uint64_t key;            // string offset
+    SnapValue value;
+} SnapEntry;
+
+typedef struct {
+    uint64_t name;           // string offset
+    SnapValue value;
+} SnapVar;
+
+// Strings are stored as a 64-bit length followed by the bytes, a NUL and
+// padding to a multiple of 8.
+
+// Writing
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+static void buffer_put(Buffer *b, const void *data, size_t n) {
+    if (!n) return;
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (b->len + n > cap) cap *= 2;
+        char *tmp = memory_realloc(b->data, cap);
+        if (!tmp) {
+            report_error("Memory allocation failed for snapshot", -1);
+            exit(1);
+        }
+        b->data = tmp;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+}
+
+typedef struct {
+    Buffer table;
+    Buffer vars;
+    Buffer objects;
+    Buffer strings;
+    // Objects in index order, and an open addressing table from object
+    // pointer to index so shared objects are written once
+    Value *found;
+    size_t found_count;
+    size_t found_cap;
+    const void **seen;
+    uint64_t *seen_index;
+    size_t seen_cap;
+    int failed;
+} Writer;
+
+static uint64_t put_string(Writer *w, const char *s) {
+    uint64_t offset = w->strings.len;
+    uint64_t length = strlen(s);
+    static const char zeros[8] = { 0 };
+    buffer_put(&w->strings, &length, sizeof(length));
+    buffer_put(&w->strings, s, length + 1);
+    buffer_put(&w->strings, zeros, (8 - (length + 1) % 8) % 8);
+    return offset;
+}
+
+static size_t slot_of(const void *ptr, size_t cap) {
+    return (size_t)(((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull) & (cap - 1);
+}
+
+static void grow_seen(Writer *w) {
+    size_t cap = w->seen_cap ? w->seen_cap * 2 : 64;
+    const void **seen = memory_calloc(cap, sizeof(void *));
+    uint64_t *index = memory_calloc(cap, sizeof(uint64_t));
+    if (!seen || !index) {
+        report_error("Memory allocation failed for snapshot", -1);
+        exit(1);
+    }
+    for (size_t i = 0; i < w->seen_cap; ++i) {
+        if (!w->seen[i]) continue;
+        size_t s = slot_of(w->seen[i], cap);
+        while (seen[s]) s = (s + 1) & (cap - 1);
+        seen[s] = w->seen[i];
+        index[s] = w->seen_index[i];
+    }
+    memory_free(w->seen);
+    memory_free(w->seen_index);
+    w->seen = seen;
+    w->seen_index = index;
+    w->seen_cap = cap;
+}
+
+// Index of the list or map in v, adding it to the objects to write
+static uint64_t object_index(Writer *w, Value v) {
+    const void *ptr = v.type == VAL_LIST ? (const void *)v.as.list : (const void *)v.as.map;
+    if ((w->found_count + 1) * 2 > w->seen_cap) grow_seen(w);
+    size_t s = slot_of(ptr, w->seen_cap);
+    while (w->seen[s]) {
+        if (w->seen[s] == ptr) return w->seen_index[s];
+        s = (s + 1) & (w->seen_cap - 1);
+    }
+    if (w->found_count == w->found_cap) {
+        w->found_cap = w->found_cap ? w->found_cap * 2 : 64;
+        w->found = memory_realloc(w->found, sizeof(Value) * w->found_cap);
+        if (!w->found) {
+            report_error("Memory allocation failed for snapshot", -1);
+            exit(1);
+        }
+    }
+    w->seen[s] = ptr;
+    w->seen_index[s] = w->found_count;
+    w->found[w->found_count] = v;
+    return w->found_count++;
+}
+
+static SnapValue encode_value(Writer *w, Value v) {
+    SnapValue out;
+    memset(&out, 0, sizeof(out));
+    switch (v.type) {
+        case VAL_NUMBER:
+            out.type = SNAP_NUMBER;
+            out.as.number = v.as.number;
+            break;
+        case VAL_STRING:
+            out.type = SNAP_STRING;
+            out.as.ref = put_string(w, v.as.string);
+            break;
+        case VAL_BOOL:
+            out.type = SNAP_BOOL;
+            out.as.ref = v.as.boolean != 0;
+            break;
+        case VAL_LIST:
+        case VAL_MAP:
+            out.type = v.type == VAL_LIST ? SNAP_LIST : SNAP_MAP;
+            out.as.ref = object_index(w, v);
+            break;
+        case VAL_GENERATOR: {
+            char msg[160];
+            snprintf(msg, sizeof(msg), "Cannot save generator '%s' in a snapshot",
+                     v.as.generator->name);
+            report_error(msg, -1);
+            w->failed = 1;
+            break;
+        }
+        case VAL_CHANNEL:
+            report_error("Cannot save a channel in a snapshot", -1);
+            w->failed = 1;
+            break;
+        case VAL_UNSET:
+            break;
+    }
+    return out;
+}
+
+static void encode_object(Writer *w, Value v) {
+    uint64_t offset = w->objects.len;
+    buffer_put(&w->table, &offset, sizeof(offset));
+    SnapObject obj;
+    memset(&obj, 0, sizeof(obj));
+    if (v.type == VAL_LIST) {
+        List *list = v.as.list;
+        obj.kind = list->boxed ? SNAP_ITEMS : SNAP_NUMBERS;
+        obj.count = list->count;
+        buffer_put(&w->objects, &obj, sizeof(obj));
+        if (!list->boxed) {
+            buffer_put(&w->objects, list->nums, sizeof(double) * list->count);
+            return;
+        }
+        for (size_t i = 0; i < list->count; ++i) {
+            SnapValue item = encode_value(w, list->items[i]);
+            buffer_put(&w->objects, &item, sizeof(item));
+        }
+        return;
+    }
+    Map *map = v.as.map;
+    obj.kind = SNAP_ENTRIES;
+    obj.count = map->count;
+    buffer_put(&w->objects, &obj, sizeof(obj));
+    size_t pos = 0;
+    MapEntry *entry;
+    while ((entry = map_next(map, &pos)) != NULL) {
+        SnapEntry e;
+        e.key = put_string(w, entry->key->chars);
+        e.value = encode_value(w, entry->value);
+        buffer_put(&w->objects, &e, sizeof(e));
+    }
+}
+
+static int write_file(const char *path, const char *data, size_t size) {
+    size_t length = strlen(path) + 5;
+    char *tmp = memory_alloc(length);
+    if (!tmp) {
+        report_error("Memory allocation failed for snapshot", -1);
+        exit(1);
+    }
+    snprintf(tmp, length, "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    int ok = f && fwrite(data, 1, size, f) == size;
+    if (f && fclose(f) != 0) ok = 0;
+    if (ok && rename(tmp, path) != 0) ok = 0;
+    if (!ok) {
+        char msg[512];
+        snprintf(msg, sizeof(msg), "Could not write snapshot: %s", path);
+        report_error(msg, -1);
+        remove(tmp);
+    }
+    memory_free(tmp);
+    return ok;
+}
+
+int snapshot_save(const char *path, const SnapshotGlobal *globals, size_t count) {
+    Writer w;
+    memset(&w, 0, sizeof(w));
+    for (size_t i = 0; i < count; ++i) {
+        if (globals[i].value.type == VAL_UNSET) continue;
+        SnapVar var;
+        var.name = put_string(&w, globals[i].name);
+        var.value = encode_value(&w, globals[i].value);
+        buffer_put(&w.vars, &var, sizeof(var));
+    }
+    // Writing an object can find more of them
+    for (size_t i = 0; i < w.found_count; ++i)
+        encode_object(&w, w.found[i]);
+
+    int ok = !w.failed;
+    if (ok) {
+        SnapshotHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+        h.version = SNAPSHOT_VERSION;
+        h.byte_order = SNAPSHOT_BYTE_ORDER;
+        h.object_count = w.found_count;
+        h.var_count = w.vars.len / sizeof(SnapVar);
+        h.table = sizeof(h);
+        h.vars = h.table + w.table.len;
+        h.objects = h.vars + w.vars.len;
+        h.strings = h.objects + w.objects.len;
+        h.size = h.strings + w.strings.len;
+        Buffer file = { NULL, 0, 0 };
+        buffer_put(&file, &h, sizeof(h));
+        buffer_put(&file, w.table.data, w.table.len);
+        buffer_put(&file, w.vars.data, w.vars.len);
+        buffer_put(&file, w.objects.data, w.objects.len);
+        buffer_put(&file, w.strings.data, w.strings.len);
+        h.checksum = hash_bytes(file.data + sizeof(h), file.len - sizeof(h));
+        memcpy(file.data, &h, sizeof(h));
+        ok = write_file(path, file.data, file.len);
+        memory_free(file.data);
+    }
+    memory_free(w.table.data);
+    memory_free(w.vars.data);
+    memory_free(w.objects.data);
+    memory_free(w.strings.data);
+    memory_free(w.found);
+    memory_free(w.seen);
+    memory_free(w.seen_index);
+    return ok;
+}
+
+// Reading. Every offset, index and count is checked against the file
+// before it is used.
+
+typedef struct {
+    const char *base;
+    const SnapshotHeader *h;
+    Value *objects;          // the lists and maps, by index
+} Reader;
+
+// The string stored at offset into the string pool, or NULL
+static const char *string_at(Reader *r, uint64_t offset) {
+    uint64_t room = r->h->size - r->h->strings;
+    if (offset % 8 || offset > room || room - offset < sizeof(uint64_t) + 1) return NULL;
+    const char *at = r->base + r->h->strings + offset;
+    uint64_t length;
+    memcpy(&length, at, sizeof(length));
+    if (length > room - offset - sizeof(uint64_t) - 1 || at[sizeof(uint64_t) + length] != '\0')
+        return NULL;
+    return at + sizeof(uint64_t);
+}
+
+// Object number index, or NULL if it does not fit in the objects section
+static const SnapObject *object_at(Reader *r, uint64_t index) {
+    const uint64_t *table = (const uint64_t *)(r->base + r->h->table);
+    uint64_t offset = table[index];
+    uint64_t room = r->h->strings - r->h->objects;
+    if (offset % 8 || offset > room || room - offset < sizeof(SnapObject)) return NULL;
+    const SnapObject *obj = (const SnapObject *)(r->base + r->h->objects + offset);
+    size_t size = obj->kind == SNAP_NUMBERS ? sizeof(double)
+                : obj->kind == SNAP_ITEMS ? sizeof(SnapValue)
+                : obj->kind == SNAP_ENTRIES ? sizeof(SnapEntry) : 0;
+    if (!size || obj->count > (room - offset - sizeof(SnapObject)) / size) return NULL;
+    return obj;
+}
+
+// Decode a value into *out, which the caller then owns
+static int decode_value(Reader *r, const SnapValue *in, Value *out) {
+    switch (in->type) {
+        case SNAP_NUMBER:
+            out->type = VAL_NUMBER;
+            out->as.number = in->as.number;
+            return 1;
+        case SNAP_BOOL:
+            out->type = VAL_BOOL;
+            out->as.boolean = in->as.ref != 0;
+            return 1;
+        case SNAP_STRING: {
+            const char *s = string_at(r, in->as.ref);
+            if (!s) return 0;
+            out->type = VAL_STRING;
+            out->as.string = string_duplicate(s);
+            return 1;
+        }
+        case SNAP_LIST:
+        case SNAP_MAP: {
+            if (in->as.ref >= r->h->object_count) return 0;
+            Value obj = r->objects[in->as.ref];
+            if (obj.type != (in->type == SNAP_LIST ? VAL_LIST : VAL_MAP)) return 0;
+            *out = value_copy(obj);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// The sections must follow each other in order and fit in the file
+static int check_header(const SnapshotHeader *h, uint64_t size) {
+    if (h->size != size || h->table != sizeof(*h)) return 0;
+    if (h->object_count > (size - h->table) / sizeof(uint64_t)) return 0;
+    if (h->vars != h->table + h->object_count * sizeof(uint64_t)) return 0;
+    if (h->var_count > (size - h->vars) / sizeof(SnapVar)) return 0;
+    if (h->objects != h->vars + h->var_count * sizeof(SnapVar)) return 0;
+    return h->strings >= h->objects && h->strings <= size && h->strings % 8 == 0;
+}
+
+// Build every list and map, then fill them in, so references between
+// them (including cycles) can be resolved by index
+static int decode_objects(Reader *r) {
+    uint64_t count = r->h->object_count;
+    for (uint64_t i = 0; i < count; ++i) {
+        const SnapObject *obj = object_at(r, i);
+        if (!obj) return 0;
+        if (obj->kind == SNAP_ENTRIES) {
+            r->objects[i].type = VAL_MAP;
+            r->objects[i].as.map = map_new();
+            continue;
+        }
+        List *list = list_new((size_t)obj->count);
+        if (obj->kind == SNAP_NUMBERS && obj->count) {
+            memcpy(list->nums, obj + 1, sizeof(double) * obj->count);
+            list->count = (size_t)obj->count;
+        }
+        r->objects[i].type = VAL_LIST;
+        r->objects[i].as.list = list;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        const SnapObject *obj = object_at(r, i);
+        if (obj->kind == SNAP_ITEMS) {
+            const SnapValue *items = (const SnapValue *)(obj + 1);
+            for (uint64_t k = 0; k < obj->count; ++k) {
+                Value item;
+                if (!decode_value(r, &items[k], &item)) return 0;
+                list_push(r->objects[i].as.list, item);
+            }
+        } else if (obj->kind == SNAP_ENTRIES) {
+            // Entries come in the order of the saved table; inserting them
+            // into a table that is still growing would cluster them.
+            const SnapEntry *entries = (const SnapEntry *)(obj + 1);
+            map_reserve(r->objects[i].as.map, (size_t)obj->count);
+            for (uint64_t k = 0; k < obj->count; ++k) {
+                const char *key = string_at(r, entries[k].key);
+                Value value;
+                if (!key || !decode_value(r, &entries[k].value, &value)) return 0;
+                map_set(r->objects[i].as.map, intern(key, strlen(key)), value);
+                value_free(value);
+            }
+        }
+    }
+    return 1;
+}
+
+int snapshot_load(const char *path, void (*define)(const char *name, Value value)) {
+    char msg[512];
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        snprintf(msg, sizeof(msg), "Could not read snapshot: %s", path);
+        report_error(msg, -1);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = size >= sizeof(SnapshotHeader)
+        ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        snprintf(msg, sizeof(msg), "Not a snapshot file: %s", path);
+        report_error(msg, -1);
+        return 0;
+    }
+    // The whole file is about to be read: fault it in with one request
+    posix_madvise(map, size, POSIX_MADV_WILLNEED);
+
+    Reader r;
+    r.base = map;
+    r.h = map;
+    r.objects = NULL;
+    const char *problem = NULL;
+    if (memcmp(r.h->magic, SNAPSHOT_MAGIC, sizeof(r.h->magic)) != 0)
+        problem = "Not a snapshot file";
+    else if (r.h->version != SNAPSHOT_VERSION)
+        problem = "Snapshot was written by an incompatible version of the interpreter";
+    else if (r.h->byte_order != SNAPSHOT_BYTE_ORDER)
+        problem = "Snapshot was written on a machine with a different byte order";
+    else if (!check_header(r.h, size) ||
+             hash_bytes(r.base + sizeof(SnapshotHeader), size - sizeof(SnapshotHeader)) != r.h->checksum)
+        problem = "Snapshot is damaged";
+    if (problem) {
+        snprintf(msg, sizeof(msg), "%s: %s", problem, path);
+        report_error(msg, -1);
+        munmap(map, size);
+        return 0;
+    }
+
+    uint64_t count = r.h->object_count;
+    uint64_t var_count = r.h->var_count;
+    r.objects = memory_calloc(count ? count : 1, sizeof(Value));
+    Value *values = memory_calloc(var_count ? var_count : 1, sizeof(Value));
+    if (!r.objects || !values) {
+        report_error("Memory allocation failed for snapshot", -1);
+        exit(1);
+    }
+    int ok = decode_objects(&r);
+    const SnapVar *vars = (const SnapVar *)(r.base + r.h->vars);
+    uint64_t decoded = 0;
+    while (ok && decoded < var_count) {
+        if (!string_at(&r, vars[decoded].name) ||
+            !decode_value(&r, &vars[decoded].value, &values[decoded]))
+            ok = 0;
+        else
+            decoded++;
+    }
+    if (ok) {
+        for (uint64_t i = 0; i < var_count; ++i)
+            define(string_at(&r, vars[i].name), values[i]);
+    } else {
+        snprintf(msg, sizeof(msg), "Snapshot is damaged: %s", path);
+        report_error(msg, -1);
+    }
+    for (uint64_t i = 0; i < decoded; ++i)
+        value_free(values[i]);
+    // Objects that were never created are still zero, a number
+    for (uint64_t i = 0; i < count; ++i)
+        value_free(r.objects[i]);
+    memory_free(values);
+    memory_free(r.objects);
+    munmap(map, size);
+    return ok;
+}
@@ -0,0 +1,39 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include "value.h"
+
+// Snapshots hold a set of global variables and every list and map they
+// reach, so a later run can start from them instead of recomputing them.
+//
+// The file contains no pointers: strings, objects and variables refer to
+// each other by offset or by index into an object table, so it can be
+// mapped at any address. Lists and maps referenced from several places
+// (or from themselves) are stored once and come back shared. The header
+// records a format version and a checksum of everything after it; files
+// from another version or that fail the check are rejected.
+//
+//   header | object table | variables | objects | string pool
+//
+// Functions and generators refer to the program's syntax tree and cannot
+// be saved.
+
+#define SNAPSHOT_VERSION 1
+
+typedef struct {
+    const char *name;
+    Value value;
+} SnapshotGlobal;
+
+// Write the globals to path (through a temporary file that replaces it
+// once complete). Reports an error and returns 0 on failure.
+int snapshot_save(const char *path, const SnapshotGlobal *globals, size_t count);
+
+// Map the snapshot at path and call define() for each variable in it.
+// Nothing is defined unless the whole file is valid. define() gets a
+// borrowed value and must copy it to keep it. Reports an error and
+// returns 0 on failure.
+int snapshot_load(const char *path, void (*define)(const char *name, Value value));
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,252 @@
+#include "text.h"
+#include "memory.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+size_t text_find(const char *s, size_t len, const char *needle, size_t needle_len,
+                 size_t from) {
+    if (from > len || needle_len > len - from) return TEXT_NOT_FOUND;
+    if (needle_len == 0) return from;
+    size_t i = from;
+#if defined(__SSE2__)
+    // Compare 16 candidate positions at once against the first and last
+    // byte of the needle, and only check the rest where both match.
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    for (; i + needle_len + 15 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i + needle_len - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (memcmp(s + at, needle, needle_len) == 0) return at;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (i + needle_len <= len) {
+        const char *hit = memchr(s + i, needle[0], len - needle_len + 1 - i);
+        if (!hit) break;
+        i = (size_t)(hit - s);
+        if (memcmp(hit, needle, needle_len) == 0) return i;
+        i++;
+    }
+    return TEXT_NOT_FOUND;
+}
+
+// A character starts at every byte that is not a continuation byte
+// (10xxxxxx).
+static int starts_char(unsigned char c) {
+    return (c & 0xC0) != 0x80;
+}
+
+#if defined(__SSE2__)
+// Bit mask of the bytes of a 16 byte block that start a character. As
+// signed bytes, continuation bytes are exactly those below -64.
+static unsigned char_starts(const char *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8((char)0xBF)));
+}
+#endif
+
+size_t text_count_chars(const char *s, size_t len) {
+    size_t i = 0;
+    size_t count = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16)
+        count += (size_t)__builtin_popcount(char_starts(s + i));
+#endif
+    for (; i < len; ++i)
+        count += starts_char((unsigned char)s[i]);
+    return count;
+}
+
+size_t text_char_offset(const char *s, size_t len, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Skip whole blocks while character n lies beyond them
+    for (; i + 16 <= len; i += 16) {
+        size_t starts = (size_t)__builtin_popcount(char_starts(s + i));
+        if (n < starts) break;
+        n -= starts;
+    }
+#endif
+    for (; i < len; ++i) {
+        if (starts_char((unsigned char)s[i]) && n-- == 0) return i;
+    }
+    return len;
+}
+
+// Decode the character at s, returning its length. Malformed sequences
+// decode as a single byte and are copied through unchanged.
+static size_t decode(const unsigned char *s, size_t len, unsigned *cp) {
+    unsigned c = s[0];
+    *cp = c;
+    if (c >= 0xC2 && c < 0xE0 && len >= 2 && (s[1] & 0xC0) == 0x80) {
+        *cp = ((c & 0x1F) << 6) | (s[1] & 0x3F);
+        return 2;
+    }
+    if (c >= 0xE0 && c < 0xF0 && len >= 3 && (s[1] & 0xC0) == 0x80 &&
+        (s[2] & 0xC0) == 0x80) {
+        unsigned v = ((c & 0x0F) << 12) | ((s[1] & 0x3Fu) << 6) | (s[2] & 0x3F);
+        if (v >= 0x800 && (v < 0xD800 || v > 0xDFFF)) {
+            *cp = v;
+            return 3;
+        }
+    }
+    // Four byte characters have no case mapping here, so they are left to
+    // the byte by byte copy
+    return 1;
+}
+
+static size_t encode(unsigned cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    out[0] = (char)(0xE0 | (cp >> 12));
+    out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (cp & 0x3F));
+    return 3;
+}
+
+// Most of the Latin Extended blocks pair each capital with the small
+// letter one code point after it, starting on an even or an odd code point.
+static int in_pairs(unsigned c, unsigned lo, unsigned hi) {
+    return c >= lo && c <= hi;
+}
+
+// Letters of African alphabets whose small letter sits in the IPA block,
+// away from the capital: Ɓ ɓ, Ɔ ɔ, Ɗ ɗ and Ɛ ɛ.
+static const unsigned scattered[][2] = {
+    { 0x181, 0x253 }, { 0x186, 0x254 }, { 0x18A, 0x257 }, { 0x190, 0x25B },
+};
+
+// The digraphs Ǆ ǅ ǆ, Ǉ ǈ ǉ, Ǌ ǋ ǌ (U+01C4-01CC) and Ǳ ǲ ǳ (U+01F1-01F3)
+// come in threes: capital, title case and small. Returns the capital,
+// or 0 for any other character.
+static unsigned digraph(unsigned c) {
+    if (c >= 0x1C4 && c <= 0x1CC) return 0x1C4 + (c - 0x1C4) / 3 * 3;
+    if (c >= 0x1F1 && c <= 0x1F3) return 0x1F1;
+    return 0;
+}
+
+static unsigned upper_char(unsigned c) {
+    if (c >= 'a' && c <= 'z') return c - 32;
+    if (c >= 0xE0 && c <= 0xFE && c != 0xF7) return c - 32;
+    if (c == 0xFF) return 0x178;
+    if (c == 0x131) return 'I';
+    if (c == 0x17F) return 'S';
+    if (c == 0x3C2) return 0x3A3;
+    if (digraph(c)) return digraph(c);
+    for (size_t k = 0; k < sizeof(scattered) / sizeof(scattered[0]); ++k)
+        if (c == scattered[k][1]) return scattered[k][0];
+    if ((in_pairs(c, 0x100, 0x137) || in_pairs(c, 0x14A, 0x177) ||
+         in_pairs(c, 0x1DE, 0x1EF) || in_pairs(c, 0x1F8, 0x21F) ||
+         in_pairs(c, 0x1E00, 0x1E95) || in_pairs(c, 0x1EA0, 0x1EFF)) && (c & 1))
+        return c - 1;
+    if ((in_pairs(c, 0x139, 0x148) || in_pairs(c, 0x179, 0x17E) ||
+         in_pairs(c, 0x1CD, 0x1DC)) && !(c & 1))
+        return c - 1;
+    if (c >= 0x3B1 && c <= 0x3C9) return c - 32;
+    if (c == 0x3AC) return 0x386;
+    if (c >= 0x3AD && c <= 0x3AF) return c - 37;
+    if (c == 0x3CC) return 0x38C;
+    if (c == 0x3CD || c == 0x3CE) return c - 63;
+    if (c >= 0x430 && c <= 0x44F) return c - 32;
+    if (c >= 0x450 && c <= 0x45F) return c - 80;
+    return c;
+}
+
+static unsigned lower_char(unsigned c) {
+    if (c >= 'A' && c <= 'Z') return c + 32;
+    if (c >= 0xC0 && c <= 0xDE && c != 0xD7) return c + 32;
+    if (c == 0x178) return 0xFF;
+    if (c == 0x130) return 'i';
+    if (digraph(c)) return digraph(c) + 2;
+    for (size_t k = 0; k < sizeof(scattered) / sizeof(scattered[0]); ++k)
+        if (c == scattered[k][0]) return scattered[k][1];
+    if ((in_pairs(c, 0x100, 0x137) || in_pairs(c, 0x14A, 0x177) ||
+         in_pairs(c, 0x1DE, 0x1EF) || in_pairs(c, 0x1F8, 0x21F) ||
+         in_pairs(c, 0x1E00, 0x1E95) || in_pairs(c, 0x1EA0, 0x1EFF)) && !(c & 1))
+        return c + 1;
+    if ((in_pairs(c, 0x139, 0x148) || in_pairs(c, 0x179, 0x17E) ||
+         in_pairs(c, 0x1CD, 0x1DC)) && (c & 1))
+        return c + 1;
+    if (c >= 0x391 && c <= 0x3A9 && c != 0x3A2) return c + 32;
+    if (c == 0x386) return 0x3AC;
+    if (c >= 0x388 && c <= 0x38A) return c + 37;
+    if (c == 0x38C) return 0x3CC;
+    if (c == 0x38E || c == 0x38F) return c + 63;
+    if (c >= 0x410 && c <= 0x42F) return c + 32;
+    if (c >= 0x400 && c <= 0x40F) return c + 80;
+    return c;
+}
+
+// ASCII letters from 'from' to 'from' + 25 change case by flipping bit 5.
+// No mapping above makes a character longer, so the result fits in len
+// bytes.
+static char *convert_case(const char *s, size_t len, int upper) {
+    char *out = memory_alloc(len + 1);
+    if (!out) {
+        report_error("Memory allocation failed for string", -1);
+        exit(1);
+    }
+    char from = upper ? 'a' : 'A';
+    size_t i = 0;
+    size_t o = 0;
+    while (i < len) {
+#if defined(__SSE2__)
+        if (i + 16 <= len) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+            if (_mm_movemask_epi8(v) == 0) {
+                // All ASCII: convert the whole block
+                __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((char)(from - 1))),
+                                               _mm_cmplt_epi8(v, _mm_set1_epi8((char)(from + 26))));
+                __m128i flip = _mm_and_si128(letter, _mm_set1_epi8(0x20));
+                _mm_storeu_si128((__m128i *)(out + o), _mm_xor_si128(v, flip));
+                i += 16;
+                o += 16;
+                continue;
+            }
+        }
+#endif
+        unsigned char c = (unsigned char)s[i];
+        if (c < 0x80) {
+            out[o++] = (char)(c >= (unsigned char)from && c < (unsigned char)from + 26 ? c ^ 0x20 : c);
+            i++;
+            continue;
+        }
+        unsigned cp;
+        size_t n = decode((const unsigned char *)s + i, len - i, &cp);
+        unsigned mapped = n == 1 ? cp : upper ? upper_char(cp) : lower_char(cp);
+        if (mapped == cp) {
+            memcpy(out + o, s + i, n);
+            o += n;
+        } else {
+            o += encode(mapped, out + o);
+        }
+        i += n;
+    }
+    out[o] = '\0';
+    return out;
+}
+
+char *text_upper(const char *s, size_t len) {
+    return convert_case(s, len, 1);
+}
+
+char *text_lower(const char *s, size_t len) {
+    return convert_case(s, len, 0);
+}
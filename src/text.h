@@ -0,0 +1,32 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stddef.h>
+
+// Kernels behind the string builtins. Strings are UTF-8; a character is a
+// code point, so a letter written with a combining mark counts as two.
+// Text is not validated: every byte that is not a continuation byte starts
+// a character. The kernels use SSE2 where the CPU supports it and give
+// the same results without it.
+
+#define TEXT_NOT_FOUND ((size_t)-1)
+
+// Byte offset of the first occurrence of needle in s at or after byte
+// 'from', or TEXT_NOT_FOUND. An empty needle is found at 'from'.
+size_t text_find(const char *s, size_t len, const char *needle, size_t needle_len,
+                 size_t from);
+
+// Number of characters in s[0..len).
+size_t text_count_chars(const char *s, size_t len);
+
+// Byte offset of character n of s, or len if s has n characters or fewer.
+size_t text_char_offset(const char *s, size_t len, size_t n);
+
+// Upper or lower case copy of s[0..len), NUL terminated. Covers ASCII,
+// Latin-1, the Latin Extended blocks used by Igbo and other African
+// orthographies (including the dotted vowels ị ọ ụ and ṅ), Greek and
+// Cyrillic; other characters are copied unchanged.
+char *text_upper(const char *s, size_t len);
+char *text_lower(const char *s, size_t len);
+
+#endif // TEXT_H
@@ -1,9 +1,10 @@
 #include "token.h"
+#include "memory.h"
 #include "util.h"
 #include <string.h>
 
 Token *create_token(TokenType type, const char *value, int line_number) {
-    Token *token = (Token *)malloc(sizeof(Token));
+    Token *token = (Token *)memory_alloc(sizeof(Token));
     if (!token) {
         report_error("Memory allocation failed for token", line_number);
         return NULL;
@@ -16,6 +17,6 @@ Token *create_token(TokenType type, const char *value, int line_number) {
 
 void free_token(Token *token) {
     if (!token) return;
-    free(token->value);
-    free(token);
+    memory_free(token->value);
+    memory_free(token);
 }
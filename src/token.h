@@ -9,6 +9,11 @@ typedef enum {
     TOKEN_MANA,
     TOKEN_MGBE,
     TOKEN_GOSI,
+    TOKEN_MAKA,
+    TOKEN_NA,
+    TOKEN_ORU,
+    TOKEN_LAGHACHI,
+    TOKEN_NYE,
     TOKEN_EZIOKWU,
     TOKEN_UGHA,
     TOKEN_IDENTIFIER,
@@ -29,6 +34,10 @@ typedef enum {
     TOKEN_RPAREN,
     TOKEN_LBRACE,
     TOKEN_RBRACE,
+    TOKEN_LBRACKET,
+    TOKEN_RBRACKET,
+    TOKEN_COMMA,
+    TOKEN_COLON,
     TOKEN_EOF
 } TokenType;
 
@@ -0,0 +1,670 @@
+#include "types.h"
+#include "builtins.h"
+#include "intern.h"
+#include "memory.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The abstract state is one cell per variable holding the types it may
+// have at the current point: a cell per slot of the function or parallel
+// loop being analysed and, at the top level, one per global name. Cells
+// are updated in place and every change is logged, so a branch or a loop
+// pass can be undone and joined at a cost that depends on the number of
+// assignments in it rather than on the number of variables.
+typedef struct {
+    unsigned types;
+    unsigned seen;      // stamp of the last collect() that listed the cell
+} Cell;
+
+typedef struct {
+    Cell *cell;
+    unsigned types;     // in the log: the previous types
+} Change;
+
+typedef struct {
+    const char *name;
+    int index;
+} GlobalName;
+
+typedef struct {
+    int open;           // code the pass cannot see may define functions
+    int reachable;      // 0 after 'laghachi': nothing flows on from here
+    Cell *locals;       // slots of the current function or parallel body
+    int local_count;
+    Cell *globals;      // globals at the top level, NULL when not followed
+    GlobalName *names;  // open addressing table of global names
+    size_t name_capacity;
+    int global_count;
+    Change *log;
+    size_t log_count;
+    size_t log_capacity;
+    unsigned stamp;
+    const char **functions;   // names the program defines with 'oru'
+    int function_count;
+} Infer;
+
+static void *checked_realloc(void *p, size_t size) {
+    p = memory_realloc(p, size ? size : 1);
+    if (!p) {
+        report_error("Memory allocation failed in type inference", -1);
+        exit(1);
+    }
+    return p;
+}
+
+static Cell *new_cells(int count, unsigned types) {
+    Cell *cells = checked_realloc(NULL, sizeof(Cell) * (size_t)count);
+    for (int i = 0; i < count; ++i)
+        cells[i] = (Cell){types, 0};
+    return cells;
+}
+
+static void set(Infer *in, Cell *cell, unsigned types) {
+    if (cell->types == types) return;
+    if (in->log_count == in->log_capacity) {
+        in->log_capacity = in->log_capacity ? in->log_capacity * 2 : 64;
+        in->log = checked_realloc(in->log, sizeof(Change) * in->log_capacity);
+    }
+    in->log[in->log_count++] = (Change){cell, cell->types};
+    cell->types = types;
+}
+
+// Put back the state from when the log had 'mark' entries
+static void undo(Infer *in, size_t mark) {
+    while (in->log_count > mark) {
+        Change *c = &in->log[--in->log_count];
+        c->cell->types = c->types;
+    }
+}
+
+// The cells changed since 'mark', each once, with their current types.
+// Cells already stamped 'skip' are left out. Returns a new array.
+static Change *collect(Infer *in, size_t mark, unsigned skip, size_t *count) {
+    unsigned stamp = ++in->stamp;
+    Change *changes = checked_realloc(NULL, sizeof(Change) * (in->log_count - mark));
+    *count = 0;
+    for (size_t i = mark; i < in->log_count; ++i) {
+        Cell *cell = in->log[i].cell;
+        if (cell->seen == stamp) continue;
+        int skipped = skip && cell->seen == skip;
+        cell->seen = stamp;
+        // The first entry for a cell holds its types from before 'mark'
+        if (!skipped) changes[(*count)++] = (Change){cell, in->log[i].types};
+    }
+    return changes;
+}
+
+static size_t name_slot(const Infer *in, const char *name) {
+    size_t mask = in->name_capacity - 1;
+    size_t i = (size_t)hash_bytes(name, strlen(name)) & mask;
+    while (in->names[i].name && strcmp(in->names[i].name, name) != 0)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static void add_global(Infer *in, const char *name) {
+    if ((size_t)(in->global_count + 1) * 2 > in->name_capacity) {
+        GlobalName *old = in->names;
+        size_t old_capacity = in->name_capacity;
+        in->name_capacity = old_capacity ? old_capacity * 2 : 64;
+        in->names = checked_realloc(NULL, sizeof(GlobalName) * in->name_capacity);
+        memset(in->names, 0, sizeof(GlobalName) * in->name_capacity);
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old[i].name) in->names[name_slot(in, old[i].name)] = old[i];
+        }
+        memory_free(old);
+    }
+    size_t i = name_slot(in, name);
+    if (!in->names[i].name) in->names[i] = (GlobalName){name, in->global_count++};
+}
+
+// Number the globals and collect the names defined with 'oru'. The right
+// child is followed in a loop, so long statement chains do not recurse.
+static void collect_names(Infer *in, const ASTNode *node) {
+    for (; node != NULL; node = node->right) {
+        if (node->type == NODE_FUNC_DEF) {
+            in->functions = checked_realloc(in->functions,
+                                            sizeof(const char *) * (size_t)(in->function_count + 1));
+            in->functions[in->function_count++] = node->value;
+        } else if (node->slot < 0 && (node->type == NODE_IDENTIFIER || node->type == NODE_VAR_DECL ||
+                                      node->type == NODE_FOR_STMT || node->type == NODE_INDEX_ASSIGN)) {
+            add_global(in, node->value);
+        } else if (node->type == NODE_PARALLEL_FOR) {
+            for (const ASTNode *n = node->right->right; n != NULL; n = n->right)
+                add_global(in, n->left->value);
+        }
+        collect_names(in, node->left);
+        collect_names(in, node->third);
+    }
+}
+
+static Cell *global_cell(const Infer *in, const char *name) {
+    if (!in->globals) return NULL;
+    size_t i = name_slot(in, name);
+    return in->names[i].name ? &in->globals[in->names[i].index] : NULL;
+}
+
+// The cell of the variable named by node, or NULL if it is not followed
+static Cell *cell_of(const Infer *in, const ASTNode *node) {
+    if (node->slot >= 0) return node->slot < in->local_count ? &in->locals[node->slot] : NULL;
+    return global_cell(in, node->value);
+}
+
+// Whether the tree contains a node of the given type, following the right
+// child in a loop like collect_names()
+static int contains(const ASTNode *node, NodeType type) {
+    for (; node != NULL; node = node->right) {
+        if (node->type == type || contains(node->left, type) || contains(node->third, type))
+            return 1;
+    }
+    return 0;
+}
+
+static int defines_function(const Infer *in, const char *name) {
+    for (int i = 0; i < in->function_count; ++i) {
+        if (strcmp(in->functions[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+// Value produced by reading a variable of the given types; reading an
+// unassigned variable reports an error and yields 0
+static unsigned read_types(unsigned types) {
+    return types & TYPE_UNSET ? (types & TYPE_VALUE) | TYPE_NUMBER : types;
+}
+
+static void assign(Infer *in, const ASTNode *target, unsigned types) {
+    Cell *cell = cell_of(in, target);
+    if (cell) set(in, cell, types);
+}
+
+static unsigned variable(const Infer *in, const ASTNode *node) {
+    Cell *cell = cell_of(in, node);
+    return cell ? cell->types : TYPE_ANY;
+}
+
+static unsigned expr(Infer *in, ASTNode *node);
+static void block(Infer *in, ASTNode *list);
+
+static unsigned binary(const char *op, unsigned left, unsigned right) {
+    if (strcmp(op, "+") == 0) {
+        unsigned types = 0;
+        if ((left | right) & TYPE_STRING) types |= TYPE_STRING;
+        // Numbers add up, and anything else is an error that yields 0
+        if ((left & ~TYPE_STRING) && (right & ~TYPE_STRING)) types |= TYPE_NUMBER;
+        return types;
+    }
+    if (strcmp(op, "-") == 0 || strcmp(op, "*") == 0 || strcmp(op, "/") == 0) return TYPE_NUMBER;
+    return TYPE_BOOL;
+}
+
+static unsigned call(Infer *in, ASTNode *node) {
+    size_t argc = 0;
+    ASTNode *last = NULL;
+    for (ASTNode *a = node->left; a != NULL; a = a->right, ++argc) {
+        expr(in, a->left);
+        last = a->left;
+    }
+    const Builtin *builtin = find_builtin(node->value);
+    int user = in->open || defines_function(in, node->value);
+    int arity = builtin && argc >= builtin->min_args && argc <= builtin->max_args;
+    if (arity && builtin->moves && last->type == NODE_IDENTIFIER && last->slot >= 0) {
+        // A string, list or map is moved out of the variable (see
+        // Builtin.moves), unless a function of that name is called instead
+        const unsigned movable = TYPE_STRING | TYPE_LIST | TYPE_MAP;
+        Cell *cell = cell_of(in, last);
+        if (cell && (cell->types & movable))
+            set(in, cell, (user ? cell->types : cell->types & ~movable) | TYPE_UNSET);
+    }
+    if (user) return TYPE_VALUE;
+    // An undefined function or a wrong number of arguments is an error
+    // that yields 0
+    if (!arity) return TYPE_NUMBER;
+    return builtin->returns >= 0 ? TYPE_OF(builtin->returns) : TYPE_VALUE;
+}
+
+static unsigned expr(Infer *in, ASTNode *node) {
+    unsigned types;
+    switch (node->type) {
+        case NODE_NUMBER:
+            types = TYPE_NUMBER;
+            break;
+        case NODE_STRING:
+            types = TYPE_STRING;
+            break;
+        case NODE_BOOL:
+            types = TYPE_BOOL;
+            break;
+        case NODE_IDENTIFIER:
+            node->types = variable(in, node);
+            return read_types(node->types);
+        case NODE_BINARY_EXPR: {
+            unsigned left = expr(in, node->left);
+            unsigned right = expr(in, node->right);
+            types = binary(node->value, left, right);
+            break;
+        }
+        case NODE_LIST:
+            for (ASTNode *n = node->left; n != NULL; n = n->right)
+                expr(in, n->left);
+            types = TYPE_LIST;
+            break;
+        case NODE_MAP:
+            for (ASTNode *n = node->left; n != NULL; n = n->right) {
+                expr(in, n->left);
+                expr(in, n->third);
+            }
+            types = TYPE_MAP;
+            break;
+        case NODE_INDEX:
+            expr(in, node->left);
+            expr(in, node->right);
+            types = TYPE_VALUE;
+            break;
+        case NODE_CALL:
+            types = call(in, node);
+            break;
+        default:
+            return TYPE_VALUE;
+    }
+    node->types = types;
+    return types;
+}
+
+// ma cond { then } mana { other }: run each branch from the state before
+// it, then join the two results
+static void branches(Infer *in, ASTNode *then, ASTNode *other) {
+    size_t mark = in->log_count;
+    block(in, then);
+    int then_reachable = in->reachable;
+    size_t then_count;
+    Change *then_changes = collect(in, mark, 0, &then_count);
+    for (size_t i = 0; i < then_count; ++i)
+        then_changes[i].types = then_changes[i].cell->types;
+    undo(in, mark);
+    in->reachable = 1;
+    block(in, other);
+    if (!then_reachable) {
+        // Only the other branch goes on
+    } else if (!in->reachable) {
+        undo(in, mark);
+        for (size_t i = 0; i < then_count; ++i)
+            set(in, then_changes[i].cell, then_changes[i].types);
+        in->reachable = 1;
+    } else {
+        // Stamp the cells the first branch changed, to tell them apart
+        unsigned then_stamp = ++in->stamp;
+        for (size_t i = 0; i < then_count; ++i)
+            then_changes[i].cell->seen = then_stamp;
+        size_t other_count;
+        Change *other_changes = collect(in, mark, then_stamp, &other_count);
+        // A cell either branch changed may have the types it got there or
+        // those it had before the branch, or got in the other one
+        for (size_t i = 0; i < then_count; ++i)
+            set(in, then_changes[i].cell, then_changes[i].cell->types | then_changes[i].types);
+        for (size_t i = 0; i < other_count; ++i)
+            set(in, other_changes[i].cell, other_changes[i].cell->types | other_changes[i].types);
+        memory_free(other_changes);
+    }
+    memory_free(then_changes);
+}
+
+// Run a loop body until the state at the top of the loop stops growing;
+// that state is also the state after the loop. 'prepare' is applied at
+// the top of every iteration.
+typedef void (*Prepare)(Infer *in, ASTNode *loop);
+
+static void loop(Infer *in, ASTNode *node, ASTNode *cond, ASTNode *body, Prepare prepare) {
+    for (;;) {
+        size_t mark = in->log_count;
+        if (cond) expr(in, cond);
+        if (prepare) prepare(in, node);
+        block(in, body);
+        int back = in->reachable;
+        in->reachable = 1;
+        size_t count;
+        Change *changes = collect(in, mark, 0, &count);
+        for (size_t i = 0; i < count; ++i)
+            changes[i].types = changes[i].cell->types;
+        undo(in, mark);
+        int grew = 0;
+        for (size_t i = 0; back && i < count; ++i) {
+            Cell *cell = changes[i].cell;
+            if ((cell->types | changes[i].types) != cell->types) {
+                set(in, cell, cell->types | changes[i].types);
+                grew = 1;
+            }
+        }
+        memory_free(changes);
+        if (!grew) break;
+    }
+    // The condition is evaluated once more before the loop ends
+    if (cond) expr(in, cond);
+}
+
+static void prepare_for(Infer *in, ASTNode *node) {
+    assign(in, node, TYPE_VALUE);
+}
+
+// Every iteration of a parallel loop starts with its own locals unset,
+// the loop variable a number and the reduction variables carried over
+static void prepare_parallel(Infer *in, ASTNode *node) {
+    int reductions = 0;
+    for (ASTNode *n = node->right->right; n != NULL; n = n->right)
+        reductions++;
+    set(in, &in->locals[0], TYPE_NUMBER);
+    for (int i = 1 + reductions; i < in->local_count; ++i)
+        set(in, &in->locals[i], TYPE_UNSET);
+}
+
+// Analyse a function or parallel loop body with cells of its own. Globals
+// are only followed into a parallel loop, which cannot change them.
+static void body(Infer *in, ASTNode *node, Cell *locals, int follow_globals) {
+    Cell *saved_locals = in->locals;
+    int saved_count = in->local_count;
+    Cell *saved_globals = in->globals;
+    size_t mark = in->log_count;
+    in->locals = locals;
+    in->local_count = node->slot;
+    if (!follow_globals) in->globals = NULL;
+    if (node->type == NODE_FUNC_DEF) {
+        block(in, node->right);
+    } else {
+        prepare_parallel(in, node);
+        loop(in, node, NULL, node->right->left, prepare_parallel);
+    }
+    in->reachable = 1;
+    // The body's cells are thrown away, so its changes need no undoing
+    in->log_count = mark;
+    in->locals = saved_locals;
+    in->local_count = saved_count;
+    in->globals = saved_globals;
+    memory_free(locals);
+}
+
+static void function(Infer *in, ASTNode *def) {
+    Cell *locals = new_cells(def->slot, TYPE_UNSET);
+    for (ASTNode *p = def->left; p != NULL; p = p->right)
+        locals[p->left->slot].types = TYPE_VALUE;
+    body(in, def, locals, 0);
+}
+
+static void parallel(Infer *in, ASTNode *node) {
+    expr(in, node->left);
+    expr(in, node->third);
+    body(in, node, new_cells(node->slot, TYPE_NUMBER), 1);
+    // Afterwards each reduction variable (a global) holds a number, unless
+    // it held something else before, which is reported and left alone
+    for (ASTNode *n = node->right->right; n != NULL; n = n->right) {
+        Cell *cell = global_cell(in, n->left->value);
+        if (cell) set(in, cell, (cell->types & TYPE_VALUE) | TYPE_NUMBER);
+    }
+}
+
+static void stmt(Infer *in, ASTNode *node) {
+    switch (node->type) {
+        case NODE_VAR_DECL:
+            assign(in, node, expr(in, node->left));
+            break;
+        case NODE_INDEX_ASSIGN:
+            // The variable keeps its type; record it for types_check()
+            node->types = variable(in, node);
+            expr(in, node->right);
+            expr(in, node->left);
+            break;
+        case NODE_PRINT_STMT:
+        case NODE_YIELD:
+            if (node->left) expr(in, node->left);
+            break;
+        case NODE_RETURN:
+            if (node->left) expr(in, node->left);
+            in->reachable = 0;
+            break;
+        case NODE_IF_STMT:
+            expr(in, node->left);
+            branches(in, node->right, node->third);
+            break;
+        case NODE_WHILE_STMT:
+            loop(in, node, node->left, node->right, NULL);
+            break;
+        case NODE_FOR_STMT:
+            node->types = expr(in, node->left);
+            loop(in, node, NULL, node->right, prepare_for);
+            break;
+        case NODE_FUNC_DEF:
+            function(in, node);
+            break;
+        case NODE_PARALLEL_FOR:
+            parallel(in, node);
+            break;
+        case NODE_SPAWN:
+            // Only the arguments are evaluated here
+            for (ASTNode *a = node->left->left; a != NULL; a = a->right)
+                expr(in, a->left);
+            break;
+        case NODE_IMPORT:
+            break;
+        case NODE_LAZY_BLOCK:
+            // Not parsed yet: anything may happen in it
+            for (int i = 0; i < in->local_count; ++i)
+                set(in, &in->locals[i], TYPE_ANY);
+            for (int i = 0; in->globals && i < in->global_count; ++i)
+                set(in, &in->globals[i], TYPE_ANY);
+            break;
+        default:
+            expr(in, node);
+            break;
+    }
+}
+
+static void block(Infer *in, ASTNode *list) {
+    for (ASTNode *n = list; n != NULL && in->reachable; n = n->right)
+        stmt(in, n->left);
+}
+
+void types_infer(ASTNode *program, int open) {
+    if (!program) return;
+    Infer in = {0};
+    // Imported modules and lazily parsed blocks may define functions and
+    // assign globals out of sight
+    in.open = open || contains(program, NODE_IMPORT) || contains(program, NODE_LAZY_BLOCK);
+    in.reachable = 1;
+    collect_names(&in, program);
+    if (!in.open) in.globals = new_cells(in.global_count, TYPE_ANY);
+    if (program->type == NODE_PROGRAM)
+        block(&in, program);
+    else
+        stmt(&in, program);
+    memory_free(in.globals);
+    memory_free(in.names);
+    memory_free(in.log);
+    memory_free(in.functions);
+}
+
+// Checking
+
+// Short source-like text of an expression for error messages
+static void describe(const ASTNode *node, char *buf, size_t size) {
+    size_t used = strlen(buf);
+    if (!node || used + 1 >= size) return;
+    char *out = buf + used;
+    size_t room = size - used;
+    switch (node->type) {
+        case NODE_NUMBER:
+        case NODE_IDENTIFIER:
+        case NODE_BOOL:
+            snprintf(out, room, "%s", node->value);
+            break;
+        case NODE_STRING:
+            snprintf(out, room, "\"%s\"", node->value);
+            break;
+        case NODE_BINARY_EXPR:
+            if (node->left->type == NODE_BINARY_EXPR) {
+                snprintf(out, room, "(");
+                describe(node->left, buf, size);
+                snprintf(buf + strlen(buf), size - strlen(buf), ")");
+            } else {
+                describe(node->left, buf, size);
+            }
+            snprintf(buf + strlen(buf), size - strlen(buf), " %s ", node->value);
+            if (node->right->type == NODE_BINARY_EXPR) {
+                snprintf(buf + strlen(buf), size - strlen(buf), "(");
+                describe(node->right, buf, size);
+                snprintf(buf + strlen(buf), size - strlen(buf), ")");
+            } else {
+                describe(node->right, buf, size);
+            }
+            break;
+        case NODE_INDEX:
+            describe(node->left, buf, size);
+            snprintf(buf + strlen(buf), size - strlen(buf), "[");
+            describe(node->right, buf, size);
+            snprintf(buf + strlen(buf), size - strlen(buf), "]");
+            break;
+        case NODE_CALL:
+            snprintf(out, room, "%s(%s)", node->value, node->left ? "..." : "");
+            break;
+        case NODE_LIST:
+            snprintf(out, room, "[...]");
+            break;
+        case NODE_MAP:
+            snprintf(out, room, "{...}");
+            break;
+        default:
+            snprintf(out, room, "...");
+            break;
+    }
+}
+
+typedef struct {
+    const char *function;   // name of the enclosing function, or NULL
+    int errors;
+} Check;
+
+// Report problem at the line of node 'at', found in expression 'where' if
+// it is not NULL
+static void check_error(Check *c, const char *problem, const ASTNode *at, const ASTNode *where) {
+    char text[96] = "";
+    describe(where, text, sizeof(text));
+    char function[96] = "";
+    if (c->function) snprintf(function, sizeof(function), " (function '%s')", c->function);
+    char msg[320];
+    snprintf(msg, sizeof(msg), "%s%s%s%s", problem, where ? " in " : "", text, function);
+    report_error(msg, at->line ? at->line : -1);
+    c->errors++;
+}
+
+// The value types node yields, or 0 if it was not annotated
+static unsigned yields(const ASTNode *node) {
+    if (node->type == NODE_IDENTIFIER) return node->types ? read_types(node->types) : 0;
+    return node->types;
+}
+
+static void check_binary(Check *c, const ASTNode *node) {
+    unsigned left = yields(node->left);
+    unsigned right = yields(node->right);
+    if (!left || !right) return;
+    const char *op = node->value;
+    if (strcmp(op, "+") == 0) {
+        if (!((left | right) & TYPE_STRING) && !(left & right & TYPE_NUMBER))
+            check_error(c, "Operands must be numbers or strings for '+'", node, node);
+    } else if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0) {
+        char problem[40];
+        snprintf(problem, sizeof(problem), "Type mismatch for '%s'", op);
+        if (!(left & right)) check_error(c, problem, node, node);
+    } else if (!(left & TYPE_NUMBER) || !(right & TYPE_NUMBER)) {
+        char problem[48];
+        if (strcmp(op, "-") == 0 || strcmp(op, "*") == 0 || strcmp(op, "/") == 0)
+            snprintf(problem, sizeof(problem), "Operands must be numbers for '%s'", op);
+        else
+            snprintf(problem, sizeof(problem), "Operands must be numbers for comparison");
+        check_error(c, problem, node, node);
+    }
+}
+
+static int single_type(unsigned types, ValueType *type) {
+    for (int t = 0; t <= VAL_UNSET; ++t) {
+        if (types == TYPE_OF(t)) {
+            *type = (ValueType)t;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void check(Check *c, ASTNode *node) {
+    if (!node) return;
+    if (node->type == NODE_PROGRAM || node->type == NODE_EXPR_LIST) {
+        // Walk long statement and argument chains without recursing
+        for (; node != NULL; node = node->right) {
+            check(c, node->left);
+            check(c, node->third);
+        }
+        return;
+    }
+    char msg[160];
+    ValueType type;
+    switch (node->type) {
+        case NODE_FUNC_DEF: {
+            // The parameters are not reads
+            const char *function = c->function;
+            c->function = node->value;
+            check(c, node->right);
+            c->function = function;
+            return;
+        }
+        case NODE_PARALLEL_FOR:
+            check(c, node->left);
+            check(c, node->third);
+            check(c, node->right->left);
+            return;
+        case NODE_IDENTIFIER:
+            if (node->types == TYPE_UNSET) {
+                snprintf(msg, sizeof(msg), "Undefined variable '%s'", node->value);
+                check_error(c, msg, node, NULL);
+            }
+            return;
+        case NODE_BINARY_EXPR:
+            check(c, node->left);
+            check(c, node->right);
+            check_binary(c, node);
+            return;
+        case NODE_INDEX: {
+            check(c, node->left);
+            check(c, node->right);
+            unsigned target = yields(node->left);
+            if (target && !(target & (TYPE_LIST | TYPE_MAP)))
+                check_error(c, "Only lists and maps can be indexed", node, node);
+            return;
+        }
+        case NODE_INDEX_ASSIGN:
+            if (node->types == TYPE_UNSET) {
+                snprintf(msg, sizeof(msg), "Undefined variable '%s'", node->value);
+                check_error(c, msg, node, NULL);
+            } else if (node->types && !(node->types & (TYPE_LIST | TYPE_MAP | TYPE_UNSET))) {
+                snprintf(msg, sizeof(msg), "Only lists and maps can be indexed ('%s')", node->value);
+                check_error(c, msg, node, NULL);
+            }
+            break;
+        case NODE_FOR_STMT:
+            if (single_type(node->types, &type) &&
+                !(node->types & (TYPE_LIST | TYPE_MAP | TYPE_GENERATOR | TYPE_CHANNEL))) {
+                snprintf(msg, sizeof(msg), "Cannot iterate over a %s", value_type_name(type));
+                check_error(c, msg, node, node->left);
+            }
+            break;
+        default:
+            break;
+    }
+    check(c, node->left);
+    check(c, node->right);
+    check(c, node->third);
+}
+
+int types_check(ASTNode *program) {
+    Check c = {NULL, 0};
+    check(&c, program);
+    return c.errors;
+}
@@ -0,0 +1,48 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+#include "ast.h"
+#include "value.h"
+
+// Static type inference. A flow-sensitive pass over the syntax tree works
+// out, for every expression, the set of value types it can produce and
+// stores it in the node's 'types' field as a bitmask of TYPE_OF(VAL_*).
+//
+// Local variables (function, generator and parallel loop slots) are
+// followed through assignments, branches and loops. Globals are followed
+// at the top level only: functions may run at any point, so inside them a
+// global can hold anything. A set with a single bit means the expression
+// is monomorphic, and the interpreter and the compiler then skip the type
+// checks on it. A node the pass has not seen has 'types' 0 and always
+// takes the generic path.
+//
+// On an identifier the set includes TYPE_UNSET when the variable may not
+// be assigned yet, so TYPE_NUMBER alone means "certainly a number".
+// Other expressions never produce TYPE_UNSET; an operation that reports
+// an error yields its placeholder value, which is included in the set.
+
+#define TYPE_OF(type) (1u << (type))
+#define TYPE_NUMBER TYPE_OF(VAL_NUMBER)
+#define TYPE_STRING TYPE_OF(VAL_STRING)
+#define TYPE_BOOL TYPE_OF(VAL_BOOL)
+#define TYPE_LIST TYPE_OF(VAL_LIST)
+#define TYPE_MAP TYPE_OF(VAL_MAP)
+#define TYPE_GENERATOR TYPE_OF(VAL_GENERATOR)
+#define TYPE_CHANNEL TYPE_OF(VAL_CHANNEL)
+#define TYPE_UNSET TYPE_OF(VAL_UNSET)
+#define TYPE_VALUE (TYPE_OF(VAL_UNSET) - 1)   // any value a script can see
+#define TYPE_ANY (TYPE_VALUE | TYPE_UNSET)
+
+// Annotate program (a statement chain or a single statement). 'open' is
+// set when code the pass cannot see, such as earlier statements of a
+// stream, a snapshot or an imported module, may define functions or
+// globals, so a call is not assumed to reach the builtin of that name and
+// globals are not followed.
+void types_infer(ASTNode *program, int open);
+
+// Report the errors an annotated program is certain to run into if the
+// offending expression runs, such as '"a" - 1'. Returns the number of
+// errors reported.
+int types_check(ASTNode *program);
+
+#endif // TYPES_H
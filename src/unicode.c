@@ -0,0 +1,311 @@
+#include "unicode.h"
+#include "memory.h"
+#include "util.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+typedef struct {
+    unsigned first;
+    unsigned last;
+    unsigned char ccc;
+} CombiningRange;
+
+typedef struct {
+    unsigned cp;
+    unsigned first;
+    unsigned second;     // 0 for a single code point decomposition
+} Decomposition;
+
+typedef struct {
+    unsigned first;
+    unsigned second;
+    unsigned cp;
+} Composition;
+
+#include "unicode_table.h"
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+// Hangul syllables are composed and decomposed arithmetically
+#define HANGUL_S 0xAC00
+#define HANGUL_L 0x1100
+#define HANGUL_V 0x1161
+#define HANGUL_T 0x11A7
+#define HANGUL_V_COUNT 21
+#define HANGUL_T_COUNT 28
+#define HANGUL_COUNT (19 * HANGUL_V_COUNT * HANGUL_T_COUNT)
+
+// Length of the ASCII run at the start of s[0..len)
+static size_t ascii_prefix(const unsigned char *s, size_t len) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(s + i + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))))
+            break;
+    }
+    for (; i + 16 <= len; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)))) break;
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, s + i, 8);
+        if (word & 0x8080808080808080ull) break;
+    }
+#endif
+    while (i < len && s[i] < 0x80) i++;
+    return i;
+}
+
+size_t unicode_validate(const char *s, size_t len, int *truncated) {
+    const unsigned char *p = (const unsigned char *)s;
+    size_t i = 0;
+    *truncated = 0;
+    for (;;) {
+        i += ascii_prefix(p + i, len - i);
+        if (i == len) return len;
+        unsigned c = p[i];
+        size_t n;
+        if (c >= 0xC2 && c <= 0xDF) n = 2;
+        else if (c >= 0xE0 && c <= 0xEF) n = 3;
+        else if (c >= 0xF0 && c <= 0xF4) n = 4;
+        else return i;
+        // The second byte's range rules out overlong forms, surrogates
+        // and code points past U+10FFFF
+        unsigned lo = 0x80, hi = 0xBF;
+        if (c == 0xE0) lo = 0xA0;
+        else if (c == 0xED) hi = 0x9F;
+        else if (c == 0xF0) lo = 0x90;
+        else if (c == 0xF4) hi = 0x8F;
+        for (size_t k = 1; k < n; ++k) {
+            if (i + k == len) {
+                *truncated = 1;
+                return i;
+            }
+            unsigned b = p[i + k];
+            if (k == 1 ? b < lo || b > hi : (b & 0xC0) != 0x80) return i;
+        }
+        i += n;
+    }
+}
+
+static int combining_class(unsigned c) {
+    if (c < NFC_QUICK_MIN) return 0;
+    size_t lo = 0, hi = COUNT(combining_classes);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (c < combining_classes[mid].first) hi = mid;
+        else if (c > combining_classes[mid].last) lo = mid + 1;
+        else return combining_classes[mid].ccc;
+    }
+    return 0;
+}
+
+static const Decomposition *find_decomposition(unsigned c) {
+    size_t lo = 0, hi = COUNT(decompositions);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (c < decompositions[mid].cp) hi = mid;
+        else if (c > decompositions[mid].cp) lo = mid + 1;
+        else return &decompositions[mid];
+    }
+    return NULL;
+}
+
+// The primary composite of first and second, or 0 if there is none
+static unsigned compose(unsigned first, unsigned second) {
+    if (first >= HANGUL_L && first < HANGUL_L + 19 &&
+        second >= HANGUL_V && second < HANGUL_V + HANGUL_V_COUNT)
+        return HANGUL_S + ((first - HANGUL_L) * HANGUL_V_COUNT + (second - HANGUL_V)) * HANGUL_T_COUNT;
+    if (first >= HANGUL_S && first < HANGUL_S + HANGUL_COUNT &&
+        (first - HANGUL_S) % HANGUL_T_COUNT == 0 &&
+        second > HANGUL_T && second < HANGUL_T + HANGUL_T_COUNT)
+        return first + (second - HANGUL_T);
+    size_t lo = 0, hi = COUNT(compositions);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const Composition *e = &compositions[mid];
+        if (first < e->first || (first == e->first && second < e->second)) hi = mid;
+        else if (first > e->first || second > e->second) lo = mid + 1;
+        else return e->cp;
+    }
+    return 0;
+}
+
+typedef struct {
+    unsigned *cps;
+    size_t count;
+    size_t capacity;
+} CodePoints;
+
+static void push(CodePoints *out, unsigned c) {
+    if (out->count == out->capacity) {
+        out->capacity *= 2;
+        out->cps = memory_realloc(out->cps, sizeof(unsigned) * out->capacity);
+        if (!out->cps) {
+            report_error("Memory allocation failed while normalizing", -1);
+            exit(1);
+        }
+    }
+    out->cps[out->count++] = c;
+}
+
+// Append the full canonical decomposition of c
+static void decompose(CodePoints *out, unsigned c) {
+    if (c >= HANGUL_S && c < HANGUL_S + HANGUL_COUNT) {
+        unsigned s = c - HANGUL_S;
+        push(out, HANGUL_L + s / (HANGUL_V_COUNT * HANGUL_T_COUNT));
+        push(out, HANGUL_V + (s % (HANGUL_V_COUNT * HANGUL_T_COUNT)) / HANGUL_T_COUNT);
+        if (s % HANGUL_T_COUNT) push(out, HANGUL_T + s % HANGUL_T_COUNT);
+        return;
+    }
+    // Nothing below U+00C0 has a canonical decomposition
+    const Decomposition *d = c < 0xC0 ? NULL : find_decomposition(c);
+    if (!d) {
+        push(out, c);
+        return;
+    }
+    decompose(out, d->first);
+    if (d->second) decompose(out, d->second);
+}
+
+// Decode one character; a malformed byte stands for itself
+static size_t decode(const unsigned char *s, size_t len, unsigned *cp) {
+    unsigned c = s[0];
+    size_t n = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    if (n > len || c >= 0xF8) n = 1;
+    for (size_t k = 1; k < n; ++k) {
+        if ((s[k] & 0xC0) != 0x80) n = 1;
+    }
+    if (n == 1) {
+        *cp = c;
+        return 1;
+    }
+    unsigned v = c & (0x7F >> n);
+    for (size_t k = 1; k < n; ++k)
+        v = (v << 6) | (s[k] & 0x3F);
+    *cp = v;
+    return n;
+}
+
+static size_t encode(unsigned cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+char *unicode_nfc(const char *s, size_t len) {
+    const unsigned char *p = (const unsigned char *)s;
+    char *result = NULL;
+
+    // Nothing below NFC_QUICK_MIN decomposes differently or combines
+    // with what comes before it
+    size_t i = ascii_prefix(p, len);
+    while (i < len) {
+        unsigned c;
+        size_t n = decode(p + i, len - i, &c);
+        if (c >= NFC_QUICK_MIN) break;
+        i += n;
+    }
+    if (i == len) {
+        result = memory_alloc(len + 1);
+        if (!result) {
+            report_error("Memory allocation failed while normalizing", -1);
+            exit(1);
+        }
+        memcpy(result, s, len);
+        result[len] = '\0';
+        return result;
+    }
+
+    // Decompose
+    CodePoints cps = { memory_alloc(sizeof(unsigned) * (len + 8)), 0, len + 8 };
+    if (!cps.cps) {
+        report_error("Memory allocation failed while normalizing", -1);
+        exit(1);
+    }
+    for (size_t j = 0; j < len;) {
+        unsigned c;
+        j += decode(p + j, len - j, &c);
+        decompose(&cps, c);
+    }
+
+    // Put each run of combining marks in canonical order (a stable sort by
+    // combining class)
+    for (size_t j = 1; j < cps.count; ++j) {
+        unsigned c = cps.cps[j];
+        int cc = combining_class(c);
+        if (cc == 0) continue;
+        size_t k = j;
+        while (k > 0) {
+            int prev = combining_class(cps.cps[k - 1]);
+            if (prev <= cc) break;
+            cps.cps[k] = cps.cps[k - 1];
+            k--;
+        }
+        cps.cps[k] = c;
+    }
+
+    // Compose: a character joins the last starter if it directly follows
+    // it, or if everything in between is a mark of a lower class. Marks
+    // are sorted by now, so the last one has the highest class.
+    size_t out = 0;
+    size_t starter = 0;
+    int have_starter = 0;
+    int last_class = 0;
+    for (size_t j = 0; j < cps.count; ++j) {
+        unsigned c = cps.cps[j];
+        int cc = combining_class(c);
+        if (have_starter && (out == starter + 1 || last_class < cc)) {
+            unsigned composite = compose(cps.cps[starter], c);
+            if (composite) {
+                cps.cps[starter] = composite;
+                continue;
+            }
+        }
+        if (cc == 0) {
+            starter = out;
+            have_starter = 1;
+        }
+        last_class = cc;
+        cps.cps[out++] = c;
+    }
+
+    result = memory_alloc(out * 4 + 1);
+    if (!result) {
+        report_error("Memory allocation failed while normalizing", -1);
+        exit(1);
+    }
+    size_t n = 0;
+    for (size_t j = 0; j < out; ++j)
+        n += encode(cps.cps[j], result + n);
+    result[n] = '\0';
+    memory_free(cps.cps);
+    return result;
+}
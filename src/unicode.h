@@ -0,0 +1,20 @@
+#ifndef UNICODE_H
+#define UNICODE_H
+
+#include <stddef.h>
+
+// UTF-8 validation and normalization for the lexer.
+
+// Check that s[0..len) is well-formed UTF-8: no stray continuation bytes,
+// overlong forms, surrogates or code points past U+10FFFF. Returns len if
+// it is, otherwise the offset of the first byte of the first bad sequence.
+// *truncated is set when that sequence is only cut short by the end of the
+// input, so that more input could still complete it.
+size_t unicode_validate(const char *s, size_t len, int *truncated);
+
+// The UTF-8 text s[0..len) in Normalization Form C, as a new NUL
+// terminated string. Text that is all ASCII, or otherwise cannot change,
+// is copied as it is. Malformed bytes are kept as they are.
+char *unicode_nfc(const char *s, size_t len);
+
+#endif // UNICODE_H
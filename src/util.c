@@ -1,19 +1,102 @@
 #include "util.h"
+#include "memory.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 char *string_duplicate(const char *src) {
     if (!src) return NULL;
-    char *dup = (char *)malloc(strlen(src) + 1);
-    if (!dup) return NULL;
+    char *dup = (char *)memory_alloc(strlen(src) + 1);
+    if (!dup) {
+        report_error("Memory allocation failed for string", -1);
+        exit(1);
+    }
     strcpy(dup, src);
     return dup;
 }
 
+// Counted atomically: worker threads of a parallel loop report errors too
+static int errors_reported = 0;
+
 void report_error(const char *message, int line_number) {
+    __atomic_fetch_add(&errors_reported, 1, __ATOMIC_RELAXED);
     if (line_number >= 0)
         fprintf(stderr, "Error (line %d): %s\n", line_number, message);
     else
         fprintf(stderr, "Error: %s\n", message);
 }
+
+int error_count(void) {
+    return __atomic_load_n(&errors_reported, __ATOMIC_RELAXED);
+}
+
+// Decimal powers of ten that are exact as doubles
+static const double exact_powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+int parse_number(const char *s, size_t length, double *out) {
+    const char *p = s;
+    const char *end = s + length;
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    if (p == end) return 0;
+
+    // Fast path: at most 19 significant digits and a small exponent, where
+    // one exact multiplication or division gives the correctly rounded
+    // result (all digits fit in 53 bits).
+    const char *q = p;
+    int negative = 0;
+    if (*q == '+' || *q == '-') negative = *q++ == '-';
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int scale = 0;
+    int seen_digit = 0;
+    for (; q < end && *q >= '0' && *q <= '9'; ++q, seen_digit = 1) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (unsigned)(*q - '0');
+            if (mantissa) digits++;
+        } else {
+            scale++;
+        }
+    }
+    if (q < end && *q == '.') {
+        for (++q; q < end && *q >= '0' && *q <= '9'; ++q, seen_digit = 1) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (unsigned)(*q - '0');
+                if (mantissa) digits++;
+                scale--;
+            }
+        }
+    }
+    if (!seen_digit) return 0;
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        const char *e = q + 1;
+        int exp_negative = 0;
+        int exponent = 0;
+        if (e < end && (*e == '+' || *e == '-')) exp_negative = *e++ == '-';
+        if (e == end || *e < '0' || *e > '9') return 0;
+        for (; e < end && *e >= '0' && *e <= '9'; ++e) {
+            if (exponent < 10000) exponent = exponent * 10 + (*e - '0');
+        }
+        scale += exp_negative ? -exponent : exponent;
+        q = e;
+    }
+    if (q != end) return 0;
+    if (mantissa < (1ULL << 53) && scale >= -22 && scale <= 22) {
+        double value = (double)mantissa;
+        value = scale < 0 ? value / exact_powers[-scale] : value * exact_powers[scale];
+        *out = negative ? -value : value;
+        return 1;
+    }
+
+    // Anything else goes through strtod on a terminated copy
+    char text[128];
+    size_t n = (size_t)(end - p);
+    if (n >= sizeof(text)) return 0;
+    memcpy(text, p, n);
+    text[n] = '\0';
+    *out = strtod(text, NULL);
+    return 1;
+}
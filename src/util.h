@@ -1,7 +1,17 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stddef.h>
+
 char *string_duplicate(const char *src);
 void report_error(const char *message, int line_number);
 
+// Number of errors reported so far.
+int error_count(void);
+
+// Parse the decimal number in s[0..length), allowing surrounding blanks
+// and a trailing '\r'. The text need not be NUL terminated. Returns 0 if
+// it is not a number.
+int parse_number(const char *s, size_t length, double *out);
+
 #endif // UTIL_H
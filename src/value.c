@@ -0,0 +1,228 @@
+#include "value.h"
+#include "generator.h"
+#include "isolate.h"
+#include "list.h"
+#include "map.h"
+#include "memory.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Value value_copy(Value value) {
+    if (value.type == VAL_STRING) {
+        value.as.string = string_duplicate(value.as.string);
+    } else if (value.type == VAL_LIST) {
+        list_retain(value.as.list);
+    } else if (value.type == VAL_MAP) {
+        map_retain(value.as.map);
+    } else if (value.type == VAL_GENERATOR) {
+        generator_retain(value.as.generator);
+    } else if (value.type == VAL_CHANNEL) {
+        channel_retain(value.as.channel);
+    }
+    return value;
+}
+
+void value_free(Value value) {
+    if (value.type == VAL_STRING)
+        memory_free(value.as.string);
+    else if (value.type == VAL_LIST)
+        list_release(value.as.list);
+    else if (value.type == VAL_MAP)
+        map_release(value.as.map);
+    else if (value.type == VAL_GENERATOR)
+        generator_release(value.as.generator);
+    else if (value.type == VAL_CHANNEL)
+        channel_release(value.as.channel);
+}
+
+void value_drop(Value value) {
+    if (value.type == VAL_STRING)
+        memory_free(value.as.string);
+}
+
+int value_truthy(Value value) {
+    switch (value.type) {
+        case VAL_BOOL: return value.as.boolean;
+        case VAL_NUMBER: return value.as.number != 0;
+        case VAL_STRING: return value.as.string[0] != '\0';
+        case VAL_LIST: return value.as.list->count != 0;
+        case VAL_MAP: return value.as.map->count != 0;
+        case VAL_GENERATOR: return 1;
+        case VAL_CHANNEL: return 1;
+        case VAL_UNSET: return 0;
+    }
+    return 0;
+}
+
+int value_equals(Value a, Value b) {
+    if (a.type != b.type) return 0;
+    switch (a.type) {
+        case VAL_NUMBER: return a.as.number == b.as.number;
+        case VAL_STRING: return strcmp(a.as.string, b.as.string) == 0;
+        case VAL_BOOL: return a.as.boolean == b.as.boolean;
+        case VAL_LIST: {
+            List *x = a.as.list;
+            List *y = b.as.list;
+            if (x == y) return 1;
+            if (x->count != y->count) return 0;
+            for (size_t i = 0; i < x->count; ++i) {
+                Value ex = list_get(x, i);
+                Value ey = list_get(y, i);
+                int same = value_equals(ex, ey);
+                value_free(ex);
+                value_free(ey);
+                if (!same) return 0;
+            }
+            return 1;
+        }
+        case VAL_MAP: {
+            Map *x = a.as.map;
+            Map *y = b.as.map;
+            if (x == y) return 1;
+            if (x->count != y->count) return 0;
+            size_t pos = 0;
+            MapEntry *entry;
+            while ((entry = map_next(x, &pos)) != NULL) {
+                Value *other = map_get(y, entry->key);
+                if (!other || !value_equals(entry->value, *other)) return 0;
+            }
+            return 1;
+        }
+        case VAL_GENERATOR:
+            return a.as.generator == b.as.generator;
+        case VAL_CHANNEL:
+            return a.as.channel == b.as.channel;
+        case VAL_UNSET:
+            return 1;
+    }
+    return 0;
+}
+
+const char *value_type_name(ValueType type) {
+    switch (type) {
+        case VAL_NUMBER: return "number";
+        case VAL_STRING: return "string";
+        case VAL_BOOL: return "bool";
+        case VAL_LIST: return "list";
+        case VAL_MAP: return "map";
+        case VAL_GENERATOR: return "generator";
+        case VAL_CHANNEL: return "channel";
+        case VAL_UNSET: return "unset";
+    }
+    return "unknown";
+}
+
+// Simple growable buffer used while formatting lists and maps
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} StrBuf;
+
+static void buf_append(StrBuf *b, const char *s) {
+    size_t n = strlen(s);
+    if (b->len + n + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : 32;
+        while (b->len + n + 1 > cap) cap *= 2;
+        char *tmp = memory_realloc(b->data, cap);
+        if (!tmp) {
+            report_error("Memory allocation failed while formatting value", -1);
+            exit(1);
+        }
+        b->data = tmp;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, s, n + 1);
+    b->len += n;
+}
+
+// The lists and maps being formatted, innermost first. A list that
+// contains itself is printed as [...] (and a map as {...}) the second
+// time round instead of recursing forever.
+typedef struct Enclosing {
+    const void *container;
+    const struct Enclosing *outer;
+} Enclosing;
+
+static int enclosed(const Enclosing *e, const void *container) {
+    for (; e; e = e->outer) {
+        if (e->container == container) return 1;
+    }
+    return 0;
+}
+
+static void format_value(StrBuf *b, Value value, int quote_strings, const Enclosing *outer) {
+    char num[64];
+    switch (value.type) {
+        case VAL_NUMBER:
+            snprintf(num, sizeof(num), "%g", value.as.number);
+            buf_append(b, num);
+            break;
+        case VAL_STRING:
+            if (quote_strings) buf_append(b, "\"");
+            buf_append(b, value.as.string);
+            if (quote_strings) buf_append(b, "\"");
+            break;
+        case VAL_BOOL:
+            buf_append(b, value.as.boolean ? "eziokwu" : "ụgha");
+            break;
+        case VAL_LIST: {
+            List *list = value.as.list;
+            if (enclosed(outer, list)) {
+                buf_append(b, "[...]");
+                break;
+            }
+            Enclosing here = { list, outer };
+            buf_append(b, "[");
+            for (size_t i = 0; i < list->count; ++i) {
+                if (i > 0) buf_append(b, ", ");
+                Value item = list_get(list, i);
+                format_value(b, item, 1, &here);
+                value_free(item);
+            }
+            buf_append(b, "]");
+            break;
+        }
+        case VAL_MAP: {
+            size_t pos = 0;
+            int first = 1;
+            MapEntry *entry;
+            if (enclosed(outer, value.as.map)) {
+                buf_append(b, "{...}");
+                break;
+            }
+            Enclosing here = { value.as.map, outer };
+            buf_append(b, "{");
+            while ((entry = map_next(value.as.map, &pos)) != NULL) {
+                if (!first) buf_append(b, ", ");
+                first = 0;
+                buf_append(b, "\"");
+                buf_append(b, entry->key->chars);
+                buf_append(b, "\": ");
+                format_value(b, entry->value, 1, &here);
+            }
+            buf_append(b, "}");
+            break;
+        }
+        case VAL_GENERATOR:
+            buf_append(b, "<generator ");
+            buf_append(b, value.as.generator->name);
+            buf_append(b, ">");
+            break;
+        case VAL_CHANNEL:
+            buf_append(b, "<channel of ");
+            buf_append(b, value_type_name(value.as.channel->type));
+            buf_append(b, ">");
+            break;
+        case VAL_UNSET:
+            break;
+    }
+}
+
+char *value_to_string(Value value) {
+    StrBuf b = { NULL, 0, 0 };
+    format_value(&b, value, 0, NULL);
+    return b.data;
+}
@@ -0,0 +1,53 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <stddef.h>
+
+struct List;
+struct Map;
+struct Generator;
+struct Channel;
+
+// VAL_UNSET marks a function's local slot that has not been assigned yet.
+// It is never visible to scripts.
+typedef enum { VAL_NUMBER, VAL_STRING, VAL_BOOL, VAL_LIST, VAL_MAP, VAL_GENERATOR, VAL_CHANNEL, VAL_UNSET } ValueType;
+
+typedef struct Value {
+    ValueType type;
+    union {
+        double number;
+        char *string;
+        int boolean;
+        struct List *list;
+        struct Map *map;
+        struct Generator *generator;
+        struct Channel *channel;
+    } as;
+} Value;
+
+// Make a copy of a value that the caller owns. Strings are duplicated,
+// lists, maps, generators and channels are shared and their reference
+// count is increased.
+Value value_copy(Value value);
+
+// Release a value obtained from eval(), value_copy() or a builtin.
+void value_free(Value value);
+
+// Free a value's own string without releasing the container it refers
+// to. Used by the cycle collector, which frees those itself.
+void value_drop(Value value);
+
+// Truthiness used by 'ma' and 'mgbe' conditions.
+int value_truthy(Value value);
+
+// Structural equality. Values of different types are never equal.
+int value_equals(Value a, Value b);
+
+// Human readable name of a value's type for error messages.
+const char *value_type_name(ValueType type);
+
+// Return a newly allocated string representation of a value, as used by
+// 'gosi' and string concatenation.
+char *value_to_string(Value value);
+
+#endif // VALUE_H
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Run the regression tests.
+
+Every tests/NAME.igbo is run by the interpreter and, when the runtime
+library is built, compiled with ``igbo build``; both must print exactly
+tests/NAME.out. Tests named check_NAME are run with ``--check`` instead,
+and are not compiled.
+
+Programs too large to keep in the tree are written by the functions in
+GENERATED instead. They are run by the interpreter, checked with
+``--check`` and translated with ``--emit-c``, each of which must succeed;
+the C compiler is not run on them.
+
+Usage:
+    python3 tests/run_tests.py [--igbo ./igbo] [name ...]
+"""
+
+import argparse
+import glob
+import os
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def long_program():
+    # Walking a long top-level statement chain must not recurse per statement
+    lines = ["dee x = %d" % i for i in range(200000)]
+    lines.append("gosi(x)")
+    return "\n".join(lines) + "\n", "199999\n"
+
+
+# name -> function returning the program and what it prints
+GENERATED = {
+    "long_program": long_program,
+}
+
+
+def run(cmd):
+    out = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    return out.stdout.decode("utf-8", "replace")
+
+
+def run_generated(igbo, out, name):
+    source, expected = GENERATED[name]()
+    path = os.path.join(out, name + ".igbo")
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(source)
+    failed = 0
+    for mode, cmd in (("interpreted", [igbo, path]), ("check", [igbo, "--check", path]),
+                      ("emit-c", [igbo, "--emit-c", path])):
+        result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        got = result.stdout.decode("utf-8", "replace")
+        errors = result.stderr.decode("utf-8", "replace")
+        if result.returncode != 0 or errors or (mode == "interpreted" and got != expected):
+            failed += 1
+            print("FAIL %s (%s): exit %d\n%s" % (name, mode, result.returncode,
+                                                 errors or got[-200:]))
+        else:
+            print("ok   %s (%s)" % (name, mode))
+    return failed
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--igbo", default="./igbo", help="interpreter binary to test")
+    ap.add_argument("--out", default="build/tests", help="directory for compiled tests")
+    ap.add_argument("names", nargs="*", help="tests to run (default: all)")
+    args = ap.parse_args()
+
+    if not os.access(args.igbo, os.X_OK):
+        sys.exit("interpreter not found: %s" % args.igbo)
+    names = args.names or sorted(os.path.splitext(os.path.basename(p))[0]
+                                 for p in glob.glob(os.path.join(HERE, "*.igbo"))) + list(GENERATED)
+    os.makedirs(args.out, exist_ok=True)
+    failed = 0
+    for name in names:
+        if name in GENERATED:
+            failed += run_generated(args.igbo, args.out, name)
+            continue
+        path = os.path.join(HERE, name + ".igbo")
+        with open(os.path.join(HERE, name + ".out"), encoding="utf-8") as f:
+            expected = f.read()
+        if name.startswith("check_"):
+            results = [("check", run([args.igbo, "--check", path]))]
+        else:
+            binary = os.path.join(args.out, name)
+            if os.path.exists(binary):
+                os.remove(binary)
+            build = run([args.igbo, "build", path, "-o", binary])
+            results = [("interpreted", run([args.igbo, path]))]
+            if os.access(binary, os.X_OK):
+                results.append(("compiled", run([binary])))
+            else:
+                results.append(("compiled", build))
+        for mode, got in results:
+            if got != expected:
+                failed += 1
+                print("FAIL %s (%s)\n--- expected\n%s--- got\n%s" % (name, mode, expected, got))
+            else:
+                print("ok   %s (%s)" % (name, mode))
+    if failed:
+        sys.exit("%d failed" % failed)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Generate src/unicode_table.h, the data behind NFC normalization of
+identifiers (src/unicode.c), from the Unicode database bundled with Python.
+
+Usage:
+    python3 tools/gen_unicode_table.py > src/unicode_table.h
+"""
+
+import unicodedata
+
+MAX_CODE_POINT = 0x110000
+HANGUL_FIRST, HANGUL_LAST = 0xAC00, 0xD7A3
+
+
+def code_points():
+    for c in range(MAX_CODE_POINT):
+        if 0xD800 <= c <= 0xDFFF:
+            continue
+        yield c
+
+
+def canonical_decomposition(c):
+    d = unicodedata.decomposition(chr(c))
+    if not d or d.startswith("<"):
+        return None
+    return [int(x, 16) for x in d.split()]
+
+
+def main():
+    # Ranges of code points sharing a nonzero canonical combining class
+    ranges = []
+    for c in code_points():
+        ccc = unicodedata.combining(chr(c))
+        if not ccc:
+            continue
+        if ranges and ranges[-1][1] == c - 1 and ranges[-1][2] == ccc:
+            ranges[-1][1] = c
+        else:
+            ranges.append([c, c, ccc])
+
+    # Canonical decompositions (one or two code points each; Hangul
+    # syllables are decomposed arithmetically) and the primary composites,
+    # which are the pairs that NFC composes again.
+    decompositions = []
+    compositions = []
+    for c in code_points():
+        if HANGUL_FIRST <= c <= HANGUL_LAST:
+            continue
+        parts = canonical_decomposition(c)
+        if not parts:
+            continue
+        decompositions.append((c, parts[0], parts[1] if len(parts) > 1 else 0))
+        nfd = unicodedata.normalize("NFD", chr(c))
+        if len(parts) == 2 and unicodedata.normalize("NFC", nfd) == chr(c):
+            compositions.append((parts[0], parts[1], c))
+    compositions.sort()
+
+    # Strings made only of code points below this are already in NFC
+    quick_min = next(c for c in code_points()
+                     if unicodedata.combining(chr(c))
+                     or unicodedata.normalize("NFC", chr(c)) != chr(c))
+
+    out = []
+    out.append("// Generated by tools/gen_unicode_table.py from Unicode %s. Do not edit."
+               % unicodedata.unidata_version)
+    out.append("")
+    out.append("#define NFC_QUICK_MIN 0x%X" % quick_min)
+    out.append("")
+    out.append("static const CombiningRange combining_classes[] = {")
+    for first, last, ccc in ranges:
+        out.append("    { 0x%X, 0x%X, %d }," % (first, last, ccc))
+    out.append("};")
+    out.append("")
+    out.append("static const Decomposition decompositions[] = {")
+    for c, a, b in decompositions:
+        out.append("    { 0x%X, 0x%X, 0x%X }," % (c, a, b))
+    out.append("};")
+    out.append("")
+    out.append("static const Composition compositions[] = {")
+    for a, b, c in compositions:
+        out.append("    { 0x%X, 0x%X, 0x%X }," % (a, b, c))
+    out.append("};")
+    print("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()